@@ -0,0 +1,162 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_alloc.c
+ *
+ * Description:
+ *
+ * Allocation tracking, see sr_alloc.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sr_alloc.h"
+
+#ifdef SR_ALLOC_TRACK
+
+/* -- this file calls the real thing -- */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#define SR_ALLOC_SITES 256
+
+struct sr_alloc_site
+{
+    const char* file;               /* __FILE__, a string literal */
+    int line;
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long long bytes;
+};
+
+/* open addressed on (file, line), the last slot takes the overflow */
+static struct sr_alloc_site sites[SR_ALLOC_SITES];
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long total_allocs = 0;
+
+static struct sr_alloc_site* sr_alloc_site(const char* file, int line)
+{
+    unsigned int h, i;
+
+    h = (unsigned int)(((unsigned long)file >> 3) * 31 + line);
+    for(i = 0; i < SR_ALLOC_SITES - 1; i++)
+    {
+        struct sr_alloc_site* s = &sites[(h + i) % (SR_ALLOC_SITES - 1)];
+
+        if(s->file == 0)
+        {
+            s->file = file;
+            s->line = line;
+        }
+        if(s->file == file && s->line == line)
+        { return s; }
+    }
+
+    sites[SR_ALLOC_SITES - 1].file = "(other)";
+    return &sites[SR_ALLOC_SITES - 1];
+} /* -- sr_alloc_site -- */
+
+static void sr_alloc_count_site(const char* file, int line, int alloc,
+                                size_t size)
+{
+    struct sr_alloc_site* s;
+
+    pthread_mutex_lock(&sites_lock);
+    s = sr_alloc_site(file, line);
+    if(alloc)
+    {
+        s->allocs++;
+        s->bytes += size;
+        total_allocs++;
+    }
+    else
+    { s->frees++; }
+    pthread_mutex_unlock(&sites_lock);
+} /* -- sr_alloc_count_site -- */
+
+void* sr_alloc_malloc(size_t size, const char* file, int line)
+{
+    sr_alloc_count_site(file, line, 1, size);
+    return malloc(size);
+} /* -- sr_alloc_malloc -- */
+
+void* sr_alloc_calloc(size_t n, size_t size, const char* file, int line)
+{
+    sr_alloc_count_site(file, line, 1, n * size);
+    return calloc(n, size);
+} /* -- sr_alloc_calloc -- */
+
+void* sr_alloc_realloc(void* p, size_t size, const char* file, int line)
+{
+    sr_alloc_count_site(file, line, 1, size);
+    return realloc(p, size);
+} /* -- sr_alloc_realloc -- */
+
+void sr_alloc_free(void* p, const char* file, int line)
+{
+    if(p)
+    { sr_alloc_count_site(file, line, 0, 0); }
+    free(p);
+} /* -- sr_alloc_free -- */
+
+unsigned long sr_alloc_count(void)
+{
+    unsigned long n;
+
+    pthread_mutex_lock(&sites_lock);
+    n = total_allocs;
+    pthread_mutex_unlock(&sites_lock);
+    return n;
+} /* -- sr_alloc_count -- */
+
+/* keeps the sites, so a report after reset only lists the new activity */
+void sr_alloc_reset(void)
+{
+    int i;
+
+    pthread_mutex_lock(&sites_lock);
+    for(i = 0; i < SR_ALLOC_SITES; i++)
+    {
+        sites[i].allocs = 0;
+        sites[i].frees = 0;
+        sites[i].bytes = 0;
+    }
+    total_allocs = 0;
+    pthread_mutex_unlock(&sites_lock);
+} /* -- sr_alloc_reset -- */
+
+void sr_alloc_report(FILE* fp)
+{
+    int i;
+
+    pthread_mutex_lock(&sites_lock);
+    fprintf(fp, "%-28s %10s %10s %12s\n", "site", "allocs", "frees", "bytes");
+    for(i = 0; i < SR_ALLOC_SITES; i++)
+    {
+        char where[64];
+
+        if(sites[i].allocs == 0 && sites[i].frees == 0)
+        { continue; }
+        snprintf(where, sizeof(where), "%s:%d", sites[i].file, sites[i].line);
+        fprintf(fp, "%-28s %10lu %10lu %12llu\n", where,
+                sites[i].allocs, sites[i].frees, sites[i].bytes);
+    }
+    pthread_mutex_unlock(&sites_lock);
+} /* -- sr_alloc_report -- */
+
+#else /* SR_ALLOC_TRACK */
+
+unsigned long sr_alloc_count(void)
+{ return 0; }
+
+void sr_alloc_reset(void)
+{ }
+
+void sr_alloc_report(FILE* fp)
+{ fprintf(fp, "(no call sites, build with make ALLOC_TRACK=1)\n"); }
+
+#endif /* SR_ALLOC_TRACK */
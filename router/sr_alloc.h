@@ -0,0 +1,43 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_alloc.h
+ *
+ * Description:
+ *
+ * Allocation tracking.  Built with make ALLOC_TRACK=1, every malloc,
+ * calloc, realloc and free in a module that includes this header is
+ * counted against the file and line it was called from, so that an
+ * allocation on the forwarding path can be found and blamed.  Otherwise
+ * the calls go straight to libc and the counters stay at zero.
+ *
+ * Include it after the system headers.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ALLOC_H
+#define SR_ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* allocations (malloc, calloc and realloc) since the last reset */
+unsigned long sr_alloc_count(void);
+void sr_alloc_reset(void);
+
+/* one line per call site that allocated or freed since the last reset */
+void sr_alloc_report(FILE* fp);
+
+#ifdef SR_ALLOC_TRACK
+
+void* sr_alloc_malloc(size_t size, const char* file, int line);
+void* sr_alloc_calloc(size_t n, size_t size, const char* file, int line);
+void* sr_alloc_realloc(void* p, size_t size, const char* file, int line);
+void  sr_alloc_free(void* p, const char* file, int line);
+
+#define malloc(size)     sr_alloc_malloc((size), __FILE__, __LINE__)
+#define calloc(n, size)  sr_alloc_calloc((n), (size), __FILE__, __LINE__)
+#define realloc(p, size) sr_alloc_realloc((p), (size), __FILE__, __LINE__)
+#define free(p)          sr_alloc_free((p), __FILE__, __LINE__)
+
+#endif /* SR_ALLOC_TRACK */
+
+#endif /* -- SR_ALLOC_H -- */
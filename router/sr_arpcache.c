@@ -10,17 +10,27 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_tsc.h"
+#include "sr_replay.h"
+#include "sr_vrf.h"
+#include "sr_alloc.h"
 
 
 
-void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req){
-    	struct sr_arpcache *cache = &(sr->cache);
+void handle_arpreq(struct sr_instance *sr, struct sr_vrf *vrf, struct sr_arpreq* req){
+    	struct sr_arpcache *cache = &(vrf->cache);
     	/*struct sr_if *currIface;*/
-    	time_t now = time(0);
+    	time_t now = sr_time();
     	time_t last_sent = req->sent;
     	uint32_t times_sent = req->times_sent;
     	struct sr_packet *pkt_pt;
 
+	/* Nothing waits on a request without packets, and there is no
+	   interface to ask on */
+	if (req->packets == NULL) {
+		sr_arpreq_destroy(cache, req);
+		return;
+	}
 
     	if (difftime(now, last_sent) >= 1) {
         	if (times_sent >= 5) {
@@ -28,6 +38,7 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req){
            		while (pkt_pt != NULL) {
                 		/* Send type 3 code 1 ICMP (Host Unreachable) */
                 		send_icmp_t3_pkt(sr, pkt_pt->buf, pkt_pt->iface, pkt_pt->len, 3, 1);
+				sr_drop_queued(sr, pkt_pt->buf, pkt_pt->len, pkt_pt->iface, SR_DROP_ARP_FAIL);
                 		pkt_pt = pkt_pt->next;
             		}
             		/* destroy the request */
@@ -39,7 +50,7 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req){
 			int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
 
 			struct sr_if *dst_interface = sr_get_interface(sr, req->packets->iface);
-			uint8_t * pkt = (uint8_t *)malloc(arp_hdr_size + etnet_hdr_size);
+			uint8_t pkt[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
 			sr_ethernet_hdr_t * etnet_hdr = (sr_ethernet_hdr_t *)pkt;
 			sr_arp_hdr_t * arp_hdr = (sr_arp_hdr_t *)(pkt + sizeof(sr_ethernet_hdr_t));	
 
@@ -58,8 +69,6 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req){
 			replace_arp_hardware_addrs(arp_hdr, dst_interface->addr, broadcast_addr);
 			replace_etnet_addrs(etnet_hdr, dst_interface->addr, broadcast_addr);
 			sr_send_packet(sr, pkt, arp_hdr_size + etnet_hdr_size, dst_interface->name);
-
-			free(pkt);
         	}
 	        req->sent = now;
             	req->times_sent++;
@@ -71,15 +80,15 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req){
   checking whether we should resend an request or destroy the arp request.
   See the comments in the header file for an idea of what it should look like.
 */
-void sr_arpcache_sweepreqs(struct sr_instance *sr) {
-    struct sr_arpcache *arpcache = &(sr->cache);
+void sr_arpcache_sweepreqs(struct sr_instance *sr, struct sr_vrf *vrf) {
+    struct sr_arpcache *arpcache = &(vrf->cache);
     struct sr_arpreq *req = arpcache->requests;
     struct sr_arpreq *req_cp;
 
     while(req != NULL) {
 	req_cp = req;
         req = req->next;
-        handle_arpreq(sr, req_cp);
+        handle_arpreq(sr, vrf, req_cp);
     }
 }
 
@@ -89,27 +98,38 @@ void sr_arpcache_sweepreqs(struct sr_instance *sr) {
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
+    struct sr_arpentry entry, *copy = NULL;
+
+    if (sr_arpcache_get(cache, ip, &entry)) {
+        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
+        if (copy)
+            memcpy(copy, &entry, sizeof(struct sr_arpentry));
+    }
+
+    return copy;
+}
+
+/* Like sr_arpcache_lookup, but copies the entry to *out instead of
+   allocating. Returns 1 if the IP was found, 0 otherwise. */
+int sr_arpcache_get(struct sr_arpcache *cache, uint32_t ip,
+                    struct sr_arpentry *out) {
+    int i, found = 0;
+
     pthread_mutex_lock(&(cache->lock));
     
-    struct sr_arpentry *entry = NULL, *copy = NULL;
-    
-    int i;
+    /* Must copy b/c another thread could jump in and modify
+       table after we return. */
     for (i = 0; i < SR_ARPCACHE_SZ; i++) {
         if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+            memcpy(out, &(cache->entries[i]), sizeof(struct sr_arpentry));
+            found = 1;
+            break;
         }
     }
-    
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
-    }
         
     pthread_mutex_unlock(&(cache->lock));
     
-    return copy;
+    return found;
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
@@ -124,6 +144,12 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        unsigned int packet_len,
                                        char *iface)
 {
+    struct sr_packet *new_pkt = NULL;
+    uint8_t *frame = NULL;
+
+    if (packet && packet_len && iface && packet_len > SR_ARPREQ_FRAME_LEN)
+        return NULL;
+
     pthread_mutex_lock(&(cache->lock));
     
     struct sr_arpreq *req;
@@ -133,42 +159,65 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         }
     }
     
+    /* Take everything the packet needs before touching the queue, so a
+       failure never leaves a request without packets on it */
+    if (packet && packet_len && iface) {
+        if (req && req->npackets >= SR_ARPREQ_MAX_PACKETS) {
+            pthread_mutex_unlock(&(cache->lock));
+            return NULL;
+        }
+        new_pkt = SR_POOL_GET(&(cache->pools->pkt_pool), struct sr_packet);
+        frame = (uint8_t *)sr_pool_get(&(cache->pools->frame_pool));
+        if (new_pkt == NULL || frame == NULL)
+            goto fail;
+    }
+    
     /* If the IP wasn't found, add it */
     if (!req) {
-        req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
+        req = SR_POOL_GET(&(cache->pools->req_pool), struct sr_arpreq);
+        if (req == NULL)
+            goto fail;
+        memset(req, 0, sizeof(struct sr_arpreq));
         req->ip = ip;
+        req->created = sr_tsc();
         req->next = cache->requests;
         cache->requests = req;
     }
     
     /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
-        
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
+    if (new_pkt) {
+        new_pkt->buf = frame;
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
+        new_pkt->queued = sr_tsc();
+        new_pkt->iface = (char *)(new_pkt + 1);
         strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
         new_pkt->next = req->packets;
         req->packets = new_pkt;
+        req->npackets++;
     }
     
     pthread_mutex_unlock(&(cache->lock));
     
     return req;
+
+fail:
+    sr_pool_put(&(cache->pools->pkt_pool), new_pkt);
+    sr_pool_put(&(cache->pools->frame_pool), frame);
+    pthread_mutex_unlock(&(cache->lock));
+    return NULL;
 }
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
       to the sr_arpreq with this IP. Otherwise, returns NULL.
-   2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
-struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
-                                     unsigned char *mac,
-                                     uint32_t ip)
+   2) Inserts this IP to MAC mapping in the cache, and marks it valid. If
+      the IP is already cached its entry is refreshed instead. */
+/* Takes the request for ip off the queue and returns it, or NULL if there is
+   none. The cache lock must be held. */
+static struct sr_arpreq *sr_arpcache_pop_req(struct sr_arpcache *cache,
+                                             uint32_t ip)
 {
-    pthread_mutex_lock(&(cache->lock));
-    
     struct sr_arpreq *req, *prev = NULL, *next = NULL; 
     for (req = cache->requests; req != NULL; req = req->next) {
         if (req->ip == ip) {            
@@ -185,17 +234,45 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         }
         prev = req;
     }
-    
+
+    return req;
+}
+
+/* The entry for ip if it is cached, else a free one, else -1. The cache lock
+   must be held. */
+static int sr_arpcache_slot(struct sr_arpcache *cache, uint32_t ip)
+{
     int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip))
+            return i;
+    }
+    
     for (i = 0; i < SR_ARPCACHE_SZ; i++) {
         if (!(cache->entries[i].valid))
-            break;
+            return i;
     }
+
+    return -1;
+}
+
+struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
+                                     unsigned char *mac,
+                                     uint32_t ip)
+{
+    pthread_mutex_lock(&(cache->lock));
     
-    if (i != SR_ARPCACHE_SZ) {
+    struct sr_arpreq *req = sr_arpcache_pop_req(cache, ip);
+    
+    /* Refresh an existing mapping rather than adding a duplicate, so
+       learning from every ARP request does not fill up the cache. Static
+       mappings are left as they were set. */
+    int i = sr_arpcache_slot(cache, ip);
+    
+    if (i >= 0 && !cache->entries[i].permanent) {
         memcpy(cache->entries[i].mac, mac, 6);
         cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
+        cache->entries[i].added = sr_time();
         cache->entries[i].valid = 1;
     }
     
@@ -204,6 +281,49 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
     return req;
 }
 
+int sr_arpcache_insert_static(struct sr_arpcache *cache, unsigned char *mac,
+                              uint32_t ip, struct sr_arpreq **req)
+{
+    pthread_mutex_lock(&(cache->lock));
+
+    int i = sr_arpcache_slot(cache, ip);
+
+    *req = NULL;
+    if (i >= 0) {
+        memcpy(cache->entries[i].mac, mac, 6);
+        cache->entries[i].ip = ip;
+        cache->entries[i].added = sr_time();
+        cache->entries[i].permanent = 1;
+        cache->entries[i].valid = 1;
+        *req = sr_arpcache_pop_req(cache, ip);
+    }
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return i >= 0 ? 0 : -1;
+}
+
+int sr_arpcache_remove_static(struct sr_arpcache *cache, uint32_t ip)
+{
+    int i, found = -1;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && (cache->entries[i].permanent) &&
+            (cache->entries[i].ip == ip)) {
+            cache->entries[i].valid = 0;
+            cache->entries[i].permanent = 0;
+            found = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return found;
+}
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
@@ -231,14 +351,11 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
         
         for (pkt = entry->packets; pkt; pkt = nxt) {
             nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+            sr_pool_put(&(cache->pools->frame_pool), pkt->buf);
+            sr_pool_put(&(cache->pools->pkt_pool), pkt);
         }
         
-        free(entry);
+        sr_pool_put(&(cache->pools->req_pool), entry);
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -259,8 +376,23 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\n");
 }
 
-/* Initialize table + table lock. Returns 0 on success. */
-int sr_arpcache_init(struct sr_arpcache *cache) {  
+/* Set up the pools requests and the packets queued on them come from.
+   Returns 0 on success. */
+int sr_arppools_init(struct sr_arppools *pools) {
+    if (SR_POOL_INIT(&(pools->req_pool), "arpreq", struct sr_arpreq,
+                     SR_ARPREQ_POOL_BATCH, 0) != 0 ||
+        sr_pool_init(&(pools->pkt_pool), "arpreq_pkt",
+                     sizeof(struct sr_packet) + sr_IFACE_NAMELEN,
+                     SR_ARPREQ_POOL_BATCH, 0) != 0 ||
+        sr_pool_init(&(pools->frame_pool), "arpreq_frame", SR_ARPREQ_FRAME_LEN,
+                     SR_ARPREQ_POOL_BATCH, SR_POOL_HUGE) != 0)
+        return -1;
+    return 0;
+}
+
+/* Initialize table + table lock, taking requests from pools. Returns 0 on
+   success. */
+int sr_arpcache_init(struct sr_arpcache *cache, struct sr_arppools *pools) {  
     /* Seed RNG to kick out a random entry if all entries full. */
     srand(time(NULL));
     
@@ -272,6 +404,8 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
     pthread_mutexattr_init(&(cache->attr));
     pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
     int success = pthread_mutex_init(&(cache->lock), &(cache->attr));
+
+    cache->pools = pools;
     
     return success;
 }
@@ -281,29 +415,49 @@ int sr_arpcache_destroy(struct sr_arpcache *cache) {
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+static void sr_arpcache_tick_vrf(struct sr_instance *sr, struct sr_vrf *vrf) {
+    struct sr_arpcache *cache = &(vrf->cache);
+
+    pthread_mutex_lock(&(cache->lock));
+
+    time_t curtime = sr_time();
+
+    int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && !(cache->entries[i].permanent) &&
+            (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
+            cache->entries[i].valid = 0;
+        }
+    }
+
+    sr_arpcache_sweepreqs(sr, vrf);
+
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+/* One sweep of the caches of all routing tables: invalidates entries that
+   were added more than SR_ARPCACHE_TO seconds ago and retries or fails
+   pending requests. */
+void sr_arpcache_tick(struct sr_instance *sr) {
+    unsigned int id;
+
+    for (id = 0; id < SR_VRF_MAX; id++) {
+        if (sr->vrfs[id])
+            sr_arpcache_tick_vrf(sr, sr->vrfs[id]);
+    }
+}
+
+/* Thread which sweeps the cache once a second. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
-    struct sr_arpcache *cache = &(sr->cache);
     
     while (1) {
         sleep(1.0);
         
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
-        }
-        
-        sr_arpcache_sweepreqs(sr);
+        if (sr->replay)
+            sr_record_tick(sr->replay);
 
-        pthread_mutex_unlock(&(cache->lock));
+        sr_arpcache_tick(sr);
     }
     
     return NULL;
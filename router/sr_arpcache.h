@@ -53,8 +53,8 @@
    all packets waiting on this ARP request), you must fill out the following
    function that is called every second and is defined in sr_arpcache.c:
 
-   void sr_arpcache_sweepreqs(struct sr_instance *sr) {
-       for each request on sr->cache.requests:
+   void sr_arpcache_sweepreqs(struct sr_instance *sr, struct sr_vrf *vrf) {
+       for each request on vrf->cache.requests:
            handle_arpreq(request)
    }
 
@@ -70,14 +70,19 @@
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_pool.h"
 
 #define SR_ARPCACHE_SZ    100  
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPREQ_MAX_PACKETS 64    /* packets queued per request */
+#define SR_ARPREQ_FRAME_LEN   2048  /* largest frame that can be queued */
+#define SR_ARPREQ_POOL_BATCH  64
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
     char *iface;                /* The outgoing interface */
+    uint64_t queued;            /* sr_tsc() when it was queued */
     struct sr_packet *next;
 };
 
@@ -86,10 +91,13 @@ struct sr_arpentry {
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    int permanent;              /* static, never timed out or relearned */
 };
 
 struct sr_arpreq {
     uint32_t ip;
+    unsigned int npackets;      /* Length of packets */
+    uint64_t created;           /* sr_tsc() when the first packet queued */
     time_t sent;                /* Last time this ARP request was sent. You 
                                    should update this. If the ARP request was 
                                    never sent, will be 0. */
@@ -99,26 +107,47 @@ struct sr_arpreq {
     struct sr_arpreq *next;
 };
 
+/* Where requests and the packets queued on them come from. One set is
+   shared by the caches of all routing tables, see sr_vrf.h. */
+struct sr_arppools {
+    struct sr_pool req_pool;    /* struct sr_arpreq */
+    struct sr_pool pkt_pool;    /* struct sr_packet, iface name after it */
+    struct sr_pool frame_pool;  /* queued frames, SR_ARPREQ_FRAME_LEN */
+};
+
 struct sr_arpcache {
     struct sr_arpentry entries[SR_ARPCACHE_SZ];
     struct sr_arpreq *requests;
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
+    struct sr_arppools *pools;
 };
 
-void handle_arpreq(struct sr_instance *, struct sr_arpreq *);
+struct sr_vrf;
+
+/* Both take the routing table whose cache the request is queued in. */
+void handle_arpreq(struct sr_instance *, struct sr_vrf *, struct sr_arpreq *);
+void sr_arpcache_sweepreqs(struct sr_instance *sr, struct sr_vrf *vrf);
 
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
 
+/* Copies the IP->MAC mapping to *out, without allocating. Returns 1 if it
+   was found and 0 if not. This is what the forwarding path uses. */
+int sr_arpcache_get(struct sr_arpcache *cache, uint32_t ip,
+                    struct sr_arpentry *out);
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
    that corresponds to this ARP request. The packet argument should not be
    freed by the caller.
 
    A pointer to the ARP request is returned; it should be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   NULL is returned and the packet is not queued if SR_ARPREQ_MAX_PACKETS
+   packets are already waiting on the request, if it is longer than
+   SR_ARPREQ_FRAME_LEN or if the pools are exhausted. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
@@ -128,11 +157,22 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
       to the sr_arpreq with this IP. Otherwise, returns NULL.
-   2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
+   2) Inserts this IP to MAC mapping in the cache, and marks it valid. If
+      the IP is already cached its entry is refreshed instead. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
                                      uint32_t ip);
 
+/* Sets a static IP->MAC mapping, which is never timed out and which ARP
+   traffic does not change. Like sr_arpcache_insert, the request waiting on
+   the IP, if any, is taken off the queue and returned in *req. Returns 0,
+   or -1 if the cache is full. */
+int sr_arpcache_insert_static(struct sr_arpcache *cache, unsigned char *mac,
+                              uint32_t ip, struct sr_arpreq **req);
+
+/* Removes the static mapping for ip. Returns 0, or -1 if there is none. */
+int sr_arpcache_remove_static(struct sr_arpcache *cache, uint32_t ip);
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
@@ -143,10 +183,12 @@ void sr_arpcache_dump(struct sr_arpcache *cache);
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
    a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   seconds. The pools are set up once, before the first cache. */
 
-int   sr_arpcache_init(struct sr_arpcache *cache);
+int   sr_arppools_init(struct sr_arppools *pools);
+int   sr_arpcache_init(struct sr_arpcache *cache, struct sr_arppools *pools);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
+void  sr_arpcache_tick(struct sr_instance *sr);
 
 #endif
@@ -0,0 +1,647 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Offline forwarding benchmark.  Loads a routing table and an interface
+ * list, reads frames from a pcap or pcapng file and feeds them straight
+ * into sr_handlepacket, with no VNS server or network involved.  Frames
+ * the router sends end up in the sr_send_packet below, which counts
+ * them and can write them to a pcap file so the output of two versions
+ * of the router can be compared.
+ *
+ * The binary is linked with --wrap for malloc, calloc and realloc so
+ * allocations made while forwarding can be counted.  With -z any
+ * allocation in the timed passes, which run warm, is a failure: the
+ * exit status is 3 and, in a make ALLOC_TRACK=1 build, the call sites
+ * responsible are listed.
+ *
+ *   sr_bench [-r rtable] [-m rules] [-A] [-i interfaces] [-I ingress]
+ *            [-n loops] [-b burst] [-w out.pcap] [-a] [-s] [-z] frames.pcap
+ *
+ * With -b frames are handed over burst at a time, as a receive path that
+ * reads many at once would, to sr_handlepacket_burst, which looks up
+ * their routes together; the latency recorded for each is its share of
+ * the burst.
+ *
+ * With -m the routing table is an MRT RIB dump and rules maps its next
+ * hops onto interfaces, see sr_mrt.h.  With -A the fib is aggregated,
+ * see sr_ortc.h.
+ *
+ * The interface file has one "name ip mac" line per interface.  Without
+ * it every interface named in the routing table gets 192.0.2.<n> and
+ * 02:00:00:00:00:<n>.  Frames from a pcapng file arrive on the interface
+ * named in their interface description, and outbound frames are skipped;
+ * frames from a classic pcap arrive on -I, or the first interface.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_ecmp.h"
+#include "sr_mrt.h"
+#include "sr_vrf.h"
+#include "sr_arpcache.h"
+#include "sr_dumper.h"
+#include "sr_capture.h"
+#include "sr_flight.h"
+#include "sr_icmp.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+#include "sr_tsc.h"
+#include "sr_rcu.h"
+#include "sr_alloc.h"
+
+#define DEFAULT_RTABLE "rtable"
+#define SR_BENCH_MAX_FRAME 2048
+#define SR_BENCH_MAX_BURST 256
+
+struct sr_bench_frame
+{
+    uint8_t* data;
+    unsigned int len;
+    char iface[sr_IFACE_NAMELEN];
+};
+
+static struct sr_bench_frame* frames = 0;
+static unsigned int nframes = 0;
+static unsigned int maxframes = 0;
+
+/* -- what sr_send_packet saw -- */
+static FILE* out_fp = 0;
+static uint64_t sent = 0;
+static uint64_t sent_bytes = 0;
+
+static unsigned long allocs = 0;
+
+static void usage(char* argv0);
+
+/*---------------------------------------------------------------------
+ * Allocation counting, see -Wl,--wrap in the Makefile
+ *---------------------------------------------------------------------*/
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_send_packet(..)
+ * Scope:  Global
+ *
+ * Stands in for the one in sr_vns_comm.c.  Taps the packet like the
+ * real one does and writes it to -w, if given.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{
+    uint8_t rec[PCAP_REC_MAXLEN(SR_BENCH_MAX_FRAME)];
+    struct timespec ts;
+    unsigned int caplen;
+
+    sr_log_packet(sr, buf, len, iface, SR_CAPTURE_TX);
+
+    sent++;
+    sent_bytes += len;
+
+    if(out_fp)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        caplen = len < SR_BENCH_MAX_FRAME ? len : SR_BENCH_MAX_FRAME;
+        fwrite(rec, sr_dump_pcap_rec(rec, 1,
+                    (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+                    caplen, len, buf), 1, out_fp);
+    }
+
+    return 0;
+} /* -- sr_send_packet -- */
+
+/*---------------------------------------------------------------------
+ * Reading frames
+ *---------------------------------------------------------------------*/
+
+static void sr_bench_add_frame(const uint8_t* data, unsigned int len,
+                               const char* iface)
+{
+    struct sr_bench_frame* f;
+
+    if(len == 0 || len > SR_BENCH_MAX_FRAME)
+    { return; }
+
+    if(nframes == maxframes)
+    {
+        maxframes = maxframes ? maxframes * 2 : 1024;
+        frames = (struct sr_bench_frame*)realloc(frames,
+                maxframes * sizeof(struct sr_bench_frame));
+        assert(frames);
+    }
+
+    f = &(frames[nframes++]);
+    f->data = (uint8_t*)malloc(len);
+    assert(f->data);
+    memcpy(f->data, data, len);
+    f->len = len;
+    strncpy(f->iface, iface, sr_IFACE_NAMELEN - 1);
+    f->iface[sr_IFACE_NAMELEN - 1] = 0;
+} /* -- sr_bench_add_frame -- */
+
+static uint32_t sr_bench_get32(const uint8_t* p, int swap)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    if(swap)
+    {
+        v = ((v & 0xff) << 24) | ((v & 0xff00) << 8) |
+            ((v >> 8) & 0xff00) | (v >> 24);
+    }
+    return v;
+} /* -- sr_bench_get32 -- */
+
+static int sr_bench_read_pcap(const uint8_t* buf, size_t size,
+                              const char* ingress)
+{
+    size_t off = sizeof(struct pcap_file_header);
+    uint32_t magic = sr_bench_get32(buf, 0);
+    int swap = magic != TCPDUMP_MAGIC && magic != TCPDUMP_MAGIC_NSEC;
+    uint32_t caplen;
+
+    while(off + sizeof(struct pcap_sf_pkthdr) <= size)
+    {
+        caplen = sr_bench_get32(buf + off + 8, swap);
+        off += sizeof(struct pcap_sf_pkthdr);
+        if(off + caplen > size)
+        { break; }
+        sr_bench_add_frame(buf + off, caplen, ingress);
+        off += caplen;
+    }
+
+    return 0;
+} /* -- sr_bench_read_pcap -- */
+
+static int sr_bench_read_pcapng(const uint8_t* buf, size_t size)
+{
+    char names[SR_CAPTURE_MAX_IF][sr_IFACE_NAMELEN];
+    unsigned int nif = 0, ifid, caplen, flags;
+    size_t off = 0, len, p, end;
+    uint16_t code, olen;
+    uint32_t type;
+
+    while(off + 12 <= size)
+    {
+        type = sr_bench_get32(buf + off, 0);
+        len  = sr_bench_get32(buf + off + 4, 0);
+        if(len < 12 || off + len > size)
+        { break; }
+
+        if(type == PCAPNG_BLOCK_SHB &&
+           sr_bench_get32(buf + off + 8, 0) != PCAPNG_BYTE_ORDER_MAGIC)
+        {
+            fprintf(stderr, "sr_bench: only native byte order pcapng\n");
+            return -1;
+        }
+
+        if(type == PCAPNG_BLOCK_IDB && nif < SR_CAPTURE_MAX_IF)
+        {
+            names[nif][0] = 0;
+            for(p = off + 16, end = off + len - 4; p + 4 <= end;
+                p += 4 + PCAPNG_PAD(olen))
+            {
+                memcpy(&code, buf + p, 2);
+                memcpy(&olen, buf + p + 2, 2);
+                if(code == PCAPNG_OPT_ENDOFOPT)
+                { break; }
+                if(code == PCAPNG_OPT_IF_NAME && olen < sr_IFACE_NAMELEN)
+                {
+                    memcpy(names[nif], buf + p + 4, olen);
+                    names[nif][olen] = 0;
+                }
+            }
+            nif++;
+        }
+
+        if(type == PCAPNG_BLOCK_EPB)
+        {
+            ifid   = sr_bench_get32(buf + off + 8, 0);
+            caplen = sr_bench_get32(buf + off + 20, 0);
+            flags  = 0;
+            for(p = off + 28 + PCAPNG_PAD(caplen), end = off + len - 4;
+                p + 4 <= end; p += 4 + PCAPNG_PAD(olen))
+            {
+                memcpy(&code, buf + p, 2);
+                memcpy(&olen, buf + p + 2, 2);
+                if(code == PCAPNG_OPT_ENDOFOPT)
+                { break; }
+                if(code == PCAPNG_OPT_EPB_FLAGS && olen == 4)
+                { flags = sr_bench_get32(buf + p + 4, 0); }
+            }
+            if(ifid < nif && (flags & 3) != PCAPNG_EPB_OUTBOUND)
+            { sr_bench_add_frame(buf + off + 28, caplen, names[ifid]); }
+        }
+
+        off += len;
+    }
+
+    return 0;
+} /* -- sr_bench_read_pcapng -- */
+
+static int sr_bench_read(const char* path, const char* ingress)
+{
+    FILE* fp = fopen(path, "rb");
+    uint8_t* buf;
+    long size;
+    uint32_t magic;
+    int ret = -1;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = (uint8_t*)malloc(size > 0 ? size : 1);
+    if(buf && size >= 24 && fread(buf, size, 1, fp) == 1)
+    {
+        magic = sr_bench_get32(buf, 0);
+        if(magic == PCAPNG_BLOCK_SHB)
+        { ret = sr_bench_read_pcapng(buf, size); }
+        else if(magic == TCPDUMP_MAGIC || magic == TCPDUMP_MAGIC_NSEC ||
+                sr_bench_get32(buf, 1) == TCPDUMP_MAGIC ||
+                sr_bench_get32(buf, 1) == TCPDUMP_MAGIC_NSEC)
+        { ret = sr_bench_read_pcap(buf, size, ingress); }
+        else
+        { fprintf(stderr, "sr_bench: %s is not a capture\n", path); }
+    }
+
+    free(buf);
+    fclose(fp);
+    return ret;
+} /* -- sr_bench_read -- */
+
+/*---------------------------------------------------------------------
+ * Setting up the router
+ *---------------------------------------------------------------------*/
+
+static int sr_bench_load_ifs(struct sr_instance* sr, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    char line[256], name[sr_IFACE_NAMELEN], ip[32];
+    unsigned int m[6];
+    unsigned char mac[6];
+    int i;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(sscanf(line, "%31s %31s %x:%x:%x:%x:%x:%x", name, ip, &m[0],
+                  &m[1], &m[2], &m[3], &m[4], &m[5]) != 8)
+        { continue; }
+        for(i = 0; i < 6; i++)
+        { mac[i] = m[i]; }
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, inet_addr(ip));
+    }
+
+    fclose(fp);
+    return sr->if_list ? 0 : -1;
+} /* -- sr_bench_load_ifs -- */
+
+static void sr_bench_synth_ifs(struct sr_instance* sr)
+{
+    struct sr_vrf* vrf = sr->vrfs[0];
+    struct sr_rt* rt;
+    const char* name;
+    unsigned char mac[6] = { 2, 0, 0, 0, 0, 0 };
+    unsigned int i;
+    int n = 0;
+
+    for(rt = sr_rt_first(vrf); rt; rt = sr_rt_next(vrf, rt))
+    {
+        for(i = 0; i == 0 || (rt->group && i < rt->group->npaths); i++)
+        {
+            name = i == 0 ? rt->interface : rt->group->paths[i].interface;
+            if(sr_get_interface(sr, name))
+            { continue; }
+            n++;
+            mac[5] = n;
+            sr_add_interface(sr, name);
+            sr_set_ether_addr(sr, mac);
+            sr_set_ether_ip(sr, htonl(0xc0000200 + n));
+        }
+    }
+} /* -- sr_bench_synth_ifs -- */
+
+/* give every next hop, of every path and table, a static ARP entry so
+   nothing waits on ARP however long the run; -1 if a cache is full */
+static int sr_bench_fill_arp(struct sr_instance* sr)
+{
+    struct sr_vrf* vrf;
+    struct sr_rt* rt;
+    struct sr_arpreq* req;
+    unsigned char mac[6] = { 2, 0, 0, 0xff, 0, 0 };
+    unsigned int id, i;
+    int n = 0;
+
+    for(id = 0; id < SR_VRF_MAX; id++)
+    {
+        if((vrf = sr->vrfs[id]) == 0)
+        { continue; }
+        for(rt = sr_rt_first(vrf); rt; rt = sr_rt_next(vrf, rt))
+        {
+            n++;
+            mac[4] = n >> 8;
+            mac[5] = n;
+            for(i = 0; i == 0 || (rt->group && i < rt->group->npaths); i++)
+            {
+                if(sr_arpcache_insert_static(&(vrf->cache), mac,
+                            i == 0 ? rt->gw.s_addr :
+                                     rt->group->paths[i].gw.s_addr,
+                            &req) != 0)
+                {
+                    fprintf(stderr, "sr_bench: more next hops than the "
+                            "%d the ARP cache of table %u holds, use -a\n",
+                            SR_ARPCACHE_SZ, id);
+                    return -1;
+                }
+                if(req)
+                { sr_arpreq_destroy(&(vrf->cache), req); }
+            }
+        }
+    }
+    return 0;
+} /* -- sr_bench_fill_arp -- */
+
+static double sr_bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- sr_bench_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_bench_pass(..)
+ * Scope:  Local
+ *
+ * Feed every frame to the router once, copied in as a receive path
+ * would, one at a time or burst at a time.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_bench_pass(struct sr_instance* sr, unsigned int burst,
+                          int timed)
+{
+    static uint8_t work[SR_BENCH_MAX_BURST][SR_BENCH_MAX_FRAME];
+    uint8_t* packets[SR_BENCH_MAX_BURST];
+    unsigned int lens[SR_BENCH_MAX_BURST];
+    char* ifaces[SR_BENCH_MAX_BURST];
+    struct sr_bench_frame* f;
+    unsigned int i, j, m;
+    uint64_t start;
+
+    for(i = 0; i < nframes; i += m)
+    {
+        m = nframes - i < burst ? nframes - i : burst;
+        for(j = 0; j < m; j++)
+        {
+            f = &(frames[i + j]);
+            memcpy(work[j], f->data, f->len);
+            sr_log_packet(sr, work[j], f->len, f->iface, SR_CAPTURE_RX);
+            packets[j] = work[j];
+            lens[j] = f->len;
+            ifaces[j] = f->iface;
+        }
+
+        start = sr_tsc();
+        sr_rcu_read_lock();
+        if(burst == 1)
+        { sr_handlepacket(sr, packets[0], lens[0], ifaces[0]); }
+        else
+        { sr_handlepacket_burst(sr, packets, lens, ifaces, m); }
+        sr_rcu_read_unlock();
+        if(timed)
+        {
+            start = (sr_tsc() - start) / m;
+            for(j = 0; j < m; j++)
+            { sr_stats_latency(SR_LAT_FASTPATH, start); }
+        }
+    }
+} /* -- sr_bench_pass -- */
+
+int main(int argc, char** argv)
+{
+    const char* rtable = DEFAULT_RTABLE;
+    const char* iffile = 0;
+    const char* mrt_rules = 0;
+    const char* ingress = 0;
+    const char* outfile = 0;
+    unsigned int loops = 1, burst = 1, l, i;
+    int fill_arp = 1, print_stats = 0, zero_alloc = 0, aggregate = 0, c;
+    struct sr_instance sr;
+    uint8_t work[SR_BENCH_MAX_FRAME];
+    uint8_t hdr[sizeof(struct pcap_file_header)];
+    unsigned long allocs0, nalloc;
+    uint64_t packets;
+    double t0, t1, copy;
+
+    while((c = getopt(argc, argv, "hr:m:Ai:I:n:b:w:asz")) != EOF)
+    {
+        switch(c)
+        {
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'm':
+                mrt_rules = optarg;
+                break;
+            case 'A':
+                aggregate = 1;
+                break;
+            case 'i':
+                iffile = optarg;
+                break;
+            case 'I':
+                ingress = optarg;
+                break;
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            case 'b':
+                burst = atoi(optarg);
+                break;
+            case 'w':
+                outfile = optarg;
+                break;
+            case 'a':
+                fill_arp = 0;
+                break;
+            case 's':
+                print_stats = 1;
+                break;
+            case 'z':
+                zero_alloc = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(optind != argc - 1 || loops == 0 || burst == 0 ||
+       burst > SR_BENCH_MAX_BURST)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    sr_tsc_init();
+    sr_log_init(SR_LOG_WARN);
+    atexit(sr_log_shutdown);
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    if(sr_rt_init(&sr) != 0 || (aggregate && sr_vrf_aggregate(&sr) != 0))
+    {
+        fprintf(stderr, "sr_bench: out of memory\n");
+        exit(1);
+    }
+    if((mrt_rules ? sr_load_mrt(sr.vrfs[0], rtable, mrt_rules)
+                  : sr_load_rt(sr.vrfs[0], rtable)) != 0)
+    {
+        fprintf(stderr, "sr_bench: error loading routing table %s\n", rtable);
+        exit(1);
+    }
+    if(iffile ? sr_bench_load_ifs(&sr, iffile) != 0 :
+                (sr_bench_synth_ifs(&sr), sr.if_list == 0))
+    {
+        fprintf(stderr, "sr_bench: no interfaces\n");
+        exit(1);
+    }
+    sr_icmp_init_templates(&sr);
+    sr_init(&sr);
+    sr.flight = sr_flight_create(&sr, SR_FLIGHT_DEFAULT_ENTRIES);
+    if(fill_arp && sr_bench_fill_arp(&sr) != 0)
+    { exit(1); }
+
+    if(sr_bench_read(argv[optind], ingress ? ingress : sr.if_list->name) != 0)
+    { exit(1); }
+    if(nframes == 0)
+    {
+        fprintf(stderr, "sr_bench: no frames in %s\n", argv[optind]);
+        exit(1);
+    }
+
+    /* -- one untimed pass to warm up and write -w -- */
+    if(outfile)
+    {
+        out_fp = fopen(outfile, "wb");
+        if(out_fp == 0)
+        {
+            perror(outfile);
+            exit(1);
+        }
+        fwrite(hdr, sr_dump_pcap_hdr(hdr, 1, SR_BENCH_MAX_FRAME), 1, out_fp);
+    }
+    sr_bench_pass(&sr, burst, 0);
+    if(out_fp)
+    {
+        fclose(out_fp);
+        out_fp = 0;
+    }
+
+    /* -- what copying the frames costs on its own -- */
+    t0 = sr_bench_now();
+    for(l = 0; l < loops; l++)
+    {
+        for(i = 0; i < nframes; i++)
+        {
+            memcpy(work, frames[i].data, frames[i].len);
+            __asm__ __volatile__ ("" : : "r" (work) : "memory");
+        }
+    }
+    copy = sr_bench_now() - t0;
+
+    /* -- the timed passes -- */
+    sent = sent_bytes = 0;
+    sr_alloc_reset();
+    allocs0 = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+    t0 = sr_bench_now();
+    for(l = 0; l < loops; l++)
+    { sr_bench_pass(&sr, burst, 1); }
+    t1 = sr_bench_now();
+    nalloc = __atomic_load_n(&allocs, __ATOMIC_RELAXED) - allocs0;
+
+    packets = (uint64_t)loops * nframes;
+    printf("frames %u, loops %u, burst %u, packets %llu, sent %llu (%llu bytes)\n",
+            nframes, loops, burst, (unsigned long long)packets,
+            (unsigned long long)sent, (unsigned long long)sent_bytes);
+    printf("time %.6f s, %.3f Mpps, %.1f ns/packet "
+           "(%.1f of it copying the frame in)\n",
+            t1 - t0, packets / (t1 - t0) / 1e6, (t1 - t0) * 1e9 / packets,
+            copy * 1e9 / packets);
+    printf("allocations %lu, %.3f allocations/packet\n",
+            nalloc, (double)nalloc / packets);
+
+    if(print_stats)
+    { sr_stats_print(&sr, stdout); }
+
+    if(zero_alloc && nalloc != 0)
+    {
+        fprintf(stderr, "sr_bench: warm packets allocated\n");
+        sr_alloc_report(stderr);
+        return 3;
+    }
+
+    return 0;
+} /* -- main -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-r routing table] [-m MRT next hop rules] \n", argv0);
+    printf("           [-A aggregate the fib] [-i interface file] \n");
+    printf("           [-I ingress interface] [-n loops] [-b frames per burst] \n");
+    printf("           [-w output pcap] \n");
+    printf("           [-a leave the arp cache empty] [-s print stats] \n");
+    printf("           [-z fail if warm packets allocate] \n");
+    printf("           frames.pcap|frames.pcapng \n");
+    printf("   defaults rtable=%s loops=1 burst=1 \n", DEFAULT_RTABLE);
+} /* -- usage -- */
@@ -0,0 +1,566 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Description:
+ *
+ * Buffered packet capture, see sr_capture.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_capture.h"
+#include "sr_ring.h"
+#include "sr_dumper.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+#include "sr_flight.h"
+#include "sr_stats.h"
+#include "sr_alloc.h"
+
+#define SR_CAPTURE_REC_PKT 1
+#define SR_CAPTURE_IDLE_NS 1000000
+
+/* ----------------------------------------------------------------------------
+ * struct sr_capture_rec
+ *
+ * One captured packet, rec.aux is the direction and rec.len the number of
+ * captured bytes that follow.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_capture_rec
+{
+    struct sr_ring_rec rec;
+    uint32_t len;               /* length on the wire */
+    uint32_t ifindex;
+    uint64_t ts_ns;
+};
+
+struct sr_capture
+{
+    struct sr_instance* sr;
+    struct sr_capture_cfg cfg;
+    char* path;
+
+    /* -- producers -- */
+    struct sr_ring* rings;
+    pthread_mutex_t lock;
+
+    /* -- writer -- */
+    pthread_t tid;
+    int running;
+    int fd;
+    uint8_t* out;
+    unsigned int out_len;
+    unsigned long long file_bytes;
+    unsigned long file_packets;
+    time_t file_opened;
+    int ifid[SR_CAPTURE_MAX_IF + 1];    /* pcapng id per ifindex, or -1 */
+    int nifid;
+    unsigned long reported;
+    time_t reported_at;
+
+    struct sr_capture_stats stats;
+};
+
+static __thread struct sr_ring* sr_capture_self = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_now(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_capture_now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_capture_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_flush(..)
+ * Scope:  Local
+ *
+ * Write out the batch buffer.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_flush(struct sr_capture* cap)
+{
+    unsigned int done = 0;
+    ssize_t ret;
+
+    while(done < cap->out_len)
+    {
+        ret = write(cap->fd, cap->out + done, cap->out_len - done);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            sr_log_err("capture: write to %s failed\n", cap->path);
+            break;
+        }
+        done += ret;
+    }
+
+    cap->file_bytes += cap->out_len;
+    cap->stats.bytes += cap->out_len;
+    cap->out_len = 0;
+} /* -- sr_capture_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_open_file(..)
+ * Scope:  Local
+ *
+ * Close the current file, if any, and start the next one with its file
+ * header.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_capture_open_file(struct sr_capture* cap)
+{
+    char* name;
+    int i;
+
+    if(cap->fd >= 0)
+    {
+        sr_capture_flush(cap);
+        if(cap->fd != STDOUT_FILENO)
+        { close(cap->fd); }
+        cap->fd = -1;
+    }
+
+    if(strcmp(cap->path, "-") == 0)
+    { cap->fd = STDOUT_FILENO; }
+    else
+    {
+        name = (char*)malloc(strlen(cap->path) + 16);
+        if(name == 0)
+        { return -1; }
+        if(cap->stats.files == 0)
+        { strcpy(name, cap->path); }
+        else
+        { sprintf(name, "%s.%u", cap->path, cap->stats.files); }
+
+        cap->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(cap->fd < 0)
+        {
+            fprintf(stderr, "sr_capture: can't open %s\n", name);
+            free(name);
+            return -1;
+        }
+        free(name);
+    }
+
+    cap->stats.files++;
+    cap->file_bytes = 0;
+    cap->file_packets = 0;
+    cap->file_opened = time(0);
+    for(i = 0; i <= SR_CAPTURE_MAX_IF; i++)
+    { cap->ifid[i] = -1; }
+    cap->nifid = 0;
+
+    if(cap->cfg.format == SR_CAPTURE_PCAPNG)
+    { cap->out_len += sr_dump_pcapng_shb(cap->out + cap->out_len); }
+    else
+    {
+        cap->out_len += sr_dump_pcap_hdr(cap->out + cap->out_len, 0,
+                cap->cfg.snaplen);
+    }
+
+    return 0;
+} /* -- sr_capture_open_file -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_if_name(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static const char* sr_capture_if_name(struct sr_capture* cap,
+                                      unsigned int ifindex)
+{
+    struct sr_if* if_walker;
+
+    for(if_walker = cap->sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(if_walker->index == ifindex)
+        { return if_walker->name; }
+    }
+
+    return "unknown";
+} /* -- sr_capture_if_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_write_rec(..)
+ * Scope:  Local
+ *
+ * Append one packet to the batch buffer, rotating and flushing as
+ * needed.  The buffer always has room for the largest record.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_write_rec(struct sr_capture* cap,
+                                 struct sr_capture_rec* rec)
+{
+    const uint8_t* data = (const uint8_t*)(rec + 1);
+    unsigned int caplen = rec->rec.len;
+    unsigned int slot = rec->ifindex;
+    unsigned int need;
+    const char* name;
+
+    if(slot > SR_CAPTURE_MAX_IF)
+    { slot = SR_CAPTURE_MAX_IF; }
+
+    if(cap->cfg.format == SR_CAPTURE_PCAPNG)
+    {
+        need = PCAPNG_EPB_MAXLEN(caplen);
+        if(cap->ifid[slot] < 0)
+        { need += PCAPNG_IDB_MAXLEN(sr_IFACE_NAMELEN); }
+    }
+    else
+    { need = PCAP_REC_MAXLEN(caplen); }
+
+    if(cap->cfg.rotate_bytes && cap->file_bytes + cap->out_len + need >
+            cap->cfg.rotate_bytes && cap->file_packets > 0)
+    {
+        if(sr_capture_open_file(cap) != 0)
+        { return; }
+        if(cap->cfg.format == SR_CAPTURE_PCAPNG)
+        { need += PCAPNG_IDB_MAXLEN(sr_IFACE_NAMELEN); }
+    }
+
+    if(cap->out_len + need > SR_CAPTURE_WRITE_SZ)
+    { sr_capture_flush(cap); }
+
+    if(cap->cfg.format == SR_CAPTURE_PCAPNG)
+    {
+        /* interfaces are described the first time they show up in a file */
+        if(cap->ifid[slot] < 0)
+        {
+            name = slot == SR_CAPTURE_MAX_IF ? "unknown" :
+                sr_capture_if_name(cap, slot);
+            cap->out_len += sr_dump_pcapng_idb(cap->out + cap->out_len, name,
+                    cap->cfg.snaplen);
+            cap->ifid[slot] = cap->nifid++;
+        }
+        cap->out_len += sr_dump_pcapng_epb(cap->out + cap->out_len,
+                cap->ifid[slot], rec->ts_ns, caplen, rec->len, data,
+                rec->rec.aux == SR_CAPTURE_RX ? PCAPNG_EPB_INBOUND :
+                                                PCAPNG_EPB_OUTBOUND, 0);
+    }
+    else
+    {
+        cap->out_len += sr_dump_pcap_rec(cap->out + cap->out_len, 0,
+                rec->ts_ns, caplen, rec->len, data);
+    }
+
+    cap->file_packets++;
+    cap->stats.packets++;
+} /* -- sr_capture_write_rec -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_drain(..)
+ * Scope:  Local
+ *
+ * Move everything published in the rings into the batch buffer.
+ * Returns the number of packets handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_capture_drain(struct sr_capture* cap)
+{
+    struct sr_ring* ring;
+    struct sr_ring_rec* rec;
+    uint64_t head, tail;
+    unsigned long dropped = 0;
+    int n = 0;
+
+    ring = __atomic_load_n(&(cap->rings), __ATOMIC_ACQUIRE);
+    for(; ring; ring = ring->next)
+    {
+        head = sr_ring_head(ring);
+        tail = ring->tail;
+
+        while(tail != head)
+        {
+            rec = sr_ring_at(ring, tail);
+            if(rec->kind == SR_CAPTURE_REC_PKT)
+            {
+                sr_capture_write_rec(cap, (struct sr_capture_rec*)rec);
+                n++;
+            }
+            tail += rec->size;
+        }
+
+        sr_ring_release(ring, tail);
+        dropped += __atomic_load_n(&(ring->dropped), __ATOMIC_RELAXED);
+    }
+
+    cap->stats.dropped = dropped;
+
+    return n;
+} /* -- sr_capture_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_thread(..)
+ * Scope:  Local
+ *
+ * Background writer.  Buffered data is written once the batch buffer
+ * fills up or is SR_CAPTURE_FLUSH_MS old; drops are reported at most
+ * once a second.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_capture_thread(void* arg)
+{
+    struct sr_capture* cap = (struct sr_capture*)arg;
+    struct timespec idle;
+    uint64_t last_flush = sr_capture_now(CLOCK_MONOTONIC);
+    uint64_t now;
+    time_t wall;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = SR_CAPTURE_IDLE_NS;
+
+    while(__atomic_load_n(&(cap->running), __ATOMIC_ACQUIRE))
+    {
+        if(sr_capture_drain(cap) > 0)
+        { continue; }
+
+        now = sr_capture_now(CLOCK_MONOTONIC);
+        if(cap->out_len &&
+           now - last_flush >= SR_CAPTURE_FLUSH_MS * 1000000ULL)
+        {
+            sr_capture_flush(cap);
+            last_flush = now;
+        }
+
+        wall = time(0);
+        if(cap->cfg.rotate_secs && cap->fd != STDOUT_FILENO &&
+           wall - cap->file_opened >= cap->cfg.rotate_secs)
+        { sr_capture_open_file(cap); }
+
+        if(cap->stats.dropped != cap->reported && wall != cap->reported_at)
+        {
+            sr_log_warn("capture: writer behind, %lu packets dropped\n",
+                    cap->stats.dropped - cap->reported);
+            cap->reported = cap->stats.dropped;
+            cap->reported_at = wall;
+        }
+
+        nanosleep(&idle, 0);
+    }
+
+    return 0;
+} /* -- sr_capture_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_open(..)
+ * Scope:  Global
+ *
+ * Open the first capture file and start the writer.  Returns 0 on
+ * failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(struct sr_instance* sr,
+                                   const struct sr_capture_cfg* cfg)
+{
+    struct sr_capture* cap;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(cfg);
+    assert(cfg->path);
+
+    cap = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    if(cap == 0)
+    { return 0; }
+
+    cap->sr = sr;
+    cap->cfg = *cfg;
+    if(cap->cfg.snaplen == 0)
+    { cap->cfg.snaplen = PACKET_DUMP_SIZE; }
+    cap->path = strdup(cfg->path);
+    cap->out = (uint8_t*)malloc(SR_CAPTURE_WRITE_SZ);
+    cap->fd = -1;
+    pthread_mutex_init(&(cap->lock), 0);
+
+    if(cap->path == 0 || cap->out == 0 || sr_capture_open_file(cap) != 0)
+    {
+        free(cap->path);
+        free(cap->out);
+        free(cap);
+        return 0;
+    }
+
+    cap->running = 1;
+    if(pthread_create(&(cap->tid), 0, sr_capture_thread, cap) != 0)
+    {
+        cap->running = 0;
+        sr_capture_close(cap);
+        return 0;
+    }
+
+    return cap;
+} /* -- sr_capture_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_packet(..)
+ * Scope:  Global
+ *
+ * Queue a packet for the capture file.  Called from the forwarding
+ * path: never blocks and never allocates after the calling thread's
+ * first packet.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf,
+                       unsigned int len, unsigned int ifindex, int dir)
+{
+    struct sr_ring* ring = sr_capture_self;
+    struct sr_capture_rec* rec;
+    unsigned int caplen;
+    uint64_t pos;
+
+    if(ring == 0)
+    {
+        if((ring = sr_ring_create(SR_CAPTURE_RING_SZ)) == 0)
+        { return; }
+
+        pthread_mutex_lock(&(cap->lock));
+        ring->next = cap->rings;
+        __atomic_store_n(&(cap->rings), ring, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&(cap->lock));
+
+        sr_capture_self = ring;
+    }
+
+    caplen = len < cap->cfg.snaplen ? len : cap->cfg.snaplen;
+
+    rec = (struct sr_capture_rec*)sr_ring_reserve(ring,
+            sizeof(struct sr_capture_rec) + caplen, &pos);
+    if(rec == 0)
+    { return; }
+
+    rec->rec.size = SR_RING_ALIGN(sizeof(struct sr_capture_rec) + caplen);
+    rec->rec.kind = SR_CAPTURE_REC_PKT;
+    rec->rec.aux = dir;
+    rec->rec.len = caplen;
+    rec->len = len;
+    rec->ifindex = ifindex;
+    rec->ts_ns = sr_capture_now(CLOCK_REALTIME);
+    memcpy(rec + 1, buf, caplen);
+
+    sr_ring_commit(ring, pos, rec->rec.size);
+} /* -- sr_capture_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_get_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_get_stats(struct sr_capture* cap,
+                          struct sr_capture_stats* stats)
+{
+    struct sr_ring* ring;
+
+    *stats = cap->stats;
+
+    /* drops are counted by the producers, the writer may lag behind */
+    stats->dropped = 0;
+    ring = __atomic_load_n(&(cap->rings), __ATOMIC_ACQUIRE);
+    for(; ring; ring = ring->next)
+    { stats->dropped += __atomic_load_n(&(ring->dropped), __ATOMIC_RELAXED); }
+} /* -- sr_capture_get_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_close(..)
+ * Scope:  Global
+ *
+ * Stop the writer, write out everything still queued, close the file
+ * and free the capture.  The per-thread rings are left behind.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_close(struct sr_capture* cap)
+{
+    if(cap == 0)
+    { return; }
+
+    if(cap->running)
+    {
+        __atomic_store_n(&(cap->running), 0, __ATOMIC_RELEASE);
+        pthread_join(cap->tid, 0);
+    }
+
+    while(sr_capture_drain(cap) > 0)
+    { }
+    sr_capture_flush(cap);
+
+    if(cap->stats.dropped)
+    {
+        fprintf(stderr, "capture: %lu packets written, %lu dropped\n",
+                cap->stats.packets, cap->stats.dropped);
+    }
+
+    if(cap->fd >= 0 && cap->fd != STDOUT_FILENO)
+    { close(cap->fd); }
+
+    pthread_mutex_destroy(&(cap->lock));
+    free(cap->path);
+    free(cap->out);
+    free(cap);
+} /* -- sr_capture_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_packet(..)
+ * Scope:  Global
+ *
+ * Count the packet, record it in the flight recorder and hand it to the
+ * capture writer, if -l is in effect.  This only copies the packet into
+ * memory; files are written in the background or on demand.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   const char* name, int dir)
+{
+    struct sr_if* iface;
+    unsigned int ifindex, vrf;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    iface = sr_get_interface(sr, name);
+    ifindex = iface ? iface->index : SR_CAPTURE_NO_IF;
+    vrf = iface ? iface->vrf : 0;
+
+    if(dir == SR_CAPTURE_RX)
+    { sr_stats_rx(ifindex, vrf, len); }
+    else
+    { sr_stats_tx(ifindex, vrf, len); }
+
+    if(sr->flight)
+    {
+        sr_flight_record(sr->flight, buf, len, ifindex,
+                dir == SR_CAPTURE_RX ? SR_FLIGHT_RX : SR_FLIGHT_TX,
+                SR_DROP_NONE);
+    }
+    if(sr->capture)
+    { sr_capture_packet(sr->capture, buf, len, ifindex, dir); }
+} /* -- sr_log_packet -- */
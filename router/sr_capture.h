@@ -0,0 +1,77 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Description:
+ *
+ * Buffered packet capture for the -l log file.
+ *
+ * The forwarding threads only timestamp a packet and copy its first
+ * snaplen bytes into a per-thread sr_ring.  A background writer turns
+ * the records into pcap or pcapng, batches them in a large buffer and
+ * writes the file sequentially.  Packets that do not fit in a ring
+ * because the writer has fallen behind are dropped and counted.
+ *
+ * The capture file can be rotated once it reaches a size and/or age;
+ * rotated files are named <file>.1, <file>.2, ...
+ *
+ * Only one capture may be open per process.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_CAPTURE_PCAP   0
+#define SR_CAPTURE_PCAPNG 1
+
+#define SR_CAPTURE_RX 1
+#define SR_CAPTURE_TX 2
+
+#define SR_CAPTURE_NO_IF 0xffff     /* ifindex of an unknown interface */
+#define SR_CAPTURE_MAX_IF 256
+
+#define SR_CAPTURE_RING_SZ  (1 << 22)   /* bytes per thread */
+#define SR_CAPTURE_WRITE_SZ (1 << 20)   /* bytes per write(2) */
+#define SR_CAPTURE_FLUSH_MS 200         /* max age of buffered data */
+
+struct sr_instance;
+struct sr_capture;
+
+struct sr_capture_cfg
+{
+    const char* path;           /* "-" for stdout */
+    int format;                 /* SR_CAPTURE_PCAP or SR_CAPTURE_PCAPNG */
+    unsigned int snaplen;
+    unsigned long rotate_bytes; /* 0: never rotate on size */
+    unsigned int rotate_secs;   /* 0: never rotate on time */
+};
+
+struct sr_capture_stats
+{
+    unsigned long packets;      /* written to a file */
+    unsigned long dropped;      /* lost because the writer was behind */
+    unsigned long long bytes;   /* written to files, headers included */
+    unsigned int files;         /* files opened so far */
+};
+
+struct sr_capture* sr_capture_open(struct sr_instance* sr,
+                                   const struct sr_capture_cfg* cfg);
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf,
+                       unsigned int len, unsigned int ifindex, int dir);
+void sr_capture_get_stats(struct sr_capture* cap,
+                          struct sr_capture_stats* stats);
+void sr_capture_close(struct sr_capture* cap);
+
+/* -- every packet sent or received goes through here -- */
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   const char* name, int dir);
+
+#endif /* -- SR_CAPTURE_H -- */
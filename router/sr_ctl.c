@@ -0,0 +1,490 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * The control socket, see sr_ctl.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_ctl.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_arpcache.h"
+#include "sr_log.h"
+#include "sr_alloc.h"
+
+#define SR_CTL_ROUTE_ADD     0
+#define SR_CTL_ROUTE_REPLACE 1
+#define SR_CTL_ROUTE_DEL     2
+#define SR_CTL_NEIGH_ADD     3
+#define SR_CTL_NEIGH_DEL     4
+#define SR_CTL_ROUTE_ADD_PATH 5
+#define SR_CTL_ROUTE_DEL_PATH 6
+
+/* errors of the neighbor commands, beside those of sr_rt_add and co. */
+#define SR_CTL_NEIGH_FULL    -100
+#define SR_CTL_NO_NEIGH      -101
+#define SR_CTL_NO_IFACE      -102
+#define SR_CTL_NO_VRF        -103
+#define SR_CTL_IFACE_VRF     -104
+
+struct sr_ctl_op
+{
+    int what;                   /* SR_CTL_* */
+    int err;                    /* once applied */
+    unsigned int vrf;           /* routing table ID */
+    struct in_addr dest, gw, mask;
+    unsigned char mac[ETHER_ADDR_LEN];
+    char iface[sr_IFACE_NAMELEN];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ctl
+ *
+ * The server and the client it is serving.  The batch grows as commands
+ * arrive and is emptied once it has been applied and answered.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ctl
+{
+    struct sr_instance* sr;
+    int fd;                     /* listening */
+    int client;
+    struct sr_ctl_op* ops;
+    unsigned int nops, maxops;
+    unsigned int count;         /* commands in the batch, parsed or not */
+    unsigned int bad;           /* first command that did not parse, or 0 */
+    char why[64];               /* and why */
+    char reply[SR_CTL_REPLY_SZ];
+    unsigned int nreply;
+};
+
+/* -- the replies, buffered so a batch is answered in few writes -- */
+
+static void sr_ctl_flush(struct sr_ctl* c)
+{
+    unsigned int off;
+    int n;
+
+    for(off = 0; off < c->nreply; off += n)
+    {
+        n = write(c->client, c->reply + off, c->nreply - off);
+        if(n <= 0)
+        { break; }
+    }
+    c->nreply = 0;
+} /* -- sr_ctl_flush -- */
+
+static void sr_ctl_reply(struct sr_ctl* c, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if(c->nreply + SR_CTL_LINE_MAX > sizeof(c->reply))
+    { sr_ctl_flush(c); }
+    va_start(ap, fmt);
+    n = vsnprintf(c->reply + c->nreply, sizeof(c->reply) - c->nreply, fmt, ap);
+    va_end(ap);
+    if(n > 0)
+    { c->nreply += n; }
+} /* -- sr_ctl_reply -- */
+
+static const char* sr_ctl_strerror(int err)
+{
+    switch(err)
+    {
+        case SR_CTL_NEIGH_FULL: return "neighbor table full";
+        case SR_CTL_NO_NEIGH:   return "no static neighbor entry";
+        case SR_CTL_NO_IFACE:   return "no such interface";
+        case SR_CTL_NO_VRF:     return "no such routing table";
+        case SR_CTL_IFACE_VRF:  return "interface is in another routing table";
+    }
+    return sr_rt_strerror(err);
+} /* -- sr_ctl_strerror -- */
+
+/* -- the parser, on one line with its newline cut off -- */
+
+static int sr_ctl_parse_ip(const char* tok, struct in_addr* addr)
+{ return tok && inet_pton(AF_INET, tok, addr) == 1 ? 0 : -1; }
+
+static int sr_ctl_parse_mac(const char* tok, unsigned char* mac)
+{
+    unsigned int b[ETHER_ADDR_LEN];
+    char end;
+    int i;
+
+    if(tok == 0 || sscanf(tok, "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2],
+                          &b[3], &b[4], &b[5], &end) != ETHER_ADDR_LEN)
+    { return -1; }
+    for(i = 0; i < ETHER_ADDR_LEN; i++)
+    {
+        if(b[i] > 0xff)
+        { return -1; }
+        mac[i] = b[i];
+    }
+    return 0;
+} /* -- sr_ctl_parse_mac -- */
+
+/* -- fill op from the words of a command, or say why not -- */
+static const char* sr_ctl_parse(char** w, int n, struct sr_ctl_op* op)
+{
+    unsigned long vrf = 0;
+    char* end;
+    int route;
+
+    /* -- the table it is for, 0 unless named -- */
+    if(strcmp(w[0], "vrf") == 0)
+    {
+        if(n < 3 || (vrf = strtoul(w[1], &end, 10)) >= SR_VRF_MAX || *end)
+        { return "expected vrf <id> <command>"; }
+        w += 2;
+        n -= 2;
+    }
+
+    route = strcmp(w[0], "route") == 0;
+    if(n < 2 || (!route && strcmp(w[0], "neigh") != 0))
+    { return "unknown command"; }
+
+    memset(op, 0, sizeof(*op));
+    op->vrf = vrf;
+    if(route && (strcmp(w[1], "add") == 0 || strcmp(w[1], "replace") == 0 ||
+                 strcmp(w[1], "add-path") == 0 || strcmp(w[1], "del-path") == 0))
+    {
+        if(strcmp(w[1], "add") == 0)
+        { op->what = SR_CTL_ROUTE_ADD; }
+        else if(strcmp(w[1], "replace") == 0)
+        { op->what = SR_CTL_ROUTE_REPLACE; }
+        else
+        { op->what = w[1][0] == 'a' ? SR_CTL_ROUTE_ADD_PATH : SR_CTL_ROUTE_DEL_PATH; }
+        if(n != 6 || sr_ctl_parse_ip(w[2], &(op->dest)) ||
+           sr_ctl_parse_ip(w[3], &(op->gw)) || sr_ctl_parse_ip(w[4], &(op->mask)))
+        { return "expected <dest> <gw> <mask> <iface>"; }
+        if(strlen(w[5]) >= sr_IFACE_NAMELEN)
+        { return "interface name too long"; }
+        strcpy(op->iface, w[5]);
+    }
+    else if(route && strcmp(w[1], "del") == 0)
+    {
+        op->what = SR_CTL_ROUTE_DEL;
+        if(n != 4 || sr_ctl_parse_ip(w[2], &(op->dest)) ||
+           sr_ctl_parse_ip(w[3], &(op->mask)))
+        { return "expected <dest> <mask>"; }
+    }
+    else if(!route && strcmp(w[1], "add") == 0)
+    {
+        op->what = SR_CTL_NEIGH_ADD;
+        if(n != 4 || sr_ctl_parse_ip(w[2], &(op->dest)) ||
+           sr_ctl_parse_mac(w[3], op->mac))
+        { return "expected <ip> <mac>"; }
+    }
+    else if(!route && strcmp(w[1], "del") == 0)
+    {
+        op->what = SR_CTL_NEIGH_DEL;
+        if(n != 3 || sr_ctl_parse_ip(w[2], &(op->dest)))
+        { return "expected <ip>"; }
+    }
+    else
+    { return "unknown command"; }
+    return 0;
+} /* -- sr_ctl_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_apply(..)
+ * Scope:  Local
+ *
+ * Apply the batch and answer it.  Routes first, all under one hold of
+ * the routing table lock, then neighbor entries.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_apply(struct sr_ctl* c)
+{
+    struct sr_instance* sr = c->sr;
+    struct sr_ctl_op* op;
+    struct sr_arpreq* req;
+    struct sr_vrf* vrf;
+    struct sr_if* iface;
+    unsigned int i, failed = 0;
+
+    if(c->bad)
+    {
+        sr_ctl_reply(c, "error %u %s\n", c->bad, c->why);
+        sr_ctl_reply(c, "ok 0 %u\n", c->count);
+        sr_ctl_flush(c);
+        c->nops = c->count = c->bad = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&(sr->rt_lock));
+    for(i = 0; i < c->nops; i++)
+    {
+        op = &(c->ops[i]);
+        if((vrf = sr->vrfs[op->vrf]) == 0)
+        {
+            op->err = SR_CTL_NO_VRF;
+            continue;
+        }
+        switch(op->what)
+        {
+            case SR_CTL_ROUTE_ADD:
+            case SR_CTL_ROUTE_REPLACE:
+            case SR_CTL_ROUTE_ADD_PATH:
+                iface = sr->if_list ? sr_get_interface(sr, op->iface) : 0;
+                if(sr->if_list && iface == 0)
+                { op->err = SR_CTL_NO_IFACE; }
+                else if(iface && iface->vrf != op->vrf)
+                { op->err = SR_CTL_IFACE_VRF; }
+                else if(op->what == SR_CTL_ROUTE_ADD)
+                { op->err = sr_rt_add(vrf, op->dest, op->gw, op->mask, op->iface); }
+                else if(op->what == SR_CTL_ROUTE_REPLACE)
+                { op->err = sr_rt_replace(vrf, op->dest, op->gw, op->mask, op->iface); }
+                else
+                { op->err = sr_rt_add_path(vrf, op->dest, op->gw, op->mask, op->iface); }
+                break;
+            case SR_CTL_ROUTE_DEL:
+                op->err = sr_rt_del(vrf, op->dest, op->mask);
+                break;
+            case SR_CTL_ROUTE_DEL_PATH:
+                op->err = sr_rt_del_path(vrf, op->dest, op->gw, op->mask, op->iface);
+                break;
+        }
+    }
+    pthread_mutex_unlock(&(sr->rt_lock));
+
+    for(i = 0; i < c->nops; i++)
+    {
+        op = &(c->ops[i]);
+        vrf = sr->vrfs[op->vrf];
+        if(vrf && op->what == SR_CTL_NEIGH_ADD)
+        {
+            if(sr_arpcache_insert_static(&(vrf->cache), op->mac,
+                                         op->dest.s_addr, &req) != 0)
+            { op->err = SR_CTL_NEIGH_FULL; }
+            else if(req)
+            { flush_arpreq_packets(sr, vrf, req, op->mac); }
+        }
+        else if(vrf && op->what == SR_CTL_NEIGH_DEL &&
+                sr_arpcache_remove_static(&(vrf->cache), op->dest.s_addr) != 0)
+        { op->err = SR_CTL_NO_NEIGH; }
+
+        if(op->err)
+        {
+            sr_ctl_reply(c, "error %u %s\n", i + 1, sr_ctl_strerror(op->err));
+            failed++;
+        }
+    }
+
+    sr_ctl_reply(c, "ok %u %u\n", c->nops - failed, failed);
+    sr_ctl_flush(c);
+    sr_log_info("ctl: applied %u commands, %u failed\n", c->nops - failed, failed);
+    c->nops = c->count = 0;
+} /* -- sr_ctl_apply -- */
+
+/* -- a command of the batch that did not parse -- */
+static void sr_ctl_fail(struct sr_ctl* c, const char* why)
+{
+    if(c->bad == 0)
+    {
+        c->bad = c->count;
+        strncpy(c->why, why, sizeof(c->why) - 1);
+    }
+} /* -- sr_ctl_fail -- */
+
+/* -- one line of a batch -- */
+static void sr_ctl_line(struct sr_ctl* c, char* line)
+{
+    struct sr_ctl_op* ops;
+    char* w[10];
+    char* save;
+    const char* why;
+    unsigned int n;
+    int nw = 0;
+
+    for(w[0] = strtok_r(line, " \t\r", &save); w[nw] && nw < 9; )
+    { w[++nw] = strtok_r(0, " \t\r", &save); }
+    if(nw == 0 || w[0][0] == '#')
+    { return; }
+
+    if(nw == 1 && strcmp(w[0], "commit") == 0)
+    {
+        sr_ctl_apply(c);
+        return;
+    }
+    c->count++;
+    if(c->bad)
+    { return; }
+
+    if(c->nops == c->maxops)
+    {
+        n = c->maxops ? c->maxops * 2 : 1024;
+        if((ops = (struct sr_ctl_op*)realloc(c->ops, n * sizeof(*ops))) == 0)
+        {
+            sr_ctl_fail(c, "out of memory");
+            return;
+        }
+        c->ops = ops;
+        c->maxops = n;
+    }
+
+    if((why = sr_ctl_parse(w, nw, &(c->ops[c->nops]))) != 0)
+    {
+        sr_ctl_fail(c, why);
+        return;
+    }
+    c->nops++;
+} /* -- sr_ctl_line -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_serve(..)
+ * Scope:  Local
+ *
+ * Serve one client after another, splitting what they send into lines.
+ * A line longer than SR_CTL_LINE_MAX fails its batch.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_ctl_serve(void* arg)
+{
+    struct sr_ctl* c = (struct sr_ctl*)arg;
+    char* buf;
+    char *p, *nl;
+    int len, n, skip;
+
+    if((buf = (char*)malloc(SR_CTL_READ_SZ + 1)) == 0)
+    {
+        sr_log_err("ctl: out of memory, not serving\n");
+        return 0;
+    }
+
+    for(;;)
+    {
+        if((c->client = accept(c->fd, 0, 0)) < 0)
+        { continue; }
+
+        len = 0;
+        skip = 0;
+        while((n = read(c->client, buf + len, SR_CTL_READ_SZ - len)) > 0)
+        {
+            len += n;
+            for(p = buf; (nl = (char*)memchr(p, '\n', buf + len - p)); p = nl + 1)
+            {
+                *nl = 0;
+                if(skip)
+                { skip = 0; }
+                else if(nl - p >= SR_CTL_LINE_MAX)
+                {
+                    c->count++;
+                    sr_ctl_fail(c, "line too long");
+                }
+                else
+                { sr_ctl_line(c, p); }
+            }
+            len -= p - buf;
+            memmove(buf, p, len);
+
+            /* -- no newline in sight: drop the line up to the next one -- */
+            if(len >= SR_CTL_LINE_MAX)
+            {
+                if(!skip)
+                {
+                    c->count++;
+                    sr_ctl_fail(c, "line too long");
+                    skip = 1;
+                }
+                len = 0;
+            }
+        }
+
+        if(len > 0 && !skip)
+        {
+            buf[len] = 0;
+            sr_ctl_line(c, buf);
+        }
+        if(c->count)
+        { sr_ctl_apply(c); }
+        close(c->client);
+        c->client = -1;
+    }
+
+    return 0;
+} /* -- sr_ctl_serve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_listen(..)
+ * Scope:  Global
+ *
+ * Open the control socket at 'path' and serve it on a thread of its
+ * own.  Returns 0 if the socket could be set up, -1 otherwise.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_listen(struct sr_instance* sr, const char* path)
+{
+    struct sr_ctl* c;
+    struct sockaddr_un addr;
+    pthread_t tid;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        sr_log_err("control socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_ctl_listen");
+        return -1;
+    }
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(fd, 8) < 0)
+    {
+        perror("bind(..):sr_ctl_listen");
+        close(fd);
+        return -1;
+    }
+
+    if((c = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl))) == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    c->sr = sr;
+    c->fd = fd;
+    c->client = -1;
+
+    if(pthread_create(&tid, 0, sr_ctl_serve, c) != 0)
+    {
+        close(fd);
+        free(c);
+        return -1;
+    }
+    pthread_detach(tid);
+
+    return 0;
+} /* -- sr_ctl_listen -- */
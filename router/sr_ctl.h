@@ -0,0 +1,60 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Description:
+ *
+ * The control socket, sr -c <path>: a unix stream socket on which a
+ * routing daemon, or anything else, installs and withdraws routes and
+ * static neighbor entries while the router forwards.
+ *
+ * The protocol is lines of text, one command each, in batches:
+ *
+ *   route add <dest> <gw> <mask> <iface>
+ *   route replace <dest> <gw> <mask> <iface>
+ *   route del <dest> <mask>
+ *   route add-path <dest> <gw> <mask> <iface>
+ *   route del-path <dest> <gw> <mask> <iface>
+ *   neigh add <ip> <mac>
+ *   neigh del <ip>
+ *   commit
+ *
+ * The fields of a route are those of an rtable line.  A command changes
+ * routing table 0 unless it starts with "vrf <id>", naming a table -V
+ * made (sr_vrf.h), and the interface of a route must be bound to the
+ * table it goes in.  Commands are only parsed as they arrive; "commit",
+ * or the client closing its end, applies the batch.  Its routes go in
+ * under one hold of sr->rt_lock, each with sr_rt_add, sr_rt_replace,
+ * sr_rt_del or, for the paths of a multipath route, sr_rt_add_path and
+ * sr_rt_del_path, so the forwarding path sees a route either before or
+ * after its change, then its neighbor entries.
+ * A neighbor entry is a static ARP cache entry, which is never timed out
+ * and which ARP traffic does not change; setting one sends the packets
+ * waiting on the address.
+ *
+ * Every batch is answered once it has been applied: a line
+ *
+ *   error <n> <reason>
+ *
+ * for each command that failed, n counting from 1 in the batch, then
+ *
+ *   ok <applied> <failed>
+ *
+ * A batch with a line that does not parse is not applied at all and is
+ * answered with the error for that line and "ok 0 <commands>".  Lines
+ * that are blank or start with # are skipped.  One client is served at a
+ * time, e.g. "nc -U <path> < batch".
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#define SR_CTL_LINE_MAX 256         /* longest command */
+#define SR_CTL_READ_SZ  (1 << 16)   /* bytes read at a time */
+#define SR_CTL_REPLY_SZ 4096        /* bytes of replies written at a time */
+
+struct sr_instance;
+
+int sr_ctl_listen(struct sr_instance* sr, const char* path);
+
+#endif /* -- SR_CTL_H -- */
@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <string.h>
 #include "sr_dumper.h"
 
 static void
@@ -69,3 +70,126 @@ sr_dump_close(FILE *fp)
   fclose(fp);
 }
 
+/*
+ * Buffer based writers, used where packets are batched up before they
+ * reach the file.
+ */
+unsigned int
+sr_dump_pcap_hdr(uint8_t *buf, int nsec, int snaplen)
+{
+        struct pcap_file_header hdr;
+
+        hdr.magic = nsec ? TCPDUMP_MAGIC_NSEC : TCPDUMP_MAGIC;
+        hdr.version_major = PCAP_VERSION_MAJOR;
+        hdr.version_minor = PCAP_VERSION_MINOR;
+        hdr.thiszone = 0;
+        hdr.snaplen = snaplen;
+        hdr.sigfigs = 0;
+        hdr.linktype = LINKTYPE_ETHERNET;
+
+        memcpy(buf, &hdr, sizeof(hdr));
+        return sizeof(hdr);
+}
+
+unsigned int
+sr_dump_pcap_rec(uint8_t *buf, int nsec, uint64_t ts_ns, uint32_t caplen,
+                 uint32_t len, const uint8_t *data)
+{
+        struct pcap_sf_pkthdr sf_hdr;
+
+        sf_hdr.ts.tv_sec  = ts_ns / 1000000000;
+        sf_hdr.ts.tv_usec = nsec ? ts_ns % 1000000000
+                                 : (ts_ns % 1000000000) / 1000;
+        sf_hdr.caplen     = caplen;
+        sf_hdr.len        = len;
+
+        memcpy(buf, &sf_hdr, sizeof(sf_hdr));
+        memcpy(buf + sizeof(sf_hdr), data, caplen);
+        return sizeof(sf_hdr) + caplen;
+}
+
+static uint8_t *
+pcapng_put32(uint8_t *p, uint32_t v)
+{
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+}
+
+static uint8_t *
+pcapng_put_opt(uint8_t *p, uint16_t code, const void *val, uint16_t len)
+{
+        memcpy(p, &code, sizeof(code));
+        memcpy(p + 2, &len, sizeof(len));
+        if (len)
+                memcpy(p + 4, val, len);
+        memset(p + 4 + len, 0, PCAPNG_PAD(len) - len);
+        return p + 4 + PCAPNG_PAD(len);
+}
+
+unsigned int
+sr_dump_pcapng_shb(uint8_t *buf)
+{
+        uint8_t *p = buf;
+
+        p = pcapng_put32(p, PCAPNG_BLOCK_SHB);
+        p = pcapng_put32(p, PCAPNG_SHB_LEN);
+        p = pcapng_put32(p, PCAPNG_BYTE_ORDER_MAGIC);
+        p = pcapng_put32(p, 1);                 /* major 1, minor 0 */
+        p = pcapng_put32(p, 0xffffffff);        /* section length unknown */
+        p = pcapng_put32(p, 0xffffffff);
+        p = pcapng_put32(p, PCAPNG_SHB_LEN);
+
+        return p - buf;
+}
+
+unsigned int
+sr_dump_pcapng_idb(uint8_t *buf, const char *name, int snaplen)
+{
+        uint8_t *p = buf + 8;
+        uint8_t tsresol = 9;
+        uint32_t len;
+
+        p = pcapng_put32(p, LINKTYPE_ETHERNET); /* linktype, reserved */
+        p = pcapng_put32(p, snaplen);
+        p = pcapng_put_opt(p, PCAPNG_OPT_IF_NAME, name, strlen(name));
+        p = pcapng_put_opt(p, PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+        p = pcapng_put_opt(p, PCAPNG_OPT_ENDOFOPT, 0, 0);
+
+        len = p - buf + 4;
+        pcapng_put32(buf, PCAPNG_BLOCK_IDB);
+        pcapng_put32(buf + 4, len);
+        pcapng_put32(p, len);
+
+        return len;
+}
+
+unsigned int
+sr_dump_pcapng_epb(uint8_t *buf, uint32_t ifid, uint64_t ts_ns,
+                   uint32_t caplen, uint32_t len, const uint8_t *data,
+                   uint32_t flags, const char *comment)
+{
+        uint8_t *p = buf + 8;
+        uint32_t total;
+
+        p = pcapng_put32(p, ifid);
+        p = pcapng_put32(p, (uint32_t)(ts_ns >> 32));
+        p = pcapng_put32(p, (uint32_t)ts_ns);
+        p = pcapng_put32(p, caplen);
+        p = pcapng_put32(p, len);
+        memcpy(p, data, caplen);
+        memset(p + caplen, 0, PCAPNG_PAD(caplen) - caplen);
+        p += PCAPNG_PAD(caplen);
+        if (flags)
+                p = pcapng_put_opt(p, PCAPNG_OPT_EPB_FLAGS, &flags, 4);
+        if (comment)
+                p = pcapng_put_opt(p, PCAPNG_OPT_COMMENT, comment,
+                                   strlen(comment));
+        p = pcapng_put_opt(p, PCAPNG_OPT_ENDOFOPT, 0, 0);
+
+        total = p - buf + 4;
+        pcapng_put32(buf, PCAPNG_BLOCK_EPB);
+        pcapng_put32(buf + 4, total);
+        pcapng_put32(p, total);
+
+        return total;
+}
@@ -3,6 +3,9 @@
  * format as well as a set of operations for logging.
  */
 
+#ifndef SR_DUMPER_H
+#define SR_DUMPER_H
+
 
 #ifdef _LINUX_
 #include <stdint.h>
@@ -20,6 +23,7 @@
 #define PCAP_PROTO_LEN 2
 
 #define TCPDUMP_MAGIC 0xa1b2c3d4
+#define TCPDUMP_MAGIC_NSEC 0xa1b23c4d
 
 #define LINKTYPE_ETHERNET 1
 
@@ -77,3 +81,56 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+/*
+ * pcapng (draft-ietf-opsawg-pcapng) blocks.  Every block is padded to 4
+ * bytes; timestamps are written with an if_tsresol of 9 (nanoseconds).
+ */
+#define PCAPNG_BLOCK_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_ENDOFOPT   0
+#define PCAPNG_OPT_COMMENT    1
+#define PCAPNG_OPT_IF_NAME    2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS  2
+
+#define PCAPNG_EPB_INBOUND  1
+#define PCAPNG_EPB_OUTBOUND 2
+
+#define PCAPNG_PAD(x) (((x) + 3) & ~3)
+
+/* upper bounds on the size of a block written by the functions below */
+#define PCAPNG_SHB_LEN 28
+#define PCAPNG_IDB_MAXLEN(namelen) (36 + PCAPNG_PAD(namelen))
+#define PCAPNG_EPB_MAXLEN(caplen) (44 + PCAPNG_PAD(caplen))
+#define PCAPNG_COMMENT_MAXLEN(len) (4 + PCAPNG_PAD(len))
+#define PCAP_REC_MAXLEN(caplen) (sizeof(struct pcap_sf_pkthdr) + (caplen))
+
+/**
+ * Fill buf with a classic pcap file header, returns the bytes written.
+ * With nsec set the timestamps of the records are in nanoseconds.
+ */
+unsigned int sr_dump_pcap_hdr(uint8_t *buf, int nsec, int snaplen);
+
+/**
+ * Fill buf with a classic pcap record, returns the bytes written.
+ */
+unsigned int sr_dump_pcap_rec(uint8_t *buf, int nsec, uint64_t ts_ns,
+                              uint32_t caplen, uint32_t len,
+                              const uint8_t *data);
+
+/**
+ * Fill buf with a pcapng block, returns the bytes written.  A non-null
+ * comment is attached to the packet as an opt_comment.
+ */
+unsigned int sr_dump_pcapng_shb(uint8_t *buf);
+unsigned int sr_dump_pcapng_idb(uint8_t *buf, const char *name, int snaplen);
+unsigned int sr_dump_pcapng_epb(uint8_t *buf, uint32_t ifid, uint64_t ts_ns,
+                                uint32_t caplen, uint32_t len,
+                                const uint8_t *data, uint32_t flags,
+                                const char *comment);
+
+#endif /* -- SR_DUMPER_H -- */
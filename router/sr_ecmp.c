@@ -0,0 +1,369 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ecmp.c
+ *
+ * Description:
+ *
+ * Equal cost multipath groups and flow hashing, see sr_ecmp.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_ecmp.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_alloc.h"
+
+/* -- the weight of a path out of iface, 0 if its speed is unknown -- */
+static uint32_t sr_ecmp_weight(struct sr_instance* sr, const char* iface)
+{
+    struct sr_if* ifc;
+
+    if(!sr->ecmp_weighted)
+    { return 1; }
+    ifc = sr->if_list ? sr_get_interface(sr, iface) : 0;
+    return ifc ? ifc->speed : 0;
+} /* -- sr_ecmp_weight -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ecmp_fill(..)
+ * Scope:  Local
+ *
+ * Give the buckets of g to its paths in proportion to their weights,
+ * largest remainders rounding, with at least one bucket each.  old is
+ * the bucket array g replaces and map takes its paths to those of g, -1
+ * for a path that is gone: a bucket keeps its path as long as that path
+ * is in g and under its share, and only the rest are handed out again.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ecmp_fill(struct sr_ecmp_group* g, const uint8_t* old,
+                         const int* map)
+{
+    uint32_t w[SR_ECMP_MAX_PATHS], target[SR_ECMP_MAX_PATHS];
+    uint32_t count[SR_ECMP_MAX_PATHS], rem[SR_ECMP_MAX_PATHS];
+    uint32_t n = g->npaths, i, j, b, min = 0, left = SR_ECMP_BUCKETS;
+    uint64_t total = 0;
+    uint8_t spare[SR_ECMP_BUCKETS];
+    uint32_t nspare = 0;
+    int m;
+
+    /* -- a path of unknown speed counts as the slowest known -- */
+    for(i = 0; i < n; i++)
+    {
+        if(g->weight[i] && (min == 0 || g->weight[i] < min))
+        { min = g->weight[i]; }
+    }
+    for(i = 0; i < n; i++)
+    {
+        w[i] = g->weight[i] ? g->weight[i] : (min ? min : 1);
+        total += w[i];
+    }
+
+    for(i = 0; i < n; i++)
+    {
+        target[i] = (uint32_t)((uint64_t)SR_ECMP_BUCKETS * w[i] / total);
+        rem[i] = (uint32_t)((uint64_t)SR_ECMP_BUCKETS * w[i] % total);
+        left -= target[i];
+    }
+    for( ; left; left--)
+    {
+        for(i = 1, j = 0; i < n; i++)
+        {
+            if(rem[i] > rem[j])
+            { j = i; }
+        }
+        target[j]++;
+        rem[j] = 0;
+    }
+    for(i = 0; i < n; i++)
+    {
+        if(target[i])
+        { continue; }
+        for(j = 0, b = 1; b < n; b++)
+        {
+            if(target[b] > target[j])
+            { j = b; }
+        }
+        target[j]--;
+        target[i]++;
+    }
+
+    memset(count, 0, sizeof(count));
+    for(b = 0; b < SR_ECMP_BUCKETS; b++)
+    {
+        m = map[old[b]];
+        if(m >= 0 && count[m] < target[m])
+        {
+            g->bucket[b] = (uint8_t)m;
+            count[m]++;
+        }
+        else
+        { spare[nspare++] = (uint8_t)b; }
+    }
+
+    /* -- round robin, so a new path's buckets are spread out -- */
+    for(i = 0, j = 0; i < nspare; i++, j = (j + 1) % n)
+    {
+        while(count[j] >= target[j])
+        { j = (j + 1) % n; }
+        g->bucket[spare[i]] = (uint8_t)j;
+        count[j]++;
+    }
+} /* -- sr_ecmp_fill -- */
+
+/* -- a path of g: only the gateway and interface are kept -- */
+static void sr_ecmp_set_path(struct sr_ecmp_group* g, uint32_t i,
+                             struct in_addr gw, const char* iface,
+                             uint32_t weight)
+{
+    memset(&(g->paths[i]), 0, sizeof(struct sr_rt));
+    g->paths[i].gw = gw;
+    strncpy(g->paths[i].interface, iface, sr_IFACE_NAMELEN - 1);
+    g->weight[i] = weight;
+} /* -- sr_ecmp_set_path -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ecmp_add_path(..)
+ * Scope:  Global
+ *
+ * A new group for rt with path's gateway and interface added, rt's
+ * buckets moving only as far as the new path's share needs.  rt itself
+ * is not changed.  Returns 0 if out of memory; the caller makes sure rt
+ * has fewer than SR_ECMP_MAX_PATHS paths and not this one.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ecmp_group* sr_ecmp_add_path(struct sr_instance* sr,
+                                       const struct sr_rt* rt,
+                                       const struct sr_rt* path)
+{
+    const struct sr_ecmp_group* old = rt->group;
+    struct sr_ecmp_group* g;
+    uint8_t single[SR_ECMP_BUCKETS];
+    int map[SR_ECMP_MAX_PATHS];
+    uint32_t i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(rt);
+    assert(path);
+    assert(old == 0 || old->npaths < SR_ECMP_MAX_PATHS);
+
+    if((g = (struct sr_ecmp_group*)calloc(1, sizeof(*g))) == 0)
+    { return 0; }
+
+    if(old)
+    {
+        for(i = 0; i < old->npaths; i++)
+        {
+            sr_ecmp_set_path(g, i, old->paths[i].gw, old->paths[i].interface,
+                             old->weight[i]);
+            map[i] = i;
+        }
+        g->npaths = old->npaths;
+    }
+    else
+    {
+        /* -- a route without a group is one path with every bucket -- */
+        sr_ecmp_set_path(g, 0, rt->gw, rt->interface,
+                         sr_ecmp_weight(sr, rt->interface));
+        map[0] = 0;
+        memset(single, 0, sizeof(single));
+        g->npaths = 1;
+    }
+
+    sr_ecmp_set_path(g, g->npaths++, path->gw, path->interface,
+                     sr_ecmp_weight(sr, path->interface));
+    sr_ecmp_fill(g, old ? old->bucket : single, map);
+    return g;
+} /* -- sr_ecmp_add_path -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ecmp_del_path(..)
+ * Scope:  Global
+ *
+ * A new group for rt without its path i, whose buckets go to the paths
+ * left; every other bucket stays.  rt must have more than two paths,
+ * with two the route simply becomes the other one.  Returns 0 if out of
+ * memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ecmp_group* sr_ecmp_del_path(struct sr_instance* sr,
+                                       const struct sr_rt* rt, int i)
+{
+    const struct sr_ecmp_group* old = rt->group;
+    struct sr_ecmp_group* g;
+    int map[SR_ECMP_MAX_PATHS];
+    uint32_t j;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(old && old->npaths > 2);
+    assert(i >= 0 && (uint32_t)i < old->npaths);
+
+    if((g = (struct sr_ecmp_group*)calloc(1, sizeof(*g))) == 0)
+    { return 0; }
+
+    for(j = 0; j < old->npaths; j++)
+    {
+        if(j == (uint32_t)i)
+        {
+            map[j] = -1;
+            continue;
+        }
+        map[j] = g->npaths;
+        sr_ecmp_set_path(g, g->npaths++, old->paths[j].gw,
+                         old->paths[j].interface, old->weight[j]);
+    }
+    sr_ecmp_fill(g, old->bucket, map);
+    return g;
+} /* -- sr_ecmp_del_path -- */
+
+/* -- a new group for rt weighed by the speeds its interfaces have now,
+ *    0 if they are unchanged -- */
+struct sr_ecmp_group* sr_ecmp_reweigh(struct sr_instance* sr,
+                                      const struct sr_rt* rt)
+{
+    const struct sr_ecmp_group* old = rt->group;
+    struct sr_ecmp_group* g;
+    int map[SR_ECMP_MAX_PATHS];
+    uint32_t i, w, changed = 0;
+
+    if(old == 0 || (g = sr_ecmp_copy(old)) == 0)
+    { return 0; }
+    for(i = 0; i < g->npaths; i++)
+    {
+        w = sr_ecmp_weight(sr, g->paths[i].interface);
+        changed |= w != g->weight[i];
+        g->weight[i] = w;
+        map[i] = i;
+    }
+    if(!changed)
+    {
+        sr_ecmp_free(g);
+        return 0;
+    }
+    sr_ecmp_fill(g, old->bucket, map);
+    return g;
+} /* -- sr_ecmp_reweigh -- */
+
+/* -- the index of rt's path through gw and iface, -1 if it has none -- */
+int sr_ecmp_find_path(const struct sr_rt* rt, struct in_addr gw,
+                      const char* iface)
+{
+    const struct sr_ecmp_group* g = rt->group;
+    uint32_t i;
+
+    if(g == 0)
+    {
+        return rt->gw.s_addr == gw.s_addr &&
+               strncmp(rt->interface, iface, sr_IFACE_NAMELEN) == 0 ? 0 : -1;
+    }
+    for(i = 0; i < g->npaths; i++)
+    {
+        if(g->paths[i].gw.s_addr == gw.s_addr &&
+           strncmp(g->paths[i].interface, iface, sr_IFACE_NAMELEN) == 0)
+        { return i; }
+    }
+    return -1;
+} /* -- sr_ecmp_find_path -- */
+
+/* -- groups are copied whole, 0 copies to 0 -- */
+
+struct sr_ecmp_group* sr_ecmp_copy(const struct sr_ecmp_group* g)
+{
+    struct sr_ecmp_group* copy;
+
+    if(g == 0)
+    { return 0; }
+    if((copy = (struct sr_ecmp_group*)malloc(sizeof(*copy))) == 0)
+    { return 0; }
+    memcpy(copy, g, sizeof(*copy));
+    return copy;
+} /* -- sr_ecmp_copy -- */
+
+void sr_ecmp_free(struct sr_ecmp_group* g)
+{ free(g); }
+
+/* -- the same paths with the same buckets -- */
+int sr_ecmp_equal(const struct sr_ecmp_group* a, const struct sr_ecmp_group* b)
+{
+    uint32_t i;
+
+    if(a == 0 || b == 0)
+    { return a == b; }
+    if(a->npaths != b->npaths ||
+       memcmp(a->bucket, b->bucket, sizeof(a->bucket)) != 0)
+    { return 0; }
+    for(i = 0; i < a->npaths; i++)
+    {
+        if(a->paths[i].gw.s_addr != b->paths[i].gw.s_addr ||
+           strncmp(a->paths[i].interface, b->paths[i].interface,
+                   sr_IFACE_NAMELEN) != 0)
+        { return 0; }
+    }
+    return 1;
+} /* -- sr_ecmp_equal -- */
+
+/* -- mixes what sr_ecmp_equal compares, 0 for no group -- */
+uint32_t sr_ecmp_group_hash(const struct sr_ecmp_group* g)
+{
+    uint32_t h = 0, i;
+
+    if(g == 0)
+    { return 0; }
+    for(i = 0; i < g->npaths; i++)
+    { h = (h ^ g->paths[i].gw.s_addr) * 16777619u; }
+    for(i = 0; i < SR_ECMP_BUCKETS; i += 4)
+    {
+        h = (h ^ (g->bucket[i] | g->bucket[i + 1] << 8 |
+                  g->bucket[i + 2] << 16 | (uint32_t)g->bucket[i + 3] << 24))
+            * 16777619u;
+    }
+    return h;
+} /* -- sr_ecmp_group_hash -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ecmp_hash(..)
+ * Scope:  Global
+ *
+ * Hash the flow of the IP packet at ip: source, destination, protocol
+ * and, for TCP and UDP, the ports.  Fragments after the first have no
+ * ports and the first may be hashed with them, so any fragment hashes
+ * without, which keeps a fragmented datagram on one path.
+ *
+ *---------------------------------------------------------------------*/
+
+uint32_t sr_ecmp_hash(const uint8_t* ip, unsigned int len)
+{
+    uint32_t h, ports = 0;
+    unsigned int hl;
+
+    if(len < 20)
+    { return 0; }
+    hl = (ip[0] & 0x0f) * 4;
+
+    /* -- no more fragments clear and offset 0 -- */
+    if((ip[9] == 6 || ip[9] == 17) && (ip[6] & 0x3f) == 0 && ip[7] == 0 &&
+       hl >= 20 && len >= hl + 4)
+    {
+        ports = (uint32_t)ip[hl] << 24 | ip[hl + 1] << 16 |
+                ip[hl + 2] << 8 | ip[hl + 3];
+    }
+
+    h = ((uint32_t)ip[12] << 24 | ip[13] << 16 | ip[14] << 8 | ip[15]) *
+        0x9e3779b1u;
+    h = (h ^ ((uint32_t)ip[16] << 24 | ip[17] << 16 | ip[18] << 8 | ip[19]))
+        * 0x85ebca6bu;
+    h = (h ^ ports ^ ip[9]) * 0xc2b2ae35u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    return h ^ (h >> 16);
+} /* -- sr_ecmp_hash -- */
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ecmp.h
+ *
+ * Description:
+ *
+ * Equal cost multipath.  A route may have a group of up to
+ * SR_ECMP_MAX_PATHS next hops, its paths, and the forwarding path picks
+ * one per flow: a hash of the packet's 5-tuple selects one of
+ * SR_ECMP_BUCKETS buckets and the bucket names the path.  The hash
+ * uses fixed constants, so a flow keeps its path across packets and
+ * restarts, and packets of a flow are never reordered over two links.
+ *
+ * Paths get buckets in proportion to their weights, all 1 unless sr -W
+ * weighs them by the speed HWINFO reports for their interface, a path
+ * of unknown speed counting as the slowest; the groups are weighed
+ * again once HWINFO arrives (sr_rt_reweigh).  Hashing
+ * is resilient: when a path is added or removed the group is rebuilt
+ * from the old one, and only the buckets that have to move do, those of
+ * a removed path or the share a new path takes, so every other flow
+ * stays where it was.
+ *
+ * A group belongs to the route it hangs off and never changes once
+ * published; adding or removing a path makes a new route with a new
+ * group (sr_rt_add_path, sr_rt_del_path).  The fib and the aggregation
+ * keep copies of their own, freed with their route slots, so no reader
+ * can be left holding a freed group.  The route's own gateway and
+ * interface are those of its first path, for code that ignores groups.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ECMP_H
+#define SR_ECMP_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_rt.h"
+
+#define SR_ECMP_MAX_PATHS 8
+#define SR_ECMP_BUCKETS   256       /* power of two, at most 256 */
+
+struct sr_instance;
+
+struct sr_ecmp_group
+{
+    uint32_t npaths;
+    uint32_t weight[SR_ECMP_MAX_PATHS];
+    struct sr_rt paths[SR_ECMP_MAX_PATHS];  /* gw and interface only */
+    uint8_t bucket[SR_ECMP_BUCKETS];        /* path of each bucket */
+};
+
+struct sr_ecmp_group* sr_ecmp_add_path(struct sr_instance* sr,
+                                       const struct sr_rt* rt,
+                                       const struct sr_rt* path);
+struct sr_ecmp_group* sr_ecmp_del_path(struct sr_instance* sr,
+                                       const struct sr_rt* rt, int i);
+struct sr_ecmp_group* sr_ecmp_reweigh(struct sr_instance* sr,
+                                      const struct sr_rt* rt);
+int  sr_ecmp_find_path(const struct sr_rt* rt, struct in_addr gw,
+                       const char* iface);
+struct sr_ecmp_group* sr_ecmp_copy(const struct sr_ecmp_group* g);
+void sr_ecmp_free(struct sr_ecmp_group* g);
+int  sr_ecmp_equal(const struct sr_ecmp_group* a, const struct sr_ecmp_group* b);
+uint32_t sr_ecmp_group_hash(const struct sr_ecmp_group* g);
+uint32_t sr_ecmp_hash(const uint8_t* ip, unsigned int len);
+
+/* the path of rt that the packet at ip, len bytes of IP, takes */
+static __inline__ const struct sr_rt* sr_ecmp_select(const struct sr_rt* rt,
+                                                     const uint8_t* ip,
+                                                     unsigned int len)
+{
+    const struct sr_ecmp_group* g = rt->group;
+
+    if(g == 0)
+    { return rt; }
+    return &(g->paths[g->bucket[sr_ecmp_hash(ip, len) & (SR_ECMP_BUCKETS - 1)]]);
+}
+
+#endif /* -- SR_ECMP_H -- */
@@ -0,0 +1,1123 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * The forwarding table, see sr_fib.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+
+#include "sr_fib.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_ortc.h"
+#include "sr_rcu.h"
+#include "sr_ecmp.h"
+#include "sr_log.h"
+#include "sr_alloc.h"
+
+#define SR_FIB_MAX_CHUNKS (1 << 23)     /* chunk << 8 must fit 31 bits */
+
+/* -- the prefix length of a contiguous mask, -1 for any other -- */
+int sr_fib_prefix_len(uint32_t mask)
+{
+    int len = mask ? 32 - __builtin_ctz(mask) : 0;
+
+    if(len && mask != 0xffffffff << (32 - len))
+    { return -1; }
+    return len;
+} /* -- sr_fib_prefix_len -- */
+
+static uint32_t sr_fib_mask(int len)
+{ return len ? 0xffffffff << (32 - len) : 0; }
+
+/* -- n copies of value from e on, doubling up with memcpy -- */
+static void sr_fib_fill(uint32_t* e, uint32_t n, uint32_t value)
+{
+    uint32_t done = 1;
+
+    e[0] = value;
+    while(done < n)
+    {
+        uint32_t more = done < n - done ? done : n - done;
+
+        memcpy(e + done, e, more * sizeof(uint32_t));
+        done += more;
+    }
+} /* -- sr_fib_fill -- */
+
+static void sr_fib_free_later(void* arg, void* p)
+{ free(p); }
+
+static void sr_fib_destroy_later(void* arg, void* p)
+{ sr_fib_destroy((struct sr_fib*)p); }
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_grow(..)
+ * Scope:  Local
+ *
+ * Grow the array at *array to size bytes, keeping the first keep.
+ * Once the fib is live readers may be in the old one, so it is copied
+ * and the old one freed later instead of reallocated.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_grow(struct sr_fib* fib, void** array, size_t keep,
+                       size_t size)
+{
+    void *p, *old = *array;
+
+    if(!fib->live)
+    {
+        if((p = realloc(old, size)) == 0)
+        { return -1; }
+        *array = p;
+        return 0;
+    }
+
+    if((p = malloc(size)) == 0)
+    { return -1; }
+    memcpy(p, old, keep);
+    __atomic_store_n(array, p, __ATOMIC_RELEASE);
+    sr_rcu_retire(sr_fib_free_later, 0, old);
+    return 0;
+} /* -- sr_fib_grow -- */
+
+/* -- the free lists: an index goes in when it is unlinked and comes
+ *    out once no reader can still see it -- */
+
+static void sr_fib_fifo_put(struct sr_fib_fifo* f, uint32_t index)
+{
+    struct sr_fib_free* q;
+    uint32_t size;
+
+    if(f->tail == f->size && f->head >= f->size / 2)
+    {
+        memmove(f->q, f->q + f->head,
+                (f->tail - f->head) * sizeof(struct sr_fib_free));
+        f->tail -= f->head;
+        f->head = 0;
+    }
+    if(f->tail == f->size)
+    {
+        size = f->size ? f->size * 2 : 64;
+        if((q = (struct sr_fib_free*)realloc(f->q,
+                        size * sizeof(struct sr_fib_free))) == 0)
+        { return; }             /* -- never reused, then -- */
+        f->q = q;
+        f->size = size;
+    }
+
+    f->q[f->tail].stamp = sr_rcu_stamp();
+    f->q[f->tail++].index = index;
+} /* -- sr_fib_fifo_put -- */
+
+/* -- the oldest index that can be reused, + 1, or 0 if there is none -- */
+static uint32_t sr_fib_fifo_get(struct sr_fib_fifo* f)
+{
+    if(f->head == f->tail || !sr_rcu_passed(f->q[f->head].stamp))
+    { return 0; }
+    return f->q[f->head++].index + 1;
+} /* -- sr_fib_fifo_get -- */
+
+/* -- the prefix hash, open addressing with linear probing -- */
+
+static uint32_t sr_fib_hash(uint32_t prefix, int len)
+{
+    uint32_t h = (prefix ^ (uint32_t)len) * 0x9e3779b1u;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    return h ^ (h >> 13);
+} /* -- sr_fib_hash -- */
+
+static struct sr_fib_prefix* sr_fib_find(const struct sr_fib* fib,
+                                         uint32_t prefix, int len)
+{
+    struct sr_fib_prefix* p;
+    uint32_t mask = fib->prefixes_size - 1, i;
+
+    if(fib->prefixes == 0)
+    { return 0; }
+
+    for(i = sr_fib_hash(prefix, len) & mask; ; i = (i + 1) & mask)
+    {
+        p = &(fib->prefixes[i]);
+        if(p->len == 0)
+        { return 0; }
+        if(p->len == len + 1 && p->prefix == prefix)
+        { return p; }
+    }
+} /* -- sr_fib_find -- */
+
+static void sr_fib_hash_put(struct sr_fib_prefix* table, uint32_t size,
+                            const struct sr_fib_prefix* p)
+{
+    uint32_t i;
+
+    for(i = sr_fib_hash(p->prefix, p->len - 1) & (size - 1); table[i].len;
+        i = (i + 1) & (size - 1))
+    { }
+    table[i] = *p;
+} /* -- sr_fib_hash_put -- */
+
+/* -- prefix/len is for value now, the first time or again -- */
+static int sr_fib_remember(struct sr_fib* fib, uint32_t prefix, int len,
+                           uint32_t value)
+{
+    struct sr_fib_prefix *p, *table;
+    uint32_t size, i;
+
+    if((p = sr_fib_find(fib, prefix, len)))
+    {
+        p->value = value;
+        return 0;
+    }
+
+    /* -- at most half full -- */
+    if((fib->nprefixes + 1) * 2 > fib->prefixes_size)
+    {
+        size = fib->prefixes_size ? fib->prefixes_size * 2 : 64;
+        table = (struct sr_fib_prefix*)calloc(size, sizeof(*table));
+        if(table == 0)
+        { return -1; }
+        for(i = 0; i < fib->prefixes_size; i++)
+        {
+            if(fib->prefixes[i].len)
+            { sr_fib_hash_put(table, size, &(fib->prefixes[i])); }
+        }
+        free(fib->prefixes);
+        fib->prefixes = table;
+        fib->prefixes_size = size;
+    }
+
+    table = fib->prefixes;
+    size = fib->prefixes_size;
+    for(i = sr_fib_hash(prefix, len) & (size - 1); table[i].len;
+        i = (i + 1) & (size - 1))
+    { }
+    table[i].prefix = prefix;
+    table[i].len = len + 1;
+    table[i].value = value;
+    fib->nprefixes++;
+    fib->len_count[len]++;
+    return 0;
+} /* -- sr_fib_remember -- */
+
+/* -- p is gone: close the gap behind it so every probe still finds its
+ *    prefix -- */
+static void sr_fib_forget(struct sr_fib* fib, struct sr_fib_prefix* p)
+{
+    struct sr_fib_prefix* table = fib->prefixes;
+    uint32_t mask = fib->prefixes_size - 1;
+    uint32_t i = p - table, j = i, home;
+
+    fib->nprefixes--;
+    fib->len_count[p->len - 1]--;
+
+    for(;;)
+    {
+        j = (j + 1) & mask;
+        if(table[j].len == 0)
+        { break; }
+        home = sr_fib_hash(table[j].prefix, table[j].len - 1) & mask;
+        /* -- j may move to i unless its home lies in (i, j] -- */
+        if(i <= j ? (home > i && home <= j) : (home > i || home <= j))
+        { continue; }
+        table[i] = table[j];
+        i = j;
+    }
+    table[i].len = 0;
+} /* -- sr_fib_forget -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_chunk(..)
+ * Scope:  Local
+ *
+ * Turn the entry at *e into a chunk of 256 copies of it, unless it is
+ * one already, and return the chunk's first entry.  The chunk is
+ * filled in before *e points at it.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t* sr_fib_chunk(struct sr_fib* fib, uint32_t* e)
+{
+    uint32_t c;
+    uint8_t len;
+    int in_l1 = e >= fib->l1 && e < fib->l1 + SR_FIB_L1_SIZE;
+    size_t off = in_l1 ? e - fib->l1 : e - fib->chunks;  /* chunks move */
+
+    if(*e & SR_FIB_CHUNK)
+    { return fib->chunks + ((size_t)(*e & ~SR_FIB_CHUNK) << 8); }
+
+    if((c = sr_fib_fifo_get(&(fib->free_chunks))) != 0)
+    { c--; }
+    else
+    {
+        if(fib->nchunks == fib->maxchunks)
+        {
+            c = fib->maxchunks ? fib->maxchunks * 2 : 256;
+            if(fib->maxchunks == SR_FIB_MAX_CHUNKS ||
+               sr_fib_grow(fib, (void**)&(fib->chunks_len),
+                           (size_t)fib->nchunks * SR_FIB_L2_SIZE,
+                           (size_t)c * SR_FIB_L2_SIZE) != 0 ||
+               sr_fib_grow(fib, (void**)&(fib->chunks),
+                           (size_t)fib->nchunks * SR_FIB_L2_SIZE *
+                           sizeof(uint32_t), (size_t)c * SR_FIB_L2_SIZE *
+                           sizeof(uint32_t)) != 0)
+            { return 0; }
+            fib->maxchunks = c;
+        }
+        c = fib->nchunks++;
+    }
+
+    if(in_l1)
+    { len = fib->l1_len[off]; }
+    else
+    {
+        e = fib->chunks + off;
+        len = fib->chunks_len[off];
+    }
+    sr_fib_fill(fib->chunks + ((size_t)c << 8), SR_FIB_L2_SIZE, *e);
+    memset(fib->chunks_len + ((size_t)c << 8), len, SR_FIB_L2_SIZE);
+    __atomic_store_n(e, SR_FIB_CHUNK | c, __ATOMIC_RELEASE);
+
+    return fib->chunks + ((size_t)c << 8);
+} /* -- sr_fib_chunk -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert(..)
+ * Scope:  Local
+ *
+ * Point every entry prefix/len covers at value, while building.
+ * Prefixes must come shortest first, so the ranges written never hold
+ * chunks.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_insert(struct sr_fib* fib, uint32_t prefix, int len,
+                         uint32_t value)
+{
+    uint32_t *l2, *l3, *e;
+    uint8_t* d;
+    uint32_t n;
+
+    if(len <= 16)
+    {
+        e = fib->l1 + (prefix >> 16);
+        d = fib->l1_len + (prefix >> 16);
+        n = 1 << (16 - len);
+    }
+    else
+    {
+        if((l2 = sr_fib_chunk(fib, &(fib->l1[prefix >> 16]))) == 0)
+        { return -1; }
+
+        if(len <= 24)
+        {
+            e = l2 + ((prefix >> 8) & 0xff);
+            n = 1 << (24 - len);
+        }
+        else
+        {
+            if((l3 = sr_fib_chunk(fib, &(l2[(prefix >> 8) & 0xff]))) == 0)
+            { return -1; }
+            e = l3 + (prefix & 0xff);
+            n = 1 << (32 - len);
+        }
+        d = fib->chunks_len + (e - fib->chunks);
+    }
+
+    sr_fib_fill(e, n, value);
+    memset(d, len + 1, n);
+    return sr_fib_remember(fib, prefix, len, value);
+} /* -- sr_fib_insert -- */
+
+/* -- a chunk whose entries are all the same goes back into *e -- */
+static void sr_fib_fold(struct sr_fib* fib, uint32_t* e, uint8_t* d)
+{
+    uint32_t c = *e & ~SR_FIB_CHUNK, i;
+    const uint32_t* ce = fib->chunks + ((size_t)c << 8);
+    const uint8_t* cd = fib->chunks_len + ((size_t)c << 8);
+
+    if(!(*e & SR_FIB_CHUNK) || (ce[0] & SR_FIB_CHUNK))
+    { return; }
+    for(i = 1; i < SR_FIB_L2_SIZE; i++)
+    {
+        if(ce[i] != ce[0] || cd[i] != cd[0])
+        { return; }
+    }
+
+    *d = cd[0];
+    __atomic_store_n(e, ce[0], __ATOMIC_RELEASE);
+    sr_fib_fifo_put(&(fib->free_chunks), c);
+} /* -- sr_fib_fold -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_rewrite(..)
+ * Scope:  Local
+ *
+ * Set each of the n entries from e on that is for a prefix of length
+ * lo - 1 to hi - 1, going by the lengths + 1 at d, to value for length
+ * len - 1, descending into chunks and folding those left uniform.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib_rewrite(struct sr_fib* fib, uint32_t* e, uint8_t* d,
+                           uint32_t n, int lo, int hi, uint32_t value,
+                           int len)
+{
+    uint32_t i;
+    size_t c;
+
+    for(i = 0; i < n; i++)
+    {
+        if(e[i] & SR_FIB_CHUNK)
+        {
+            c = (size_t)(e[i] & ~SR_FIB_CHUNK) << 8;
+            sr_fib_rewrite(fib, fib->chunks + c, fib->chunks_len + c,
+                           SR_FIB_L2_SIZE, lo, hi, value, len);
+            sr_fib_fold(fib, e + i, d + i);
+        }
+        else if(d[i] >= lo && d[i] <= hi)
+        {
+            d[i] = len;
+            __atomic_store_n(e + i, value, __ATOMIC_RELEASE);
+        }
+    }
+} /* -- sr_fib_rewrite -- */
+
+/* -- sr_fib_rewrite over the entries prefix/len covers, making the
+ *    chunks it needs first and folding them after -- */
+static int sr_fib_rewrite_prefix(struct sr_fib* fib, uint32_t prefix,
+                                 int len, int lo, int hi, uint32_t value,
+                                 int vlen)
+{
+    uint32_t* l1e = &(fib->l1[prefix >> 16]);
+    uint8_t* l1d = &(fib->l1_len[prefix >> 16]);
+    uint32_t *l2, *l3;
+    size_t off2, off3;
+
+    if(len <= 16)
+    {
+        sr_fib_rewrite(fib, l1e, l1d, 1 << (16 - len), lo, hi, value, vlen);
+        return 0;
+    }
+
+    if((l2 = sr_fib_chunk(fib, l1e)) == 0)
+    { return -1; }
+    off2 = (l2 - fib->chunks) + ((prefix >> 8) & 0xff);
+
+    if(len <= 24)
+    {
+        sr_fib_rewrite(fib, fib->chunks + off2, fib->chunks_len + off2,
+                       1 << (24 - len), lo, hi, value, vlen);
+    }
+    else
+    {
+        if((l3 = sr_fib_chunk(fib, fib->chunks + off2)) == 0)
+        { return -1; }
+        off3 = (l3 - fib->chunks) + (prefix & 0xff);
+        sr_fib_rewrite(fib, fib->chunks + off3, fib->chunks_len + off3,
+                       1 << (32 - len), lo, hi, value, vlen);
+        sr_fib_fold(fib, fib->chunks + off2, fib->chunks_len + off2);
+    }
+
+    sr_fib_fold(fib, l1e, l1d);
+    return 0;
+} /* -- sr_fib_rewrite_prefix -- */
+
+/* -- a route for nh with prefix/len as its own, returning the entry
+ *    for it, or 0 if out of memory.  It has its own copy of nh's group,
+ *    and a slot used before still has the group it had -- */
+static uint32_t sr_fib_new_route(struct sr_fib* fib, const struct sr_rt* nh,
+                                 uint32_t prefix, int len)
+{
+    struct sr_ecmp_group* group = 0;
+    struct sr_rt* rt;
+    uint32_t i, n;
+
+    if(nh->group && (group = sr_ecmp_copy(nh->group)) == 0)
+    { return 0; }
+
+    if((i = sr_fib_fifo_get(&(fib->free_rt))) != 0)
+    { sr_ecmp_free(fib->rt[--i].group); }
+    else
+    {
+        if(fib->nroutes == fib->maxroutes)
+        {
+            n = fib->maxroutes * 2;
+            if(sr_fib_grow(fib, (void**)&(fib->rt),
+                           (size_t)fib->nroutes * sizeof(struct sr_rt),
+                           (size_t)n * sizeof(struct sr_rt)) != 0)
+            {
+                sr_ecmp_free(group);
+                return 0;
+            }
+            fib->maxroutes = n;
+        }
+        i = fib->nroutes++;
+    }
+
+    rt = &(fib->rt[i]);
+    *rt = *nh;
+    rt->group = group;
+    rt->dest.s_addr = htonl(prefix);
+    rt->mask.s_addr = htonl(sr_fib_mask(len));
+    rt->next = 0;
+    return i + 1;
+} /* -- sr_fib_new_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_set(..)
+ * Scope:  Global
+ *
+ * Add prefix/len (host byte order) to a built fib, or change it, so it
+ * leads to nh's gateway and interface, or nowhere if nh is 0.  The
+ * entries change under readers one at a time.  Returns 0 on success;
+ * on -1, out of memory, the fib may be left part way and needs to be
+ * built again.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_set(struct sr_fib* fib, uint32_t prefix, int len,
+               const struct sr_rt* nh)
+{
+    struct sr_fib_prefix* p;
+    struct sr_rt* rt;
+    uint32_t value = 0, old = 0;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(fib->l1_len);
+    assert(len >= 0 && len <= 32);
+
+    prefix &= sr_fib_mask(len);
+    if((p = sr_fib_find(fib, prefix, len)))
+    {
+        old = p->value;
+        rt = old ? &(fib->rt[old - 1]) : 0;
+        if(nh ? rt && rt->gw.s_addr == nh->gw.s_addr &&
+                strncmp(rt->interface, nh->interface, sr_IFACE_NAMELEN) == 0 &&
+                sr_ecmp_equal(rt->group, nh->group)
+              : rt == 0)
+        { return 0; }
+    }
+
+    if(nh && (value = sr_fib_new_route(fib, nh, prefix, len)) == 0)
+    { return -1; }
+    if(sr_fib_remember(fib, prefix, len, value) != 0 ||
+       sr_fib_rewrite_prefix(fib, prefix, len, 0, len + 1, value,
+                             len + 1) != 0)
+    { return -1; }
+
+    if(old)
+    { sr_fib_fifo_put(&(fib->free_rt), old - 1); }
+    return 0;
+} /* -- sr_fib_set -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_unset(..)
+ * Scope:  Global
+ *
+ * Take prefix/len out of a built fib, so what it covered goes to the
+ * longest prefix left covering it.  Returns 0 on success, or if it was
+ * not there; -1 as for sr_fib_set.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_unset(struct sr_fib* fib, uint32_t prefix, int len)
+{
+    struct sr_fib_prefix *p, *up;
+    uint32_t old, value = 0;
+    int l, vlen = 0;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(fib->l1_len);
+    assert(len >= 0 && len <= 32);
+
+    prefix &= sr_fib_mask(len);
+    if((p = sr_fib_find(fib, prefix, len)) == 0)
+    { return 0; }
+    old = p->value;
+    sr_fib_forget(fib, p);
+
+    for(l = len - 1; l >= 0; l--)
+    {
+        if(fib->len_count[l] &&
+           (up = sr_fib_find(fib, prefix & sr_fib_mask(l), l)))
+        {
+            value = up->value;
+            vlen = l + 1;
+            break;
+        }
+    }
+
+    if(sr_fib_rewrite_prefix(fib, prefix, len, len + 1, len + 1, value,
+                             vlen) != 0)
+    { return -1; }
+
+    if(old)
+    { sr_fib_fifo_put(&(fib->free_rt), old - 1); }
+    return 0;
+} /* -- sr_fib_unset -- */
+
+/* -- an empty fib with room for n routes -- */
+static struct sr_fib* sr_fib_alloc(uint32_t n)
+{
+    struct sr_fib* fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    uint32_t size = 64;
+
+    if(fib == 0)
+    { return 0; }
+    while(size < 2 * n)
+    { size *= 2; }
+    fib->l1 = (uint32_t*)calloc(SR_FIB_L1_SIZE, sizeof(uint32_t));
+    fib->l1_len = (uint8_t*)calloc(SR_FIB_L1_SIZE, 1);
+    fib->prefixes = (struct sr_fib_prefix*)calloc(size,
+                                                  sizeof(struct sr_fib_prefix));
+    fib->maxroutes = n ? n : 1;
+    fib->rt = (struct sr_rt*)calloc(fib->maxroutes, sizeof(struct sr_rt));
+    if(fib->l1 == 0 || fib->l1_len == 0 || fib->prefixes == 0 || fib->rt == 0)
+    {
+        sr_fib_destroy(fib);
+        return 0;
+    }
+    fib->prefixes_size = size;
+    fib->nroutes = n;
+    fib->nsource = n;
+    return fib;
+} /* -- sr_fib_alloc -- */
+
+/* -- the aggregated set of an sr_ortc, one entry at a time -- */
+
+static int sr_fib_count_entry(void* arg, uint32_t prefix, int len,
+                              const struct sr_rt* nh)
+{
+    if(nh)
+    { (*(uint32_t*)arg)++; }
+    return 0;
+} /* -- sr_fib_count_entry -- */
+
+static int sr_fib_ortc_entry(void* arg, uint32_t prefix, int len,
+                             const struct sr_rt* nh)
+{
+    struct sr_fib* fib = (struct sr_fib*)arg;
+    struct sr_rt* rt;
+
+    if(nh == 0)
+    { return sr_fib_insert(fib, prefix, len, 0); }
+
+    rt = &(fib->rt[fib->nroutes++]);
+    *rt = *nh;
+    rt->mask.s_addr = htonl(sr_fib_mask(len));
+    rt->dest.s_addr = htonl(prefix);
+    rt->next = 0;
+    if(nh->group && (rt->group = sr_ecmp_copy(nh->group)) == 0)
+    { return -1; }
+    return sr_fib_insert(fib, prefix, len, fib->nroutes);
+} /* -- sr_fib_ortc_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build_ortc(..)
+ * Scope:  Global
+ *
+ * Publish a trie over the aggregated set vrf->ortc holds now, which
+ * must be up to date with the routing table.  The routes of the fib
+ * are the entries of the set, with their own prefixes.  Returns 0 on
+ * success, leaving vrf->fib as it was otherwise.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_build_ortc(struct sr_vrf* vrf)
+{
+    struct sr_fib* fib;
+    uint32_t n = 0;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(vrf->ortc);
+
+    sr_ortc_walk(vrf->ortc, sr_fib_count_entry, &n);
+    if((fib = sr_fib_alloc(n)) == 0)
+    { return -1; }
+
+    /* -- the walk puts covering entries first, as sr_fib_insert needs -- */
+    fib->nroutes = 0;
+    if(sr_ortc_walk(vrf->ortc, sr_fib_ortc_entry, fib) != 0)
+    {
+        sr_log_err("fib: out of memory\n");
+        sr_fib_destroy(fib);
+        return -1;
+    }
+    fib->nsource = vrf->ortc->routes;
+    fib->aggregated = 1;
+
+    sr_fib_publish(vrf, fib);
+    return 0;
+} /* -- sr_fib_build_ortc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope:  Global
+ *
+ * Publish a trie over the current routing table, or over its aggregated
+ * set if vrf->ortc is set (sr -A).  The old fib serves lookups until the
+ * new one is ready.  Leaves no fib, so lookups walk the table, if it
+ * has a mask that is not a prefix or if memory runs out.  Returns 0 on
+ * success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_build(struct sr_vrf* vrf)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt;
+    uint32_t count[33], start[33];
+    uint32_t n = 0, i;
+    int len;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+
+    if(vrf->ortc)
+    {
+        if(sr_ortc_build(vrf->ortc, vrf->routing_table) == 0 &&
+           sr_fib_build_ortc(vrf) == 0)
+        {
+            sr_log_info("fib: %u routes aggregated to %u prefixes (%.1f%%), "
+                        "%u chunks\n", vrf->fib->nsource, vrf->ortc->entries,
+                        vrf->fib->nsource ? 100.0 * vrf->ortc->entries /
+                        vrf->fib->nsource : 100.0, vrf->fib->nchunks);
+            return 0;
+        }
+        sr_log_warn("fib: cannot aggregate the routing table\n");
+    }
+
+    memset(count, 0, sizeof(count));
+    for(rt = vrf->routing_table; rt; rt = rt->next, n++)
+    {
+        if((len = sr_fib_prefix_len(ntohl(rt->mask.s_addr))) < 0)
+        {
+            sr_log_warn("fib: mask of route %u is not a prefix, "
+                        "using linear lookups\n", n);
+            sr_fib_publish(vrf, 0);
+            return -1;
+        }
+        count[len]++;
+    }
+
+    if((fib = sr_fib_alloc(n)) == 0)
+    {
+        sr_fib_publish(vrf, 0);
+        return -1;
+    }
+
+    /* -- counting sort by prefix length, stable -- */
+    for(len = 0, i = 0; len <= 32; len++)
+    {
+        start[len] = i;
+        i += count[len];
+    }
+    for(rt = vrf->routing_table; rt; rt = rt->next)
+    {
+        struct sr_rt* copy;
+
+        len = sr_fib_prefix_len(ntohl(rt->mask.s_addr));
+        copy = &(fib->rt[start[len]++]);
+        *copy = *rt;
+        copy->next = 0;
+        if(rt->group && (copy->group = sr_ecmp_copy(rt->group)) == 0)
+        {
+            sr_log_err("fib: out of memory\n");
+            sr_fib_destroy(fib);
+            sr_fib_publish(vrf, 0);
+            return -1;
+        }
+    }
+
+    /* -- shortest first, and the first of equal routes last so it wins -- */
+    for(len = 0, i = 0; len <= 32; len++)
+    {
+        uint32_t j;
+
+        for(j = i + count[len]; j > i; j--)
+        {
+            rt = &(fib->rt[j - 1]);
+            if(sr_fib_insert(fib, ntohl(rt->dest.s_addr & rt->mask.s_addr),
+                             len, j) != 0)
+            {
+                sr_log_err("fib: out of memory\n");
+                sr_fib_destroy(fib);
+                sr_fib_publish(vrf, 0);
+                return -1;
+            }
+        }
+        i += count[len];
+    }
+
+    sr_fib_publish(vrf, fib);
+    return 0;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup_burst(..)
+ * Scope:  Global
+ *
+ * sr_fib_lookup of each of the n addresses at ips, host byte order,
+ * into results.  A lookup is up to three dependent loads, each likely a
+ * cache miss on a large table, so one at a time the forwarding path
+ * waits on memory for every packet.  Here each level is prefetched for
+ * up to SR_FIB_BURST lookups before any of them is read, so the misses
+ * of a burst overlap and it waits about as long as one lookup does.
+ * The routes found are prefetched for the caller too.  As with
+ * sr_fib_lookup each array pointer is loaded after the entries that
+ * point into it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_lookup_burst(const struct sr_fib* fib, const uint32_t* ips,
+                         unsigned int n, struct sr_rt** results)
+{
+    uint32_t e[SR_FIB_BURST], at[SR_FIB_BURST];
+    const uint32_t* chunks;
+    struct sr_rt* rt;
+    unsigned int i, m, level;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(ips || n == 0);
+    assert(results || n == 0);
+
+    for( ; n; n -= m, ips += m, results += m)
+    {
+        m = n < SR_FIB_BURST ? n : SR_FIB_BURST;
+
+        for(i = 0; i < m; i++)
+        { __builtin_prefetch(&(fib->l1[ips[i] >> 16])); }
+        for(i = 0; i < m; i++)
+        { e[i] = __atomic_load_n(&(fib->l1[ips[i] >> 16]), __ATOMIC_ACQUIRE); }
+
+        /* -- the /24 chunks, then the /32 ones -- */
+        for(level = 0; level < 2; level++)
+        {
+            chunks = __atomic_load_n(&(fib->chunks), __ATOMIC_ACQUIRE);
+            for(i = 0; i < m; i++)
+            {
+                if(e[i] & SR_FIB_CHUNK)
+                {
+                    at[i] = ((e[i] & ~SR_FIB_CHUNK) << 8) |
+                            ((level ? ips[i] : ips[i] >> 8) & 0xff);
+                    __builtin_prefetch(&(chunks[at[i]]));
+                }
+            }
+            for(i = 0; i < m; i++)
+            {
+                if(e[i] & SR_FIB_CHUNK)
+                { e[i] = __atomic_load_n(&(chunks[at[i]]), __ATOMIC_ACQUIRE); }
+            }
+        }
+
+        rt = __atomic_load_n(&(fib->rt), __ATOMIC_ACQUIRE);
+        for(i = 0; i < m; i++)
+        {
+            results[i] = e[i] ? &(rt[e[i] - 1]) : 0;
+            if(results[i])
+            { __builtin_prefetch(results[i]); }
+        }
+    }
+} /* -- sr_fib_lookup_burst -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_publish(..)
+ * Scope:  Global
+ *
+ * Make fib, or none if 0, the one lookups use.  The one it replaces is
+ * destroyed once no reader can still be in it.  From here on fib may
+ * only change through sr_fib_set and sr_fib_unset.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_publish(struct sr_vrf* vrf, struct sr_fib* fib)
+{
+    struct sr_fib* old = vrf->fib;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+
+    if(fib)
+    { fib->live = 1; }
+    __atomic_store_n(&(vrf->fib), fib, __ATOMIC_RELEASE);
+
+    if(old)
+    { sr_rcu_retire(sr_fib_destroy_later, 0, old); }
+} /* -- sr_fib_publish -- */
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    uint32_t i;
+
+    if(fib == 0)
+    { return; }
+
+    if(fib->map)
+    { munmap(fib->map, fib->map_len); }
+    else
+    {
+        for(i = 0; fib->rt && i < fib->nroutes; i++)
+        { sr_ecmp_free(fib->rt[i].group); }
+        free(fib->l1);
+        free(fib->chunks);
+        free(fib->rt);
+    }
+    free(fib->l1_len);
+    free(fib->chunks_len);
+    free(fib->prefixes);
+    free(fib->free_rt.q);
+    free(fib->free_chunks.q);
+    free(fib);
+} /* -- sr_fib_destroy -- */
+
+
+/* -- images -- */
+
+#define SR_FIB_PAGE 4096
+#define SR_FIB_ALIGN(x) (((x) + SR_FIB_PAGE - 1) & ~((uint64_t)SR_FIB_PAGE - 1))
+
+/* -- len bytes at *off, on the next page if page is set -- */
+static int sr_fib_put(FILE* fp, const void* buf, size_t len, uint64_t* off,
+                      int page)
+{
+    static const char zero[SR_FIB_PAGE];
+    size_t pad = page ? SR_FIB_ALIGN(*off) - *off : 0;
+
+    if(pad && fwrite(zero, pad, 1, fp) != 1)
+    { return -1; }
+    if(len && fwrite(buf, len, 1, fp) != 1)
+    { return -1; }
+    *off += pad + len;
+    return 0;
+} /* -- sr_fib_put -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_write(..)
+ * Scope:  Global
+ *
+ * Write fib as an image to path.  The image is written next to it and
+ * renamed into place, so a router mapping the old one is not disturbed.
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_write(const struct sr_fib* fib, const char* path)
+{
+    struct sr_fib_image img;
+    char tmp[4096];
+    uint64_t off = 0;
+    uint32_t i;
+    FILE* fp;
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(path);
+
+    memset(&img, 0, sizeof(img));
+    img.magic = SR_FIB_MAGIC;
+    img.version = SR_FIB_VERSION;
+    img.rt_size = sizeof(struct sr_rt);
+    img.nroutes = fib->nroutes;
+    img.nsource = fib->nsource;
+    img.nchunks = fib->nchunks;
+    img.l1_off = SR_FIB_ALIGN(sizeof(img));
+    img.chunks_off = SR_FIB_ALIGN(img.l1_off +
+            (uint64_t)SR_FIB_L1_SIZE * sizeof(uint32_t));
+    img.rt_off = SR_FIB_ALIGN(img.chunks_off +
+            (uint64_t)fib->nchunks * SR_FIB_L2_SIZE * sizeof(uint32_t));
+    img.size = img.rt_off + (uint64_t)fib->nroutes * sizeof(struct sr_rt);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if((fp = fopen(tmp, "wb")) == 0)
+    {
+        perror(tmp);
+        return -1;
+    }
+
+    if(sr_fib_put(fp, &img, sizeof(img), &off, 0) != 0 ||
+       sr_fib_put(fp, fib->l1, SR_FIB_L1_SIZE * sizeof(uint32_t), &off, 1) != 0 ||
+       sr_fib_put(fp, fib->chunks, (size_t)fib->nchunks * SR_FIB_L2_SIZE *
+                  sizeof(uint32_t), &off, 1) != 0 ||
+       sr_fib_put(fp, 0, 0, &off, 1) != 0)
+    { ret = -1; }
+
+    /* -- routes one at a time, to leave out the pointers; a route keeps
+     *    only its first path -- */
+    for(i = 0; ret == 0 && i < fib->nroutes; i++)
+    {
+        struct sr_rt rt = fib->rt[i];
+
+        rt.group = 0;
+        rt.next = 0;
+        if(sr_fib_put(fp, &rt, sizeof(rt), &off, 0) != 0)
+        { ret = -1; }
+    }
+
+    if(fclose(fp) != 0 || ret != 0 || rename(tmp, path) != 0)
+    {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_fib_write -- */
+
+/* -- every entry must lead to a chunk or route the image has -- */
+static int sr_fib_check(const struct sr_fib* fib, const uint32_t* e,
+                        uint32_t n)
+{
+    uint32_t i;
+
+    for(i = 0; i < n; i++)
+    {
+        if(e[i] & SR_FIB_CHUNK ? (e[i] & ~SR_FIB_CHUNK) >= fib->nchunks
+                               : e[i] > fib->nroutes)
+        { return -1; }
+    }
+    return 0;
+} /* -- sr_fib_check -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_map(..)
+ * Scope:  Global
+ *
+ * Map an image written by sr_fib_write read only and shared, so every
+ * router using it shares the page cache, and return a fib over it, or
+ * 0 if it cannot be used.  Nothing is copied.  Every entry is checked
+ * once, so a damaged image cannot send lookups outside it.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_map(const char* path)
+{
+    const struct sr_fib_image* img;
+    struct sr_fib* fib;
+    struct stat st;
+    void* map;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(path);
+
+    if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        if(fd >= 0)
+        { close(fd); }
+        return 0;
+    }
+    if(st.st_size < (off_t)sizeof(struct sr_fib_image))
+    {
+        fprintf(stderr, "%s is not a fib image\n", path);
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        return 0;
+    }
+
+    img = (const struct sr_fib_image*)map;
+    if(img->magic != SR_FIB_MAGIC || img->version != SR_FIB_VERSION ||
+       img->rt_size != sizeof(struct sr_rt) || img->size != (uint64_t)st.st_size ||
+       img->l1_off + (uint64_t)SR_FIB_L1_SIZE * sizeof(uint32_t) >
+           img->chunks_off ||
+       img->chunks_off + (uint64_t)img->nchunks * SR_FIB_L2_SIZE *
+           sizeof(uint32_t) > img->rt_off ||
+       img->rt_off + (uint64_t)img->nroutes * sizeof(struct sr_rt) > img->size ||
+       (img->l1_off | img->chunks_off | img->rt_off) % SR_FIB_PAGE)
+    {
+        fprintf(stderr, "%s is not a fib image for this router\n", path);
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    if((fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib))) == 0)
+    {
+        munmap(map, st.st_size);
+        return 0;
+    }
+    fib->l1 = (uint32_t*)((char*)map + img->l1_off);
+    fib->chunks = (uint32_t*)((char*)map + img->chunks_off);
+    fib->nchunks = fib->maxchunks = img->nchunks;
+    fib->rt = (struct sr_rt*)((char*)map + img->rt_off);
+    fib->nroutes = img->nroutes;
+    fib->nsource = img->nsource;
+    fib->map = map;
+    fib->map_len = st.st_size;
+
+    if(sr_fib_check(fib, fib->l1, SR_FIB_L1_SIZE) != 0 ||
+       sr_fib_check(fib, fib->chunks, fib->nchunks * SR_FIB_L2_SIZE) != 0)
+    {
+        fprintf(stderr, "%s is damaged\n", path);
+        sr_fib_destroy(fib);
+        return 0;
+    }
+
+    return fib;
+} /* -- sr_fib_map -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_format(..)
+ * Scope:  Global
+ *
+ * One line on the fib into buf: the routes it stands for, the prefixes
+ * it holds, which differ once aggregated, and what the trie takes.
+ * Returns the length, as snprintf.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_format(struct sr_vrf* vrf, char* buf, unsigned int size)
+{
+    const struct sr_fib* fib;
+    uint32_t prefixes;
+    int len;
+
+    sr_rcu_read_lock();
+    if((fib = __atomic_load_n(&(vrf->fib), __ATOMIC_ACQUIRE)) == 0)
+    {
+        sr_rcu_read_unlock();
+        return snprintf(buf, size, "fib: none, lookups walk the table\n");
+    }
+
+    /* -- a mapped fib has no prefix hash, but no entries to no route
+     *    or routes no longer used either -- */
+    prefixes = fib->prefixes ? fib->nprefixes : fib->nroutes;
+
+    len = snprintf(buf, size,
+            "fib: %u routes, %u prefixes (%.1f%%%s), %u chunks, %lu bytes%s\n",
+            fib->nsource, prefixes,
+            fib->nsource ? 100.0 * prefixes / fib->nsource : 100.0,
+            fib->aggregated ? " aggregated" : "", fib->nchunks,
+            (unsigned long)((SR_FIB_L1_SIZE + (size_t)fib->nchunks *
+                SR_FIB_L2_SIZE) * sizeof(uint32_t) +
+                (size_t)fib->nroutes * sizeof(struct sr_rt)),
+            fib->map ? ", mapped" : "");
+    sr_rcu_read_unlock();
+    return len;
+} /* -- sr_fib_format -- */
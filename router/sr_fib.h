@@ -0,0 +1,175 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * The forwarding table: a 16-8-8 multibit trie over the routing table,
+ * so rt_entry_lpm is at most three dependent loads whatever the number
+ * of routes.
+ *
+ * The first level has an entry for every /16.  An entry is 0 for no
+ * route, the index + 1 of the route in 'rt', or SR_FIB_CHUNK and
+ * the number of a chunk of 256 entries for the next 8 bits, laid out
+ * the same way.  Entries are indices rather than pointers, and the fib
+ * keeps its own copy of the routes in an array, so the whole thing can
+ * be written out as an image (sr_fibc) and mapped back as it is.
+ *
+ * sr_fib_build makes one pass over the routing table, ordering it by
+ * prefix length with a counting sort and then writing each prefix over
+ * the ranges it covers, shortest first, so longer prefixes simply
+ * overwrite shorter ones.  Among routes with the same prefix the first
+ * in the table wins, as in the linear lookup.  With sr -A it is built
+ * over the aggregated set of sr_ortc.h instead, whose entries it takes
+ * in prefix order, which also puts covering prefixes first.
+ *
+ * A fib that was built rather than mapped can also change in place,
+ * one prefix at a time, under the forwarding path: sr_fib_set and
+ * sr_fib_unset.  For that the writer keeps, next to each entry, the
+ * length of the prefix that wrote it, and a hash of every prefix in
+ * the fib.  A new prefix writes the entries it covers whose prefix is
+ * no longer, a prefix going rewrites the entries it wrote with the
+ * longest prefix covering it, and a chunk whose 256 entries end up the
+ * same folds back into the entry above it.  Each entry is written with
+ * a single store, so a lookup sees the old route or the new one and
+ * never a mix; a new chunk or route is filled in before the entry
+ * pointing at it.  Arrays that grow are copied, and routes, chunks and
+ * old arrays are only reused or freed once no reader can still see
+ * them (sr_rcu.h).  Readers take no lock: see rt_entry_lpm.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_rt.h"
+
+#define SR_FIB_CHUNK   0x80000000
+#define SR_FIB_L1_SIZE (1 << 16)
+#define SR_FIB_L2_SIZE (1 << 8)
+
+struct sr_vrf;
+
+/* a prefix of the fib, by prefix and length */
+struct sr_fib_prefix
+{
+    uint32_t prefix;
+    uint32_t value;             /* its entry: 0 for no route, or index + 1 */
+    uint8_t len;                /* + 1, 0 for an empty slot */
+};
+
+/* routes and chunks waiting until no reader can still see them */
+struct sr_fib_free
+{
+    uint64_t stamp;
+    uint32_t index;
+};
+
+struct sr_fib_fifo
+{
+    struct sr_fib_free* q;
+    uint32_t head, tail, size;
+};
+
+struct sr_fib
+{
+    uint32_t* l1;               /* SR_FIB_L1_SIZE entries */
+    uint32_t* chunks;           /* nchunks * SR_FIB_L2_SIZE entries */
+    uint32_t nchunks;
+    uint32_t maxchunks;
+    struct sr_rt* rt;           /* by index, covering prefixes first */
+    uint32_t nroutes;
+    uint32_t maxroutes;
+    uint32_t nsource;           /* routes it stands for (sr -A) */
+    int aggregated;             /* built over vrf->ortc */
+    int live;                   /* readers may see it, see sr_fib_publish */
+    void* map;                  /* the image all of it lives in, or 0 */
+    size_t map_len;
+
+    /* -- the writer's own, for sr_fib_set and sr_fib_unset; mapped fibs
+     *    have none -- */
+    uint8_t* l1_len;            /* len + 1 of the prefix each entry is for */
+    uint8_t* chunks_len;        /* ... 0 for none */
+    struct sr_fib_prefix* prefixes;
+    uint32_t nprefixes, prefixes_size;
+    uint32_t len_count[33];     /* prefixes of each length */
+    struct sr_fib_fifo free_rt, free_chunks;
+};
+
+/* ----------------------------------------------------------------------------
+ * A fib image is this header, then l1, the chunks and the routes, each
+ * starting on a page.  The routes are struct sr_rt with next 0, so an
+ * image only maps on the kind of machine that wrote it; rt_size and the
+ * version catch the rest.
+ * -------------------------------------------------------------------------- */
+
+#define SR_FIB_MAGIC   0x42465253   /* "SRFB" */
+#define SR_FIB_VERSION 2
+
+struct sr_fib_image
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rt_size;           /* sizeof(struct sr_rt) */
+    uint32_t nroutes;
+    uint32_t nchunks;
+    uint32_t nsource;
+    uint64_t l1_off;            /* from the start of the image */
+    uint64_t chunks_off;
+    uint64_t rt_off;
+    uint64_t size;              /* of the whole image */
+};
+
+int  sr_fib_build(struct sr_vrf* vrf);
+int  sr_fib_build_ortc(struct sr_vrf* vrf);
+void sr_fib_publish(struct sr_vrf* vrf, struct sr_fib* fib);
+void sr_fib_destroy(struct sr_fib* fib);
+
+int  sr_fib_set(struct sr_fib* fib, uint32_t prefix, int len,
+                const struct sr_rt* nh);
+int  sr_fib_unset(struct sr_fib* fib, uint32_t prefix, int len);
+
+int  sr_fib_prefix_len(uint32_t mask);
+
+int  sr_fib_write(const struct sr_fib* fib, const char* path);
+struct sr_fib* sr_fib_map(const char* path);
+
+int  sr_fib_format(struct sr_vrf* vrf, char* buf, unsigned int size);
+
+#define SR_FIB_BURST 32         /* lookups sr_fib_lookup_burst overlaps */
+
+void sr_fib_lookup_burst(const struct sr_fib* fib, const uint32_t* ips,
+                         unsigned int n, struct sr_rt** results);
+
+/* longest match for ip, in host byte order.  The acquire loads cost
+ * nothing on x86 and order the arrays after the entries pointing in. */
+static __inline__ struct sr_rt* sr_fib_lookup(const struct sr_fib* fib,
+                                              uint32_t ip)
+{
+    uint32_t e = __atomic_load_n(&(fib->l1[ip >> 16]), __ATOMIC_ACQUIRE);
+    const uint32_t* chunks;
+
+    if(e & SR_FIB_CHUNK)
+    {
+        chunks = __atomic_load_n(&(fib->chunks), __ATOMIC_ACQUIRE);
+        e = __atomic_load_n(&(chunks[((e & ~SR_FIB_CHUNK) << 8) |
+                                     ((ip >> 8) & 0xff)]), __ATOMIC_ACQUIRE);
+        if(e & SR_FIB_CHUNK)
+        {
+            chunks = __atomic_load_n(&(fib->chunks), __ATOMIC_ACQUIRE);
+            e = __atomic_load_n(&(chunks[((e & ~SR_FIB_CHUNK) << 8) |
+                                         (ip & 0xff)]), __ATOMIC_ACQUIRE);
+        }
+    }
+
+    return e ? &(__atomic_load_n(&(fib->rt), __ATOMIC_ACQUIRE)[e - 1]) : 0;
+}
+
+#endif /* -- SR_FIB_H -- */
@@ -0,0 +1,163 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fibc.c
+ *
+ * Description:
+ *
+ * Compile a routing table into a fib image the router can map with -f
+ * instead of parsing the table and building the fib on every start:
+ *
+ *   sr_fibc [-q] [-m rules] [-A] rtable image
+ *
+ * The table is loaded as sr -r would load it, the fib built over it is
+ * written to image and then mapped back and compared with the one in
+ * memory before the sizes are reported.  The image is replaced with a
+ * rename, so routers already running on the old one keep it until they
+ * restart.  With -m the table is an MRT RIB dump and rules maps its next
+ * hops onto interfaces, see sr_mrt.h.  With -A the image holds the
+ * aggregated set of the table, see sr_ortc.h.
+ *
+ * An image holds struct sr_rt as this build lays it out, so compile it
+ * with the same build as the routers that map it; they refuse any other.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_mrt.h"
+#include "sr_vrf.h"
+
+static void usage(char* argv0);
+
+/* sr_router.o needs one to link, nothing here sends */
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{ return 0; }
+
+static double sr_fibc_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+} /* -- sr_fibc_now -- */
+
+/* -- the mapped image must look up exactly as the fib it came from -- */
+static int sr_fibc_same(const struct sr_fib* a, const struct sr_fib* b)
+{
+    uint32_t i;
+
+    if(a->nroutes != b->nroutes || a->nchunks != b->nchunks ||
+       memcmp(a->l1, b->l1, SR_FIB_L1_SIZE * sizeof(uint32_t)) != 0 ||
+       memcmp(a->chunks, b->chunks,
+              (size_t)a->nchunks * SR_FIB_L2_SIZE * sizeof(uint32_t)) != 0)
+    { return 0; }
+
+    for(i = 0; i < a->nroutes; i++)
+    {
+        if(a->rt[i].dest.s_addr != b->rt[i].dest.s_addr ||
+           a->rt[i].gw.s_addr != b->rt[i].gw.s_addr ||
+           a->rt[i].mask.s_addr != b->rt[i].mask.s_addr ||
+           strncmp(a->rt[i].interface, b->rt[i].interface,
+                   sr_IFACE_NAMELEN) != 0)
+        { return 0; }
+    }
+    return 1;
+} /* -- sr_fibc_same -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_instance sr;
+    struct sr_vrf* vrf;
+    struct sr_fib* mapped;
+    double t0, t1, t2;
+    const char* mrt_rules = 0;
+    int quiet = 0, aggregate = 0, c;
+
+    while((c = getopt(argc, argv, "hqm:A")) != EOF)
+    {
+        switch(c)
+        {
+            case 'q':
+                quiet = 1;
+                break;
+            case 'm':
+                mrt_rules = optarg;
+                break;
+            case 'A':
+                aggregate = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(argc - optind != 2)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    if(sr_rt_init(&sr) != 0 || (aggregate && sr_vrf_aggregate(&sr) != 0))
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    vrf = sr.vrfs[0];
+
+    t0 = sr_fibc_now();
+    if((mrt_rules ? sr_load_mrt(vrf, argv[optind], mrt_rules)
+                  : sr_load_rt(vrf, argv[optind])) != 0)
+    {
+        fprintf(stderr, "Error loading routing table %s\n", argv[optind]);
+        exit(1);
+    }
+    if(vrf->fib == 0)
+    {
+        fprintf(stderr, "Cannot build a fib over %s\n", argv[optind]);
+        exit(1);
+    }
+    t1 = sr_fibc_now();
+
+    if(sr_fib_write(vrf->fib, argv[optind + 1]) != 0)
+    { exit(1); }
+    t2 = sr_fibc_now();
+
+    if((mapped = sr_fib_map(argv[optind + 1])) == 0)
+    { exit(1); }
+    if(!sr_fibc_same(vrf->fib, mapped))
+    {
+        fprintf(stderr, "%s does not match the table it was written from\n",
+                argv[optind + 1]);
+        unlink(argv[optind + 1]);
+        exit(1);
+    }
+
+    if(!quiet)
+    {
+        printf("%s: %u routes, %u prefixes, %u chunks, %lu bytes, "
+               "loaded in %.1f ms, written in %.1f ms\n",
+               argv[optind + 1], mapped->nsource, mapped->nroutes,
+               mapped->nchunks,
+               (unsigned long)mapped->map_len, t1 - t0, t2 - t1);
+    }
+
+    sr_fib_destroy(mapped);
+    sr_clear_rt(vrf);
+    return 0;
+} /* -- main -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-q] [-m MRT next hop rules] [-A aggregate] \n"
+           "           rtable image \n", argv0);
+} /* -- usage -- */
@@ -0,0 +1,239 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flight.c
+ *
+ * Description:
+ *
+ * Always-on flight recorder, see sr_flight.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sr_flight.h"
+#include "sr_dumper.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+#include "sr_alloc.h"
+
+/* the last entry this thread received, so the router can mark it dropped */
+static __thread struct sr_flight_entry* sr_flight_last = 0;
+static __thread uint32_t sr_flight_last_seq = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_flight_create(..)
+ * Scope:  Global
+ *
+ * Allocate a recorder for the last 'entries' packets, rounded up to a
+ * power of two and at most SR_FLIGHT_MAX_ENTRIES.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_flight* sr_flight_create(struct sr_instance* sr,
+                                   unsigned int entries)
+{
+    struct sr_flight* fr;
+    unsigned int n = 1;
+    void* ring;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(entries > 0);
+
+    while(n < entries && n < SR_FLIGHT_MAX_ENTRIES)
+    { n <<= 1; }
+
+    if(posix_memalign(&ring, sizeof(struct sr_flight_entry),
+                n * sizeof(struct sr_flight_entry)) != 0)
+    { return 0; }
+    memset(ring, 0, n * sizeof(struct sr_flight_entry));
+
+    if(posix_memalign((void**)&fr, 64, sizeof(struct sr_flight)) != 0)
+    {
+        free(ring);
+        return 0;
+    }
+    memset(fr, 0, sizeof(struct sr_flight));
+
+    fr->sr   = sr;
+    fr->mask = n - 1;
+    fr->ring = (struct sr_flight_entry*)ring;
+
+    return fr;
+} /* -- sr_flight_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_flight_record(..)
+ * Scope:  Global
+ *
+ * Record one packet.  Only the cache line of its slot is written.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_flight_record(struct sr_flight* fr, const uint8_t* buf,
+                      unsigned int len, unsigned int ifindex, int dir,
+                      int reason)
+{
+    uint64_t ticket = __atomic_fetch_add(&(fr->next), 1, __ATOMIC_RELAXED);
+    struct sr_flight_entry* e = &(fr->ring[ticket & fr->mask]);
+    unsigned int caplen = len < SR_FLIGHT_SNAP ? len : SR_FLIGHT_SNAP;
+    struct timespec ts;
+
+    __atomic_store_n(&(e->seq), 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    e->ts_ns   = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    e->len     = len > 0xffff ? 0xffff : len;
+    e->ifindex = ifindex;
+    e->dir     = dir;
+    e->reason  = reason;
+    e->caplen  = caplen;
+    memcpy(e->data, buf, caplen);
+
+    __atomic_store_n(&(e->seq), (uint32_t)ticket + 1, __ATOMIC_RELEASE);
+
+    if(dir == SR_FLIGHT_RX)
+    {
+        sr_flight_last = e;
+        sr_flight_last_seq = (uint32_t)ticket + 1;
+    }
+} /* -- sr_flight_record -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_flight_drop(..)
+ * Scope:  Global
+ *
+ * Mark the packet this thread received last as dropped for 'reason'.
+ * Nothing happens if its entry has been reused in the meantime.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_flight_drop(struct sr_flight* fr, int reason)
+{
+    struct sr_flight_entry* e = sr_flight_last;
+
+    if(e == 0 || e->seq != sr_flight_last_seq)
+    { return; }
+
+    e->reason = reason;
+} /* -- sr_flight_drop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_flight_dump(..)
+ * Scope:  Global
+ *
+ * Write the recorder to 'path', or to flight.<pid>.<n>.pcapng in the
+ * working directory if path is 0.  Recording goes on while the dump
+ * runs.  Returns 0 on success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_flight_dump(struct sr_flight* fr, const char* path)
+{
+    struct sr_flight_entry* snap;
+    struct sr_flight_entry* e;
+    struct sr_if* iface;
+    char name[64];
+    char comment[64];
+    uint8_t* blk;
+    uint64_t end, t;
+    unsigned int nif = 0, ifid, n = fr->mask + 1, written = 0;
+    uint32_t flags;
+    FILE* fp;
+    int ok = 1;
+
+    /* -- REQUIRES -- */
+    assert(fr);
+
+    if(path == 0)
+    {
+        snprintf(name, sizeof(name), "flight.%ld.%u.pcapng",
+                (long)getpid(), fr->dumps);
+        path = name;
+    }
+    fr->dumps++;
+
+    snap = (struct sr_flight_entry*)malloc(n * sizeof(*snap));
+    blk  = (uint8_t*)malloc(PCAPNG_EPB_MAXLEN(SR_FLIGHT_SNAP) +
+                            PCAPNG_COMMENT_MAXLEN(sizeof(comment)) +
+                            PCAPNG_IDB_MAXLEN(sr_IFACE_NAMELEN));
+    if(snap == 0 || blk == 0)
+    {
+        free(snap);
+        free(blk);
+        return -1;
+    }
+
+    end = __atomic_load_n(&(fr->next), __ATOMIC_ACQUIRE);
+    memcpy(snap, fr->ring, n * sizeof(*snap));
+
+    fp = fopen(path, "wb");
+    if(fp == 0)
+    {
+        sr_log_err("flight recorder: cannot open %s\n", path);
+        free(snap);
+        free(blk);
+        return -1;
+    }
+
+    /* -- one interface description per interface, in index order, and
+     *    one for packets that came in on an unknown interface -- */
+    ok &= fwrite(blk, sr_dump_pcapng_shb(blk), 1, fp) == 1;
+    for(iface = fr->sr->if_list; iface; iface = iface->next, nif++)
+    {
+        ok &= fwrite(blk, sr_dump_pcapng_idb(blk, iface->name,
+                    SR_FLIGHT_SNAP), 1, fp) == 1;
+    }
+    ok &= fwrite(blk, sr_dump_pcapng_idb(blk, "unknown", SR_FLIGHT_SNAP),
+            1, fp) == 1;
+
+    for(t = end > n ? end - n : 0; t < end; t++)
+    {
+        e = &(snap[t & fr->mask]);
+        if(e->seq != (uint32_t)t + 1)
+        { continue; }
+
+        ifid  = e->ifindex < nif ? e->ifindex : nif;
+        flags = e->dir == SR_FLIGHT_RX ? PCAPNG_EPB_INBOUND :
+                e->dir == SR_FLIGHT_TX ? PCAPNG_EPB_OUTBOUND : 0;
+        if(e->reason)
+        {
+            snprintf(comment, sizeof(comment), "%s: %s",
+                    e->dir == SR_FLIGHT_QUEUED ? "dropped from queue" :
+                    "dropped", sr_drop_reason_name(e->reason));
+        }
+
+        ok &= fwrite(blk, sr_dump_pcapng_epb(blk, ifid, e->ts_ns, e->caplen,
+                    e->len, e->data, flags, e->reason ? comment : 0),
+                1, fp) == 1;
+        written++;
+    }
+
+    ok &= fclose(fp) == 0;
+    free(snap);
+    free(blk);
+
+    if(!ok)
+    {
+        sr_log_err("flight recorder: error writing %s\n", path);
+        return -1;
+    }
+
+    sr_log_info("flight recorder: wrote %u packets to %s\n", written, path);
+    return 0;
+} /* -- sr_flight_dump -- */
+
+void sr_flight_destroy(struct sr_flight* fr)
+{
+    if(fr == 0)
+    { return; }
+
+    free(fr->ring);
+    free(fr);
+} /* -- sr_flight_destroy -- */
@@ -0,0 +1,85 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flight.h
+ *
+ * Description:
+ *
+ * Always-on flight recorder holding the headers of the last N packets the
+ * router received or sent, so there is something to look at after a
+ * problem even when -l capture was off.
+ *
+ * Each packet takes one cache line in a fixed circular array: the
+ * timestamp, interface, direction, the drop reason if the router dropped
+ * it, and the first SR_FLIGHT_SNAP bytes of the frame.  Recording claims
+ * a slot with a single atomic add and fills it in place, there is no
+ * allocation or lock.
+ *
+ * sr_flight_dump writes the recorder out as pcapng, oldest packet first,
+ * with the direction in the epb_flags and drop reasons as packet comments.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FLIGHT_H
+#define SR_FLIGHT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_FLIGHT_DEFAULT_ENTRIES 4096  /* 256KB */
+#define SR_FLIGHT_MAX_ENTRIES (1 << 24) /* 1GB */
+#define SR_FLIGHT_SNAP 44               /* eth + ip + start of l4 */
+
+#define SR_FLIGHT_NO_IF 0xffff          /* ifindex of an unknown interface */
+
+#define SR_FLIGHT_QUEUED 0              /* dropped from a queue */
+#define SR_FLIGHT_RX 1
+#define SR_FLIGHT_TX 2
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_flight_entry
+ *
+ * seq is 0 while the entry is being written and ticket + 1 once it is
+ * complete, which lets the dumper skip entries that are overwritten
+ * under it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_flight_entry
+{
+    uint64_t ts_ns;
+    uint32_t seq;
+    uint16_t len;               /* length on the wire */
+    uint16_t ifindex;
+    uint8_t  dir;
+    uint8_t  reason;            /* enum sr_drop_reason */
+    uint8_t  caplen;
+    uint8_t  pad;
+    uint8_t  data[SR_FLIGHT_SNAP];
+} __attribute__ ((aligned (64)));
+
+struct sr_flight
+{
+    uint64_t next;              /* next ticket */
+    char pad0[56];
+    struct sr_instance* sr;
+    unsigned int mask;          /* entries - 1 */
+    unsigned int dumps;
+    struct sr_flight_entry* ring;
+};
+
+struct sr_flight* sr_flight_create(struct sr_instance* sr,
+                                   unsigned int entries);
+void sr_flight_record(struct sr_flight* fr, const uint8_t* buf,
+                      unsigned int len, unsigned int ifindex, int dir,
+                      int reason);
+void sr_flight_drop(struct sr_flight* fr, int reason);
+int  sr_flight_dump(struct sr_flight* fr, const char* path);
+void sr_flight_destroy(struct sr_flight* fr);
+
+#endif /* -- SR_FLIGHT_H -- */
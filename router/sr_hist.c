@@ -0,0 +1,74 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_hist.c
+ *
+ * Description:
+ *
+ * Log bucketed histograms, see sr_hist.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "sr_hist.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_merge(..)
+ * Scope:  Global
+ *
+ * Add the counts of src to dst.  src may be changing under us, in which
+ * case the result is off by the values recorded meanwhile.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_hist_merge(struct sr_hist* dst, const struct sr_hist* src)
+{
+    uint64_t max = __atomic_load_n(&(src->max), __ATOMIC_RELAXED);
+    int i;
+
+    for(i = 0; i < SR_HIST_BUCKETS; i++)
+    { dst->buckets[i] += __atomic_load_n(&(src->buckets[i]), __ATOMIC_RELAXED); }
+    dst->count += __atomic_load_n(&(src->count), __ATOMIC_RELAXED);
+    dst->sum   += __atomic_load_n(&(src->sum), __ATOMIC_RELAXED);
+    if(max > dst->max)
+    { dst->max = max; }
+} /* -- sr_hist_merge -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_percentile(..)
+ * Scope:  Global
+ *
+ * Return the value below which a fraction p (0 .. 1) of the recorded
+ * values lie, as the top of the bucket it falls in.
+ *
+ *---------------------------------------------------------------------*/
+
+uint64_t sr_hist_percentile(const struct sr_hist* h, double p)
+{
+    uint64_t want, seen = 0, top;
+    unsigned int i, shift;
+
+    if(h->count == 0)
+    { return 0; }
+
+    want = (uint64_t)(p * h->count + 0.5);
+    if(want < 1)
+    { want = 1; }
+
+    for(i = 0; i < SR_HIST_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if(seen >= want)
+        { break; }
+    }
+    if(i == SR_HIST_BUCKETS)
+    { return h->max; }
+
+    if(i < SR_HIST_SUB)
+    { top = i; }
+    else
+    {
+        shift = (i >> SR_HIST_SUB_BITS) - 1;
+        top = (((uint64_t)(SR_HIST_SUB + (i & (SR_HIST_SUB - 1)))) << shift) +
+              (((uint64_t)1) << shift) - 1;
+    }
+
+    return top < h->max ? top : h->max;
+} /* -- sr_hist_percentile -- */
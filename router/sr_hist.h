@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_hist.h
+ *
+ * Description:
+ *
+ * Log bucketed histograms in the style of HdrHistogram, for latencies
+ * measured in sr_tsc cycles.
+ *
+ * Values below SR_HIST_SUB are counted exactly.  Above that every power
+ * of two is split into SR_HIST_SUB equal buckets, so a value is known
+ * to within 1/SR_HIST_SUB (6%) of itself up to SR_HIST_MAX_VALUE, and
+ * larger values are counted as SR_HIST_MAX_VALUE.  Recording is a count
+ * leading zeros, a shift and three adds; histograms are not thread safe
+ * and are kept per thread, see sr_stats.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_HIST_H
+#define SR_HIST_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_HIST_SUB_BITS  4
+#define SR_HIST_SUB       (1 << SR_HIST_SUB_BITS)
+#define SR_HIST_MAX_BITS  40
+#define SR_HIST_MAX_VALUE ((((uint64_t)1) << SR_HIST_MAX_BITS) - 1)
+#define SR_HIST_BUCKETS   ((SR_HIST_MAX_BITS - SR_HIST_SUB_BITS + 1) * \
+                           SR_HIST_SUB)
+
+struct sr_hist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[SR_HIST_BUCKETS];
+};
+
+static __inline__ unsigned int sr_hist_index(uint64_t v)
+{
+    unsigned int shift;
+
+    if(v < SR_HIST_SUB)
+    { return (unsigned int)v; }
+
+    shift = 63 - __builtin_clzll(v) - SR_HIST_SUB_BITS;
+    return ((shift + 1) << SR_HIST_SUB_BITS) +
+           (unsigned int)((v >> shift) & (SR_HIST_SUB - 1));
+}
+
+static __inline__ void sr_hist_record(struct sr_hist* h, uint64_t v)
+{
+    if(v > SR_HIST_MAX_VALUE)
+    { v = SR_HIST_MAX_VALUE; }
+
+    h->buckets[sr_hist_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if(v > h->max)
+    { h->max = v; }
+}
+
+void     sr_hist_merge(struct sr_hist* dst, const struct sr_hist* src);
+uint64_t sr_hist_percentile(const struct sr_hist* h, double p);
+
+#endif /* -- SR_HIST_H -- */
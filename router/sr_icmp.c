@@ -0,0 +1,187 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.c
+ *
+ * Description:
+ *
+ * Template based generation of ICMP error messages, see sr_icmp.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_icmp.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_pool.h"
+#include "sr_utils.h"
+#include "sr_alloc.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_fill_template(..)
+ * Scope:  Local
+ *
+ * Fill in the constant part of an error frame for one interface and
+ * sum up everything that does not change between errors.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_icmp_fill_template(struct sr_if* iface, uint8_t* frame,
+                                  uint8_t type, uint32_t* ip_sum,
+                                  uint32_t* icmp_sum)
+{
+    sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_hdr_t* icmp_hdr = (sr_icmp_hdr_t*)(frame +
+            sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+
+    memset(frame, 0, SR_ICMP_ERR_HDR_LEN);
+
+    /* destination is the sender of the offending packet, set per error */
+    memcpy(eth_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eth_hdr->ether_type = htons(ethertype_ip);
+
+    /* source and destination addresses are added per error */
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    ip_hdr->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t));
+    ip_hdr->ip_ttl = INIT_TTL;
+    ip_hdr->ip_p = ip_protocol_icmp;
+    *ip_sum = cksum_partial(ip_hdr, sizeof(sr_ip_hdr_t), 0);
+
+    /* code and quoted data are added per error, the rest is zero */
+    icmp_hdr->icmp_type = type;
+    *icmp_sum = cksum_partial(icmp_hdr, sizeof(sr_icmp_t3_hdr_t) -
+            ICMP_DATA_SIZE, 0);
+} /* -- sr_icmp_fill_template -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_init_templates(..)
+ * Scope:  Global
+ *
+ * (Re)build the error templates for every interface.  Must be called
+ * once the interface addresses are known, i.e. after HWINFO.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmp_init_templates(struct sr_instance* sr)
+{
+    struct sr_if* if_walker = 0;
+    struct sr_icmp_tmpl* tmpl;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        tmpl = if_walker->icmp_tmpl;
+        if(tmpl == 0)
+        {
+            tmpl = (struct sr_icmp_tmpl*)malloc(sizeof(struct sr_icmp_tmpl));
+            assert(tmpl);
+        }
+
+        sr_icmp_fill_template(if_walker, tmpl->t3, 3,
+                &(tmpl->t3_ip_sum), &(tmpl->t3_icmp_sum));
+        sr_icmp_fill_template(if_walker, tmpl->t11, 11,
+                &(tmpl->t11_ip_sum), &(tmpl->t11_icmp_sum));
+
+        if_walker->icmp_tmpl = tmpl;
+    }
+} /* -- sr_icmp_init_templates -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_send_error(..)
+ * Scope:  Global
+ *
+ * Send a type 3 or type 11 error about 'packet' (received Ethernet frame
+ * of length len) out of 'iface'.  Destination unreachable codes other
+ * than net/host unreachable are answered from the address the packet was
+ * sent to, everything else from the address of 'iface'.
+ *
+ * Returns the result of sr_send_packet, or -1 if no error was sent.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmp_send_error(struct sr_instance* sr, uint8_t* packet,
+                       unsigned int len, const char* iface,
+                       uint8_t type, uint8_t code)
+{
+    struct sr_if* sr_iface;
+    struct sr_icmp_tmpl* tmpl;
+    sr_ethernet_hdr_t* received_eth_hdr = (sr_ethernet_hdr_t*)packet;
+    sr_ip_hdr_t* received_ip_hdr;
+    sr_ethernet_hdr_t* eth_hdr;
+    sr_ip_hdr_t* ip_hdr;
+    sr_icmp_t3_hdr_t* icmp_hdr;
+    uint8_t* frame;
+    uint32_t ip_sum, icmp_sum;
+    unsigned int quoted;
+    int ret;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(packet);
+    assert(iface);
+    assert(type == 3 || type == 11);
+
+    sr_iface = sr_get_interface(sr, iface);
+    if(sr_iface == 0 || sr_iface->icmp_tmpl == 0 ||
+       len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    { return -1; }
+    tmpl = sr_iface->icmp_tmpl;
+
+    frame = (uint8_t*)sr_pool_get(&(sr->reply_pool));
+    if(frame == 0)
+    { return -1; }
+
+    eth_hdr = (sr_ethernet_hdr_t*)frame;
+    ip_hdr = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    icmp_hdr = (sr_icmp_t3_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t) +
+            sizeof(sr_ip_hdr_t));
+    received_ip_hdr = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+
+    if(type == 3)
+    {
+        memcpy(frame, tmpl->t3, SR_ICMP_ERR_HDR_LEN);
+        ip_sum = tmpl->t3_ip_sum;
+        icmp_sum = tmpl->t3_icmp_sum;
+    }
+    else
+    {
+        memcpy(frame, tmpl->t11, SR_ICMP_ERR_HDR_LEN);
+        ip_sum = tmpl->t11_ip_sum;
+        icmp_sum = tmpl->t11_icmp_sum;
+    }
+
+    /* -- Ethernet: back to whoever handed us the packet -- */
+    memcpy(eth_hdr->ether_dhost, received_eth_hdr->ether_shost,
+            ETHER_ADDR_LEN);
+
+    /* -- IP: addresses are the only per error fields -- */
+    if(type == 3 && code != 0 && code != 1)
+    { ip_hdr->ip_src = received_ip_hdr->ip_dst; }
+    else
+    { ip_hdr->ip_src = sr_iface->ip; }
+    ip_hdr->ip_dst = received_ip_hdr->ip_src;
+    ip_sum = cksum_partial(&(ip_hdr->ip_src), 2 * sizeof(uint32_t), ip_sum);
+    ip_hdr->ip_sum = cksum_fold(ip_sum);
+
+    /* -- ICMP: code and the quoted header, zero padded if short -- */
+    quoted = len - sizeof(sr_ethernet_hdr_t);
+    if(quoted > ICMP_DATA_SIZE)
+    { quoted = ICMP_DATA_SIZE; }
+    memcpy(icmp_hdr->data, received_ip_hdr, quoted);
+    memset(icmp_hdr->data + quoted, 0, ICMP_DATA_SIZE - quoted);
+
+    icmp_hdr->icmp_code = code;
+    icmp_sum += code;
+    icmp_sum = cksum_partial(icmp_hdr->data, ICMP_DATA_SIZE, icmp_sum);
+    icmp_hdr->icmp_sum = cksum_fold(icmp_sum);
+
+    ret = sr_send_packet(sr, frame, SR_ICMP_ERR_LEN, iface);
+    sr_pool_put(&(sr->reply_pool), frame);
+
+    return ret;
+} /* -- sr_icmp_send_error -- */
@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.h
+ *
+ * Description:
+ *
+ * Pre-built ICMP error frames.  Every interface carries a template for
+ * type 3 (destination unreachable) and type 11 (time exceeded) errors
+ * with the Ethernet, IP and ICMP headers already filled in and the
+ * checksums of the constant fields already summed.  Generating an error
+ * only copies the quoted bytes and folds the remaining fields into the
+ * checksums.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMP_H
+#define SR_ICMP_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_protocol.h"
+
+/* both error formats quote ICMP_DATA_SIZE bytes behind an 8 byte header */
+#define SR_ICMP_ERR_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                         sizeof(sr_icmp_t3_hdr_t))
+#define SR_ICMP_ERR_HDR_LEN (SR_ICMP_ERR_LEN - ICMP_DATA_SIZE)
+
+#define SR_ICMP_POOL_BATCH 64
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_icmp_tmpl
+ *
+ * Per interface error templates.  The partial sums cover every field
+ * except the ones filled in per error (IP src/dst, ICMP code, quoted data)
+ * and are kept unfolded so those fields can simply be added in.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_icmp_tmpl
+{
+    uint8_t  t3[SR_ICMP_ERR_HDR_LEN];
+    uint8_t  t11[SR_ICMP_ERR_HDR_LEN];
+    uint32_t t3_ip_sum;
+    uint32_t t3_icmp_sum;
+    uint32_t t11_ip_sum;
+    uint32_t t11_icmp_sum;
+};
+
+void sr_icmp_init_templates(struct sr_instance* sr);
+int  sr_icmp_send_error(struct sr_instance* sr, uint8_t* packet,
+                        unsigned int len, const char* iface,
+                        uint8_t type, uint8_t code);
+
+#endif /* -- SR_ICMP_H -- */
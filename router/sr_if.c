@@ -24,6 +24,7 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_alloc.h"
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
@@ -58,7 +59,8 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list, in the routing table -V bound
+ * it to if any
  *
  *---------------------------------------------------------------------*/
 
@@ -76,6 +78,10 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
+        sr->if_list->index = 0;
+        sr->if_list->speed = 0;
+        sr->if_list->vrf = sr_vrf_bound(sr, name);
+        sr->if_list->icmp_tmpl = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
         return;
     }
@@ -87,8 +93,12 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
 
     if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
     assert(if_walker->next);
+    if_walker->next->index = if_walker->index + 1;
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+    if_walker->speed = 0;
+    if_walker->vrf = sr_vrf_bound(sr, name);
+    if_walker->icmp_tmpl = 0;
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
@@ -140,6 +150,30 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
 } /* -- sr_set_ether_ip -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_speed(..)
+ * Scope: Global
+ *
+ * set the speed of the LAST interface in the interface list, as HWINFO
+ * reports it, 0 if unknown
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_speed(struct sr_instance* sr, uint32_t speed)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+
+    if_walker = sr->if_list;
+    while(if_walker->next)
+    {if_walker = if_walker->next; }
+
+    if_walker->speed = speed;
+
+} /* -- sr_set_ether_speed -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -191,4 +225,6 @@ void sr_print_if(struct sr_if* iface)
     DebugMAC(iface->addr);
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
+    if(iface->vrf)
+    { Debug("\tvrf %u\n",iface->vrf); }
 } /* -- sr_print_if -- */
@@ -27,6 +27,7 @@
 #include "sr_protocol.h"
 
 struct sr_instance;
+struct sr_icmp_tmpl;
 
 /* ----------------------------------------------------------------------------
  * struct sr_if
@@ -38,9 +39,12 @@ struct sr_instance;
 struct sr_if
 {
   char name[sr_IFACE_NAMELEN];
+  unsigned int index;             /* position in the interface list */
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  unsigned int vrf;               /* routing table ID, see sr_vrf.h */
+  struct sr_icmp_tmpl* icmp_tmpl; /* ICMP error templates, see sr_icmp.h */
   struct sr_if* next;
 };
 
@@ -48,6 +52,7 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
+void sr_set_ether_speed(struct sr_instance*, uint32_t speed);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
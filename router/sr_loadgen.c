@@ -0,0 +1,967 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_loadgen.c
+ *
+ * Description:
+ *
+ * Load generator that stands in for the VNS server (POX), so the router
+ * can be driven at a known rate over its real TCP transport.
+ *
+ * It listens for the router, authenticates it without checking the key,
+ * answers its open with a VNSHWINFO describing the interfaces (and a
+ * VNS_RTABLE if it asked for a template), then sends VNSPACKET frames
+ * in from one interface at the given rate and mix while a second thread
+ * reads whatever the router sends back.  ARP requests are answered on
+ * behalf of the next hops; everything else is matched to the frame that
+ * caused it by IP id and counted and timed.
+ *
+ * Traffic kinds, mixed by weight with -m, e.g. -m fwd=90,echo=5,ttl=5
+ *
+ *   fwd       UDP to a random address in a random route, comes back as UDP
+ *   echo      ICMP echo to the ingress interface, comes back as a reply
+ *   noroute   UDP to an address no route covers, comes back as ICMP 3/0
+ *   ttl       like fwd with a TTL of 1, comes back as ICMP 11/0
+ *
+ * Interfaces are read from -i ("name ip mac" lines) or synthesized from
+ * the routing table exactly as sr_bench does, so run the router with the
+ * same -r table:
+ *
+ *   sr_loadgen -r rtable -R 100000 -d 10 &
+ *   sr -s localhost -r rtable
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_hist.h"
+#include "vnscommand.h"
+
+#define DEFAULT_PORT 8888
+#define DEFAULT_RTABLE "rtable"
+#define SR_LG_MAX_IF 32
+#define SR_LG_MAX_RT 4096
+#define SR_LG_MAX_FRAME 1514
+#define SR_LG_MIN_FRAME (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8)
+#define SR_LG_MAX_BATCH 256
+#define SR_LG_RXBUF (1 << 16)
+#define SR_LG_IDS 65536             /* send times kept, one per ip id */
+#define SR_LG_START_MS 200          /* time given the router to sr_init */
+
+enum sr_lg_kind
+{
+    SR_LG_FWD = 0,
+    SR_LG_ECHO,
+    SR_LG_NOROUTE,
+    SR_LG_TTL,
+    SR_LG_KINDS
+};
+
+static const char* sr_lg_kind_names[SR_LG_KINDS] =
+{ "fwd", "echo", "noroute", "ttl" };
+
+struct sr_lg_if
+{
+    char name[sr_IFACE_NAMELEN];
+    uint32_t ip;
+    uint8_t mac[ETHER_ADDR_LEN];
+};
+
+struct sr_lg_rt
+{
+    uint32_t dest;
+    uint32_t mask;
+};
+
+struct sr_lg
+{
+    int fd;
+    pthread_mutex_t wlock;          /* sender and ARP replies both write */
+
+    struct sr_lg_if ifs[SR_LG_MAX_IF];
+    int nifs;
+    struct sr_lg_if* in;            /* ingress */
+    struct sr_lg_rt rts[SR_LG_MAX_RT];
+    int nrts;
+    char rtable[256];
+
+    int mix[100];                   /* kind per percent */
+    uint32_t noroute;               /* destination for noroute */
+    double rate;                    /* pps, 0 for as fast as possible */
+    double duration;                /* seconds */
+    unsigned int len;               /* frame length */
+    unsigned int batch;             /* frames per write */
+    uint64_t seed;
+
+    volatile int sending;
+    volatile int receiving;
+
+    /* -- sender -- */
+    uint64_t sent[SR_LG_KINDS];
+    uint64_t sent_bytes;
+    double t_start, t_stop;
+    uint64_t sent_ns[SR_LG_IDS];
+    uint8_t sent_kind[SR_LG_IDS];
+
+    /* -- receiver -- */
+    uint8_t rxbuf[SR_LG_RXBUF];
+    unsigned int rxlen;
+    uint64_t rcvd[SR_LG_KINDS];
+    uint64_t rcvd_bytes;
+    uint64_t arps;
+    uint64_t other;
+    struct sr_hist lat[SR_LG_KINDS];
+};
+
+static void usage(char* argv0);
+
+static uint64_t sr_lg_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_lg_ns -- */
+
+static uint32_t sr_lg_rand(struct sr_lg* lg)
+{
+    lg->seed ^= lg->seed << 13;
+    lg->seed ^= lg->seed >> 7;
+    lg->seed ^= lg->seed << 17;
+    return (uint32_t)(lg->seed >> 16);
+} /* -- sr_lg_rand -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lg_write(..)
+ * Scope:  Local
+ *
+ * Write a buffer of whole commands, so commands from the two threads
+ * never interleave.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_lg_write(struct sr_lg* lg, const void* buf, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    ssize_t ret;
+
+    pthread_mutex_lock(&(lg->wlock));
+    while(len > 0)
+    {
+        ret = write(lg->fd, p, len);
+        if(ret < 0 && errno == EINTR)
+        { continue; }
+        if(ret <= 0)
+        {
+            pthread_mutex_unlock(&(lg->wlock));
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+    pthread_mutex_unlock(&(lg->wlock));
+    return 0;
+} /* -- sr_lg_write -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lg_read(..)
+ * Scope:  Local
+ *
+ * Return the next command from the router, in rxbuf and still in
+ * network byte order, or 0 when the connection is gone.  The command
+ * stays valid until the next call.
+ *
+ *---------------------------------------------------------------------*/
+
+static c_base* sr_lg_read(struct sr_lg* lg, unsigned int* consumed)
+{
+    uint32_t len;
+    ssize_t ret;
+
+    if(*consumed)
+    {
+        memmove(lg->rxbuf, lg->rxbuf + *consumed, lg->rxlen - *consumed);
+        lg->rxlen -= *consumed;
+        *consumed = 0;
+    }
+
+    for(;;)
+    {
+        if(lg->rxlen >= sizeof(c_base))
+        {
+            len = ntohl(((c_base*)lg->rxbuf)->mLen);
+            if(len < sizeof(c_base) || len > SR_LG_RXBUF)
+            {
+                fprintf(stderr, "sr_loadgen: bad command length %u\n", len);
+                return 0;
+            }
+            if(lg->rxlen >= len)
+            {
+                *consumed = len;
+                return (c_base*)lg->rxbuf;
+            }
+        }
+
+        ret = read(lg->fd, lg->rxbuf + lg->rxlen, SR_LG_RXBUF - lg->rxlen);
+        if(ret < 0 && errno == EINTR)
+        { continue; }
+        if(ret <= 0)
+        { return 0; }
+        lg->rxlen += ret;
+    }
+} /* -- sr_lg_read -- */
+
+/*---------------------------------------------------------------------
+ * Setup
+ *---------------------------------------------------------------------*/
+
+static int sr_lg_load_rtable(struct sr_lg* lg)
+{
+    FILE* fp = fopen(lg->rtable, "r");
+    char line[256], dest[32], gw[32], mask[32], name[sr_IFACE_NAMELEN];
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 0 };
+    struct sr_lg_if* iface;
+    int i, synth = lg->nifs == 0;
+
+    if(fp == 0)
+    {
+        perror(lg->rtable);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp) && lg->nrts < SR_LG_MAX_RT)
+    {
+        if(sscanf(line, "%31s %31s %31s %31s", dest, gw, mask, name) != 4)
+        { continue; }
+        lg->rts[lg->nrts].mask = inet_addr(mask);
+        lg->rts[lg->nrts].dest = inet_addr(dest) & lg->rts[lg->nrts].mask;
+        lg->nrts++;
+
+        /* -- same addresses as sr_bench_synth_ifs -- */
+        for(i = 0; i < lg->nifs; i++)
+        {
+            if(strcmp(lg->ifs[i].name, name) == 0)
+            { break; }
+        }
+        if(i == lg->nifs && synth && lg->nifs < SR_LG_MAX_IF)
+        {
+            iface = &(lg->ifs[lg->nifs++]);
+            strcpy(iface->name, name);
+            iface->ip = htonl(0xc0000200 + lg->nifs);
+            mac[5] = lg->nifs;
+            memcpy(iface->mac, mac, ETHER_ADDR_LEN);
+        }
+    }
+
+    fclose(fp);
+    return lg->nrts ? 0 : -1;
+} /* -- sr_lg_load_rtable -- */
+
+static int sr_lg_load_ifs(struct sr_lg* lg, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    char line[256], ip[32];
+    unsigned int m[6];
+    struct sr_lg_if* iface;
+    int i;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp) && lg->nifs < SR_LG_MAX_IF)
+    {
+        iface = &(lg->ifs[lg->nifs]);
+        if(sscanf(line, "%31s %31s %x:%x:%x:%x:%x:%x", iface->name, ip,
+                  &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 8)
+        { continue; }
+        iface->ip = inet_addr(ip);
+        for(i = 0; i < 6; i++)
+        { iface->mac[i] = m[i]; }
+        lg->nifs++;
+    }
+
+    fclose(fp);
+    return lg->nifs ? 0 : -1;
+} /* -- sr_lg_load_ifs -- */
+
+/* "fwd=90,echo=10" into a table of 100 kinds */
+static int sr_lg_parse_mix(struct sr_lg* lg, const char* spec)
+{
+    char buf[256], *tok, *save, *eq;
+    int weight[SR_LG_KINDS], total = 0, i, k, n;
+
+    memset(weight, 0, sizeof(weight));
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+
+    for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save))
+    {
+        eq = strchr(tok, '=');
+        if(eq)
+        { *eq = 0; }
+        for(k = 0; k < SR_LG_KINDS; k++)
+        {
+            if(strcmp(tok, sr_lg_kind_names[k]) == 0)
+            { break; }
+        }
+        if(k == SR_LG_KINDS)
+        {
+            fprintf(stderr, "sr_loadgen: unknown traffic kind %s\n", tok);
+            return -1;
+        }
+        weight[k] = eq ? atoi(eq + 1) : 1;
+        total += weight[k];
+    }
+    if(total <= 0)
+    { return -1; }
+
+    for(i = 0, k = 0, n = 0; i < 100; i++)
+    {
+        while(k < SR_LG_KINDS - 1 && i >= (n + weight[k]) * 100 / total)
+        { n += weight[k++]; }
+        lg->mix[i] = k;
+    }
+    return 0;
+} /* -- sr_lg_parse_mix -- */
+
+/* an address no route covers, or 0 if there is a default route */
+static uint32_t sr_lg_find_noroute(struct sr_lg* lg)
+{
+    uint32_t ip;
+    int i, tries;
+
+    for(tries = 0; tries < 1000; tries++)
+    {
+        ip = htonl(0xc6336400 + tries);     /* 198.51.100.0/24 and up */
+        for(i = 0; i < lg->nrts; i++)
+        {
+            if((ip & lg->rts[i].mask) == lg->rts[i].dest)
+            { break; }
+        }
+        if(i == lg->nrts)
+        { return ip; }
+    }
+    return 0;
+} /* -- sr_lg_find_noroute -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lg_handshake(..)
+ * Scope:  Local
+ *
+ * The server side of sr_connect_to_server: auth request and status,
+ * the open, the routing table if a template was asked for, and finally
+ * the hardware info.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_lg_handshake(struct sr_lg* lg)
+{
+    struct
+    {
+        c_auth_request req;
+        uint8_t salt[20];
+    } __attribute__ ((__packed__)) areq;
+    c_auth_status status;
+    c_hwinfo hw;
+    c_base* cmd;
+    c_rtable* rt;
+    FILE* fp;
+    unsigned int consumed = 0, n = 0, i, len;
+    char host[IDSIZE + 1];
+
+    areq.req.mLen  = htonl(sizeof(areq));
+    areq.req.mType = htonl(VNS_AUTH_REQUEST);
+    for(i = 0; i < sizeof(areq.salt); i++)
+    { areq.salt[i] = sr_lg_rand(lg); }
+    if(sr_lg_write(lg, &areq, sizeof(areq)) != 0)
+    { return -1; }
+
+    cmd = sr_lg_read(lg, &consumed);
+    if(cmd == 0 || ntohl(cmd->mType) != VNS_AUTH_REPLY)
+    {
+        fprintf(stderr, "sr_loadgen: expected an auth reply\n");
+        return -1;
+    }
+
+    memset(&status, 0, sizeof(status));
+    status.mLen    = htonl(sizeof(status));
+    status.mType   = htonl(VNS_AUTH_STATUS);
+    status.auth_ok = 1;
+    if(sr_lg_write(lg, &status, sizeof(status)) != 0)
+    { return -1; }
+
+    cmd = sr_lg_read(lg, &consumed);
+    if(cmd == 0)
+    { return -1; }
+
+    if(ntohl(cmd->mType) == VNS_OPEN_TEMPLATE)
+    {
+        memcpy(host, ((c_open_template*)cmd)->mVirtualHostID, IDSIZE);
+        host[IDSIZE] = 0;
+
+        rt = (c_rtable*)calloc(1, SR_LG_RXBUF);
+        assert(rt);
+        fp = fopen(lg->rtable, "r");
+        len = fp ? fread(rt->rtable, 1, SR_LG_RXBUF - sizeof(c_rtable), fp) : 0;
+        if(fp)
+        { fclose(fp); }
+        rt->mLen  = htonl(sizeof(c_rtable) + len);
+        rt->mType = htonl(VNS_RTABLE);
+        strncpy(rt->mVirtualHostID, host, IDSIZE);
+        i = sr_lg_write(lg, rt, sizeof(c_rtable) + len);
+        free(rt);
+        if(i != 0)
+        { return -1; }
+    }
+    else if(ntohl(cmd->mType) != VNSOPEN)
+    {
+        fprintf(stderr, "sr_loadgen: expected an open, got %u\n",
+                ntohl(cmd->mType));
+        return -1;
+    }
+
+    /* -- the router sets addresses on the interface last added -- */
+    memset(&hw, 0, sizeof(hw));
+    for(i = 0; i < (unsigned int)lg->nifs; i++)
+    {
+        hw.mHWInfo[n].mKey = htonl(HWINTERFACE);
+        strncpy(hw.mHWInfo[n++].value, lg->ifs[i].name, 31);
+        hw.mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(hw.mHWInfo[n++].value, lg->ifs[i].mac, ETHER_ADDR_LEN);
+        hw.mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(hw.mHWInfo[n++].value, &(lg->ifs[i].ip), 4);
+    }
+    len = 2 * sizeof(uint32_t) + n * sizeof(c_hw_entry);
+    hw.mLen  = htonl(len);
+    hw.mType = htonl(VNSHWINFO);
+    if(sr_lg_write(lg, &hw, len) != 0)
+    { return -1; }
+
+    /* -- anything left over is the router's first frames -- */
+    memmove(lg->rxbuf, lg->rxbuf + consumed, lg->rxlen - consumed);
+    lg->rxlen -= consumed;
+    return 0;
+} /* -- sr_lg_handshake -- */
+
+/*---------------------------------------------------------------------
+ * Sending
+ *---------------------------------------------------------------------*/
+
+/* the MAC of whatever the router ARPs for, and our source MAC */
+static void sr_lg_neighbour_mac(uint32_t ip, uint8_t* mac)
+{
+    mac[0] = 2;
+    mac[1] = 0;
+    mac[2] = 0;
+    mac[3] = 0xfe;
+    mac[4] = ntohl(ip) >> 8;
+    mac[5] = ntohl(ip);
+} /* -- sr_lg_neighbour_mac -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lg_frame(..)
+ * Scope:  Local
+ *
+ * Build one VNSPACKET of the given kind at buf, numbered id.  Returns
+ * its length.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_lg_frame(struct sr_lg* lg, uint8_t* buf, int kind,
+                                uint16_t id)
+{
+    c_packet_header* cmd = (c_packet_header*)buf;
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)(cmd + 1);
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    uint8_t* l4 = (uint8_t*)(ip + 1);
+    unsigned int l4len = lg->len - sizeof(*eth) - sizeof(*ip);
+    struct sr_lg_rt* rt;
+    uint32_t dst;
+
+    switch(kind)
+    {
+        case SR_LG_ECHO:
+            dst = lg->in->ip;
+            break;
+        case SR_LG_NOROUTE:
+            dst = lg->noroute;
+            break;
+        default:
+            rt = &(lg->rts[sr_lg_rand(lg) % lg->nrts]);
+            dst = rt->dest | (htonl(sr_lg_rand(lg)) & ~rt->mask);
+            break;
+    }
+
+    cmd->mLen  = htonl(sizeof(*cmd) + lg->len);
+    cmd->mType = htonl(VNSPACKET);
+    memset(cmd->mInterfaceName, 0, sizeof(cmd->mInterfaceName));
+    strncpy(cmd->mInterfaceName, lg->in->name, sizeof(cmd->mInterfaceName));
+
+    memcpy(eth->ether_dhost, lg->in->mac, ETHER_ADDR_LEN);
+    sr_lg_neighbour_mac(lg->in->ip ^ htonl(0xff), eth->ether_shost);
+    eth->ether_type = htons(ethertype_ip);
+
+    memset(ip, 0, sizeof(*ip));
+    ip->ip_v   = 4;
+    ip->ip_hl  = 5;
+    ip->ip_len = htons(sizeof(*ip) + l4len);
+    ip->ip_id  = htons(id);
+    ip->ip_ttl = kind == SR_LG_TTL ? 1 : 64;
+    ip->ip_p   = kind == SR_LG_ECHO ? ip_protocol_icmp : IPPROTO_UDP;
+    ip->ip_src = lg->in->ip ^ htonl(0xff);
+    ip->ip_dst = dst;
+    ip->ip_sum = cksum(ip, sizeof(*ip));
+
+    memset(l4, 0, l4len);
+    if(kind == SR_LG_ECHO)
+    {
+        l4[0] = 8;
+        *(uint16_t*)(l4 + 4) = htons(0x5247);
+        *(uint16_t*)(l4 + 6) = htons(id);
+        *(uint16_t*)(l4 + 2) = cksum(l4, l4len);
+    }
+    else
+    {
+        *(uint16_t*)(l4 + 0) = htons(40000);
+        *(uint16_t*)(l4 + 2) = htons(9);
+        *(uint16_t*)(l4 + 4) = htons(l4len);
+    }
+
+    return sizeof(*cmd) + lg->len;
+} /* -- sr_lg_frame -- */
+
+static void* sr_lg_sender(void* arg)
+{
+    struct sr_lg* lg = (struct sr_lg*)arg;
+    uint8_t* buf;
+    unsigned int off, i, bytes;
+    uint16_t id = 0;
+    uint64_t start, next, end, now;
+    struct timespec ts;
+    int kind;
+
+    buf = (uint8_t*)malloc(SR_LG_MAX_BATCH *
+                           (sizeof(c_packet_header) + SR_LG_MAX_FRAME));
+    assert(buf);
+
+    start = next = sr_lg_ns();
+    end = start + (uint64_t)(lg->duration * 1e9);
+    lg->t_start = start / 1e9;
+
+    while(lg->sending && (now = sr_lg_ns()) < end)
+    {
+        if(lg->rate > 0 && now < next)
+        {
+            ts.tv_sec  = next / 1000000000;
+            ts.tv_nsec = next % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+        }
+
+        for(i = 0, off = 0, bytes = 0; i < lg->batch; i++, id++)
+        {
+            kind = lg->mix[sr_lg_rand(lg) % 100];
+            off += sr_lg_frame(lg, buf + off, kind, id);
+            lg->sent[kind]++;
+            bytes += lg->len;
+            lg->sent_kind[id] = kind;
+            __atomic_store_n(&(lg->sent_ns[id]), sr_lg_ns(), __ATOMIC_RELEASE);
+        }
+        if(sr_lg_write(lg, buf, off) != 0)
+        {
+            fprintf(stderr, "sr_loadgen: router went away\n");
+            break;
+        }
+        lg->sent_bytes += bytes;
+
+        if(lg->rate > 0)
+        { next += (uint64_t)(lg->batch * 1e9 / lg->rate); }
+    }
+
+    lg->t_stop = sr_lg_ns() / 1e9;
+    free(buf);
+    return 0;
+} /* -- sr_lg_sender -- */
+
+/*---------------------------------------------------------------------
+ * Receiving
+ *---------------------------------------------------------------------*/
+
+static void sr_lg_arp_reply(struct sr_lg* lg, const char* iface,
+                            sr_arp_hdr_t* req)
+{
+    struct
+    {
+        c_packet_header cmd;
+        sr_ethernet_hdr_t eth;
+        sr_arp_hdr_t arp;
+    } __attribute__ ((__packed__)) f;
+
+    memset(&f, 0, sizeof(f));
+    f.cmd.mLen  = htonl(sizeof(f));
+    f.cmd.mType = htonl(VNSPACKET);
+    strncpy(f.cmd.mInterfaceName, iface, sizeof(f.cmd.mInterfaceName));
+
+    memcpy(f.eth.ether_dhost, req->ar_sha, ETHER_ADDR_LEN);
+    sr_lg_neighbour_mac(req->ar_tip, f.eth.ether_shost);
+    f.eth.ether_type = htons(ethertype_arp);
+
+    f.arp.ar_hrd = htons(arp_hrd_ethernet);
+    f.arp.ar_pro = htons(ethertype_ip);
+    f.arp.ar_hln = ETHER_ADDR_LEN;
+    f.arp.ar_pln = 4;
+    f.arp.ar_op  = htons(arp_op_reply);
+    memcpy(f.arp.ar_sha, f.eth.ether_shost, ETHER_ADDR_LEN);
+    f.arp.ar_sip = req->ar_tip;
+    memcpy(f.arp.ar_tha, req->ar_sha, ETHER_ADDR_LEN);
+    f.arp.ar_tip = req->ar_sip;
+
+    sr_lg_write(lg, &f, sizeof(f));
+} /* -- sr_lg_arp_reply -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lg_frame_in(..)
+ * Scope:  Local
+ *
+ * Classify a frame from the router and, unless it is ARP, time it
+ * against the frame that caused it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_lg_frame_in(struct sr_lg* lg, c_packet_header* cmd,
+                           unsigned int len, uint64_t now)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)(cmd + 1);
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    uint8_t* l4 = (uint8_t*)(ip + 1);
+    uint16_t id;
+    uint64_t sent;
+    int kind;
+
+    if(len < sizeof(*eth) + sizeof(sr_arp_hdr_t))
+    {
+        lg->other++;
+        return;
+    }
+
+    if(ntohs(eth->ether_type) == ethertype_arp)
+    {
+        if(ntohs(((sr_arp_hdr_t*)ip)->ar_op) == arp_op_request)
+        {
+            sr_lg_arp_reply(lg, cmd->mInterfaceName, (sr_arp_hdr_t*)ip);
+            lg->arps++;
+        }
+        else
+        { lg->other++; }
+        return;
+    }
+
+    if(ntohs(eth->ether_type) != ethertype_ip ||
+       len < sizeof(*eth) + sizeof(*ip) + 8)
+    {
+        lg->other++;
+        return;
+    }
+
+    if(ip->ip_p == IPPROTO_UDP)
+    {
+        kind = SR_LG_FWD;
+        id = ntohs(ip->ip_id);
+    }
+    else if(ip->ip_p == ip_protocol_icmp && l4[0] == 0)
+    {
+        kind = SR_LG_ECHO;
+        id = ntohs(*(uint16_t*)(l4 + 6));
+    }
+    else if(ip->ip_p == ip_protocol_icmp && (l4[0] == 3 || l4[0] == 11) &&
+            len >= sizeof(*eth) + sizeof(*ip) + 8 + sizeof(*ip))
+    {
+        kind = l4[0] == 3 ? SR_LG_NOROUTE : SR_LG_TTL;
+        id = ntohs(((sr_ip_hdr_t*)(l4 + 8))->ip_id);
+    }
+    else
+    {
+        lg->other++;
+        return;
+    }
+
+    /* -- a forwarded ttl frame is a fwd as far as counting goes -- */
+    if(kind == SR_LG_FWD && lg->sent_kind[id] == SR_LG_TTL)
+    { kind = SR_LG_TTL; }
+
+    lg->rcvd[kind]++;
+    lg->rcvd_bytes += len;
+    sent = __atomic_load_n(&(lg->sent_ns[id]), __ATOMIC_ACQUIRE);
+    if(sent && now > sent)
+    { sr_hist_record(&(lg->lat[kind]), now - sent); }
+} /* -- sr_lg_frame_in -- */
+
+static void* sr_lg_receiver(void* arg)
+{
+    struct sr_lg* lg = (struct sr_lg*)arg;
+    c_base* cmd;
+    unsigned int consumed = 0, len;
+
+    while(lg->receiving && (cmd = sr_lg_read(lg, &consumed)) != 0)
+    {
+        len = ntohl(cmd->mLen);
+        if(ntohl(cmd->mType) == VNSPACKET && len >= sizeof(c_packet_header))
+        {
+            sr_lg_frame_in(lg, (c_packet_header*)cmd,
+                           len - sizeof(c_packet_header), sr_lg_ns());
+        }
+    }
+    return 0;
+} /* -- sr_lg_receiver -- */
+
+/*---------------------------------------------------------------------
+ * Reporting
+ *---------------------------------------------------------------------*/
+
+static void sr_lg_report(struct sr_lg* lg)
+{
+    double secs = lg->t_stop - lg->t_start;
+    uint64_t sent = 0, rcvd = 0;
+    struct sr_hist* h;
+    int k;
+
+    for(k = 0; k < SR_LG_KINDS; k++)
+    {
+        sent += lg->sent[k];
+        rcvd += lg->rcvd[k];
+    }
+    if(secs <= 0)
+    { secs = 1e-9; }
+
+    printf("sent     %llu frames in %.3f s, %.3f Mpps, %.1f Mbit/s\n",
+            (unsigned long long)sent, secs, sent / secs / 1e6,
+            lg->sent_bytes * 8 / secs / 1e6);
+    printf("received %llu frames, %.3f Mpps, %.1f Mbit/s, %llu arp requests,"
+           " %llu other\n",
+            (unsigned long long)rcvd, rcvd / secs / 1e6,
+            lg->rcvd_bytes * 8 / secs / 1e6,
+            (unsigned long long)lg->arps, (unsigned long long)lg->other);
+
+    printf("%-8s %12s %12s %8s %10s %10s %10s %10s\n", "kind", "sent",
+            "received", "lost %", "p50 us", "p99 us", "p99.9 us", "max us");
+    for(k = 0; k < SR_LG_KINDS; k++)
+    {
+        if(lg->sent[k] == 0)
+        { continue; }
+        h = &(lg->lat[k]);
+        printf("%-8s %12llu %12llu %8.2f %10.1f %10.1f %10.1f %10.1f\n",
+                sr_lg_kind_names[k], (unsigned long long)lg->sent[k],
+                (unsigned long long)lg->rcvd[k],
+                lg->rcvd[k] >= lg->sent[k] ? 0.0 :
+                    100.0 * (lg->sent[k] - lg->rcvd[k]) / lg->sent[k],
+                sr_hist_percentile(h, 0.5) / 1e3,
+                sr_hist_percentile(h, 0.99) / 1e3,
+                sr_hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+    }
+} /* -- sr_lg_report -- */
+
+static int sr_lg_accept(unsigned short port)
+{
+    struct sockaddr_in addr;
+    int lfd, fd, one = 1;
+
+    if((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(lfd, 1) < 0)
+    {
+        perror("bind");
+        close(lfd);
+        return -1;
+    }
+
+    printf("waiting for the router on port %u\n", port);
+    fflush(stdout);
+    fd = accept(lfd, 0, 0);
+    close(lfd);
+    if(fd < 0)
+    {
+        perror("accept");
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+} /* -- sr_lg_accept -- */
+
+/* tell the router we are done and stop reading what it still sends */
+static void sr_lg_close(struct sr_lg* lg)
+{
+    c_close bye;
+
+    memset(&bye, 0, sizeof(bye));
+    bye.mLen  = htonl(sizeof(bye));
+    bye.mType = htonl(VNSCLOSE);
+    strcpy(bye.mErrorMessage, "load generator done");
+    sr_lg_write(lg, &bye, sizeof(bye));
+
+    lg->receiving = 0;
+    shutdown(lg->fd, SHUT_RDWR);
+} /* -- sr_lg_close -- */
+
+int main(int argc, char** argv)
+{
+    static struct sr_lg lg;
+    unsigned short port = DEFAULT_PORT;
+    const char* iffile = 0;
+    const char* ingress = 0;
+    const char* mix = "fwd";
+    int drain_ms = 500, c, i;
+    pthread_t sender, receiver;
+    struct timespec wait;
+
+    lg.rate = 0;
+    lg.duration = 5;
+    lg.len = 64;
+    lg.batch = 32;
+    lg.seed = 0x5eed5eed5eed5eedULL;
+    strcpy(lg.rtable, DEFAULT_RTABLE);
+    pthread_mutex_init(&(lg.wlock), 0);
+
+    while((c = getopt(argc, argv, "hp:r:i:I:m:R:d:l:b:w:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'r':
+                strncpy(lg.rtable, optarg, sizeof(lg.rtable) - 1);
+                break;
+            case 'i':
+                iffile = optarg;
+                break;
+            case 'I':
+                ingress = optarg;
+                break;
+            case 'm':
+                mix = optarg;
+                break;
+            case 'R':
+                lg.rate = atof(optarg);
+                break;
+            case 'd':
+                lg.duration = atof(optarg);
+                break;
+            case 'l':
+                lg.len = atoi(optarg);
+                break;
+            case 'b':
+                lg.batch = atoi(optarg);
+                break;
+            case 'w':
+                drain_ms = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(lg.len < SR_LG_MIN_FRAME || lg.len > SR_LG_MAX_FRAME ||
+       lg.batch < 1 || lg.batch > SR_LG_MAX_BATCH || lg.duration <= 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if((iffile && sr_lg_load_ifs(&lg, iffile) != 0) ||
+       sr_lg_load_rtable(&lg) != 0 || lg.nifs == 0)
+    {
+        fprintf(stderr, "sr_loadgen: no routes or no interfaces\n");
+        exit(1);
+    }
+    lg.in = &(lg.ifs[0]);
+    for(i = 0; ingress && i < lg.nifs; i++)
+    {
+        if(strcmp(lg.ifs[i].name, ingress) == 0)
+        { lg.in = &(lg.ifs[i]); }
+    }
+    if(sr_lg_parse_mix(&lg, mix) != 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    lg.noroute = sr_lg_find_noroute(&lg);
+    for(i = 0; i < 100 && lg.noroute == 0; i++)
+    {
+        if(lg.mix[i] == SR_LG_NOROUTE)
+        {
+            fprintf(stderr, "sr_loadgen: every address has a route, "
+                    "noroute traffic is impossible\n");
+            exit(1);
+        }
+    }
+
+    if((lg.fd = sr_lg_accept(port)) < 0)
+    { exit(1); }
+    if(sr_lg_handshake(&lg) != 0)
+    {
+        fprintf(stderr, "sr_loadgen: handshake with the router failed\n");
+        exit(1);
+    }
+
+    wait.tv_sec  = 0;
+    wait.tv_nsec = SR_LG_START_MS * 1000000;
+    nanosleep(&wait, 0);
+
+    lg.sending = 1;
+    lg.receiving = 1;
+    if(pthread_create(&receiver, 0, sr_lg_receiver, &lg) != 0 ||
+       pthread_create(&sender, 0, sr_lg_sender, &lg) != 0)
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    /* -- send for the duration, then give the last frames time to return -- */
+    pthread_join(sender, 0);
+    wait.tv_sec  = drain_ms / 1000;
+    wait.tv_nsec = (drain_ms % 1000) * 1000000;
+    nanosleep(&wait, 0);
+
+    sr_lg_close(&lg);
+    pthread_join(receiver, 0);
+    close(lg.fd);
+
+    sr_lg_report(&lg);
+    return 0;
+} /* -- main -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-p port] [-r routing table] [-i interface file] \n", argv0);
+    printf("           [-I ingress interface] [-m kind=weight,..] [-R pps] \n");
+    printf("           [-d seconds] [-l frame length] [-b frames per write] \n");
+    printf("           [-w drain ms] \n");
+    printf("   kinds fwd echo noroute ttl \n");
+    printf("   defaults port=%d rtable=%s mix=fwd rate=unlimited seconds=5 \n",
+            DEFAULT_PORT, DEFAULT_RTABLE);
+    printf("            length=64 batch=32 drain=500 \n");
+} /* -- usage -- */
@@ -0,0 +1,570 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Description:
+ *
+ * Asynchronous logging, see sr_log.h
+ *
+ * Each logging thread owns an sr_ring that only it writes to and only
+ * the log thread reads from.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "sr_log.h"
+#include "sr_ring.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_alloc.h"
+
+#define SR_LOG_REC_MSG  1
+#define SR_LOG_REC_HDRS 2
+
+#define SR_LOG_IDLE_NS  1000000
+
+/* ----------------------------------------------------------------------------
+ * struct sr_log_rec
+ *
+ * Message arguments follow the header in 8 byte slots, a string argument
+ * is a length slot followed by its NUL terminated bytes.  A header record
+ * keeps the captured bytes of the frame, rec.len of them.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_log_rec
+{
+    struct sr_ring_rec rec;     /* rec.aux is the level */
+    const char* fmt;            /* SR_LOG_REC_MSG */
+};
+
+int sr_log_level = SR_LOG_DEFAULT_LEVEL;
+
+static struct sr_ring* sr_log_rings = 0;
+static pthread_mutex_t sr_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sr_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct sr_ring* sr_log_self = 0;
+static pthread_t sr_log_tid;
+static int sr_log_running = 0;
+static unsigned long sr_log_reported = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_get_ring(..)
+ * Scope:  Local
+ *
+ * Return the calling thread's ring, creating it on first use.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_ring* sr_log_get_ring(void)
+{
+    struct sr_ring* ring = sr_log_self;
+
+    if(ring)
+    { return ring; }
+
+    if((ring = sr_ring_create(SR_LOG_RING_SZ)) == 0)
+    { return 0; }
+
+    pthread_mutex_lock(&sr_log_lock);
+    ring->next = sr_log_rings;
+    __atomic_store_n(&sr_log_rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sr_log_lock);
+
+    sr_log_self = ring;
+    return ring;
+} /* -- sr_log_get_ring -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_emit(..)
+ * Scope:  Global
+ *
+ * Encode a message into the calling thread's ring.  Use the sr_log
+ * macros rather than calling this directly so disabled levels are
+ * skipped without evaluating the arguments.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_emit(int level, const char* fmt, ...)
+{
+    struct sr_ring* ring;
+    struct sr_log_rec* rec;
+    uint8_t* p;
+    uint8_t* end;
+    const char* f;
+    const char* s;
+    uint64_t head;
+    int64_t ival;
+    double dval;
+    size_t slen;
+    int lng;
+    va_list ap;
+
+    if((ring = sr_log_get_ring()) == 0)
+    { return; }
+    if((rec = (struct sr_log_rec*)sr_ring_reserve(ring, SR_LOG_MAX_REC,
+                    &head)) == 0)
+    { return; }
+
+    rec->rec.kind = SR_LOG_REC_MSG;
+    rec->rec.aux = level;
+    rec->rec.len = 0;
+    rec->fmt = fmt;
+
+    p = (uint8_t*)(rec + 1);
+    end = (uint8_t*)rec + SR_LOG_MAX_REC;
+
+    va_start(ap, fmt);
+    for(f = fmt; *f; f++)
+    {
+        if(*f != '%')
+        { continue; }
+        f++;
+        if(*f == '%')
+        { continue; }
+
+        while(*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0')
+        { f++; }
+
+        /* '*' width and precision consume an int of their own */
+        if(*f == '*')
+        {
+            if(p + 8 > end)
+            { break; }
+            *(int64_t*)p = va_arg(ap, int);
+            p += 8;
+            f++;
+        }
+        while(*f >= '0' && *f <= '9')
+        { f++; }
+        if(*f == '.')
+        {
+            f++;
+            if(*f == '*')
+            {
+                if(p + 8 > end)
+                { break; }
+                *(int64_t*)p = va_arg(ap, int);
+                p += 8;
+                f++;
+            }
+            while(*f >= '0' && *f <= '9')
+            { f++; }
+        }
+
+        lng = 0;
+        while(*f == 'h' || *f == 'l' || *f == 'L' || *f == 'q' ||
+              *f == 'j' || *f == 'z' || *f == 't')
+        {
+            if(*f == 'l' || *f == 'q' || *f == 'j' || *f == 'z' || *f == 't')
+            { lng++; }
+            if(*f == 'L')
+            { lng = 2; }
+            f++;
+        }
+
+        if(*f == '\0')
+        { break; }
+        if(p + 8 > end)
+        { break; }
+        /* a string needs its length slot and room for at least a NUL */
+        if(*f == 's' && end - p < 8 + 8)
+        { break; }
+
+        switch(*f)
+        {
+            case 'd': case 'i':
+                if(lng >= 2)
+                { ival = va_arg(ap, long long); }
+                else if(lng == 1)
+                { ival = va_arg(ap, long); }
+                else
+                { ival = va_arg(ap, int); }
+                *(int64_t*)p = ival;
+                p += 8;
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                if(lng >= 2)
+                { ival = (int64_t)va_arg(ap, unsigned long long); }
+                else if(lng == 1)
+                { ival = (int64_t)va_arg(ap, unsigned long); }
+                else
+                { ival = (int64_t)va_arg(ap, unsigned int); }
+                *(int64_t*)p = ival;
+                p += 8;
+                break;
+            case 'c':
+                *(int64_t*)p = va_arg(ap, int);
+                p += 8;
+                break;
+            case 'p':
+                *(int64_t*)p = (int64_t)(uintptr_t)va_arg(ap, void*);
+                p += 8;
+                break;
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A':
+                if(lng == 2)
+                { dval = (double)va_arg(ap, long double); }
+                else
+                { dval = va_arg(ap, double); }
+                memcpy(p, &dval, sizeof(double));
+                p += 8;
+                break;
+            case 's':
+                s = va_arg(ap, const char*);
+                if(s == 0)
+                { s = "(null)"; }
+                slen = strnlen(s, SR_LOG_MAX_STR);
+                if(p + 8 + SR_RING_ALIGN(slen + 1) > end)
+                { slen = end - p - 8 - 1; }
+                *(int64_t*)p = slen;
+                memcpy(p + 8, s, slen);
+                p[8 + slen] = '\0';
+                p += 8 + SR_RING_ALIGN(slen + 1);
+                break;
+            default:
+                break;
+        }
+    }
+    va_end(ap);
+
+    rec->rec.size = p - (uint8_t*)rec;
+    sr_ring_commit(ring, head, rec->rec.size);
+} /* -- sr_log_emit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_emit_hdrs(..)
+ * Scope:  Global
+ *
+ * Copy the start of a frame into the ring so the log thread can print
+ * its headers with print_hdrs.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_emit_hdrs(int level, const uint8_t* buf, unsigned int len)
+{
+    struct sr_ring* ring;
+    struct sr_log_rec* rec;
+    uint64_t head;
+
+    if(len > SR_LOG_HDRS_SNAP)
+    { len = SR_LOG_HDRS_SNAP; }
+
+    if((ring = sr_log_get_ring()) == 0)
+    { return; }
+    if((rec = (struct sr_log_rec*)sr_ring_reserve(ring,
+                    sizeof(struct sr_log_rec) + len, &head)) == 0)
+    { return; }
+
+    rec->rec.kind = SR_LOG_REC_HDRS;
+    rec->rec.aux = level;
+    rec->rec.len = len;
+    rec->fmt = 0;
+    memcpy(rec + 1, buf, len);
+    rec->rec.size = sizeof(struct sr_log_rec) + SR_RING_ALIGN(len);
+
+    sr_ring_commit(ring, head, rec->rec.size);
+} /* -- sr_log_emit_hdrs -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_format(..)
+ * Scope:  Local
+ *
+ * Print a message record, walking the format the same way sr_log_emit
+ * did and handing each conversion to fprintf with the value it stored.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_log_format(FILE* out, struct sr_log_rec* rec)
+{
+    const uint8_t* p = (const uint8_t*)(rec + 1);
+    const uint8_t* end = (const uint8_t*)rec + rec->rec.size;
+    const char* f = rec->fmt;
+    const char* lit;
+    char spec[64];
+    char* sp;
+    int64_t ival;
+    double dval;
+    size_t slen;
+
+    while(*f)
+    {
+        /* -- literal text up to the next conversion -- */
+        lit = f;
+        while(*f && *f != '%')
+        { f++; }
+        if(f > lit)
+        { fwrite(lit, 1, f - lit, out); }
+        if(*f == '\0')
+        { break; }
+
+        f++;
+        if(*f == '%')
+        {
+            fputc('%', out);
+            f++;
+            continue;
+        }
+
+        sp = spec;
+        *sp++ = '%';
+        while(*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0')
+        { *sp++ = *f++; }
+
+        if(*f == '*')
+        {
+            if(p + 8 > end)
+            { return; }
+            sp += sprintf(sp, "%d", (int)*(const int64_t*)p);
+            p += 8;
+            f++;
+        }
+        while(*f >= '0' && *f <= '9' && sp < spec + 40)
+        { *sp++ = *f++; }
+        if(*f == '.')
+        {
+            *sp++ = *f++;
+            if(*f == '*')
+            {
+                if(p + 8 > end)
+                { return; }
+                sp += sprintf(sp, "%d", (int)*(const int64_t*)p);
+                p += 8;
+                f++;
+            }
+            while(*f >= '0' && *f <= '9' && sp < spec + 50)
+            { *sp++ = *f++; }
+        }
+
+        /* stored values are normalised, drop the length modifiers */
+        while(*f == 'h' || *f == 'l' || *f == 'L' || *f == 'q' ||
+              *f == 'j' || *f == 'z' || *f == 't')
+        { f++; }
+
+        if(*f == '\0' || p + 8 > end)
+        { return; }
+
+        switch(*f)
+        {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+                *sp++ = 'l';
+                *sp++ = 'l';
+                *sp++ = *f;
+                *sp = '\0';
+                ival = *(const int64_t*)p;
+                p += 8;
+                fprintf(out, spec, ival);
+                break;
+            case 'c':
+                *sp++ = 'c';
+                *sp = '\0';
+                fprintf(out, spec, (int)*(const int64_t*)p);
+                p += 8;
+                break;
+            case 'p':
+                *sp++ = 'p';
+                *sp = '\0';
+                fprintf(out, spec, (void*)(uintptr_t)*(const int64_t*)p);
+                p += 8;
+                break;
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A':
+                *sp++ = *f;
+                *sp = '\0';
+                memcpy(&dval, p, sizeof(double));
+                p += 8;
+                fprintf(out, spec, dval);
+                break;
+            case 's':
+                slen = *(const int64_t*)p;
+                *sp++ = 's';
+                *sp = '\0';
+                fprintf(out, spec, (const char*)(p + 8));
+                p += 8 + SR_RING_ALIGN(slen + 1);
+                break;
+            default:
+                break;
+        }
+        f++;
+    }
+} /* -- sr_log_format -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_drain(..)
+ * Scope:  Local
+ *
+ * Print everything currently published in every ring.  Returns the
+ * number of records handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_log_drain(void)
+{
+    struct sr_ring* ring;
+    struct sr_log_rec* rec;
+    uint64_t head, tail;
+    unsigned long dropped = 0;
+    char hdrs[SR_LOG_HDRS_SNAP];
+    int n = 0;
+
+    ring = __atomic_load_n(&sr_log_rings, __ATOMIC_ACQUIRE);
+    for(; ring; ring = ring->next)
+    {
+        head = sr_ring_head(ring);
+        tail = ring->tail;
+
+        while(tail != head)
+        {
+            rec = (struct sr_log_rec*)sr_ring_at(ring, tail);
+
+            if(rec->rec.kind == SR_LOG_REC_MSG)
+            {
+                sr_log_format(rec->rec.aux <= SR_LOG_WARN ? stderr : stdout,
+                        rec);
+                n++;
+            }
+            else if(rec->rec.kind == SR_LOG_REC_HDRS)
+            {
+                /* print_hdrs takes a writable buffer */
+                memcpy(hdrs, rec + 1, rec->rec.len);
+                print_hdrs((uint8_t*)hdrs, rec->rec.len);
+                n++;
+            }
+
+            tail += rec->rec.size;
+        }
+
+        sr_ring_release(ring, tail);
+        dropped += ring->dropped;
+    }
+
+    if(dropped != sr_log_reported)
+    {
+        fprintf(stderr, "sr_log: %lu messages dropped\n",
+                dropped - sr_log_reported);
+        sr_log_reported = dropped;
+    }
+
+    return n;
+} /* -- sr_log_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_thread(..)
+ * Scope:  Local
+ *
+ * Background writer, polls the rings and sleeps briefly when idle.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_log_thread(void* arg)
+{
+    struct timespec idle;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = SR_LOG_IDLE_NS;
+
+    while(__atomic_load_n(&sr_log_running, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&sr_log_drain_lock);
+        if(sr_log_drain() == 0)
+        {
+            fflush(stdout);
+            fflush(stderr);
+            pthread_mutex_unlock(&sr_log_drain_lock);
+            nanosleep(&idle, 0);
+            continue;
+        }
+        pthread_mutex_unlock(&sr_log_drain_lock);
+    }
+
+    return 0;
+} /* -- sr_log_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_init(..)
+ * Scope:  Global
+ *
+ * Set the run time level and start the background writer.  Returns 0
+ * on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_log_init(int level)
+{
+    sr_log_level = level;
+
+    if(sr_log_running)
+    { return 0; }
+
+    sr_log_running = 1;
+    if(pthread_create(&sr_log_tid, 0, sr_log_thread, 0) != 0)
+    {
+        sr_log_running = 0;
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_log_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_flush(..)
+ * Scope:  Global
+ *
+ * Write out everything logged so far.  Safe to call whether or not the
+ * background writer is running.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_flush(void)
+{
+    pthread_mutex_lock(&sr_log_drain_lock);
+    while(sr_log_drain() != 0)
+    { }
+    fflush(stdout);
+    fflush(stderr);
+    pthread_mutex_unlock(&sr_log_drain_lock);
+} /* -- sr_log_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_shutdown(..)
+ * Scope:  Global
+ *
+ * Stop the background writer and flush what is left.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_shutdown(void)
+{
+    if(sr_log_running)
+    {
+        __atomic_store_n(&sr_log_running, 0, __ATOMIC_RELEASE);
+        pthread_join(sr_log_tid, 0);
+    }
+    sr_log_flush();
+} /* -- sr_log_shutdown -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_dropped(..)
+ * Scope:  Global
+ *
+ * Total number of messages dropped because a ring was full.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned long sr_log_dropped(void)
+{
+    struct sr_ring* ring;
+    unsigned long dropped = 0;
+
+    ring = __atomic_load_n(&sr_log_rings, __ATOMIC_ACQUIRE);
+    for(; ring; ring = ring->next)
+    { dropped += ring->dropped; }
+
+    return dropped;
+} /* -- sr_log_dropped -- */
@@ -0,0 +1,85 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Description:
+ *
+ * Asynchronous logging for the forwarding path.
+ *
+ * A message is not formatted by the thread that logs it.  sr_log_emit
+ * copies the format pointer and the raw argument values (strings are
+ * copied by value) as a binary record into a ring owned by the calling
+ * thread.  A background thread drains the rings, formats the records and
+ * writes them out, so logging never blocks on stdio.  If a ring is full
+ * the message is dropped and counted.
+ *
+ * Every message has a level.  Levels above SR_LOG_MAX_LEVEL are removed
+ * at compile time; the remaining ones are filtered at run time against
+ * sr_log_level, which costs a load and a compare when disabled.
+ *
+ * Formats must be string literals and may use the usual integer, char,
+ * pointer, string and floating point conversions (%n is not supported).
+ * Strings are truncated to SR_LOG_MAX_STR bytes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_LOG_ERR   0
+#define SR_LOG_WARN  1
+#define SR_LOG_INFO  2
+#define SR_LOG_DEBUG 3
+
+/* compile time ceiling, build with -DSR_LOG_MAX_LEVEL=n to strip levels */
+#ifndef SR_LOG_MAX_LEVEL
+#ifdef _DEBUG_
+#define SR_LOG_MAX_LEVEL SR_LOG_DEBUG
+#else
+#define SR_LOG_MAX_LEVEL SR_LOG_INFO
+#endif
+#endif
+
+#define SR_LOG_DEFAULT_LEVEL SR_LOG_INFO
+
+#define SR_LOG_RING_SZ   (1 << 18)  /* bytes per thread, power of two */
+#define SR_LOG_MAX_REC   512        /* largest single record */
+#define SR_LOG_MAX_STR   128        /* longest string argument kept */
+#define SR_LOG_HDRS_SNAP 64         /* bytes kept by sr_log_hdrs */
+
+extern int sr_log_level;
+
+#define sr_log_enabled(level) \
+    ((level) <= SR_LOG_MAX_LEVEL && (level) <= sr_log_level)
+
+#define sr_log(level, fmt, args...) \
+    do { if (sr_log_enabled(level)) \
+             sr_log_emit((level), fmt, ## args); } while (0)
+
+/* log the headers of a frame the way print_hdrs prints them */
+#define sr_log_hdrs(level, buf, len) \
+    do { if (sr_log_enabled(level)) \
+             sr_log_emit_hdrs((level), (buf), (len)); } while (0)
+
+#define sr_log_err(fmt, args...)   sr_log(SR_LOG_ERR, fmt, ## args)
+#define sr_log_warn(fmt, args...)  sr_log(SR_LOG_WARN, fmt, ## args)
+#define sr_log_info(fmt, args...)  sr_log(SR_LOG_INFO, fmt, ## args)
+#define sr_log_debug(fmt, args...) sr_log(SR_LOG_DEBUG, fmt, ## args)
+
+int  sr_log_init(int level);
+void sr_log_shutdown(void);
+void sr_log_flush(void);
+unsigned long sr_log_dropped(void);
+
+void sr_log_emit(int level, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+void sr_log_emit_hdrs(int level, const uint8_t* buf, unsigned int len);
+
+#endif /* -- SR_LOG_H -- */
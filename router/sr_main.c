@@ -23,6 +23,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <pwd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
 
 #ifdef _LINUX_
@@ -32,6 +35,17 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_log.h"
+#include "sr_capture.h"
+#include "sr_flight.h"
+#include "sr_stats.h"
+#include "sr_shm.h"
+#include "sr_tsc.h"
+#include "sr_replay.h"
+#include "sr_fib.h"
+#include "sr_mrt.h"
+#include "sr_ortc.h"
+#include "sr_ctl.h"
 
 extern char* optarg;
 
@@ -49,7 +63,18 @@ static void usage(char* );
 static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
-static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable,
+                            char* mrt_rules);
+static void sr_map_fib_wrap(struct sr_instance* sr, char* image);
+static void sr_load_vrf_wrap(struct sr_instance* sr, char* vrf_file);
+static void sr_reload_rt(struct sr_instance* sr);
+static void sr_block_signals(sigset_t* set);
+static void* sr_signal_thread(void* arg);
+
+/* -- what SIGHUP reloads, the last table loaded -- */
+static char* reload_rtable = 0;
+static char* reload_rules = 0;
+static char* reload_image = 0;
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -65,11 +90,29 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    struct sr_capture_cfg capture_cfg;
+    int log_level = SR_LOG_DEFAULT_LEVEL;
+    unsigned long flight_entries = SR_FLIGHT_DEFAULT_ENTRIES;
+    char *stats_path = 0;
+    char *ctl_path = 0;
+    char *record = 0;
+    char *replay = 0;
+    char *fib_image = 0;
+    char *mrt_rules = 0;
+    char *vrf_file = 0;
+    int aggregate = 0;
+    int weighted = 0;
     struct sr_instance sr;
+    sigset_t signals;
+    pthread_t signal_tid;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    memset(&capture_cfg, 0, sizeof(capture_cfg));
+    capture_cfg.format = SR_CAPTURE_PCAP;
+    capture_cfg.snaplen = PACKET_DUMP_SIZE;
+
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:f:m:V:AWl:T:L:F:C:G:R:S:c:w:P:H")) != EOF)
     {
         switch (c)
         {
@@ -101,20 +144,144 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'L':
+                log_level = atoi((char *) optarg);
+                break;
+            case 'F':
+                if(strcmp(optarg, "pcapng") == 0)
+                { capture_cfg.format = SR_CAPTURE_PCAPNG; }
+                else if(strcmp(optarg, "pcap") == 0)
+                { capture_cfg.format = SR_CAPTURE_PCAP; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'C':
+                capture_cfg.rotate_bytes = strtoul(optarg, 0, 10) * 1000000;
+                break;
+            case 'G':
+                capture_cfg.rotate_secs = atoi((char *) optarg);
+                break;
+            case 'R':
+                flight_entries = strtoul(optarg, 0, 10);
+                if(optarg[0] == '-' || flight_entries > SR_FLIGHT_MAX_ENTRIES)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                stats_path = optarg;
+                break;
+            case 'c':
+                ctl_path = optarg;
+                break;
+            case 'w':
+                record = optarg;
+                break;
+            case 'P':
+                replay = optarg;
+                break;
+            case 'H':
+                sr_pool_hugepages(1);
+                break;
+            case 'f':
+                fib_image = optarg;
+                break;
+            case 'm':
+                mrt_rules = optarg;
+                break;
+            case 'V':
+                vrf_file = optarg;
+                break;
+            case 'A':
+                aggregate = 1;
+                break;
+            case 'W':
+                weighted = 1;
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- calibrate the cycle counter used for latencies -- */
+    sr_tsc_init();
+
+    /* -- signals are taken by sr_signal_thread, so block them before any
+     *    other thread is started and inherits the mask -- */
+    sr_block_signals(&signals);
+
+    /* -- start the log writer before anything logs -- */
+    if(sr_log_init(log_level) != 0)
+    {
+        fprintf(stderr,"Error starting log writer\n");
+        exit(1);
+    }
+    atexit(sr_log_shutdown);
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.ecmp_weighted = weighted;
+
+    if(aggregate && sr_vrf_aggregate(&sr) != 0)
+    {
+        fprintf(stderr,"Error allocating fib aggregation\n");
+        exit(1);
+    }
+
+    if(flight_entries > 0)
+    {
+        sr.flight = sr_flight_create(&sr, flight_entries);
+        if(!sr.flight)
+        {
+            fprintf(stderr,"Error allocating flight recorder\n");
+            exit(1);
+        }
+    }
+
+    if(pthread_create(&signal_tid, 0, sr_signal_thread, &sr) != 0)
+    {
+        fprintf(stderr,"Error starting signal thread\n");
+        exit(1);
+    }
+    pthread_detach(signal_tid);
+
+    if(stats_path && sr_stats_listen(&sr, stats_path) != 0)
+    {
+        fprintf(stderr,"Error opening stats socket %s\n", stats_path);
+        exit(1);
+    }
 
+    /* -- a replayed session brings its own routing table -- */
+    if(replay)
+    {
+        sr.replay = sr_replay_open(&sr, replay);
+        if(!sr.replay || sr_replay_load_rt(sr.replay, &sr) != 0)
+        {
+            fprintf(stderr,"Error loading session log %s\n", replay);
+            exit(1);
+        }
+        sr.template[0] = '\0';
+        printf("Replaying %s with routing table\n", replay);
+        sr_print_routing_table(sr.vrfs[0]);
+    }
     /* -- set up routing table from file -- */
-    if(template == NULL) {
+    else if(template == NULL) {
         sr.template[0] = '\0';
-        sr_load_rt_wrap(&sr, rtable);
+        if(fib_image)
+        { sr_map_fib_wrap(&sr, fib_image); }
+        else
+        { sr_load_rt_wrap(&sr, rtable, mrt_rules); }
     }
     else
         strncpy(sr.template, template, 30);
 
+    /* -- the other routing tables, bound before HWINFO adds the
+     *    interfaces -- */
+    if(vrf_file)
+    { sr_load_vrf_wrap(&sr, vrf_file); }
+
     sr.topo_id = topo;
     strncpy(sr.host,host,32);
 
@@ -123,11 +290,12 @@ int main(int argc, char **argv)
     else
     { strncpy(sr.user, user, 32); }
 
-    /* -- set up file pointer for logging of raw packets -- */
+    /* -- set up the capture writer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        capture_cfg.path = logfile;
+        sr.capture = sr_capture_open(&sr, &capture_cfg);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -135,30 +303,58 @@ int main(int argc, char **argv)
         }
     }
 
-    Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
-    if(template)
-        Debug("Requesting topology template %s\n", template);
-    else
-        Debug("Requesting topology %d\n", topo);
-
-    /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    if(record && !replay)
     {
-        return 1;
+        sr.replay = sr_record_open(&sr, record);
+        if(!sr.replay)
+        {
+            fprintf(stderr,"Error opening session log %s\n", record);
+            exit(1);
+        }
     }
 
-    if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
-        Debug("Connected to new instantiation of topology template %s\n", template);
-        sr_load_rt_wrap(&sr, "rtable.vrhost");
-    }
-    else {
-      /* Read from specified routing table */
-      sr_load_rt_wrap(&sr, rtable);
+    if(!replay)
+    {
+        Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
+        if(template)
+            Debug("Requesting topology template %s\n", template);
+        else
+            Debug("Requesting topology %d\n", topo);
+
+        /* connect to server and negotiate session */
+        if(sr_connect_to_server(&sr,port,server) == -1)
+        {
+            return 1;
+        }
+
+        if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
+            Debug("Connected to new instantiation of topology template %s\n", template);
+            sr_load_rt_wrap(&sr, "rtable.vrhost", 0);
+        }
+        else if(fib_image == NULL || template != NULL) {
+          /* Read from specified routing table */
+          sr_load_rt_wrap(&sr, rtable, mrt_rules);
+        }
+
+        if(sr.replay)
+        { sr_record_rtable(sr.replay, &sr); }
     }
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    /* -- publish counters for sr_stat -- */
+    sr.shm = sr_shm_open(&sr, sr.host);
+    if(!sr.shm)
+    { fprintf(stderr,"Warning: not publishing statistics to /dev/shm\n"); }
+
+    /* -- take route and neighbor changes once the table is loaded -- */
+    if(ctl_path && sr_ctl_listen(&sr, ctl_path) != 0)
+    {
+        fprintf(stderr,"Error opening control socket %s\n", ctl_path);
+        exit(1);
+    }
+
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
@@ -178,7 +374,19 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-f fib image from sr_fibc, instead of -r] \n");
+    printf("           [-m next hop rules, -r is an MRT RIB dump] \n");
+    printf("           [-V more routing tables and their interfaces (VRFs)] \n");
+    printf("           [-A aggregate the fib] \n");
+    printf("           [-W weigh multipath routes by interface speed] \n");
+    printf("           [-l log file] [-F pcap|pcapng] \n");
+    printf("           [-C rotate log file every n MB] [-G rotate every n sec] \n");
+    printf("           [-L log level (0 error .. 3 debug)] \n");
+    printf("           [-R packets kept by the flight recorder, 0 for none] \n");
+    printf("           [-S unix socket to serve counters on] \n");
+    printf("           [-c unix socket to take route and neighbor changes on] \n");
+    printf("           [-w record the session to file] [-P replay a recorded session] \n");
+    printf("           [-H put packet and route pools on huge pages] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -220,9 +428,24 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    if(sr->capture)
     {
-        sr_dump_close(sr->logfile);
+        sr_capture_close(sr->capture);
+        sr->capture = 0;
+    }
+
+    if(sr->shm)
+    {
+        sr_shm_close(sr->shm);
+        sr->shm = 0;
+    }
+
+    if(sr->replay)
+    {
+        struct sr_replay* replay = sr->replay;
+
+        sr->replay = 0;
+        sr_replay_close(replay);
     }
 
     /*
@@ -247,17 +470,135 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
-    sr->routing_table = 0;
-    sr->logfile = 0;
+    if(sr_rt_init(sr) != 0)
+    {
+        fprintf(stderr,"Error allocating routing table\n");
+        exit(1);
+    }
+    sr->capture = 0;
+    sr->flight = 0;
+    sr->shm = 0;
+    sr->replay = 0;
 } /* -- sr_init_instance -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_reload_rt(..)
+ * Scope: Local
+ *
+ * Read the routing table again from where it was last loaded: the rtable
+ * file, rtable.vrhost for a template, the MRT dump with -m, or the fib
+ * image with -f, and the tables of -V from theirs.  The router keeps
+ * forwarding; sr_rt_set_table changes only the routes that differ and
+ * logs what it did, and a new image is published with a single store.
+ * A file that does not load leaves the table as it is.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void sr_reload_rt(struct sr_instance* sr)
+{
+    struct sr_fib* fib;
+    struct timespec t0, t1;
+    unsigned int n;
+
+    if(reload_image)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if((fib = sr_fib_map(reload_image)) == 0)
+        {
+            sr_log_err("rt: cannot map fib image %s, keeping the table\n",
+                       reload_image);
+            return;
+        }
+        pthread_mutex_lock(&(sr->rt_lock));
+        n = fib->nroutes;
+        sr_fib_publish(sr->vrfs[0], fib);
+        pthread_mutex_unlock(&(sr->rt_lock));
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        sr_log_info("rt: reloaded fib image %s, %u routes in %.3f ms\n",
+                    reload_image, n, (t1.tv_sec - t0.tv_sec) * 1e3 +
+                    (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    }
+    else if(reload_rtable)
+    {
+        sr_log_info("rt: reloading %s\n", reload_rtable);
+        if((reload_rules ? sr_load_mrt(sr->vrfs[0], reload_rtable, reload_rules)
+                         : sr_load_rt(sr->vrfs[0], reload_rtable)) != 0)
+        { sr_log_err("rt: cannot load %s, keeping the table\n", reload_rtable); }
+    }
+    else
+    { sr_log_warn("rt: no routing table to reload\n"); }
+
+    sr_vrf_reload(sr);
+} /* -- sr_reload_rt -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_block_signals(..)
+ * Scope: Local
+ *
+ * Block the signals handled by sr_signal_thread in the calling thread and
+ * return them in 'set'.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void sr_block_signals(sigset_t* set)
+{
+    sigemptyset(set);
+    sigaddset(set, SIGUSR1);
+    sigaddset(set, SIGUSR2);
+    sigaddset(set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, set, 0);
+} /* -- sr_block_signals -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_signal_thread(..)
+ * Scope: Local
+ *
+ * Wait for signals and act on them outside of signal context:
+ *
+ *   SIGUSR1   print the packet and drop counters
+ *   SIGUSR2   dump the flight recorder to flight.<pid>.<n>.pcapng
+ *   SIGHUP    reload the routing tables, see sr_reload_rt
+ *
+ *----------------------------------------------------------------------------*/
+
+static void* sr_signal_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    sigset_t set;
+    int sig;
+
+    sr_block_signals(&set);
+
+    for(;;)
+    {
+        if(sigwait(&set, &sig) != 0)
+        { continue; }
+
+        switch(sig)
+        {
+            case SIGUSR1:
+                sr_stats_print(sr, stdout);
+                break;
+            case SIGUSR2:
+                if(sr->flight)
+                { sr_flight_dump(sr->flight, 0); }
+                break;
+            case SIGHUP:
+                sr_reload_rt(sr);
+                break;
+        }
+    }
+
+    return 0;
+} /* -- sr_signal_thread -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_verify_routing_table()
  * Scope: Global
  *
- * make sure the routing table is consistent with the interface list by
- * verifying that all interfaces used in the routing table actually exist
- * in the hardware.
+ * make sure the routing tables are consistent with the interface list by
+ * verifying that all interfaces used in each table actually exist in the
+ * hardware and are bound to that table.
  *
  * RETURN VALUES:
  *
@@ -270,48 +611,137 @@ int sr_verify_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
     struct sr_if* if_walker = 0;
-    int ret = 0;
+    struct sr_if* last = 0;
+    struct sr_vrf* vrf;
+    unsigned int id;
+    int ret = 0, empty = 1;
 
     /* -- REQUIRES --*/
     assert(sr);
 
-    if( (sr->if_list == 0) || (sr->routing_table == 0))
+    for(id = 0; id < SR_VRF_MAX; id++)
     {
-        return 999; /* doh! */
-    }
+        if((vrf = sr->vrfs[id]) == 0)
+        { continue; }
 
-    rt_walker = sr->routing_table;
-
-    while(rt_walker)
-    {
-        /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
+        for(rt_walker = sr_rt_first(vrf), last = 0; rt_walker;
+            rt_walker = sr_rt_next(vrf, rt_walker))
         {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
+            empty = 0;
+
+            /* -- routes come in runs through the same interface, so try
+             *    the one the previous route used before walking the
+             *    list -- */
+            if( last &&
+                strncmp(last->name,rt_walker->interface,sr_IFACE_NAMELEN) == 0)
+            { continue; }
+
+            /* -- check to see if interface exists -- */
+            if_walker = sr->if_list;
+            while(if_walker)
+            {
+                if( strncmp(if_walker->name,rt_walker->interface,
+                            sr_IFACE_NAMELEN) == 0)
+                { break; }
+                if_walker = if_walker->next;
+            }
+            if(if_walker == 0)
+            { ret++; } /* -- interface not found! -- */
+            else if(if_walker->vrf != id)
+            {
+                sr_log_err("rt: table %u routes through %s of table %u\n",
+                           id, if_walker->name, if_walker->vrf);
+                ret++;
+            }
+            else
+            { last = if_walker; }
         }
-        if(if_walker == 0)
-        { ret++; } /* -- interface not found! -- */
+    }
 
-        rt_walker = rt_walker->next;
-    } /* -- while -- */
+    if( (sr->if_list == 0) || empty)
+    {
+        return 999; /* doh! */
+    }
 
     return ret;
 } /* -- sr_verify_routing_table -- */
 
-static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
-    if(sr_load_rt(sr, rtable) != 0) {
+static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable,
+                            char* mrt_rules) {
+    if((mrt_rules ? sr_load_mrt(sr->vrfs[0], rtable, mrt_rules)
+                  : sr_load_rt(sr->vrfs[0], rtable)) != 0) {
         fprintf(stderr,"Error setting up routing table from file %s\n",
                 rtable);
         exit(1);
     }
+    reload_rtable = rtable;
+    reload_rules = mrt_rules;
+    reload_image = 0;
 
 
     printf("Loading routing table\n");
     printf("---------------------------------------------\n");
-    sr_print_routing_table(sr);
+    sr_print_routing_table(sr->vrfs[0]);
     printf("---------------------------------------------\n");
 }
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_map_fib_wrap(..)
+ * Scope: local
+ *
+ * Use a fib image compiled by sr_fibc as the routing table.  It is mapped
+ * where it lies, so this takes the same time whatever the size of the
+ * table, and routers started from the same image share its pages.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_map_fib_wrap(struct sr_instance* sr, char* image)
+{
+    struct sr_fib* fib;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sr_clear_rt(sr->vrfs[0]);
+    if((fib = sr_fib_map(image)) == 0) {
+        fprintf(stderr,"Error mapping fib image %s\n", image);
+        exit(1);
+    }
+    sr_fib_publish(sr->vrfs[0], fib);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    reload_image = image;
+
+    printf("Mapped fib image %s, %u routes in %.3f ms\n", image,
+           sr->vrfs[0]->fib->nroutes, (t1.tv_sec - t0.tv_sec) * 1e3 +
+           (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    printf("---------------------------------------------\n");
+    sr_print_routing_table(sr->vrfs[0]);
+    printf("---------------------------------------------\n");
+} /* -- sr_map_fib_wrap -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_load_vrf_wrap(..)
+ * Scope: local
+ *
+ * Make the routing tables the -V file lists, see sr_vrf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_load_vrf_wrap(struct sr_instance* sr, char* vrf_file)
+{
+    unsigned int id;
+
+    if(sr_vrf_load(sr, vrf_file) != 0) {
+        fprintf(stderr,"Error setting up routing tables from file %s\n",
+                vrf_file);
+        exit(1);
+    }
+
+    for(id = 1; id < SR_VRF_MAX; id++) {
+        if(sr->vrfs[id] == 0)
+        { continue; }
+        printf("Loading routing table %u from %s\n", id, sr->vrfs[id]->rtable);
+        printf("---------------------------------------------\n");
+        sr_print_routing_table(sr->vrfs[id]);
+        printf("---------------------------------------------\n");
+    }
+} /* -- sr_load_vrf_wrap -- */
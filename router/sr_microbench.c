@@ -0,0 +1,699 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_microbench.c
+ *
+ * Description:
+ *
+ * Microbenchmarks for the primitives on the forwarding path, one at a
+ * time and without any packets:
+ *
+ *   lpm.<n>                 rt_entry_lpm on a synthetic table of n prefixes,
+ *                           through the fib built over it
+ *   lpm.<n>_update          the same, in a read section per lookup as the
+ *                           forwarding path does, while another thread
+ *                           changes routes as fast as it can
+ *   lpm.<n>_cold            sr_fib_lookup and a read of the route, over
+ *                           far more addresses than the caches hold
+ *   lpm.<n>_burst           the same through sr_fib_lookup_burst,
+ *                           SR_FIB_BURST addresses at a time
+ *   rt_update.<n>           sr_rt_del or sr_rt_add of a prefix of the table,
+ *                           withdrawing and announcing it in turn
+ *   arp_lookup_hit.<pct>    sr_arpcache_get of a cached address, with the
+ *   arp_lookup_miss.<pct>   cache pct percent full
+ *   arp_insert.<pct>        sr_arpcache_insert refreshing a cached address
+ *   <any arp case>_sweep    the same, while another thread sweeps the cache
+ *                           as fast as it can take the lock
+ *   cksum.<len>             cksum over len bytes
+ *
+ * The synthetic tables follow the prefix length mix of a full Internet
+ * table, mostly /24s with a default route, and are built from a fixed
+ * seed so every run measures the same thing.
+ *
+ * Each case is timed -k times over at least -T milliseconds after a
+ * warm up, and printed as one tab separated line
+ *
+ *   <case> <median ns/op> <min ns/op> <max ns/op> <ops per run>
+ *
+ * so the output of a run can be saved and passed back with -b.  With a
+ * baseline every case whose median is more than -t percent slower than
+ * the baseline is reported on stderr and the exit status is 2.
+ *
+ *   sr_microbench [-f filter] [-m max prefixes] [-k runs] [-T ms]
+ *                 [-b baseline] [-t percent]
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_rcu.h"
+#include "sr_pool.h"
+#include "sr_arpcache.h"
+#include "sr_utils.h"
+
+#define SR_MB_SEED 0x5eed5eed5eed5eedULL
+#define SR_MB_ADDRS 4096            /* lookup addresses, power of two */
+#define SR_MB_COLD_ADDRS (1 << 20)  /* lookup addresses of the _cold cases */
+#define SR_MB_UPDATES 4096          /* prefixes withdrawn and announced */
+#define SR_MB_HIT_PCT 90            /* lookups that fall in a random prefix */
+#define SR_MB_MAX_BASE 256          /* cases read from a baseline */
+#define SR_MB_NAMELEN 48
+
+/* prefix lengths of a full table, in entries per thousand */
+static const struct { int len; int per_mille; } sr_mb_mix[] =
+{
+    {  8,   1 }, {  9,   1 }, { 10,   2 }, { 11,   4 }, { 12,   8 },
+    { 13,  12 }, { 14,  18 }, { 15,  20 }, { 16,  30 }, { 17,  15 },
+    { 18,  25 }, { 19,  35 }, { 20,  45 }, { 21,  50 }, { 22,  80 },
+    { 23,  70 }, { 24, 560 }, { 25,   2 }, { 26,   2 }, { 27,   2 },
+    { 28,   2 }, { 29,   3 }, { 30,   3 }, { 32,  10 }
+};
+
+static const unsigned long sr_mb_sizes[] =
+{ 10, 100, 1000, 10000, 100000, 1000000 };
+
+static const int sr_mb_occupancy[] = { 10, 50, 90, 100 };
+
+static const int sr_mb_lengths[] = { 20, 64, 576, 1500 };
+
+struct sr_mb_base
+{
+    char name[SR_MB_NAMELEN];
+    double ns;
+};
+
+static const char* filter = 0;
+static int runs = 5;
+static int min_ms = 50;
+static double threshold = 10.0;
+static struct sr_mb_base base[SR_MB_MAX_BASE];
+static int nbase = 0;
+static int regressions = 0;
+
+static volatile unsigned long sink;
+static uint64_t rng = SR_MB_SEED;
+
+static void usage(char* argv0);
+
+/* sr_router.o needs one to link, nothing here sends */
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{ return 0; }
+
+static uint32_t sr_mb_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+} /* -- sr_mb_rand -- */
+
+static double sr_mb_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- sr_mb_now -- */
+
+static int sr_mb_cmp(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+} /* -- sr_mb_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mb_measure(..)
+ * Scope:  Local
+ *
+ * Time fn, which does its operation iters times, and print a line for
+ * it.  The number of operations per run is doubled until a run takes
+ * min_ms, which also serves as the warm up.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_mb_measure(const char* name,
+                          void (*fn)(void* arg, unsigned long iters),
+                          void* arg)
+{
+    double ns[64], t0, t;
+    unsigned long iters = 1;
+    int i;
+
+    if(filter && strstr(name, filter) == 0)
+    { return; }
+
+    for(;;)
+    {
+        t0 = sr_mb_now();
+        fn(arg, iters);
+        t = sr_mb_now() - t0;
+        if(t * 1000 >= min_ms)
+        { break; }
+        iters *= t * 1000 < min_ms / 8.0 ? 8 : 2;
+    }
+
+    for(i = 0; i < runs; i++)
+    {
+        t0 = sr_mb_now();
+        fn(arg, iters);
+        ns[i] = (sr_mb_now() - t0) * 1e9 / iters;
+    }
+    qsort(ns, runs, sizeof(double), sr_mb_cmp);
+
+    printf("%s\t%.2f\t%.2f\t%.2f\t%lu\n", name, ns[runs / 2], ns[0],
+            ns[runs - 1], iters);
+    fflush(stdout);
+
+    for(i = 0; i < nbase; i++)
+    {
+        if(strcmp(base[i].name, name) == 0 &&
+           ns[runs / 2] > base[i].ns * (1 + threshold / 100))
+        {
+            fprintf(stderr, "regression: %s %.2f ns/op, baseline %.2f (+%.1f%%)\n",
+                    name, ns[runs / 2], base[i].ns,
+                    (ns[runs / 2] / base[i].ns - 1) * 100);
+            regressions++;
+        }
+    }
+} /* -- sr_mb_measure -- */
+
+static int sr_mb_read_base(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    char line[256];
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    while(nbase < SR_MB_MAX_BASE && fgets(line, sizeof(line), fp))
+    {
+        if(line[0] == '#')
+        { continue; }
+        if(sscanf(line, "%47s %lf", base[nbase].name, &(base[nbase].ns)) == 2)
+        { nbase++; }
+    }
+    fclose(fp);
+    return 0;
+} /* -- sr_mb_read_base -- */
+
+/*---------------------------------------------------------------------
+ * Longest prefix match
+ *---------------------------------------------------------------------*/
+
+struct sr_mb_update
+{
+    struct in_addr dest, gw, mask;
+    char iface[sr_IFACE_NAMELEN];
+    int present;
+};
+
+struct sr_mb_lpm
+{
+    struct sr_vrf* vrf;
+    uint32_t addrs[SR_MB_ADDRS];
+    uint32_t* cold;             /* SR_MB_COLD_ADDRS, host byte order */
+    struct sr_mb_update updates[SR_MB_UPDATES];
+    unsigned int nupdates, next;
+    volatile int updating;
+};
+
+static void sr_mb_lpm_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+    unsigned long i, hits = 0;
+
+    for(i = 0; i < iters; i++)
+    { hits += rt_entry_lpm(b->vrf, b->addrs[i & (SR_MB_ADDRS - 1)]) != 0; }
+    sink = hits;
+} /* -- sr_mb_lpm_run -- */
+
+static void sr_mb_lpm_locked_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+    unsigned long i, hits = 0;
+
+    for(i = 0; i < iters; i++)
+    {
+        sr_rcu_read_lock();
+        hits += rt_entry_lpm(b->vrf, b->addrs[i & (SR_MB_ADDRS - 1)]) != 0;
+        sr_rcu_read_unlock();
+    }
+    sink = hits;
+} /* -- sr_mb_lpm_locked_run -- */
+
+static void sr_mb_lpm_cold_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+    const struct sr_fib* fib = b->vrf->fib;
+    struct sr_rt* rt;
+    unsigned long i, sum = 0;
+
+    for(i = 0; i < iters; i++)
+    {
+        if((rt = sr_fib_lookup(fib, b->cold[i & (SR_MB_COLD_ADDRS - 1)])))
+        { sum += rt->gw.s_addr; }
+    }
+    sink = sum;
+} /* -- sr_mb_lpm_cold_run -- */
+
+static void sr_mb_lpm_burst_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+    const struct sr_fib* fib = b->vrf->fib;
+    struct sr_rt* rts[SR_FIB_BURST];
+    unsigned long i, sum = 0;
+    unsigned int j, m;
+
+    for(i = 0; i < iters; i += m)
+    {
+        m = iters - i < SR_FIB_BURST ? iters - i : SR_FIB_BURST;
+        sr_fib_lookup_burst(fib, b->cold + (i & (SR_MB_COLD_ADDRS - 1)), m, rts);
+        for(j = 0; j < m; j++)
+        {
+            if(rts[j])
+            { sum += rts[j]->gw.s_addr; }
+        }
+    }
+    sink = sum;
+} /* -- sr_mb_lpm_burst_run -- */
+
+static void sr_mb_rt_update_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+    struct sr_mb_update* u;
+    unsigned long i, errs = 0;
+
+    pthread_mutex_lock(&(b->vrf->sr->rt_lock));
+    for(i = 0; i < iters; i++)
+    {
+        u = &(b->updates[b->next]);
+        b->next = (b->next + 1) % b->nupdates;
+        if(u->present)
+        { errs += sr_rt_del(b->vrf, u->dest, u->mask) != 0; }
+        else
+        { errs += sr_rt_add(b->vrf, u->dest, u->gw, u->mask, u->iface) != 0; }
+        u->present = !u->present;
+    }
+    pthread_mutex_unlock(&(b->vrf->sr->rt_lock));
+    sink = errs;
+} /* -- sr_mb_rt_update_run -- */
+
+/* what a routing daemon feeding sr_rt_add and sr_rt_del would do */
+static void* sr_mb_updater(void* arg)
+{
+    struct sr_mb_lpm* b = (struct sr_mb_lpm*)arg;
+
+    while(b->updating)
+    { sr_mb_rt_update_run(b, 64); }
+    return 0;
+} /* -- sr_mb_updater -- */
+
+static int sr_mb_prefix_len(void)
+{
+    int r = sr_mb_rand() % 1000, i;
+
+    for(i = 0; r >= sr_mb_mix[i].per_mille; i++)
+    { r -= sr_mb_mix[i].per_mille; }
+    return sr_mb_mix[i].len;
+} /* -- sr_mb_prefix_len -- */
+
+/* n prefixes, the first a default route, built in one pass as a file
+ * is loaded rather than a route at a time */
+static void sr_mb_lpm_table(struct sr_vrf* vrf, unsigned long n)
+{
+    struct sr_rt* rt, *head = 0, *tail = 0;
+    unsigned long i;
+    uint32_t mask;
+    int len;
+
+    for(i = 0; i < n; i++)
+    {
+        len  = i == 0 ? 0 : sr_mb_prefix_len();
+        mask = len ? 0xffffffff << (32 - len) : 0;
+
+        rt = SR_POOL_GET(&(vrf->sr->rt_pool), struct sr_rt);
+        assert(rt);
+        rt->dest.s_addr = htonl(sr_mb_rand() & mask);
+        rt->mask.s_addr = htonl(mask);
+        rt->gw.s_addr   = htonl(0x0a000000 | (i & 0xffffff));
+        snprintf(rt->interface, sr_IFACE_NAMELEN, "eth%lu", i & 3);
+        rt->group = 0;
+        rt->next = 0;
+
+        if(tail)
+        { tail->next = rt; }
+        else
+        { head = rt; }
+        tail = rt;
+    }
+
+    sr_rt_set_table(vrf, head);
+} /* -- sr_mb_lpm_table -- */
+
+/* the prefixes rt_update withdraws and announces, spread over the table */
+static void sr_mb_lpm_updates(struct sr_mb_lpm* b, struct sr_rt** rts,
+                              unsigned long n)
+{
+    struct sr_mb_update* u;
+    unsigned int i;
+
+    b->nupdates = n < SR_MB_UPDATES ? n : SR_MB_UPDATES;
+    b->next = 0;
+    for(i = 0; i < b->nupdates; i++)
+    {
+        u = &(b->updates[i]);
+        u->dest = rts[i * n / b->nupdates]->dest;
+        u->gw = rts[i * n / b->nupdates]->gw;
+        u->mask = rts[i * n / b->nupdates]->mask;
+        strncpy(u->iface, rts[i * n / b->nupdates]->interface, sr_IFACE_NAMELEN);
+        u->present = 1;
+    }
+} /* -- sr_mb_lpm_updates -- */
+
+static void sr_mb_lpm_update_case(struct sr_mb_lpm* b, const char* name)
+{
+    pthread_t tid;
+
+    if(filter && strstr(name, filter) == 0)
+    { return; }
+
+    b->updating = 1;
+    if(pthread_create(&tid, 0, sr_mb_updater, b) != 0)
+    {
+        perror("pthread_create");
+        return;
+    }
+    sr_mb_measure(name, sr_mb_lpm_locked_run, b);
+    b->updating = 0;
+    pthread_join(tid, 0);
+} /* -- sr_mb_lpm_update_case -- */
+
+static void sr_mb_lpm(struct sr_vrf* vrf, unsigned long max)
+{
+    static struct sr_mb_lpm b;
+    struct sr_rt** rts;
+    struct sr_rt* rt;
+    char name[SR_MB_NAMELEN], update[SR_MB_NAMELEN], locked[SR_MB_NAMELEN];
+    char cold[SR_MB_NAMELEN], burst[SR_MB_NAMELEN];
+    unsigned long n, nrts;
+    unsigned int i, s;
+
+    b.cold = (uint32_t*)malloc(SR_MB_COLD_ADDRS * sizeof(uint32_t));
+    assert(b.cold);
+
+    for(s = 0; s < sizeof(sr_mb_sizes) / sizeof(sr_mb_sizes[0]); s++)
+    {
+        n = sr_mb_sizes[s];
+        if(n > max)
+        { break; }
+        snprintf(name, sizeof(name), "lpm.%lu", n);
+        snprintf(locked, sizeof(locked), "lpm.%lu_update", n);
+        snprintf(update, sizeof(update), "rt_update.%lu", n);
+        snprintf(cold, sizeof(cold), "lpm.%lu_cold", n);
+        snprintf(burst, sizeof(burst), "lpm.%lu_burst", n);
+        if(filter && strstr(name, filter) == 0 &&
+           strstr(locked, filter) == 0 && strstr(update, filter) == 0 &&
+           strstr(cold, filter) == 0 && strstr(burst, filter) == 0)
+        { continue; }
+
+        rng = SR_MB_SEED + n;
+        sr_mb_lpm_table(vrf, n);
+
+        rts = (struct sr_rt**)malloc(n * sizeof(struct sr_rt*));
+        assert(rts);
+        /* -- duplicate prefixes merge into one route, fewer than n -- */
+        for(i = 0, rt = vrf->routing_table; rt; rt = rt->next)
+        { rts[i++] = rt; }
+        nrts = i;
+        for(i = 0; i < SR_MB_ADDRS; i++)
+        {
+            rt = rts[sr_mb_rand() % nrts];
+            b.addrs[i] = sr_mb_rand() % 100 < SR_MB_HIT_PCT ?
+                ((rt->dest.s_addr & rt->mask.s_addr) |
+                 (htonl(sr_mb_rand()) & ~rt->mask.s_addr)) :
+                htonl(sr_mb_rand());
+        }
+        for(i = 0; i < SR_MB_COLD_ADDRS; i++)
+        {
+            rt = rts[sr_mb_rand() % nrts];
+            b.cold[i] = sr_mb_rand() % 100 < SR_MB_HIT_PCT ?
+                ntohl((rt->dest.s_addr & rt->mask.s_addr) |
+                      (htonl(sr_mb_rand()) & ~rt->mask.s_addr)) :
+                sr_mb_rand();
+        }
+        sr_mb_lpm_updates(&b, rts, nrts);
+        free(rts);
+
+        b.vrf = vrf;
+        sr_mb_measure(name, sr_mb_lpm_run, &b);
+        if(vrf->fib)
+        {
+            sr_mb_measure(cold, sr_mb_lpm_cold_run, &b);
+            sr_mb_measure(burst, sr_mb_lpm_burst_run, &b);
+        }
+        /* -- the first change builds the route index, outside the timing -- */
+        sr_mb_rt_update_run(&b, 2);
+        sr_mb_measure(update, sr_mb_rt_update_run, &b);
+        sr_mb_lpm_update_case(&b, locked);
+        sr_clear_rt(vrf);
+    }
+    free(b.cold);
+} /* -- sr_mb_lpm -- */
+
+/*---------------------------------------------------------------------
+ * ARP cache
+ *---------------------------------------------------------------------*/
+
+struct sr_mb_arp
+{
+    struct sr_vrf* vrf;
+    uint32_t ips[SR_ARPCACHE_SZ];
+    int nips;
+    volatile int sweeping;
+};
+
+static void sr_mb_arp_lookup_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_arp* b = (struct sr_mb_arp*)arg;
+    struct sr_arpentry e;
+    unsigned long i, hits = 0;
+
+    for(i = 0; i < iters; i++)
+    { hits += sr_arpcache_get(&(b->vrf->cache), b->ips[i % b->nips], &e); }
+    sink = hits;
+} /* -- sr_mb_arp_lookup_run -- */
+
+static void sr_mb_arp_insert_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_arp* b = (struct sr_mb_arp*)arg;
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+    unsigned long i;
+
+    for(i = 0; i < iters; i++)
+    { sr_arpcache_insert(&(b->vrf->cache), mac, b->ips[i % b->nips]); }
+} /* -- sr_mb_arp_insert_run -- */
+
+/* what sr_arpcache_timeout does once a second, without the second */
+static void* sr_mb_arp_sweeper(void* arg)
+{
+    struct sr_mb_arp* b = (struct sr_mb_arp*)arg;
+    struct sr_arpcache* cache = &(b->vrf->cache);
+    time_t now;
+    int i;
+
+    while(b->sweeping)
+    {
+        pthread_mutex_lock(&(cache->lock));
+        now = time(0);
+        for(i = 0; i < SR_ARPCACHE_SZ; i++)
+        {
+            if(cache->entries[i].valid && !cache->entries[i].permanent &&
+               difftime(now, cache->entries[i].added) > SR_ARPCACHE_TO)
+            { cache->entries[i].valid = 0; }
+        }
+        sr_arpcache_sweepreqs(b->vrf->sr, b->vrf);
+        pthread_mutex_unlock(&(cache->lock));
+    }
+    return 0;
+} /* -- sr_mb_arp_sweeper -- */
+
+static void sr_mb_arp_case(struct sr_mb_arp* b, const char* what, int pct,
+                           int sweep, void (*fn)(void*, unsigned long))
+{
+    char name[SR_MB_NAMELEN];
+    pthread_t tid;
+
+    snprintf(name, sizeof(name), "arp_%s.%d%s", what, pct, sweep ? "_sweep" : "");
+    if(filter && strstr(name, filter) == 0)
+    { return; }
+
+    if(sweep)
+    {
+        b->sweeping = 1;
+        if(pthread_create(&tid, 0, sr_mb_arp_sweeper, b) != 0)
+        {
+            perror("pthread_create");
+            return;
+        }
+    }
+    sr_mb_measure(name, fn, b);
+    if(sweep)
+    {
+        b->sweeping = 0;
+        pthread_join(tid, 0);
+    }
+} /* -- sr_mb_arp_case -- */
+
+static void sr_mb_arp(struct sr_vrf* vrf)
+{
+    static struct sr_mb_arp b;
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 0 };
+    unsigned int o;
+    int i, n, sweep;
+
+    b.vrf = vrf;
+    for(o = 0; o < sizeof(sr_mb_occupancy) / sizeof(int); o++)
+    {
+        n = SR_ARPCACHE_SZ * sr_mb_occupancy[o] / 100;
+
+        memset(vrf->cache.entries, 0, sizeof(vrf->cache.entries));
+        for(i = 0; i < n; i++)
+        {
+            b.ips[i] = htonl(0x0a000000 | i);
+            mac[5] = i;
+            sr_arpcache_insert(&(vrf->cache), mac, b.ips[i]);
+        }
+
+        for(sweep = 0; sweep < 2; sweep++)
+        {
+            b.nips = n;
+            sr_mb_arp_case(&b, "lookup_hit", sr_mb_occupancy[o], sweep,
+                           sr_mb_arp_lookup_run);
+            sr_mb_arp_case(&b, "insert", sr_mb_occupancy[o], sweep,
+                           sr_mb_arp_insert_run);
+
+            /* addresses that are not cached */
+            for(i = 0; i < SR_ARPCACHE_SZ; i++)
+            { b.ips[i] ^= htonl(0x00800000); }
+            b.nips = SR_ARPCACHE_SZ;
+            sr_mb_arp_case(&b, "lookup_miss", sr_mb_occupancy[o], sweep,
+                           sr_mb_arp_lookup_run);
+            for(i = 0; i < SR_ARPCACHE_SZ; i++)
+            { b.ips[i] ^= htonl(0x00800000); }
+        }
+    }
+} /* -- sr_mb_arp -- */
+
+/*---------------------------------------------------------------------
+ * Checksum
+ *---------------------------------------------------------------------*/
+
+struct sr_mb_cksum
+{
+    uint8_t data[2048];
+    int len;
+};
+
+static void sr_mb_cksum_run(void* arg, unsigned long iters)
+{
+    struct sr_mb_cksum* b = (struct sr_mb_cksum*)arg;
+    unsigned long i, sum = 0;
+
+    for(i = 0; i < iters; i++)
+    { sum += cksum(b->data, b->len); }
+    sink = sum;
+} /* -- sr_mb_cksum_run -- */
+
+static void sr_mb_cksum(void)
+{
+    static struct sr_mb_cksum b;
+    char name[SR_MB_NAMELEN];
+    unsigned int i;
+
+    for(i = 0; i < sizeof(b.data); i++)
+    { b.data[i] = sr_mb_rand(); }
+
+    for(i = 0; i < sizeof(sr_mb_lengths) / sizeof(int); i++)
+    {
+        b.len = sr_mb_lengths[i];
+        snprintf(name, sizeof(name), "cksum.%d", b.len);
+        sr_mb_measure(name, sr_mb_cksum_run, &b);
+    }
+} /* -- sr_mb_cksum -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_instance sr;
+    unsigned long max = 1000000;
+    int c;
+
+    while((c = getopt(argc, argv, "hf:m:k:T:b:t:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'f':
+                filter = optarg;
+                break;
+            case 'm':
+                max = strtoul(optarg, 0, 10);
+                break;
+            case 'k':
+                runs = atoi(optarg);
+                break;
+            case 'T':
+                min_ms = atoi(optarg);
+                break;
+            case 'b':
+                if(sr_mb_read_base(optarg) != 0)
+                { exit(1); }
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(runs < 1 || runs > 64 || min_ms < 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    if(sr_rt_init(&sr) != 0)
+    {
+        fprintf(stderr, "sr_microbench: out of memory\n");
+        exit(1);
+    }
+
+    printf("# case\tmedian_ns\tmin_ns\tmax_ns\tops\n");
+    sr_mb_lpm(sr.vrfs[0], max);
+    sr_mb_arp(sr.vrfs[0]);
+    sr_mb_cksum();
+
+    sr_arpcache_destroy(&(sr.vrfs[0]->cache));
+    sr_rcu_synchronize();
+    return regressions ? 2 : 0;
+} /* -- main -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-f case filter] [-m max prefixes] [-k runs] \n", argv0);
+    printf("           [-T min ms per run] [-b baseline] [-t percent] \n");
+    printf("   defaults max=1000000 runs=5 ms=50 percent=10 \n");
+} /* -- usage -- */
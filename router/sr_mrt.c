@@ -0,0 +1,475 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mrt.c
+ *
+ * Description:
+ *
+ * Routing tables from MRT RIB dumps, see sr_mrt.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_mrt.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_alloc.h"
+
+struct sr_mrt_rule
+{
+    uint32_t prefix;            /* host byte order */
+    uint32_t mask;
+    struct in_addr gw;          /* 0 for the next hop itself */
+    char iface[sr_IFACE_NAMELEN];
+};
+
+struct sr_mrt_rules
+{
+    struct sr_mrt_rule rule[SR_MRT_MAX_RULES];   /* longest mask first */
+    int n;
+    int use_peer;
+    struct in_addr peer;
+    int peer_index;             /* of peer in the dump, -1 until seen */
+    const struct sr_mrt_rule* last;   /* for runs of the same next hop */
+    uint32_t last_nh;
+};
+
+struct sr_mrt_counts
+{
+    unsigned long records;
+    unsigned long skipped;      /* records of other types */
+    unsigned long prefixes;
+    unsigned long no_entry;     /* no usable entry for the prefix */
+    unsigned long no_rule;      /* next hop covered by no rule */
+};
+
+/* -- big endian fields, after the caller has checked the length -- */
+
+static uint16_t sr_mrt_get16(const uint8_t* p)
+{ return (uint16_t)((p[0] << 8) | p[1]); }
+
+static uint32_t sr_mrt_get32(const uint8_t* p)
+{ return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+static int sr_mrt_rule_cmp(const void* a, const void* b)
+{
+    uint32_t ma = ((const struct sr_mrt_rule*)a)->mask;
+    uint32_t mb = ((const struct sr_mrt_rule*)b)->mask;
+
+    return ma < mb ? 1 : ma > mb ? -1 : 0;
+} /* -- sr_mrt_rule_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_read_rules(..)
+ * Scope:  Local
+ *
+ * Read the rule file described in sr_mrt.h.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_read_rules(struct sr_mrt_rules* rules, const char* path)
+{
+    char line[256], word[16], net[32], iface[64], gw[32];
+    struct sr_mrt_rule* r;
+    struct in_addr addr;
+    char* slash;
+    unsigned int lineno = 0;
+    int fields, len;
+    FILE* fp;
+
+    if((fp = fopen(path, "r")) == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if((slash = strchr(line, '#')) != 0)
+        { *slash = 0; }
+
+        fields = sscanf(line, "%15s %31s %63s %31s", word, net, iface, gw);
+        if(fields <= 0)
+        { continue; }
+
+        if(strcmp(word, "peer") == 0 && fields == 2 &&
+           inet_aton(net, &(rules->peer)))
+        {
+            rules->use_peer = 1;
+            continue;
+        }
+
+        if(strcmp(word, "nexthop") != 0 || fields < 3 ||
+           (slash = strchr(net, '/')) == 0)
+        { goto bad; }
+        *slash = 0;
+        len = atoi(slash + 1);
+        if(len < 0 || len > 32 || !inet_aton(net, &addr))
+        { goto bad; }
+        if(rules->n == SR_MRT_MAX_RULES)
+        {
+            fprintf(stderr, "%s: more than %d rules\n", path, SR_MRT_MAX_RULES);
+            fclose(fp);
+            return -1;
+        }
+
+        r = &(rules->rule[rules->n++]);
+        r->mask = len ? 0xffffffff << (32 - len) : 0;
+        r->prefix = ntohl(addr.s_addr) & r->mask;
+        r->gw.s_addr = 0;
+        if(fields == 4 && !inet_aton(gw, &(r->gw)))
+        { goto bad; }
+        strncpy(r->iface, iface, sr_IFACE_NAMELEN - 1);
+        r->iface[sr_IFACE_NAMELEN - 1] = 0;
+    }
+    fclose(fp);
+
+    qsort(rules->rule, rules->n, sizeof(struct sr_mrt_rule), sr_mrt_rule_cmp);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%u: cannot parse rule\n", path, lineno);
+    fclose(fp);
+    return -1;
+} /* -- sr_mrt_read_rules -- */
+
+static const struct sr_mrt_rule* sr_mrt_match(struct sr_mrt_rules* rules,
+                                              uint32_t nh)
+{
+    int i;
+
+    if(rules->last && rules->last_nh == nh)
+    { return rules->last; }
+
+    for(i = 0; i < rules->n; i++)
+    {
+        if((nh & rules->rule[i].mask) == rules->rule[i].prefix)
+        { break; }
+    }
+    rules->last = i < rules->n ? &(rules->rule[i]) : 0;
+    rules->last_nh = nh;
+    return rules->last;
+} /* -- sr_mrt_match -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_peers(..)
+ * Scope:  Local
+ *
+ * Find the index of the peer the rules ask for in a PEER_INDEX_TABLE.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_peers(struct sr_mrt_rules* rules, const uint8_t* p,
+                        uint32_t len)
+{
+    const uint8_t* end = p + len;
+    uint16_t count, i;
+    uint8_t type;
+
+    /* -- collector id, view name, peer count -- */
+    if(len < 6 || len < 8u + sr_mrt_get16(p + 4))
+    { return -1; }
+    p += 6 + sr_mrt_get16(p + 4);
+    count = sr_mrt_get16(p);
+    p += 2;
+
+    for(i = 0; i < count; i++)
+    {
+        if(p + 5 > end)
+        { return -1; }
+        type = p[0];
+        p += 5;             /* type, BGP id */
+        if(p + (type & 1 ? 16 : 4) + (type & 2 ? 4 : 2) > end)
+        { return -1; }
+        if(!(type & 1) && memcmp(p, &(rules->peer.s_addr), 4) == 0)
+        { rules->peer_index = i; }
+        p += (type & 1 ? 16 : 4) + (type & 2 ? 4 : 2);
+    }
+    return 0;
+} /* -- sr_mrt_peers -- */
+
+/* -- the NEXT_HOP of an attribute list, 0 if it has none -- */
+static int sr_mrt_next_hop(const uint8_t* p, uint32_t len, uint32_t* nh)
+{
+    const uint8_t* end = p + len;
+    uint32_t alen;
+    uint8_t flags, type;
+
+    while(p + 3 <= end)
+    {
+        flags = p[0];
+        type = p[1];
+        if(flags & 0x10)
+        {
+            if(p + 4 > end)
+            { return 0; }
+            alen = sr_mrt_get16(p + 2);
+            p += 4;
+        }
+        else
+        {
+            alen = p[2];
+            p += 3;
+        }
+        if(p + alen > end)
+        { return 0; }
+        if(type == SR_MRT_ATTR_NEXT_HOP && alen == 4)
+        {
+            *nh = sr_mrt_get32(p);
+            return 1;
+        }
+        p += alen;
+    }
+    return 0;
+} /* -- sr_mrt_next_hop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_rib(..)
+ * Scope:  Local
+ *
+ * Turn one RIB_IPV4_UNICAST record into a route in *rt.  Returns 1 if
+ * it made one, 0 if the prefix is left out and -1 if the record is
+ * malformed.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_rib(struct sr_mrt_rules* rules, const uint8_t* p,
+                      uint32_t len, int addpath, struct sr_rt* rt,
+                      struct sr_mrt_counts* counts)
+{
+    const uint8_t* end = p + len;
+    const struct sr_mrt_rule* rule;
+    uint32_t prefix = 0, nh = 0, alen;
+    uint16_t count, i, peer;
+    int plen, bytes, found = 0;
+
+    /* -- sequence number, prefix length, prefix, entry count -- */
+    if(len < 5 || (plen = p[4]) > 32)
+    { return -1; }
+    bytes = (plen + 7) / 8;
+    if(len < 7u + bytes)
+    { return -1; }
+    for(i = 0; i < bytes; i++)
+    { prefix |= (uint32_t)p[5 + i] << (24 - 8 * i); }
+    p += 5 + bytes;
+    count = sr_mrt_get16(p);
+    p += 2;
+
+    counts->prefixes++;
+    for(i = 0; i < count && !found; i++)
+    {
+        /* -- peer index, originated time, [path id], attribute length -- */
+        if(p + 8 + (addpath ? 4 : 0) > end)
+        { return -1; }
+        peer = sr_mrt_get16(p);
+        p += 6 + (addpath ? 4 : 0);
+        alen = sr_mrt_get16(p);
+        p += 2;
+        if(p + alen > end)
+        { return -1; }
+
+        if(!rules->use_peer || peer == rules->peer_index)
+        { found = sr_mrt_next_hop(p, alen, &nh); }
+        p += alen;
+    }
+
+    if(!found)
+    {
+        counts->no_entry++;
+        return 0;
+    }
+    if((rule = sr_mrt_match(rules, nh)) == 0)
+    {
+        counts->no_rule++;
+        return 0;
+    }
+
+    rt->mask.s_addr = htonl(plen ? 0xffffffff << (32 - plen) : 0);
+    rt->dest.s_addr = htonl(prefix) & rt->mask.s_addr;
+    rt->gw.s_addr = rule->gw.s_addr ? rule->gw.s_addr : htonl(nh);
+    memcpy(rt->interface, rule->iface, sr_IFACE_NAMELEN);
+    return 1;
+} /* -- sr_mrt_rib -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_parse(..)
+ * Scope:  Local
+ *
+ * Make a list of routes from the dump in buf.  Returns the number of
+ * routes, with the list in *head, or -1 with nothing allocated.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_parse(struct sr_vrf* vrf, struct sr_mrt_rules* rules,
+                        const uint8_t* buf, size_t size, struct sr_rt** head,
+                        struct sr_mrt_counts* counts)
+{
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + size;
+    struct sr_rt *tail = 0, *rt = 0, *next;
+    uint32_t len;
+    uint16_t type, subtype;
+    int n = 0, ret;
+
+    *head = 0;
+    while(p < end)
+    {
+        if(end - p < SR_MRT_HDR_LEN ||
+           (len = sr_mrt_get32(p + 8)) > (size_t)(end - p) - SR_MRT_HDR_LEN)
+        {
+            fprintf(stderr, "MRT dump truncated at byte %lu\n",
+                    (unsigned long)(p - buf));
+            goto fail;
+        }
+        type = sr_mrt_get16(p + 4);
+        subtype = sr_mrt_get16(p + 6);
+        p += SR_MRT_HDR_LEN;
+        counts->records++;
+
+        if(type != SR_MRT_TABLE_DUMP_V2)
+        { counts->skipped++; }
+        else if(subtype == SR_MRT_PEER_INDEX_TABLE)
+        {
+            if(rules->use_peer && sr_mrt_peers(rules, p, len) != 0)
+            { goto bad; }
+        }
+        else if(subtype == SR_MRT_RIB_IPV4_UNICAST ||
+                subtype == SR_MRT_RIB_IPV4_UNICAST_AP)
+        {
+            if(rt == 0 && (rt = SR_POOL_GET(&(vrf->sr->rt_pool), struct sr_rt)) == 0)
+            {
+                fprintf(stderr, "Error loading MRT dump, out of memory\n");
+                goto fail;
+            }
+            ret = sr_mrt_rib(rules, p, len,
+                             subtype == SR_MRT_RIB_IPV4_UNICAST_AP, rt, counts);
+            if(ret < 0)
+            { goto bad; }
+            if(ret > 0)
+            {
+                rt->group = 0;
+                rt->next = 0;
+                if(tail)
+                { tail->next = rt; }
+                else
+                { *head = rt; }
+                tail = rt;
+                rt = 0;
+                n++;
+            }
+        }
+        else
+        { counts->skipped++; }
+
+        p += len;
+    }
+
+    sr_pool_put(&(vrf->sr->rt_pool), rt);
+    return n;
+
+bad:
+    fprintf(stderr, "MRT dump malformed in record %lu at byte %lu\n",
+            counts->records, (unsigned long)(p - SR_MRT_HDR_LEN - buf));
+fail:
+    sr_pool_put(&(vrf->sr->rt_pool), rt);
+    for(rt = *head; rt; rt = next)
+    {
+        next = rt->next;
+        sr_pool_put(&(vrf->sr->rt_pool), rt);
+    }
+    *head = 0;
+    return -1;
+} /* -- sr_mrt_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_load_mrt(..)
+ * Scope:  Global
+ *
+ * Replace the routing table with the IPv4 unicast routes of the MRT
+ * dump at path, with next hops mapped by the rule file at rules, and
+ * build the fib over it.  A dump with no usable routes leaves the table
+ * as it is.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_load_mrt(struct sr_vrf* vrf, const char* path, const char* rules)
+{
+    struct sr_mrt_rules* r;
+    struct sr_mrt_counts counts;
+    struct sr_rt* head;
+    struct stat st;
+    void* map;
+    int fd, n;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(path);
+    assert(rules);
+
+    if((r = (struct sr_mrt_rules*)calloc(1, sizeof(struct sr_mrt_rules))) == 0)
+    { return -1; }
+    r->peer_index = -1;
+    if(sr_mrt_read_rules(r, rules) != 0)
+    {
+        free(r);
+        return -1;
+    }
+
+    if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        if(fd >= 0)
+        { close(fd); }
+        free(r);
+        return -1;
+    }
+    if(st.st_size == 0)
+    {
+        close(fd);
+        free(r);
+        return 0;
+    }
+
+    map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        free(r);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    memset(&counts, 0, sizeof(counts));
+    n = sr_mrt_parse(vrf, r, (const uint8_t*)map, st.st_size, &head, &counts);
+    munmap(map, st.st_size);
+
+    if(n >= 0)
+    {
+        printf("MRT dump %s: %lu records, %lu prefixes, %d routes, "
+               "%lu without an entry%s, %lu without a rule\n",
+               path, counts.records, counts.prefixes, n, counts.no_entry,
+               r->use_peer ? " from the peer" : "", counts.no_rule);
+        if(r->use_peer && r->peer_index < 0)
+        {
+            fprintf(stderr, "MRT dump %s has no peer %s\n", path,
+                    inet_ntoa(r->peer));
+        }
+    }
+    free(r);
+
+    if(n > 0)
+    { sr_rt_set_table(vrf, head); }
+
+    return n < 0 ? -1 : 0;
+} /* -- sr_load_mrt -- */
@@ -0,0 +1,55 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mrt.h
+ *
+ * Description:
+ *
+ * Routing tables from MRT RIB dumps (RFC 6396), as the route collectors
+ * publish them, so the router can be loaded with a full Internet table.
+ *
+ * Only TABLE_DUMP_V2 is read: the PEER_INDEX_TABLE and the IPv4 unicast
+ * RIB records, with or without ADD-PATH (RFC 8050).  Every other record
+ * is skipped.  Dumps are usually published compressed and must be
+ * decompressed first.  Each prefix becomes one route, using the first
+ * RIB entry with a NEXT_HOP attribute, or the first from the peer named
+ * in the rule file.
+ *
+ * A BGP next hop is rarely a neighbour of this router, so the rule file
+ * says where each one goes.  One rule per line, # starts a comment:
+ *
+ *   nexthop <prefix>/<len> <iface> [gateway]
+ *   peer <address>
+ *
+ * A next hop takes the longest nexthop rule that covers it; the route
+ * leaves through iface, to gateway if given, or else to the next hop
+ * itself.  Prefixes whose next hop no rule covers are left out.  With a
+ * peer rule only the RIB entries of that peer are used.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_MRT_H
+#define SR_MRT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* record types and subtypes */
+#define SR_MRT_TABLE_DUMP_V2        13
+#define SR_MRT_PEER_INDEX_TABLE     1
+#define SR_MRT_RIB_IPV4_UNICAST     2
+#define SR_MRT_RIB_IPV4_UNICAST_AP  8   /* with path identifiers */
+
+#define SR_MRT_HDR_LEN  12              /* time, type, subtype, length */
+#define SR_MRT_ATTR_NEXT_HOP 3
+
+#define SR_MRT_MAX_RULES 1024
+
+struct sr_vrf;
+
+int sr_load_mrt(struct sr_vrf* vrf, const char* path, const char* rules);
+
+#endif /* -- SR_MRT_H -- */
@@ -0,0 +1,615 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ortc.c
+ *
+ * Description:
+ *
+ * FIB aggregation, see sr_ortc.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_ortc.h"
+#include "sr_fib.h"
+#include "sr_ecmp.h"
+#include "sr_alloc.h"
+
+#define SR_ORTC_ROOT 1
+
+/* -- next hop ids by gateway, interface and group, each id with a copy
+ *    of its group -- */
+
+static uint32_t sr_ortc_nh_hash(const struct sr_rt* rt)
+{
+    uint32_t h = (rt->gw.s_addr ^ sr_ecmp_group_hash(rt->group)) * 2654435761u;
+    const char* iface = rt->interface;
+
+    while(*iface)
+    { h = (h ^ (unsigned char)*iface++) * 16777619u; }
+
+    /* -- the table is indexed by the low bits, mix the high ones in -- */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    return h ^ (h >> 13);
+} /* -- sr_ortc_nh_hash -- */
+
+static int sr_ortc_nh_rehash(struct sr_ortc* o, uint32_t size)
+{
+    uint32_t* hash = (uint32_t*)calloc(size, sizeof(uint32_t));
+    uint32_t i, j;
+
+    if(hash == 0)
+    { return -1; }
+    for(i = 0; i < o->nnh; i++)
+    {
+        j = sr_ortc_nh_hash(&(o->nh[i]));
+        for(j &= size - 1; hash[j]; j = (j + 1) & (size - 1))
+        { }
+        hash[j] = i + 1;
+    }
+    free(o->nh_hash);
+    o->nh_hash = hash;
+    o->nh_hash_size = size;
+    return 0;
+} /* -- sr_ortc_nh_rehash -- */
+
+/* -- the id of rt's next hop, added if new, 0 if memory runs out -- */
+static uint32_t sr_ortc_nh_id(struct sr_ortc* o, const struct sr_rt* rt)
+{
+    struct sr_rt* nh;
+    uint32_t j, id;
+
+    if(o->nnh * 2 >= o->nh_hash_size &&
+       sr_ortc_nh_rehash(o, o->nh_hash_size ? o->nh_hash_size * 2 : 64) != 0)
+    { return 0; }
+
+    j = sr_ortc_nh_hash(rt) & (o->nh_hash_size - 1);
+    for( ; (id = o->nh_hash[j]); j = (j + 1) & (o->nh_hash_size - 1))
+    {
+        if(o->nh[id - 1].gw.s_addr == rt->gw.s_addr &&
+           strncmp(o->nh[id - 1].interface, rt->interface,
+                   sr_IFACE_NAMELEN) == 0 &&
+           sr_ecmp_equal(o->nh[id - 1].group, rt->group))
+        { return id; }
+    }
+
+    if(o->nnh == o->maxnh)
+    {
+        uint32_t max = o->maxnh ? o->maxnh * 2 : 64;
+
+        if((nh = (struct sr_rt*)realloc(o->nh, max * sizeof(struct sr_rt))) == 0)
+        { return 0; }
+        o->nh = nh;
+        o->maxnh = max;
+    }
+    nh = &(o->nh[o->nnh]);
+    memset(nh, 0, sizeof(struct sr_rt));
+    nh->gw = rt->gw;
+    strncpy(nh->interface, rt->interface, sr_IFACE_NAMELEN - 1);
+    if(rt->group && (nh->group = sr_ecmp_copy(rt->group)) == 0)
+    { return 0; }
+    o->nh_hash[j] = ++o->nnh;
+
+    return o->nnh;
+} /* -- sr_ortc_nh_id -- */
+
+static const struct sr_rt* sr_ortc_nh(const struct sr_ortc* o, uint32_t id)
+{ return id ? &(o->nh[id - 1]) : 0; }
+
+static void sr_ortc_nh_clear(struct sr_ortc* o)
+{
+    uint32_t i;
+
+    for(i = 0; i < o->nnh; i++)
+    { sr_ecmp_free(o->nh[i].group); }
+    o->nnh = 0;
+    if(o->nh_hash)
+    { memset(o->nh_hash, 0, o->nh_hash_size * sizeof(uint32_t)); }
+} /* -- sr_ortc_nh_clear -- */
+
+/* -- nodes, which move when the array grows, so hold indices -- */
+
+static uint32_t sr_ortc_node_new(struct sr_ortc* o)
+{
+    struct sr_ortc_node* nodes;
+    uint32_t n;
+
+    if(o->free_nodes)
+    {
+        n = o->free_nodes;
+        o->free_nodes = o->nodes[n].child[0];
+    }
+    else
+    {
+        if(o->nnodes >= o->maxnodes)
+        {
+            uint32_t max = o->maxnodes ? o->maxnodes * 2 : 1024;
+
+            nodes = (struct sr_ortc_node*)realloc(o->nodes,
+                    (size_t)max * sizeof(struct sr_ortc_node));
+            if(nodes == 0)
+            { return 0; }
+            o->nodes = nodes;
+            o->maxnodes = max;
+        }
+        n = o->nnodes++;
+    }
+
+    memset(&(o->nodes[n]), 0, sizeof(struct sr_ortc_node));
+    return n;
+} /* -- sr_ortc_node_new -- */
+
+static void sr_ortc_node_free(struct sr_ortc* o, uint32_t n)
+{
+    o->garbage += o->nodes[n].nset;
+    memset(&(o->nodes[n]), 0, sizeof(struct sr_ortc_node));
+    o->nodes[n].child[0] = o->free_nodes;
+    o->free_nodes = n;
+} /* -- sr_ortc_node_free -- */
+
+/* -- sets -- */
+
+static int sr_ortc_reserve(struct sr_ortc* o, uint32_t n)
+{
+    uint32_t* sets;
+    uint32_t max = o->maxsets ? o->maxsets : 4096;
+
+    while(o->nsets + n > max)
+    { max *= 2; }
+    if(max != o->maxsets)
+    {
+        if((sets = (uint32_t*)realloc(o->sets,
+                (size_t)max * sizeof(uint32_t))) == 0)
+        { return -1; }
+        o->sets = sets;
+        o->maxsets = max;
+    }
+    return 0;
+} /* -- sr_ortc_reserve -- */
+
+static int sr_ortc_in_set(const struct sr_ortc* o, uint32_t n, uint32_t id)
+{
+    const uint32_t* set = o->sets + o->nodes[n].set;
+    uint32_t lo = 0, hi = o->nodes[n].nset;
+
+    while(lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if(set[mid] == id)
+        { return 1; }
+        if(set[mid] < id)
+        { lo = mid + 1; }
+        else
+        { hi = mid; }
+    }
+    return 0;
+} /* -- sr_ortc_in_set -- */
+
+/* -- move the live sets to a fresh array, dropping the garbage -- */
+static int sr_ortc_compact(struct sr_ortc* o)
+{
+    uint32_t* sets;
+    uint32_t n, k = 0, size = o->nsets - o->garbage + 4096;
+
+    if((sets = (uint32_t*)malloc((size_t)size * sizeof(uint32_t))) == 0)
+    { return -1; }
+    for(n = SR_ORTC_ROOT; n < o->nnodes; n++)
+    {
+        memcpy(sets + k, o->sets + o->nodes[n].set,
+               o->nodes[n].nset * sizeof(uint32_t));
+        o->nodes[n].set = k;
+        k += o->nodes[n].nset;
+    }
+    free(o->sets);
+    o->sets = sets;
+    o->nsets = k;
+    o->maxsets = size;
+    o->garbage = 0;
+    return 0;
+} /* -- sr_ortc_compact -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_set(..)
+ * Scope:  Local
+ *
+ * Pass 2 for one node that inherits next hop h, from its children's
+ * sets: their intersection, or their union if it is empty.  A missing
+ * child of a node with one child stands for the next hop the node
+ * passes down, and so does a node with none.  A union is cut short at
+ * SR_ORTC_MAX_SET next hops.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ortc_set(struct sr_ortc* o, uint32_t n, uint32_t h)
+{
+    struct sr_ortc_node* node = &(o->nodes[n]);
+    const uint32_t *a, *b;
+    uint32_t na, nb, i, j, k = 0;
+    uint32_t* out;
+    uint32_t hp = node->route ? node->route : h;
+
+    if(sr_ortc_reserve(o, 2 * SR_ORTC_MAX_SET) != 0)
+    { return -1; }
+
+    out = o->sets + o->nsets;
+    if(node->child[0] == 0 && node->child[1] == 0)
+    { out[k++] = hp; }
+    else
+    {
+        a = node->child[0] ? o->sets + o->nodes[node->child[0]].set : &hp;
+        na = node->child[0] ? o->nodes[node->child[0]].nset : 1;
+        b = node->child[1] ? o->sets + o->nodes[node->child[1]].set : &hp;
+        nb = node->child[1] ? o->nodes[node->child[1]].nset : 1;
+
+        /* -- the intersection, or failing that the union -- */
+        for(i = 0, j = 0; i < na && j < nb; )
+        {
+            if(a[i] == b[j])
+            {
+                out[k++] = a[i++];
+                j++;
+            }
+            else if(a[i] < b[j])
+            { i++; }
+            else
+            { j++; }
+        }
+
+        if(k == 0)
+        {
+            for(i = 0, j = 0; (i < na || j < nb) && k < SR_ORTC_MAX_SET; )
+            {
+                if(j == nb || (i < na && a[i] < b[j]))
+                { out[k++] = a[i++]; }
+                else if(i == na || b[j] < a[i])
+                { out[k++] = b[j++]; }
+                else
+                {
+                    out[k++] = a[i++];
+                    j++;
+                }
+            }
+        }
+    }
+
+    o->garbage += node->nset;
+    node->set = o->nsets;
+    node->nset = k;
+    node->dirty = 1;
+    o->nsets += k;
+    return 0;
+} /* -- sr_ortc_set -- */
+
+/* -- pass 2 below n, everywhere if full, else where h reaches -- */
+static int sr_ortc_sets(struct sr_ortc* o, uint32_t n, uint32_t h, int full)
+{
+    uint32_t hp = o->nodes[n].route ? o->nodes[n].route : h;
+    uint32_t c;
+    int s;
+
+    for(s = 0; s < 2; s++)
+    {
+        c = o->nodes[n].child[s];
+        if(c && (full || o->nodes[c].route == 0) &&
+           sr_ortc_sets(o, c, hp, full) != 0)
+        { return -1; }
+    }
+    return sr_ortc_set(o, n, h);
+} /* -- sr_ortc_sets -- */
+
+static void sr_ortc_count(struct sr_ortc* o, struct sr_ortc_node* node,
+                          int sign)
+{
+    int e = node->emit;
+
+    o->entries += sign * ((e & 1) + ((e >> 1) & 1) + ((e >> 2) & 1));
+    o->null_entries += sign * node->nulls;
+} /* -- sr_ortc_count -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_choose(..)
+ * Scope:  Local
+ *
+ * Pass 3 for node n at prefix/len, which inherits h from the routes
+ * above it and f from the entries above it.  Descends only into
+ * children whose set changed or that are passed a different next hop,
+ * unless full.  Entries that may have changed are passed to fn.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ortc_choose(struct sr_ortc* o, uint32_t n, uint32_t prefix,
+                           int len, uint32_t h, uint32_t f, int full,
+                           sr_ortc_change_fn fn, void* arg)
+{
+    struct sr_ortc_node* node = &(o->nodes[n]);
+    uint32_t hp = node->route ? node->route : h;
+    uint32_t old_fwd = node->fwd, sub, c;
+    int old_emit = node->emit, dirty = node->dirty, s, bit;
+
+    sr_ortc_count(o, node, -1);
+    if(sr_ortc_in_set(o, n, f))
+    {
+        node->fwd = f;
+        node->emit = 0;
+        node->nulls = 0;
+    }
+    else
+    {
+        node->fwd = o->sets[node->set];
+        node->emit = SR_ORTC_EMIT_SELF;
+        node->nulls = node->fwd == 0;
+    }
+    for(s = 0; s < 2 && (node->child[0] || node->child[1]); s++)
+    {
+        if(node->child[s] == 0 && node->fwd != hp)
+        {
+            node->emit |= SR_ORTC_EMIT_LEFT << s;
+            node->nulls += hp == 0;
+        }
+    }
+    sr_ortc_count(o, node, 1);
+    node->dirty = 0;
+
+    if(fn)
+    {
+        if((node->emit & SR_ORTC_EMIT_SELF) &&
+           (!(old_emit & SR_ORTC_EMIT_SELF) || old_fwd != node->fwd))
+        { fn(arg, prefix, len, 1, sr_ortc_nh(o, node->fwd)); }
+        else if(!(node->emit & SR_ORTC_EMIT_SELF) &&
+                (old_emit & SR_ORTC_EMIT_SELF))
+        { fn(arg, prefix, len, 0, 0); }
+    }
+
+    for(s = 0; s < 2; s++)
+    {
+        node = &(o->nodes[n]);
+        bit = SR_ORTC_EMIT_LEFT << s;
+        sub = prefix | ((uint32_t)s << (31 - len));
+        if(fn && (node->emit & bit) && (!(old_emit & bit) || dirty))
+        { fn(arg, sub, len + 1, 1, sr_ortc_nh(o, hp)); }
+        else if(fn && !(node->emit & bit) && (old_emit & bit))
+        { fn(arg, sub, len + 1, 0, 0); }
+
+        c = node->child[s];
+        if(c && (full || o->nodes[c].dirty || node->fwd != old_fwd))
+        { sr_ortc_choose(o, c, sub, len + 1, hp, node->fwd, full, fn, arg); }
+    }
+} /* -- sr_ortc_choose -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_create(..)
+ * Scope:  Global
+ *
+ * An empty table, whose aggregated set is empty too.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ortc* sr_ortc_create(void)
+{
+    struct sr_ortc* o = (struct sr_ortc*)calloc(1, sizeof(struct sr_ortc));
+
+    if(o == 0)
+    { return 0; }
+    if(sr_ortc_build(o, 0) != 0)
+    {
+        sr_ortc_destroy(o);
+        return 0;
+    }
+    return o;
+} /* -- sr_ortc_create -- */
+
+void sr_ortc_destroy(struct sr_ortc* o)
+{
+    if(o == 0)
+    { return; }
+
+    sr_ortc_nh_clear(o);
+    free(o->nodes);
+    free(o->sets);
+    free(o->nh);
+    free(o->nh_hash);
+    free(o);
+} /* -- sr_ortc_destroy -- */
+
+/* -- the node for prefix/len, made with the path to it if create -- */
+static uint32_t sr_ortc_find(struct sr_ortc* o, uint32_t prefix, int len,
+                             int create, uint32_t* path, uint32_t* hs)
+{
+    uint32_t n = SR_ORTC_ROOT, c, h = 0;
+    int i, bit;
+
+    for(i = 0; ; i++)
+    {
+        if(path)
+        {
+            path[i] = n;
+            hs[i] = h;
+        }
+        if(i == len)
+        { return n; }
+        if(o->nodes[n].route)
+        { h = o->nodes[n].route; }
+
+        bit = (prefix >> (31 - i)) & 1;
+        if((c = o->nodes[n].child[bit]) == 0)
+        {
+            if(!create || (c = sr_ortc_node_new(o)) == 0)
+            { return 0; }
+            o->nodes[n].child[bit] = c;
+        }
+        n = c;
+    }
+} /* -- sr_ortc_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_build(..)
+ * Scope:  Global
+ *
+ * Replace the routes with the list at routes and aggregate them from
+ * scratch.  Of routes for the same prefix the first is used, as in the
+ * linear lookup.  Returns 0 on success, -1 if a mask is not a prefix or
+ * memory runs out, leaving the table empty.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ortc_build(struct sr_ortc* o, struct sr_rt* routes)
+{
+    struct sr_rt* rt;
+    uint32_t n, id;
+    int len;
+
+    /* -- REQUIRES -- */
+    assert(o);
+
+    o->nnodes = SR_ORTC_ROOT;
+    o->free_nodes = 0;
+    o->nsets = 0;
+    o->garbage = 0;
+    sr_ortc_nh_clear(o);
+    o->routes = 0;
+    o->entries = 0;
+    o->null_entries = 0;
+    if(sr_ortc_node_new(o) != SR_ORTC_ROOT)
+    { return -1; }
+
+    for(rt = routes; rt; rt = rt->next)
+    {
+        if((len = sr_fib_prefix_len(ntohl(rt->mask.s_addr))) < 0 ||
+           (id = sr_ortc_nh_id(o, rt)) == 0 ||
+           (n = sr_ortc_find(o, ntohl(rt->dest.s_addr & rt->mask.s_addr),
+                             len, 1, 0, 0)) == 0)
+        { goto fail; }
+        if(o->nodes[n].route == 0)
+        {
+            o->nodes[n].route = id;
+            o->routes++;
+        }
+    }
+
+    if(sr_ortc_sets(o, SR_ORTC_ROOT, 0, 1) != 0)
+    { goto fail; }
+    sr_ortc_choose(o, SR_ORTC_ROOT, 0, 0, 0, 0, 1, 0, 0);
+    return 0;
+
+fail:
+    if(routes)
+    { sr_ortc_build(o, 0); }
+    return -1;
+} /* -- sr_ortc_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_update(..)
+ * Scope:  Global
+ *
+ * Point the route for dest/mask at the gateway and interface of nh, or
+ * withdraw it if nh is 0, and bring the aggregated set up to date,
+ * passing every entry that may have changed to fn if it is not 0, in
+ * the order of sr_ortc_walk.  Returns 0 on success, -1 if mask is not
+ * a prefix or memory runs out; the set is then only good for a fresh
+ * sr_ortc_build.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ortc_update(struct sr_ortc* o, struct in_addr dest,
+                   struct in_addr mask, const struct sr_rt* nh,
+                   sr_ortc_change_fn fn, void* arg)
+{
+    uint32_t path[33], hs[33], prefix, n, id = 0, parent;
+    int len, d, pruned = 0;
+
+    /* -- REQUIRES -- */
+    assert(o);
+
+    if((len = sr_fib_prefix_len(ntohl(mask.s_addr))) < 0)
+    { return -1; }
+    prefix = ntohl(dest.s_addr & mask.s_addr);
+    if(nh && (id = sr_ortc_nh_id(o, nh)) == 0)
+    { return -1; }
+
+    if((n = sr_ortc_find(o, prefix, len, id != 0, path, hs)) == 0)
+    { return id ? -1 : 0; }
+    if(o->nodes[n].route == id)
+    { return 0; }
+
+    o->routes += (id != 0) - (o->nodes[n].route != 0);
+    o->nodes[n].route = id;
+
+    /* -- a withdrawn leaf goes, and so do ancestors left with nothing -- */
+    for(d = len; d > 0 && o->nodes[n].route == 0 &&
+        o->nodes[n].child[0] == 0 && o->nodes[n].child[1] == 0; d--)
+    {
+        if(fn && (o->nodes[n].emit & SR_ORTC_EMIT_SELF))
+        { fn(arg, prefix & (d ? 0xffffffff << (32 - d) : 0), d, 0, 0); }
+        sr_ortc_count(o, &(o->nodes[n]), -1);
+        parent = path[d - 1];
+        o->nodes[parent].child[(prefix >> (32 - d)) & 1] = 0;
+        sr_ortc_node_free(o, n);
+        n = parent;
+        pruned = 1;
+    }
+
+    if((pruned ? sr_ortc_set(o, n, hs[d]) : sr_ortc_sets(o, n, hs[d], 0)) != 0)
+    { return -1; }
+    while(d-- > 0)
+    {
+        if(sr_ortc_set(o, path[d], hs[d]) != 0)
+        { return -1; }
+    }
+
+    sr_ortc_choose(o, SR_ORTC_ROOT, 0, 0, 0, 0, 0, fn, arg);
+
+    if(o->garbage > 65536 && o->garbage > o->nsets / 2)
+    { sr_ortc_compact(o); }
+    return 0;
+} /* -- sr_ortc_update -- */
+
+static int sr_ortc_walk_node(struct sr_ortc* o, uint32_t n, uint32_t prefix,
+                             int len, uint32_t h, sr_ortc_entry_fn fn,
+                             void* arg)
+{
+    struct sr_ortc_node* node = &(o->nodes[n]);
+    uint32_t hp = node->route ? node->route : h;
+    uint32_t sub;
+    int s, ret;
+
+    if((node->emit & SR_ORTC_EMIT_SELF) &&
+       (ret = fn(arg, prefix, len, sr_ortc_nh(o, node->fwd))) != 0)
+    { return ret; }
+
+    for(s = 0; s < 2; s++)
+    {
+        sub = prefix | ((uint32_t)s << (31 - len));
+        if(node->child[s])
+        { ret = sr_ortc_walk_node(o, node->child[s], sub, len + 1, hp, fn, arg); }
+        else if(node->emit & (SR_ORTC_EMIT_LEFT << s))
+        { ret = fn(arg, sub, len + 1, sr_ortc_nh(o, hp)); }
+        else
+        { ret = 0; }
+        if(ret != 0)
+        { return ret; }
+    }
+    return 0;
+} /* -- sr_ortc_walk_node -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_walk(..)
+ * Scope:  Global
+ *
+ * Pass every entry of the aggregated set to fn, in prefix order, which
+ * puts every entry before the entries it covers.  Stops at the first
+ * call that returns other than 0 and returns that.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ortc_walk(struct sr_ortc* o, sr_ortc_entry_fn fn, void* arg)
+{
+    /* -- REQUIRES -- */
+    assert(o);
+    assert(fn);
+
+    return sr_ortc_walk_node(o, SR_ORTC_ROOT, 0, 0, 0, fn, arg);
+} /* -- sr_ortc_walk -- */
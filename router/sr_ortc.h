@@ -0,0 +1,121 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ortc.h
+ *
+ * Description:
+ *
+ * FIB aggregation: the smallest set of prefixes that forwards every
+ * address exactly as the routing table does, by the Optimal Routing
+ * Table Constructor of Draves et al. (INFOCOM '99).  With sr -A the fib
+ * is built over this set instead of the routing table itself, so fewer
+ * chunks are needed and more of the trie stays in cache.
+ *
+ * Routes are kept in a binary trie by prefix, with their next hop, the
+ * gateway and interface pair, reduced to a small id.  Three passes over
+ * it give the aggregated set:
+ *
+ *   1. every node gets two children or none, a missing child standing
+ *      for the next hop the node passes down (done on the fly here);
+ *   2. bottom up, each node gets the set of next hops that would serve
+ *      its whole subtree best: the intersection of its children's sets
+ *      if they meet, their union if not;
+ *   3. top down, a node whose set holds the next hop its parent passes
+ *      down needs no entry, any other gets one for a next hop in its set.
+ *
+ * "No route" is a next hop like any other, so an aggregated set may hold
+ * entries that send a part of a covering prefix nowhere.
+ *
+ * The result forwards correctly whichever next hop of its set a node
+ * picks, so sets are cut to their SR_ORTC_MAX_SET smallest next hops.
+ * That only costs entries on tables with thousands of next hops spread
+ * evenly, where the sets near the root would otherwise hold them all.
+ *
+ * sr_ortc_update changes one route and redoes only the nodes whose sets
+ * or parent's choice changed: the path to the root, the part of the
+ * subtree below the route that inherited from it, and whatever pass 3
+ * then finds different.  Each entry of the set that may have changed is
+ * passed to a callback.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ORTC_H
+#define SR_ORTC_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <netinet/in.h>
+
+#include "sr_rt.h"
+
+/* next hops a set keeps at most, see below */
+#define SR_ORTC_MAX_SET 16
+
+/* emit bits of a node */
+#define SR_ORTC_EMIT_SELF  0x1      /* an entry for the node's prefix */
+#define SR_ORTC_EMIT_LEFT  0x2      /* ... for a missing 0 child */
+#define SR_ORTC_EMIT_RIGHT 0x4      /* ... for a missing 1 child */
+
+struct sr_ortc_node
+{
+    uint32_t child[2];          /* node index, 0 for none */
+    uint32_t route;             /* next hop of the route here, 0 for none */
+    uint32_t set;               /* its next hop set, at sets + set */
+    uint32_t nset;
+    uint32_t fwd;               /* next hop it passes down after pass 3 */
+    uint8_t emit;               /* SR_ORTC_EMIT_* */
+    uint8_t nulls;              /* of the entries emitted, those to no route */
+    uint8_t dirty;              /* set changed since the last pass 3 */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ortc
+ *
+ * Nodes and sets live in arrays and refer to each other by index, the
+ * root being node 1.  Sets are sorted next hop ids; a recomputed set is
+ * appended and the old one left as garbage until it outweighs the rest.
+ * Next hop 0 is no route; next hop i is nh[i - 1].
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ortc
+{
+    struct sr_ortc_node* nodes;
+    uint32_t nnodes, maxnodes;
+    uint32_t free_nodes;        /* free list through child[0] */
+    uint32_t* sets;
+    uint32_t nsets, maxsets;
+    uint32_t garbage;           /* of nsets */
+    struct sr_rt* nh;           /* gw, interface and group of each */
+    uint32_t nnh, maxnh;
+    uint32_t* nh_hash;          /* id by all three, 0 empty */
+    uint32_t nh_hash_size;
+    uint32_t routes;            /* in the trie */
+    uint32_t entries;           /* in the aggregated set */
+    uint32_t null_entries;      /* of which to no route */
+};
+
+/* present 0: the entry for prefix/len is gone.  present 1: it is there,
+ * for nh, which is 0 for an entry to no route. */
+typedef void (*sr_ortc_change_fn)(void* arg, uint32_t prefix, int len,
+                                  int present, const struct sr_rt* nh);
+
+/* prefix, len and next hop of each entry of the set, covering entries
+ * before those they cover */
+typedef int (*sr_ortc_entry_fn)(void* arg, uint32_t prefix, int len,
+                                const struct sr_rt* nh);
+
+struct sr_ortc* sr_ortc_create(void);
+void sr_ortc_destroy(struct sr_ortc* o);
+
+int sr_ortc_build(struct sr_ortc* o, struct sr_rt* routes);
+int sr_ortc_update(struct sr_ortc* o, struct in_addr dest,
+                   struct in_addr mask, const struct sr_rt* nh,
+                   sr_ortc_change_fn fn, void* arg);
+int sr_ortc_walk(struct sr_ortc* o, sr_ortc_entry_fn fn, void* arg);
+
+#endif /* -- SR_ORTC_H -- */
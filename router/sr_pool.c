@@ -0,0 +1,359 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.c
+ *
+ * Description:
+ *
+ * Fixed-size object pools, see sr_pool.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "sr_pool.h"
+#include "sr_alloc.h"
+
+#define SR_POOL_HUGE_SIZE (2UL << 20)
+
+/* every batch starts with this header, objects follow it */
+struct sr_pool_batch
+{
+    struct sr_pool_batch* next;
+    size_t mapped;          /* length of the mapping, 0 if malloc'ed */
+};
+
+/* -- 1 + the cache slot of this thread, 0 before its first get or put
+ *    and -1 once the slots have run out -- */
+static __thread int sr_pool_self = 0;
+static int sr_pool_threads = 0;
+
+static int sr_pool_huge_on = 0;
+
+static struct sr_pool* sr_pool_list = 0;
+static pthread_mutex_t sr_pool_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void sr_pool_hugepages(int on)
+{ sr_pool_huge_on = on; }
+
+static struct sr_pool_cache* sr_pool_cache(struct sr_pool* pool)
+{
+    int slot;
+
+    if(sr_pool_self == 0)
+    {
+        slot = __atomic_fetch_add(&sr_pool_threads, 1, __ATOMIC_RELAXED);
+        sr_pool_self = slot < SR_POOL_THREADS ? slot + 1 : -1;
+    }
+
+    return sr_pool_self > 0 ? &(pool->caches[sr_pool_self - 1]) : 0;
+} /* -- sr_pool_cache -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_map(..)
+ * Scope:  Local
+ *
+ * Map *size bytes, rounded up to whole huge pages, for a batch.  Uses
+ * reserved huge pages if there are any and asks for transparent ones
+ * otherwise.  Returns 0 if even that fails.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_pool_map(struct sr_pool* pool, size_t* size)
+{
+    void* p = MAP_FAILED;
+
+    *size = (*size + SR_POOL_HUGE_SIZE - 1) & ~(SR_POOL_HUGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+    p = mmap(0, *size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(p != MAP_FAILED)
+    {
+        pool->huge++;
+        return p;
+    }
+#endif /* MAP_HUGETLB */
+
+    p = mmap(0, *size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+    { return 0; }
+#ifdef MADV_HUGEPAGE
+    madvise(p, *size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    return p;
+} /* -- sr_pool_map -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_grow(..)
+ * Scope:  Local
+ *
+ * Allocate another batch and thread its objects onto the free list.
+ * A batch on huge pages is filled with as many objects as fit.
+ * Called with the pool lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_pool_grow(struct sr_pool* pool)
+{
+    struct sr_pool_batch* batch;
+    unsigned char* obj;
+    unsigned int i, n = pool->batch;
+    size_t size = sizeof(struct sr_pool_batch) + pool->obj_size * n;
+
+    if((pool->flags & SR_POOL_HUGE) && sr_pool_huge_on)
+    {
+        batch = (struct sr_pool_batch*)sr_pool_map(pool, &size);
+        if(batch == 0)
+        { return -1; }
+        batch->mapped = size;
+        n = (size - sizeof(struct sr_pool_batch)) / pool->obj_size;
+    }
+    else
+    {
+        batch = (struct sr_pool_batch*)malloc(size);
+        if(batch == 0)
+        { return -1; }
+        batch->mapped = 0;
+    }
+
+    batch->next = (struct sr_pool_batch*)pool->batches;
+    pool->batches = batch;
+    pool->batches_n++;
+
+    obj = (unsigned char*)(batch + 1);
+    for(i = 0; i < n; i++, obj += pool->obj_size)
+    {
+        *(void**)obj = pool->free_list;
+        pool->free_list = obj;
+    }
+    pool->total += n;
+
+    return 0;
+} /* -- sr_pool_grow -- */
+
+/* -- the free list, with the pool lock held -- */
+
+static void* sr_pool_take(struct sr_pool* pool, int grow)
+{
+    void* obj;
+
+    if(pool->free_list == 0 && (!grow || sr_pool_grow(pool) != 0))
+    { return 0; }
+
+    obj = pool->free_list;
+    pool->free_list = *(void**)obj;
+    if(++pool->in_use > pool->high_water)
+    { pool->high_water = pool->in_use; }
+
+    return obj;
+} /* -- sr_pool_take -- */
+
+static void sr_pool_give(struct sr_pool* pool, void* obj)
+{
+    *(void**)obj = pool->free_list;
+    pool->free_list = obj;
+    pool->in_use--;
+} /* -- sr_pool_give -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_init(..)
+ * Scope:  Global
+ *
+ * Set up a pool of obj_size objects and pre-allocate the first batch.
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_pool_init(struct sr_pool* pool, const char* name, size_t obj_size,
+                 unsigned int batch, int flags)
+{
+    int ret, i;
+
+    /* -- REQUIRES -- */
+    assert(pool);
+    assert(batch > 0);
+
+    /* keep every object pointer aligned */
+    if(obj_size < sizeof(void*))
+    { obj_size = sizeof(void*); }
+    obj_size = (obj_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    pool->name = name;
+    pool->obj_size = obj_size;
+    pool->batch = batch;
+    pool->flags = flags;
+    pool->total = 0;
+    pool->in_use = 0;
+    pool->high_water = 0;
+    pool->batches_n = 0;
+    pool->huge = 0;
+    pool->free_list = 0;
+    pool->batches = 0;
+    for(i = 0; i < SR_POOL_THREADS; i++)
+    { pool->caches[i].n = 0; }
+    pthread_mutex_init(&(pool->lock), 0);
+
+    pthread_mutex_lock(&(pool->lock));
+    ret = sr_pool_grow(pool);
+    pthread_mutex_unlock(&(pool->lock));
+
+    pthread_mutex_lock(&sr_pool_list_lock);
+    pool->next = sr_pool_list;
+    sr_pool_list = pool;
+    pthread_mutex_unlock(&sr_pool_list_lock);
+
+    return ret;
+} /* -- sr_pool_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_get(..)
+ * Scope:  Global
+ *
+ * Take an object from the pool, growing it if needed.  Returns 0 only
+ * if the pool is empty and malloc fails.  An empty thread cache is
+ * refilled to half full on the way.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_pool_get(struct sr_pool* pool)
+{
+    struct sr_pool_cache* c = sr_pool_cache(pool);
+    void* obj;
+    void* more;
+
+    if(c && c->n)
+    { return c->objs[--c->n]; }
+
+    pthread_mutex_lock(&(pool->lock));
+
+    obj = sr_pool_take(pool, 1);
+    while(c && obj && c->n < SR_POOL_CACHE / 2 &&
+          (more = sr_pool_take(pool, 0)) != 0)
+    { c->objs[c->n++] = more; }
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    return obj;
+} /* -- sr_pool_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_put(..)
+ * Scope:  Global
+ *
+ * Return an object obtained from sr_pool_get.  A full thread cache is
+ * emptied to half full on the way.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_put(struct sr_pool* pool, void* obj)
+{
+    struct sr_pool_cache* c;
+
+    if(obj == 0)
+    { return; }
+
+    c = sr_pool_cache(pool);
+    if(c && c->n < SR_POOL_CACHE)
+    {
+        c->objs[c->n++] = obj;
+        return;
+    }
+
+    pthread_mutex_lock(&(pool->lock));
+
+    sr_pool_give(pool, obj);
+    while(c && c->n > SR_POOL_CACHE / 2)
+    { sr_pool_give(pool, c->objs[--c->n]); }
+
+    pthread_mutex_unlock(&(pool->lock));
+} /* -- sr_pool_put -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_destroy(..)
+ * Scope:  Global
+ *
+ * Release every batch.  Objects still handed out become invalid.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_destroy(struct sr_pool* pool)
+{
+    struct sr_pool_batch* batch;
+    struct sr_pool_batch* next;
+    struct sr_pool** p;
+    int i;
+
+    pthread_mutex_lock(&sr_pool_list_lock);
+    for(p = &sr_pool_list; *p; p = &((*p)->next))
+    {
+        if(*p == pool)
+        {
+            *p = pool->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sr_pool_list_lock);
+
+    for(batch = (struct sr_pool_batch*)pool->batches; batch; batch = next)
+    {
+        next = batch->next;
+        if(batch->mapped)
+        { munmap(batch, batch->mapped); }
+        else
+        { free(batch); }
+    }
+
+    pool->batches = 0;
+    pool->free_list = 0;
+    pool->total = 0;
+    pool->in_use = 0;
+    for(i = 0; i < SR_POOL_THREADS; i++)
+    { pool->caches[i].n = 0; }
+    pthread_mutex_destroy(&(pool->lock));
+} /* -- sr_pool_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_format(..)
+ * Scope:  Global
+ *
+ * One line per live pool into buf: objects carved out, held by callers,
+ * sitting in thread caches, the high water mark of the last two together
+ * and the memory behind it all.  Returns the length, as snprintf.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_pool_format(char* buf, unsigned int size)
+{
+    struct sr_pool* pool;
+    unsigned int len = 0, cached;
+    int i;
+
+    len += snprintf(buf, size, "%-12s %8s %10s %10s %10s %10s %12s %5s\n",
+            "pool", "size", "objects", "in use", "cached", "high water",
+            "bytes", "huge");
+
+    pthread_mutex_lock(&sr_pool_list_lock);
+    for(pool = sr_pool_list; pool && len < size; pool = pool->next)
+    {
+        cached = 0;
+        for(i = 0; i < SR_POOL_THREADS; i++)
+        { cached += __atomic_load_n(&(pool->caches[i].n), __ATOMIC_RELAXED); }
+
+        pthread_mutex_lock(&(pool->lock));
+        len += snprintf(buf + len, size - len,
+                "%-12s %8lu %10u %10u %10u %10u %12llu %2u/%-2u\n",
+                pool->name, (unsigned long)pool->obj_size, pool->total,
+                pool->in_use > cached ? pool->in_use - cached : 0, cached,
+                pool->high_water,
+                (unsigned long long)pool->total * pool->obj_size,
+                pool->huge, pool->batches_n);
+        pthread_mutex_unlock(&(pool->lock));
+    }
+    pthread_mutex_unlock(&sr_pool_list_lock);
+
+    return len;
+} /* -- sr_pool_format -- */
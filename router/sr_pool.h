@@ -0,0 +1,82 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.h
+ *
+ * Description:
+ *
+ * Fixed-size object pools.  Objects are carved out of large batches and
+ * recycled through a free list so that steady-state packet processing
+ * never has to go back to malloc.
+ *
+ * Each thread keeps a small cache of objects per pool, so most gets and
+ * puts do not take the pool lock; the shared free list is only touched
+ * to move half a cache at a time.  An object may be put by a different
+ * thread than the one that got it.  Objects in the cache of a thread
+ * that has exited are not reused until the pool is destroyed.
+ *
+ * Pools created with SR_POOL_HUGE take their batches from 2MB huge pages
+ * once sr_pool_hugepages(1) has been called (sr -H), falling back to
+ * ordinary pages if none are reserved.  Every live pool is listed by
+ * sr_pool_format, which is part of the router statistics.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_POOL_H
+#define SR_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define SR_POOL_CACHE   32      /* objects a thread keeps per pool */
+#define SR_POOL_THREADS 16      /* threads with a cache, the rest lock */
+
+/* flags */
+#define SR_POOL_HUGE    0x1     /* back the batches with huge pages */
+
+struct sr_pool_cache
+{
+    unsigned int n;
+    void* objs[SR_POOL_CACHE];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pool
+ *
+ * A pool hands out objects of exactly obj_size bytes.  When the free list
+ * runs dry another batch of 'batch' objects is allocated; batches are
+ * only released by sr_pool_destroy.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pool
+{
+    const char* name;
+    size_t obj_size;
+    unsigned int batch;
+    int flags;
+    unsigned int total;      /* objects carved out so far */
+    unsigned int in_use;     /* objects off the free list, cached included */
+    unsigned int high_water; /* most in_use has been */
+    unsigned int batches_n;  /* batches allocated */
+    unsigned int huge;       /* of which on huge pages */
+    void* free_list;         /* singly linked through the first word */
+    void* batches;           /* list of batches, for destroy */
+    pthread_mutex_t lock;
+    struct sr_pool* next;    /* all live pools, for sr_pool_format */
+    struct sr_pool_cache caches[SR_POOL_THREADS];
+};
+
+int   sr_pool_init(struct sr_pool* pool, const char* name, size_t obj_size,
+                   unsigned int batch, int flags);
+void* sr_pool_get(struct sr_pool* pool);
+void  sr_pool_put(struct sr_pool* pool, void* obj);
+void  sr_pool_destroy(struct sr_pool* pool);
+
+void  sr_pool_hugepages(int on);
+int   sr_pool_format(char* buf, unsigned int size);
+
+/* -- pools of one type -- */
+#define SR_POOL_INIT(pool, name, type, batch, flags) \
+    sr_pool_init((pool), (name), sizeof(type), (batch), (flags))
+#define SR_POOL_GET(pool, type) ((type*)sr_pool_get(pool))
+
+#endif /* -- SR_POOL_H -- */
@@ -0,0 +1,211 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.c
+ *
+ * Description:
+ *
+ * Epoch based reclamation, see sr_rcu.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_rcu.h"
+
+#define SR_RCU_WAIT_NS 50000     /* between looks at the readers */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rcu_retired
+ *
+ * Something unlinked, waiting for the readers that might see it.  The
+ * list is in the order things were retired, so in stamp order too.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rcu_retired
+{
+    uint64_t stamp;
+    void (*fn)(void* arg, void* p);
+    void* arg;
+    void* p;
+    struct sr_rcu_retired* next;
+};
+
+uint64_t sr_rcu_epoch = 1;
+__thread struct sr_rcu_reader* sr_rcu_self = 0;
+
+static struct sr_rcu_reader* sr_rcu_readers = 0;
+static struct sr_rcu_retired* sr_rcu_head = 0;
+static struct sr_rcu_retired* sr_rcu_tail = 0;
+static pthread_mutex_t sr_rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_register(..)
+ * Scope:  Global
+ *
+ * Add the calling thread to the readers writers wait on.  Called by
+ * its first sr_rcu_read_lock; returns 0 if out of memory, in which
+ * case the thread reads unprotected.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rcu_reader* sr_rcu_register(void)
+{
+    struct sr_rcu_reader* r;
+
+    if((r = (struct sr_rcu_reader*)calloc(1, sizeof(*r))) == 0)
+    {
+        fprintf(stderr, "rcu: out of memory, reading unprotected\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(&sr_rcu_lock);
+    r->next = sr_rcu_readers;
+    __atomic_store_n(&sr_rcu_readers, r, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sr_rcu_lock);
+
+    sr_rcu_self = r;
+    return r;
+} /* -- sr_rcu_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_stamp(..)
+ * Scope:  Global
+ *
+ * Close the current epoch and return it.  Whatever the caller unlinked
+ * before the call may be reused once sr_rcu_passed(stamp) is true.
+ *
+ *---------------------------------------------------------------------*/
+
+uint64_t sr_rcu_stamp(void)
+{
+    return __atomic_fetch_add(&sr_rcu_epoch, 1, __ATOMIC_SEQ_CST);
+} /* -- sr_rcu_stamp -- */
+
+/* -- no reader is still in stamp or an earlier epoch -- */
+int sr_rcu_passed(uint64_t stamp)
+{
+    struct sr_rcu_reader* r;
+    uint64_t e;
+
+    /* -- pairs with the fence in sr_rcu_read_lock: a reader whose epoch
+     *    is not seen here reads after everything unlinked so far -- */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for(r = __atomic_load_n(&sr_rcu_readers, __ATOMIC_ACQUIRE); r;
+        r = r->next)
+    {
+        e = __atomic_load_n(&(r->epoch), __ATOMIC_ACQUIRE);
+        if(e && e <= stamp)
+        { return 0; }
+    }
+    return 1;
+} /* -- sr_rcu_passed -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_reclaim(..)
+ * Scope:  Global
+ *
+ * Run everything retired that no reader can see any more.  Done by
+ * every sr_rcu_retire, so writers only need it to free memory after
+ * their last change.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_reclaim(void)
+{
+    struct sr_rcu_retired *ready = 0, *last = 0, *r;
+
+    pthread_mutex_lock(&sr_rcu_lock);
+    while(sr_rcu_head && sr_rcu_passed(sr_rcu_head->stamp))
+    {
+        r = sr_rcu_head;
+        sr_rcu_head = r->next;
+        r->next = 0;
+        if(last)
+        { last->next = r; }
+        else
+        { ready = r; }
+        last = r;
+    }
+    if(sr_rcu_head == 0)
+    { sr_rcu_tail = 0; }
+    pthread_mutex_unlock(&sr_rcu_lock);
+
+    /* -- outside the lock, fn may retire more -- */
+    while((r = ready))
+    {
+        ready = r->next;
+        r->fn(r->arg, r->p);
+        free(r);
+    }
+} /* -- sr_rcu_reclaim -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_retire(..)
+ * Scope:  Global
+ *
+ * Call fn(arg, p) once no reader can still see p, which the caller
+ * has already unlinked.  fn runs on some later writer's thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_retire(void (*fn)(void* arg, void* p), void* arg, void* p)
+{
+    struct sr_rcu_retired* r;
+
+    /* -- REQUIRES -- */
+    assert(fn);
+
+    if((r = (struct sr_rcu_retired*)malloc(sizeof(*r))) == 0)
+    {
+        sr_rcu_synchronize();
+        fn(arg, p);
+        return;
+    }
+    r->fn = fn;
+    r->arg = arg;
+    r->p = p;
+    r->next = 0;
+
+    pthread_mutex_lock(&sr_rcu_lock);
+    r->stamp = sr_rcu_stamp();
+    if(sr_rcu_tail)
+    { sr_rcu_tail->next = r; }
+    else
+    { sr_rcu_head = r; }
+    sr_rcu_tail = r;
+    pthread_mutex_unlock(&sr_rcu_lock);
+
+    sr_rcu_reclaim();
+} /* -- sr_rcu_retire -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_synchronize(..)
+ * Scope:  Global
+ *
+ * Wait until every reader inside a read section now has left it, then
+ * reclaim.  Must not be called from inside one.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_synchronize(void)
+{
+    struct timespec ts;
+    uint64_t stamp;
+
+    /* -- REQUIRES -- */
+    assert(sr_rcu_self == 0 || sr_rcu_self->nest == 0);
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = SR_RCU_WAIT_NS;
+
+    stamp = sr_rcu_stamp();
+    while(!sr_rcu_passed(stamp))
+    { nanosleep(&ts, 0); }
+
+    sr_rcu_reclaim();
+} /* -- sr_rcu_synchronize -- */
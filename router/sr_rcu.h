@@ -0,0 +1,90 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.h
+ *
+ * Description:
+ *
+ * Epoch based reclamation, so the routing table can change under the
+ * forwarding path without it taking a lock.
+ *
+ * Readers bracket their use of shared state with sr_rcu_read_lock and
+ * sr_rcu_read_unlock: the forwarding path does so per packet, and any
+ * other thread that follows sr->fib or the route list does the same.
+ * A reader may not block inside, as writers wait on it.
+ *
+ * Writers make a change visible with a single release store, a pointer
+ * or a fib entry, and never change in place what a reader might be
+ * looking at.  What the change unlinked goes to sr_rcu_retire and is
+ * freed once every reader that might still see it has left its read
+ * section.  sr_rcu_stamp and sr_rcu_passed do the same for state a
+ * writer recycles itself, such as fib entries and chunks.
+ *
+ * The global epoch only ever grows.  A reader publishes the epoch it
+ * started in; something unlinked in epoch e is unreachable for every
+ * reader that started after e, so it is safe once no reader is still
+ * in e or earlier.  There is one domain for the process.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RCU_H
+#define SR_RCU_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rcu_reader
+ *
+ * One per thread that has read, allocated on its first read section and
+ * kept for the life of the process, so a thread that exits outside one
+ * simply stays idle.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rcu_reader
+{
+    uint64_t epoch;             /* started in, 0 outside a read section */
+    unsigned int nest;
+    struct sr_rcu_reader* next;
+};
+
+extern uint64_t sr_rcu_epoch;
+extern __thread struct sr_rcu_reader* sr_rcu_self;
+
+struct sr_rcu_reader* sr_rcu_register(void);
+
+static __inline__ void sr_rcu_read_lock(void)
+{
+    struct sr_rcu_reader* r = sr_rcu_self;
+
+    if(r == 0 && (r = sr_rcu_register()) == 0)
+    { return; }
+    if(r->nest++ == 0)
+    {
+        __atomic_store_n(&(r->epoch),
+                __atomic_load_n(&sr_rcu_epoch, __ATOMIC_RELAXED),
+                __ATOMIC_RELAXED);
+        /* -- the epoch must be seen before anything read under it -- */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+static __inline__ void sr_rcu_read_unlock(void)
+{
+    struct sr_rcu_reader* r = sr_rcu_self;
+
+    if(r && --r->nest == 0)
+    { __atomic_store_n(&(r->epoch), 0, __ATOMIC_RELEASE); }
+}
+
+uint64_t sr_rcu_stamp(void);
+int  sr_rcu_passed(uint64_t stamp);
+void sr_rcu_retire(void (*fn)(void* arg, void* p), void* arg, void* p);
+void sr_rcu_reclaim(void);
+void sr_rcu_synchronize(void);
+
+#endif /* -- SR_RCU_H -- */
@@ -0,0 +1,315 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.c
+ *
+ * Description:
+ *
+ * Session logs, see sr_replay.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_replay.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_arpcache.h"
+#include "vnscommand.h"
+#include "sr_alloc.h"
+
+#define SR_REPLAY_MAX_RTABLE (1 << 24)
+
+struct sr_replay
+{
+    int mode;                   /* SR_REPLAY_RECORD or SR_REPLAY_PLAY */
+    FILE* fp;
+    pthread_mutex_t lock;       /* the reader and the ARP timer record */
+    uint64_t started_ns;
+    uint64_t mono0;             /* CLOCK_MONOTONIC at started_ns */
+    long first;                 /* offset of the first record */
+};
+
+/* -- the time of the record being replayed, 0 when not replaying -- */
+static uint64_t sr_replay_clock_ns = 0;
+
+static uint64_t sr_replay_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_replay_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_time(..)
+ * Scope:  Global
+ *
+ * time() for the ARP cache, which is the recorded time while replaying.
+ *
+ *---------------------------------------------------------------------*/
+
+time_t sr_time(void)
+{
+    uint64_t ns = __atomic_load_n(&sr_replay_clock_ns, __ATOMIC_RELAXED);
+
+    return ns ? (time_t)(ns / 1000000000) : time(0);
+} /* -- sr_time -- */
+
+int sr_replaying(struct sr_instance* sr)
+{ return sr->replay && sr->replay->mode == SR_REPLAY_PLAY; }
+
+/*---------------------------------------------------------------------
+ * Recording
+ *---------------------------------------------------------------------*/
+
+struct sr_replay* sr_record_open(struct sr_instance* sr, const char* path)
+{
+    struct sr_replay* rp;
+    struct sr_replay_hdr hdr;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    rp = (struct sr_replay*)calloc(1, sizeof(struct sr_replay));
+    if(rp == 0)
+    { return 0; }
+
+    if((rp->fp = fopen(path, "wb")) == 0)
+    {
+        perror(path);
+        free(rp);
+        return 0;
+    }
+
+    rp->mode = SR_REPLAY_RECORD;
+    rp->started_ns = sr_replay_ns(CLOCK_REALTIME);
+    rp->mono0 = sr_replay_ns(CLOCK_MONOTONIC);
+    pthread_mutex_init(&(rp->lock), 0);
+
+    hdr.magic = SR_REPLAY_MAGIC;
+    hdr.version = SR_REPLAY_VERSION;
+    hdr.started_ns = rp->started_ns;
+    if(fwrite(&hdr, sizeof(hdr), 1, rp->fp) != 1)
+    {
+        perror(path);
+        fclose(rp->fp);
+        free(rp);
+        return 0;
+    }
+
+    return rp;
+} /* -- sr_record_open -- */
+
+static void sr_record(struct sr_replay* rp, uint32_t type,
+                      const void* buf, uint32_t len)
+{
+    struct sr_replay_rec rec;
+
+    if(rp == 0 || rp->mode != SR_REPLAY_RECORD)
+    { return; }
+
+    pthread_mutex_lock(&(rp->lock));
+    rec.ts_ns = sr_replay_ns(CLOCK_MONOTONIC) - rp->mono0;
+    rec.type = type;
+    rec.len = len;
+    fwrite(&rec, sizeof(rec), 1, rp->fp);
+    if(len)
+    { fwrite(buf, len, 1, rp->fp); }
+    pthread_mutex_unlock(&(rp->lock));
+} /* -- sr_record -- */
+
+void sr_record_command(struct sr_replay* rp, const uint8_t* buf, uint32_t len)
+{ sr_record(rp, SR_REC_COMMAND, buf, len); }
+
+/* ticks come once a second, which is also how often the log is flushed */
+void sr_record_tick(struct sr_replay* rp)
+{
+    if(rp == 0 || rp->mode != SR_REPLAY_RECORD)
+    { return; }
+
+    sr_record(rp, SR_REC_TICK, 0, 0);
+    pthread_mutex_lock(&(rp->lock));
+    fflush(rp->fp);
+    pthread_mutex_unlock(&(rp->lock));
+} /* -- sr_record_tick -- */
+
+void sr_record_rtable(struct sr_replay* rp, struct sr_instance* sr)
+{
+    char dest[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+    struct sr_rt* rt;
+    char* text;
+    size_t size = 256, len = 0;
+
+    for(rt = sr_rt_first(sr->vrfs[0]); rt; rt = sr_rt_next(sr->vrfs[0], rt))
+    { size += 3 * INET_ADDRSTRLEN + sr_IFACE_NAMELEN + 4; }
+
+    text = (char*)malloc(size);
+    if(text == 0)
+    { return; }
+
+    for(rt = sr_rt_first(sr->vrfs[0]); rt; rt = sr_rt_next(sr->vrfs[0], rt))
+    {
+        inet_ntop(AF_INET, &(rt->dest), dest, sizeof(dest));
+        inet_ntop(AF_INET, &(rt->gw), gw, sizeof(gw));
+        inet_ntop(AF_INET, &(rt->mask), mask, sizeof(mask));
+        len += snprintf(text + len, size - len, "%s %s %s %s\n",
+                        dest, gw, mask, rt->interface);
+    }
+
+    sr_record(rp, SR_REC_RTABLE, text, len);
+    free(text);
+} /* -- sr_record_rtable -- */
+
+/*---------------------------------------------------------------------
+ * Replay
+ *---------------------------------------------------------------------*/
+
+struct sr_replay* sr_replay_open(struct sr_instance* sr, const char* path)
+{
+    struct sr_replay* rp;
+    struct sr_replay_hdr hdr;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    rp = (struct sr_replay*)calloc(1, sizeof(struct sr_replay));
+    if(rp == 0)
+    { return 0; }
+
+    if((rp->fp = fopen(path, "rb")) == 0)
+    {
+        perror(path);
+        free(rp);
+        return 0;
+    }
+
+    if(fread(&hdr, sizeof(hdr), 1, rp->fp) != 1 ||
+       hdr.magic != SR_REPLAY_MAGIC || hdr.version != SR_REPLAY_VERSION)
+    {
+        fprintf(stderr, "%s is not a session log\n", path);
+        fclose(rp->fp);
+        free(rp);
+        return 0;
+    }
+
+    rp->mode = SR_REPLAY_PLAY;
+    rp->started_ns = hdr.started_ns;
+    rp->first = ftell(rp->fp);
+    pthread_mutex_init(&(rp->lock), 0);
+
+    __atomic_store_n(&sr_replay_clock_ns, rp->started_ns, __ATOMIC_RELAXED);
+
+    return rp;
+} /* -- sr_replay_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_load_rt(..)
+ * Scope:  Global
+ *
+ * Load the routing table recorded in the log.  It is written once the
+ * session is up, so look ahead for it and come back to the start.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_replay_load_rt(struct sr_replay* rp, struct sr_instance* sr)
+{
+    struct sr_replay_rec rec;
+    char *text = 0;
+    int ret = -1;
+
+    while(fread(&rec, sizeof(rec), 1, rp->fp) == 1)
+    {
+        if(rec.type != SR_REC_RTABLE)
+        {
+            if(fseek(rp->fp, rec.len, SEEK_CUR) != 0)
+            { break; }
+            continue;
+        }
+        if(rec.len > SR_REPLAY_MAX_RTABLE ||
+           (text = (char*)malloc(rec.len + 1)) == 0)
+        { break; }
+        if(rec.len && fread(text, rec.len, 1, rp->fp) != 1)
+        { break; }
+
+        if(sr_load_rt_buf(sr->vrfs[0], text, rec.len) >= 0)
+        { ret = 0; }
+        break;
+    }
+
+    free(text);
+    fseek(rp->fp, rp->first, SEEK_SET);
+    return ret;
+} /* -- sr_replay_load_rt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_next(..)
+ * Scope:  Global
+ *
+ * Copy the next logged command into buf, as it came off the socket, and
+ * return its length.  ARP timer ticks on the way are run here,
+ * with the clock set to when they happened.  Returns 0 at the end of
+ * the log and -1 if it is corrupt.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_replay_next(struct sr_replay* rp, struct sr_instance* sr,
+                   uint8_t* buf, int size)
+{
+    struct sr_replay_rec rec;
+
+    for(;;)
+    {
+        if(fread(&rec, sizeof(rec), 1, rp->fp) != 1)
+        { return 0; }
+
+        __atomic_store_n(&sr_replay_clock_ns, rp->started_ns + rec.ts_ns,
+                         __ATOMIC_RELAXED);
+
+        switch(rec.type)
+        {
+            case SR_REC_COMMAND:
+                if(rec.len < 8 || rec.len > VNS_MAX_COMMAND ||
+                   rec.len > (uint32_t)size)
+                {
+                    fprintf(stderr, "Error: bad command in session log\n");
+                    return -1;
+                }
+                if(fread(buf, rec.len, 1, rp->fp) != 1)
+                {
+                    fprintf(stderr, "Session log ends mid command\n");
+                    return 0;
+                }
+                return rec.len;
+
+            case SR_REC_TICK:
+                sr_arpcache_tick(sr);
+                break;
+
+            default:
+                if(fseek(rp->fp, rec.len, SEEK_CUR) != 0)
+                { return -1; }
+                break;
+        }
+    }
+} /* -- sr_replay_next -- */
+
+void sr_replay_close(struct sr_replay* rp)
+{
+    if(rp == 0)
+    { return; }
+
+    if(rp->mode == SR_REPLAY_PLAY)
+    { __atomic_store_n(&sr_replay_clock_ns, 0, __ATOMIC_RELAXED); }
+
+    fclose(rp->fp);
+    pthread_mutex_destroy(&(rp->lock));
+    free(rp);
+} /* -- sr_replay_close -- */
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.h
+ *
+ * Description:
+ *
+ * Recording of a VNS session and deterministic replay of it.
+ *
+ * With -w the router appends every command sr_read_from_server_expect
+ * receives to a session log, exactly as it came off the socket, along
+ * with every tick of the ARP cache timer and the routing table it ended
+ * up loading, table 0 of sr_vrf.h.  With -P it runs without a server: the
+ * routing table comes from the log, and sr_read_from_server feeds the
+ * logged commands through the usual dispatch one after the other,
+ * running the ARP ticks in between where they happened.  The tables of
+ * -V are loaded from their files as usual.
+ *
+ * During replay time stands still between records.  sr_time, which the
+ * ARP cache uses instead of time(), returns the time of the record being
+ * replayed, so entries age and requests are retried exactly as they did
+ * when recorded however fast the replay runs.  Latency histograms still
+ * measure real time.
+ *
+ * The log is a header followed by records, all in host byte order; the
+ * commands themselves are as sent by the server, in network byte order.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_REPLAY_H
+#define SR_REPLAY_H
+
+#include <time.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_REPLAY_MAGIC   0x52565253    /* "SRVR" */
+#define SR_REPLAY_VERSION 1
+
+#define SR_REPLAY_RECORD 1
+#define SR_REPLAY_PLAY   2
+
+/* record types */
+#define SR_REC_COMMAND 1    /* a command from the server */
+#define SR_REC_TICK    2    /* sr_arpcache_timeout woke up */
+#define SR_REC_RTABLE  3    /* the routing table, as rtable file text */
+
+struct sr_replay_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t started_ns;    /* CLOCK_REALTIME at the start of recording */
+};
+
+struct sr_replay_rec
+{
+    uint64_t ts_ns;         /* since started_ns */
+    uint32_t type;
+    uint32_t len;           /* bytes following */
+};
+
+struct sr_instance;
+struct sr_replay;
+
+struct sr_replay* sr_record_open(struct sr_instance* sr, const char* path);
+void sr_record_command(struct sr_replay* rp, const uint8_t* buf, uint32_t len);
+void sr_record_tick(struct sr_replay* rp);
+void sr_record_rtable(struct sr_replay* rp, struct sr_instance* sr);
+
+struct sr_replay* sr_replay_open(struct sr_instance* sr, const char* path);
+int  sr_replay_load_rt(struct sr_replay* rp, struct sr_instance* sr);
+int  sr_replay_next(struct sr_replay* rp, struct sr_instance* sr,
+                    uint8_t* buf, int size);
+
+int  sr_replaying(struct sr_instance* sr);
+void sr_replay_close(struct sr_replay* rp);
+
+time_t sr_time(void);
+
+#endif /* -- SR_REPLAY_H -- */
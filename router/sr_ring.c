@@ -0,0 +1,111 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.c
+ *
+ * Description:
+ *
+ * Single producer / single consumer record ring, see sr_ring.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sr_ring.h"
+#include "sr_alloc.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_create(..)
+ * Scope:  Global
+ *
+ * Allocate an empty ring of 'size' bytes (a power of two).
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ring* sr_ring_create(unsigned int size)
+{
+    struct sr_ring* ring;
+
+    /* -- REQUIRES -- */
+    assert(size >= 64 && (size & (size - 1)) == 0);
+
+    ring = (struct sr_ring*)calloc(1, sizeof(struct sr_ring));
+    if(ring == 0)
+    { return 0; }
+
+    ring->buf = (uint8_t*)malloc(size);
+    if(ring->buf == 0)
+    {
+        free(ring);
+        return 0;
+    }
+    ring->size = size;
+
+    return ring;
+} /* -- sr_ring_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_reserve(..)
+ * Scope:  Global
+ *
+ * Find 'size' contiguous free bytes for the next record.  On success
+ * *pos is set to the position of the record, which becomes visible to
+ * the consumer once sr_ring_commit publishes it; the committed size may
+ * be smaller than the reserved one.  Returns 0 and counts a drop if the
+ * ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_ring_reserve(struct sr_ring* ring, unsigned int size, uint64_t* pos)
+{
+    uint64_t tail = __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+    unsigned int off = ring->head & (ring->size - 1);
+    unsigned int contig = ring->size - off;
+    unsigned int need = size;
+    struct sr_ring_rec* pad;
+
+    if(contig < size)
+    { need += contig; }
+
+    if(ring->size - (ring->head - tail) < need)
+    {
+        ring->dropped++;
+        return 0;
+    }
+
+    *pos = ring->head;
+    if(contig < size)
+    {
+        pad = (struct sr_ring_rec*)(ring->buf + off);
+        pad->size = contig;
+        pad->kind = SR_RING_PAD;
+        *pos += contig;
+        off = 0;
+    }
+
+    return ring->buf + off;
+} /* -- sr_ring_reserve -- */
+
+void sr_ring_commit(struct sr_ring* ring, uint64_t pos, unsigned int size)
+{
+    __atomic_store_n(&(ring->head), pos + SR_RING_ALIGN(size),
+            __ATOMIC_RELEASE);
+} /* -- sr_ring_commit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_head(..) / sr_ring_release(..)
+ * Scope:  Global
+ *
+ * The consumer reads records from ring->tail up to sr_ring_head and
+ * then hands the space back with sr_ring_release.
+ *
+ *---------------------------------------------------------------------*/
+
+uint64_t sr_ring_head(struct sr_ring* ring)
+{
+    return __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+} /* -- sr_ring_head -- */
+
+void sr_ring_release(struct sr_ring* ring, uint64_t tail)
+{
+    __atomic_store_n(&(ring->tail), tail, __ATOMIC_RELEASE);
+} /* -- sr_ring_release -- */
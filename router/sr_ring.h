@@ -0,0 +1,73 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.h
+ *
+ * Description:
+ *
+ * Single producer / single consumer ring of variable sized records,
+ * used to hand data from a forwarding thread to a background thread
+ * without locks.
+ *
+ * Records are a multiple of 8 bytes, start with struct sr_ring_rec and
+ * never wrap.  If a record does not fit before the end of the ring the
+ * producer writes a pad record and starts again at the front, so the
+ * consumer must skip records of kind SR_RING_PAD.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RING_H
+#define SR_RING_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_RING_PAD 0
+
+#define SR_RING_ALIGN(x) (((x) + 7) & ~7)
+
+struct sr_ring_rec
+{
+    uint16_t size;      /* whole record, multiple of 8 */
+    uint8_t  kind;      /* SR_RING_PAD or owner defined */
+    uint8_t  aux;       /* owner defined */
+    uint32_t len;       /* owner defined */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ring
+ *
+ * head is only written by the producer and tail only by the consumer;
+ * they live on separate cache lines.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ring
+{
+    uint64_t head;
+    char pad0[56];
+    uint64_t tail;
+    char pad1[56];
+    unsigned long dropped;  /* records refused because the ring was full */
+    unsigned int size;      /* bytes, power of two */
+    uint8_t* buf;
+    struct sr_ring* next;   /* for the owner's list of rings */
+};
+
+struct sr_ring* sr_ring_create(unsigned int size);
+
+/* -- producer side -- */
+void* sr_ring_reserve(struct sr_ring* ring, unsigned int size, uint64_t* pos);
+void  sr_ring_commit(struct sr_ring* ring, uint64_t pos, unsigned int size);
+
+/* -- consumer side -- */
+uint64_t sr_ring_head(struct sr_ring* ring);
+void     sr_ring_release(struct sr_ring* ring, uint64_t tail);
+
+#define sr_ring_at(ring, pos) \
+    ((struct sr_ring_rec*)((ring)->buf + ((pos) & ((ring)->size - 1))))
+
+#endif /* -- SR_RING_H -- */
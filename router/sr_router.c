@@ -23,6 +23,16 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_icmp.h"
+#include "sr_log.h"
+#include "sr_flight.h"
+#include "sr_stats.h"
+#include "sr_tsc.h"
+#include "sr_stage.h"
+#include "sr_replay.h"
+#include "sr_fib.h"
+#include "sr_ecmp.h"
+#include "sr_alloc.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -37,8 +47,11 @@ void sr_init(struct sr_instance* sr)
 	/* REQUIRES */
 	assert(sr);
 
-	/* Initialize cache and cache cleanup thread */
-	sr_arpcache_init(&(sr->cache));
+	/* The ARP caches come with the routing tables (sr_rt_init), the
+	   thread that cleans them up is started here */
+
+	/* Frames for ICMP errors, filled from the per interface templates */
+	sr_pool_init(&(sr->reply_pool), "reply", SR_ICMP_ERR_LEN, SR_ICMP_POOL_BATCH, 0);
 
 	pthread_attr_init(&(sr->attr));
 	pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
@@ -46,7 +59,9 @@ void sr_init(struct sr_instance* sr)
 	pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
 	pthread_t thread;
 
-	pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
+	/* A replay runs the timer ticks from the session log instead */
+	if (!sr_replaying(sr))
+		pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
     
 	/* Add initialization code here! */
 
@@ -68,194 +83,383 @@ void sr_init(struct sr_instance* sr)
  *
  *---------------------------------------------------------------------*/
 
-void sr_handlepacket(struct sr_instance* sr,
+static void sr_handle_ip(struct sr_instance* sr, struct sr_vrf *vrf,
+			 uint8_t *packet, unsigned int len, char *interface,
+			 struct sr_rt *const *route);
+
+/* vrf is the routing table of interface, route, if not 0, what
+   rt_entry_lpm would find in it for an IP packet */
+static void sr_handle_frame(struct sr_instance* sr,
+        struct sr_vrf* vrf,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */)
+        char* interface/* lent */,
+        struct sr_rt *const *route)
 {
 	/* REQUIRES */
 	assert(sr);
+	assert(vrf);
 	assert(packet);
 	assert(interface);
 
-	printf("*** -> Received packet of length %d \n",len);
+	SR_STAGE(SR_STAGE_LOG, sr_log_debug("*** -> Received packet of length %d\n", len));
     
 	sr_ethernet_hdr_t *etnet_hdr;
 	etnet_hdr = (sr_ethernet_hdr_t *)packet;
 	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
+	uint16_t ethertype = 0;
 
 	/* Check length */
 	if (len < etnet_hdr_size){
 		/* Send ICMP Msg */
+		sr_drop(sr, vrf, SR_DROP_SHORT);
         	return;
     	}
+	SR_STAGE(SR_STAGE_PARSE, ethertype = ntohs((*etnet_hdr).ether_type));
 
 	/* Receive ARP */
-    	if (ntohs((*etnet_hdr).ether_type) == ethertype_arp) {
-    		printf("Receive ARP \n\n");
-		print_hdrs(packet, len);
-		printf("\n\n");
-    		handle_arp(sr, packet, len, interface);
+    	if (ethertype == ethertype_arp) {
+    		sr_log_debug("Receive ARP\n");
+		sr_log_hdrs(SR_LOG_DEBUG, packet, len);
+    		handle_arp(sr, vrf, packet, len, interface);
 		return;
     	}
 	
 	/* Receive IP */
-    	else if (ntohs((*etnet_hdr).ether_type) == ethertype_ip) {
-    		printf("Receive IP \n\n");
-		print_hdrs(packet, len);
-		printf("\n\n");
-		handle_ip(sr, packet, len, interface);
+    	else if (ethertype == ethertype_ip) {
+		SR_STAGE(SR_STAGE_LOG, sr_log_debug("Receive IP\n");
+				       sr_log_hdrs(SR_LOG_DEBUG, packet, len));
+		sr_handle_ip(sr, vrf, packet, len, interface, route);
 		return;
     	}
     	/* fill in code here */
+	sr_drop(sr, vrf, SR_DROP_ETHERTYPE);
 
 }/* end sr_ForwardPacket */
 
+void sr_handlepacket(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        char* interface/* lent */)
+{
+	sr_handle_frame(sr, sr_vrf_of(sr, interface), packet, len, interface, 0);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_burst(..)
+ * Scope:  Global
+ *
+ * Handle n frames received together, as sr_handlepacket would one after
+ * the other, but with the routes of the IP packets among them looked
+ * up in one sr_fib_lookup_burst, which overlaps their cache misses.
+ * Each lookup covers a run of frames from interfaces of one routing
+ * table.  The caller is in one sr_rcu read section for the whole burst.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket_burst(struct sr_instance* sr,
+        uint8_t ** packets/* lent */,
+        const unsigned int* lens,
+        char** interfaces/* lent */,
+        unsigned int n)
+{
+	uint32_t dsts[SR_FIB_BURST];
+	struct sr_rt *routes[SR_FIB_BURST];
+	unsigned int i, k, m, ip_min = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t);
+	struct sr_vrf *vrf;
+	struct sr_fib *fib;
+
+	/* REQUIRES */
+	assert(sr);
+	assert(packets || n == 0);
+
+	for (k = 0; k < n; k += m) {
+		/* The frames up to the next one from another table */
+		vrf = sr_vrf_of(sr, interfaces[k]);
+		for (m = 1; m < SR_FIB_BURST && k + m < n; m++) {
+			if (interfaces[k + m] != interfaces[k + m - 1] &&
+			    sr_vrf_of(sr, interfaces[k + m]) != vrf)
+				break;
+		}
+
+		/* Without a fib each packet walks the table as before */
+		fib = __atomic_load_n(&vrf->fib, __ATOMIC_ACQUIRE);
+		if (fib == NULL) {
+			for (i = 0; i < m; i++)
+				sr_handle_frame(sr, vrf, packets[k + i], lens[k + i], interfaces[k + i], 0);
+			continue;
+		}
+
+		/* Frames that are not IP look up 0.0.0.0, and ignore it */
+		for (i = 0; i < m; i++) {
+			sr_ethernet_hdr_t *etnet_hdr = (sr_ethernet_hdr_t *)packets[k + i];
+			dsts[i] = 0;
+			if (lens[k + i] >= ip_min && ntohs(etnet_hdr->ether_type) == ethertype_ip)
+				dsts[i] = ntohl(((sr_ip_hdr_t *)(packets[k + i] +
+						sizeof(sr_ethernet_hdr_t)))->ip_dst);
+		}
+		SR_STAGE(SR_STAGE_LPM, sr_fib_lookup_burst(fib, dsts, m, routes));
+
+		for (i = 0; i < m; i++)
+			sr_handle_frame(sr, vrf, packets[k + i], lens[k + i], interfaces[k + i], &routes[i]);
+	}
+} /* -- sr_handlepacket_burst -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_drop(..)
+ * Scope:  Global
+ *
+ * Count a drop and note it against the packet being handled.  Packets
+ * that were queued on an ARP request go through sr_drop_queued instead.
+ *
+ *---------------------------------------------------------------------*/
+
+static const char* sr_drop_reason_names[SR_DROP_MAX] = {
+	"none",
+	"short frame",
+	"unknown ethertype",
+	"arp not for us",
+	"bad checksum",
+	"ttl expired",
+	"no route",
+	"arp failure",
+	"arp queue full",
+	"port unreachable",
+	"icmp ignored",
+	"too big to queue"
+};
+
+void sr_drop(struct sr_instance* sr, struct sr_vrf* vrf, enum sr_drop_reason reason)
+{
+	sr_stats_drop(vrf->id, reason);
+	if (sr->flight)
+		sr_flight_drop(sr->flight, reason);
+}
+
+void sr_drop_queued(struct sr_instance* sr,
+		uint8_t * packet/* lent */,
+		unsigned int len,
+		const char* interface/* lent */,
+		enum sr_drop_reason reason)
+{
+	struct sr_if* iface = sr_get_interface(sr, interface);
+
+	sr_stats_drop(iface ? iface->vrf : 0, reason);
+	if (sr->flight) {
+		sr_flight_record(sr->flight, packet, len,
+				 iface ? iface->index : SR_FLIGHT_NO_IF, SR_FLIGHT_QUEUED, reason);
+	}
+}
+
+const char* sr_drop_reason_name(int reason)
+{
+	if (reason < 0 || reason >= SR_DROP_MAX)
+		return "unknown";
+	return sr_drop_reason_names[reason];
+}
+
 
 void handle_arp(struct sr_instance *sr,
+		     struct sr_vrf *vrf,
 		     uint8_t *packet/* lent */,
 		     unsigned int len,
 		     char *interface/* lent */)
 {
 	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
-	int ip_hdr_size = sizeof(sr_ip_hdr_t);
+	int arp_hdr_size = sizeof(sr_arp_hdr_t);
 
-	if (len < etnet_hdr_size + ip_hdr_size){
-		printf("Router received invalid length\n\n");
+	if (len < etnet_hdr_size + arp_hdr_size){
+		sr_log_debug("Router received invalid length\n");
+		sr_drop(sr, vrf, SR_DROP_SHORT);
         	return;
 	}
+	sr_ethernet_hdr_t *etnet_hdr = (sr_ethernet_hdr_t *)packet;
 	sr_arp_hdr_t *arp_hdr = (sr_arp_hdr_t *)(packet + etnet_hdr_size);
 	
 	/*arp request*/
 	if (ntohs(arp_hdr->ar_op) == arp_op_request){
-		uint8_t *reply_pkt = (uint8_t *)malloc(ip_hdr_size + etnet_hdr_size);
-
-		/*reply headers*/
-		sr_ethernet_hdr_t *reply_etnet_hdr = (sr_ethernet_hdr_t *)reply_pkt;
-		sr_arp_hdr_t *reply_arp_hdr = (sr_arp_hdr_t *)(reply_pkt + etnet_hdr_size);
 		struct sr_if *interface_pt = sr_get_interface(sr, interface);
 
-		reply_arp_hdr->ar_hrd = arp_hdr->ar_hrd;
-		reply_arp_hdr->ar_pro = arp_hdr->ar_pro;
-		reply_arp_hdr->ar_hln = arp_hdr->ar_hln;
-		reply_arp_hdr->ar_pln = arp_hdr->ar_pln;       
-		reply_arp_hdr->ar_op = htons(arp_op_reply);
-
-		replace_arp_hardware_addrs(reply_arp_hdr, interface_pt->addr, arp_hdr->ar_sha);
-		reply_arp_hdr->ar_tip = arp_hdr->ar_sip;
-		reply_arp_hdr->ar_sip = interface_pt->ip;
-		replace_etnet_addrs(reply_etnet_hdr, interface_pt->addr, arp_hdr->ar_sha);
-		reply_etnet_hdr->ether_type = htons(ethertype_arp);
+		if (interface_pt == NULL || arp_hdr->ar_tip != interface_pt->ip) {
+			sr_drop(sr, vrf, SR_DROP_ARP_NOT_FOR_US);
+			return;
+		}
+
+		/* The requester is about to talk to us, learn its mapping and
+		   release anything that was waiting on it */
+		struct sr_arpreq * request = sr_arpcache_insert(&(vrf->cache), arp_hdr->ar_sha, arp_hdr->ar_sip);
+		if (request != NULL) {
+			flush_arpreq_packets(sr, vrf, request, arp_hdr->ar_sha);
+		}
+
+		/* Turn the request into the reply in place */
+		arp_hdr->ar_op = htons(arp_op_reply);
+		memcpy(arp_hdr->ar_tha, arp_hdr->ar_sha, ETHER_ADDR_LEN);
+		memcpy(arp_hdr->ar_sha, interface_pt->addr, ETHER_ADDR_LEN);
+		arp_hdr->ar_tip = arp_hdr->ar_sip;
+		arp_hdr->ar_sip = interface_pt->ip;
+		replace_etnet_addrs(etnet_hdr, interface_pt->addr, arp_hdr->ar_tha);
 		
-		printf("Router send ARP reply\n\n");
-		print_hdrs(reply_pkt, len);
+		sr_log_debug("Router send ARP reply\n");
+		sr_log_hdrs(SR_LOG_DEBUG, packet, len);
 		
-		sr_send_packet(sr, reply_pkt, len, interface);
-		free(reply_pkt);
+		sr_send_packet(sr, packet, len, interface);
 		return;
 	}
 	/*arp reply*/
 	if (ntohs(arp_hdr->ar_op) == arp_op_reply){
-		struct sr_arpreq * request = sr_arpcache_insert(&(sr->cache), arp_hdr->ar_sha, arp_hdr->ar_sip);
+		struct sr_arpreq * request = sr_arpcache_insert(&(vrf->cache), arp_hdr->ar_sha, arp_hdr->ar_sip);
 		if (request != NULL) {
-			struct sr_packet * current_pkt = request->packets;
-			/*loop through all packet for this request*/
-			while (current_pkt != NULL) {
-
-				/*create ethernet header*/
-				struct sr_ethernet_hdr* current_etnet_hdr = (struct sr_ethernet_hdr*)(current_pkt->buf);
-				struct sr_if* current_interface_pt = sr_get_interface(sr, current_pkt->iface);
-
-				replace_etnet_addrs(current_etnet_hdr, current_interface_pt->addr, arp_hdr->ar_sha);
-				
-				printf("Router send Packets waiting in queue\n\n");
-				print_hdrs(current_pkt->buf, current_pkt->len);
-				printf("\n\n %s \n\n\n", current_pkt->iface);
-				sr_send_packet(sr, current_pkt->buf, current_pkt->len, current_pkt->iface);
-				current_pkt = (*current_pkt).next;
-			}
-			sr_arpreq_destroy(&(sr->cache), request);
+			flush_arpreq_packets(sr, vrf, request, arp_hdr->ar_sha);
 			return;
 		}
 	}
 }
 
+/* Send every packet waiting on a resolved ARP request to mac, then
+   destroy the request */
+void flush_arpreq_packets(struct sr_instance *sr,
+			struct sr_vrf *vrf,
+			struct sr_arpreq *request,
+			unsigned char *mac)
+{
+	struct sr_packet * current_pkt = request->packets;
+	uint64_t now = sr_tsc();
+
+	sr_stats_latency(SR_LAT_ARP_RESOLVE, now - request->created);
+
+	/*loop through all packet for this request*/
+	while (current_pkt != NULL) {
+		sr_stats_latency(SR_LAT_ARPQ_WAIT, now - current_pkt->queued);
+
+		/*create ethernet header*/
+		struct sr_ethernet_hdr* current_etnet_hdr = (struct sr_ethernet_hdr*)(current_pkt->buf);
+		struct sr_if* current_interface_pt = sr_get_interface(sr, current_pkt->iface);
+
+		replace_etnet_addrs(current_etnet_hdr, current_interface_pt->addr, mac);
+		
+		sr_log_debug("Router send Packets waiting in queue on %s\n", current_pkt->iface);
+		sr_log_hdrs(SR_LOG_DEBUG, current_pkt->buf, current_pkt->len);
+		sr_send_packet(sr, current_pkt->buf, current_pkt->len, current_pkt->iface);
+		current_pkt = (*current_pkt).next;
+	}
+	sr_arpreq_destroy(&(vrf->cache), request);
+}
+
 void handle_ip(struct sr_instance* sr,
+				struct sr_vrf* vrf,
 				uint8_t * packet/* lent */,
 				unsigned int len,
 				char* interface/* lent */)
+{
+	sr_handle_ip(sr, vrf, packet, len, interface, 0);
+}
+
+static void sr_handle_ip(struct sr_instance* sr,
+				struct sr_vrf* vrf,
+				uint8_t * packet/* lent */,
+				unsigned int len,
+				char* interface/* lent */,
+				struct sr_rt *const *route)
 {
 	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
 	int ip_hdr_size = sizeof(sr_ip_hdr_t);
 	
 	sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t *)(packet + etnet_hdr_size);
+	int valid = 0, to_router = 0;
 
 	if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)) {
-		printf("invalid datagram length\n");
+		sr_log_debug("invalid datagram length\n");
+		sr_drop(sr, vrf, SR_DROP_SHORT);
 		return;
 	}
 
-	if (!validate_ip_cksum(packet)) {
-		printf("invalid ip packet cksum\n");
-		return;	
+	SR_STAGE(SR_STAGE_CKSUM, valid = validate_ip_cksum(packet));
+	if (!valid) {
+		sr_log_debug("invalid ip packet cksum\n");
+		sr_drop(sr, vrf, SR_DROP_CKSUM);
+		return;
 	}
 
+	SR_STAGE(SR_STAGE_PARSE, to_router = ip_in_sr_interface_list(sr, vrf, ip_hdr->ip_dst));
+
 	/* Router is not the receiver*/
-	if (!ip_in_sr_interface_list(sr, ip_hdr->ip_dst)) {
+	if (!to_router) {
 
-		ip_hdr->ip_ttl--;
-		if (ip_hdr->ip_ttl == 0) {
+		if (ip_hdr->ip_ttl <= 1) {
 			send_icmp_t11_pkt(sr, packet, interface, len);
+			sr_drop(sr, vrf, SR_DROP_TTL);
+			return;
 		}
-		ip_hdr->ip_sum = 0x0;
-		ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr_size);
+		SR_STAGE(SR_STAGE_REWRITE, ip_hdr->ip_ttl--;
+					   ip_hdr->ip_sum = 0x0;
+					   ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr_size));
 
-		struct sr_rt *rt_entry = rt_entry_lpm(sr, ip_hdr->ip_dst);
+		struct sr_rt *rt_entry = NULL;
+		SR_STAGE(SR_STAGE_LPM, rt_entry = route ? *route : rt_entry_lpm(vrf, ip_hdr->ip_dst));
 
 		if (rt_entry != NULL) {
+			/* One path of a multipath route, by the packet's flow */
+			rt_entry = (struct sr_rt *)sr_ecmp_select(rt_entry, (uint8_t *)ip_hdr,
+								  len - etnet_hdr_size);
+
 			/* Outgoing interface*/
 			struct sr_if *sender_interface_pt = sr_get_interface(sr, rt_entry->interface);
 
 			/* Look up the cache to find arpentry*/
-			struct sr_arpentry *arp_entry = sr_arpcache_lookup(&sr->cache, rt_entry->gw.s_addr);
+			struct sr_arpentry arp_entry;
+			int arp_found = 0;
+			SR_STAGE(SR_STAGE_ARP, arp_found = sr_arpcache_get(&vrf->cache, rt_entry->gw.s_addr, &arp_entry));
 
 			/*not found*/
-			if (arp_entry == NULL) {
-				/* Add to the arp queue */
-				struct sr_arpreq * arp_req = sr_arpcache_queuereq(&sr->cache, ip_hdr->ip_dst, 
+			if (!arp_found) {
+				if (len > SR_ARPREQ_FRAME_LEN) {
+					sr_drop(sr, vrf, SR_DROP_TOO_BIG);
+					return;
+				}
+				/* Add to the arp queue of the next hop */
+				struct sr_arpreq * arp_req = sr_arpcache_queuereq(&vrf->cache, rt_entry->gw.s_addr,
 										  packet, len, sender_interface_pt->name);
-				handle_arpreq(sr, arp_req);
+				if (arp_req == NULL) {
+					sr_drop(sr, vrf, SR_DROP_QUEUE_FULL);
+					return;
+				}
+				handle_arpreq(sr, vrf, arp_req);
 				return;
 			}
 
-			else if (arp_entry != NULL){
+			else {
 
 				/*Construct ethernet header*/
 				sr_ethernet_hdr_t * etnet_hdr;
 				etnet_hdr = (sr_ethernet_hdr_t *)packet;
 
-				replace_etnet_addrs(etnet_hdr, sender_interface_pt->addr, arp_entry->mac);
+				SR_STAGE(SR_STAGE_REWRITE, replace_etnet_addrs(etnet_hdr, sender_interface_pt->addr, arp_entry.mac));
 				sr_send_packet(sr, packet, len, sender_interface_pt->name);
 				return;
 			}
 		}
 		else {
 			send_icmp_t3_pkt(sr,packet, interface, len, 3, 0);
+			sr_drop(sr, vrf, SR_DROP_NO_ROUTE);
 			return;
 		}
 	/* Router is the receiver*/
 	} else {
-		printf("packet to the router\n");
+		sr_log_debug("packet to the router\n");
 		if(ip_hdr->ip_p == ip_protocol_icmp){
-			printf("Router receives ICMP...\n");
+			sr_log_debug("Router receives ICMP...\n");
 			sr_icmp_hdr_t * icmp_hdr = (sr_icmp_hdr_t *) (packet + etnet_hdr_size + ip_hdr_size);
 			if (icmp_hdr->icmp_type == (uint8_t) 8) {
 				send_icmp_t0_pkt(sr, packet, interface,len, 0, 0);
+			} else {
+				sr_drop(sr, vrf, SR_DROP_ICMP_IGNORED);
 			}
 
 		}else{
-			printf("Router receives TCP UDP...\n");
+			sr_log_debug("Router receives TCP UDP...\n");
 			send_icmp_t3_pkt(sr,packet, interface, len, 3, 3); 
+			sr_drop(sr, vrf, SR_DROP_PORT_UNREACH);
 		}
 		return;
 	}
@@ -287,8 +491,14 @@ int validate_ip_cksum (uint8_t * packet) {
 }
 
 
-struct sr_rt* rt_entry_lpm(struct sr_instance *sr, uint32_t ip_dst){
-    	struct sr_rt* rt = sr->routing_table;
+/* Callers are inside an sr_rcu read section, the table may change. */
+struct sr_rt* rt_entry_lpm(struct sr_vrf *vrf, uint32_t ip_dst){
+	struct sr_fib *fib = __atomic_load_n(&vrf->fib, __ATOMIC_ACQUIRE);
+
+	if (fib)
+		return sr_fib_lookup(fib, ntohl(ip_dst));
+
+    	struct sr_rt* rt = vrf->routing_table;
 	struct sr_rt* longest_match = NULL;
 
     	uint32_t curr_mask = 0;
@@ -312,11 +522,12 @@ struct sr_rt* rt_entry_lpm(struct sr_instance *sr, uint32_t ip_dst){
 }
 
 
-int ip_in_sr_interface_list(struct sr_instance* sr, uint32_t ip_dst){
+/* Only the addresses of interfaces in vrf are the router's to answer */
+int ip_in_sr_interface_list(struct sr_instance* sr, struct sr_vrf* vrf, uint32_t ip_dst){
 	struct sr_if* interface_pt = sr->if_list;
 
 	while(interface_pt){
-		if (interface_pt->ip == ip_dst) {
+		if (interface_pt->ip == ip_dst && interface_pt->vrf == vrf->id) {
 			return 1;		
 		}
 		else{
@@ -333,60 +544,8 @@ void send_icmp_t11_pkt(struct sr_instance* sr,
 				char* interface,
 				unsigned int len){
 
-	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
-	int ip_hdr_size = sizeof(sr_ip_hdr_t);
-	int icmp_t11_size = sizeof(struct sr_icmp_t11_hdr);
-
-	/* received pkt*/
-	sr_ip_hdr_t * received_ip_hdr = (sr_ip_hdr_t *)(packet + etnet_hdr_size);
-
-
-	struct sr_if *sr_interface_pt = sr_get_interface(sr, interface);
-
-	uint8_t *reply_pkt = (uint8_t *)malloc(icmp_t11_size + etnet_hdr_size + ip_hdr_size);
-	memset(reply_pkt,0, icmp_t11_size + etnet_hdr_size + ip_hdr_size);
-
-	sr_ethernet_hdr_t * reply_etnet_hdr = (sr_ethernet_hdr_t *) reply_pkt;
-	sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (reply_pkt + etnet_hdr_size);
-	sr_icmp_t11_hdr_t * icmp_hdr_t11 = (sr_icmp_t11_hdr_t *) (reply_pkt + etnet_hdr_size + ip_hdr_size);
-
-	/*construct icmp t11 hdr*/
-	icmp_hdr_t11->icmp_type = (uint8_t) 11;
-	icmp_hdr_t11->unused = (uint32_t) 0;
-	icmp_hdr_t11->icmp_sum = (uint16_t) 0;
-	icmp_hdr_t11->icmp_code = (uint8_t) 0;
-	memcpy(icmp_hdr_t11->data, received_ip_hdr, ICMP_DATA_SIZE);
-	icmp_hdr_t11->icmp_sum = cksum(icmp_hdr_t11, icmp_t11_size);
-
-	/*construct ip hdr*/
-
-	ip_hdr->ip_hl = received_ip_hdr->ip_hl;
-	ip_hdr->ip_v = received_ip_hdr->ip_v;
-	ip_hdr->ip_tos = received_ip_hdr->ip_tos;
-	ip_hdr->ip_off = received_ip_hdr->ip_off;
-	ip_hdr->ip_ttl = INIT_TTL;
-	ip_hdr->ip_p = ip_protocol_icmp;
-	ip_hdr->ip_sum = 0x0;
-
-	ip_hdr->ip_src = sr_interface_pt->ip;
-	ip_hdr->ip_dst = received_ip_hdr->ip_src;
-
-
-	ip_hdr->ip_len = ip_hdr_size + icmp_t11_size;
-	ip_hdr->ip_id = 0;
-	ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr_size);
-
-	/*construct etnet hdr*/
-	memcpy(reply_etnet_hdr->ether_shost, sr_interface_pt->addr, ETHER_ADDR_LEN); 
-	memcpy(reply_etnet_hdr->ether_dhost, reply_etnet_hdr->ether_shost, ETHER_ADDR_LEN); 
-	reply_etnet_hdr->ether_type = htons(ethertype_ip);
-
-	int total_pkt_size = icmp_t11_size + etnet_hdr_size + ip_hdr_size;
-	printf("\n\nsending t11 icmp\n\n");
-	print_hdr_ip(reply_pkt);
-	sr_send_packet(sr, reply_pkt, total_pkt_size, interface);
-	free(reply_pkt);
-
+	sr_log_debug("sending t11 icmp\n");
+	sr_icmp_send_error(sr, packet, len, interface, 11, 0);
 }
 
 void send_icmp_t0_pkt(struct sr_instance* sr, 
@@ -399,18 +558,15 @@ void send_icmp_t0_pkt(struct sr_instance* sr,
 	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
 	int ip_hdr_size = sizeof(sr_ip_hdr_t);
 
-	/* received pkt*/
-	sr_ethernet_hdr_t * received_etnet_hdr = (sr_ethernet_hdr_t *) packet;
-	sr_ip_hdr_t * received_ip_hdr = (sr_ip_hdr_t *)(packet + etnet_hdr_size);
-
-	struct sr_if *sr_interface_pt = sr_get_interface(sr, interface);
-	uint8_t *reply_pkt = (uint8_t *)malloc(len);
-
-	memcpy(reply_pkt, packet, len);
+	/* the reply is built in place, the packet is ours until we return */
+	uint8_t *reply_pkt = packet;
 	sr_ethernet_hdr_t * reply_etnet_hdr = (sr_ethernet_hdr_t *) reply_pkt;
 	sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (reply_pkt + etnet_hdr_size);
 	sr_icmp_hdr_t * icmp_hdr = (sr_icmp_hdr_t *) (reply_pkt + etnet_hdr_size + ip_hdr_size);
 
+	struct sr_if *sr_interface_pt = sr_get_interface(sr, interface);
+	uint32_t ip_src = ip_hdr->ip_src;
+
 	/*construct icmp hdr*/
 	icmp_hdr->icmp_type = (uint8_t) type;
 	icmp_hdr->icmp_sum = (uint16_t) 0;
@@ -423,21 +579,20 @@ void send_icmp_t0_pkt(struct sr_instance* sr,
 	/*ip_hdr->ip_p = ip_protocol_icmp;*/
 	ip_hdr->ip_sum = 0;
 
-	ip_hdr->ip_src = received_ip_hdr->ip_dst;
-	ip_hdr->ip_dst = received_ip_hdr->ip_src;
+	ip_hdr->ip_src = ip_hdr->ip_dst;
+	ip_hdr->ip_dst = ip_src;
 
 	ip_hdr->ip_id = 0;
 	ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr_size);
 
 	/*construct etnet hdr*/
+	memcpy(reply_etnet_hdr->ether_dhost, reply_etnet_hdr->ether_shost, ETHER_ADDR_LEN); 
 	memcpy(reply_etnet_hdr->ether_shost, sr_interface_pt->addr, ETHER_ADDR_LEN); 
-	memcpy(reply_etnet_hdr->ether_dhost, received_etnet_hdr->ether_shost, ETHER_ADDR_LEN); 
 	reply_etnet_hdr->ether_type = htons(ethertype_ip);
 
-	printf("\n\nsending icmp\n\n");
-	print_hdrs(reply_pkt, len);
+	sr_log_debug("sending icmp\n");
+	sr_log_hdrs(SR_LOG_DEBUG, reply_pkt, len);
 	sr_send_packet(sr, reply_pkt, len, interface);
-	free(reply_pkt);
 
 }
 
@@ -449,64 +604,6 @@ void send_icmp_t3_pkt(struct sr_instance* sr,
 				int type, 
 				int code){
 
-	int etnet_hdr_size = sizeof(sr_ethernet_hdr_t);
-	int ip_hdr_size = sizeof(sr_ip_hdr_t);
-	int t3_icmp_size = sizeof(sr_icmp_t3_hdr_t);
-
-	/* received pkt*/
-	sr_ethernet_hdr_t * received_etnet_hdr = (sr_ethernet_hdr_t *) packet;
-	sr_ip_hdr_t * received_ip_hdr = (sr_ip_hdr_t *)(packet + etnet_hdr_size);
-
-	struct sr_if *sr_interface_pt = sr_get_interface(sr, interface);
-	uint8_t *reply_pkt = (uint8_t *)malloc(t3_icmp_size + etnet_hdr_size + ip_hdr_size);
-
-	sr_ethernet_hdr_t * reply_etnet_hdr = (sr_ethernet_hdr_t *) reply_pkt;
-	sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (reply_pkt + etnet_hdr_size);
-	sr_icmp_t3_hdr_t * icmp_hdr_t3 = (sr_icmp_t3_hdr_t *) (reply_pkt + etnet_hdr_size + ip_hdr_size);
-
-	/*construct icmp hdr*/
-	icmp_hdr_t3->icmp_type = (uint8_t) type;
-	icmp_hdr_t3->unused = 0;
-	icmp_hdr_t3->icmp_sum = 0;
-	icmp_hdr_t3->icmp_code = (uint8_t) code;
-	icmp_hdr_t3->next_mtu = 0;
-	memcpy(icmp_hdr_t3->data, received_ip_hdr, ICMP_DATA_SIZE);/**/
-	icmp_hdr_t3->icmp_sum = cksum(icmp_hdr_t3, t3_icmp_size);
-
-
-	/*construct ip hdr*/
-
-	ip_hdr->ip_hl = received_ip_hdr->ip_hl;
-	ip_hdr->ip_v = received_ip_hdr->ip_v;
-	ip_hdr->ip_tos = received_ip_hdr->ip_tos;
-	ip_hdr->ip_off = received_ip_hdr->ip_off;
-	
-	ip_hdr->ip_ttl = INIT_TTL;
-	ip_hdr->ip_p = ip_protocol_icmp;
-	ip_hdr->ip_sum = 0;
-	
-	/* wait to fix, code 0 */
-	if (code == 0 || code == 1) {
-		ip_hdr->ip_src = sr_interface_pt->ip;
-	}
-	else {
-		ip_hdr->ip_src = received_ip_hdr->ip_dst;
-	}
-	
-	
-	ip_hdr->ip_dst = received_ip_hdr->ip_src;
-	ip_hdr->ip_len = htons(ip_hdr_size + t3_icmp_size);
-	ip_hdr->ip_id = 0;
-	ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr_size);
-
-
-	/*construct etnet hdr*/
-	memcpy(reply_etnet_hdr->ether_shost, sr_interface_pt->addr, ETHER_ADDR_LEN); 
-	memcpy(reply_etnet_hdr->ether_dhost, received_etnet_hdr->ether_shost, ETHER_ADDR_LEN); 
-	reply_etnet_hdr->ether_type = htons(ethertype_ip);
-
-	printf("\n\nsending t3 icmp\n\n");
-	print_hdrs(reply_pkt, t3_icmp_size + etnet_hdr_size + ip_hdr_size);
-	sr_send_packet(sr, reply_pkt, t3_icmp_size + etnet_hdr_size + ip_hdr_size, interface);
-	free(reply_pkt);
+	sr_log_debug("sending t3 icmp\n");
+	sr_icmp_send_error(sr, packet, len, interface, (uint8_t) type, (uint8_t) code);
 }
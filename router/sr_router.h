@@ -15,6 +15,8 @@
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_pool.h"
+#include "sr_vrf.h"
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -30,9 +32,31 @@
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
 
+/* why a packet was dropped, see sr_drop() */
+enum sr_drop_reason
+{
+    SR_DROP_NONE = 0,
+    SR_DROP_SHORT,          /* frame too short for its headers */
+    SR_DROP_ETHERTYPE,      /* neither ARP nor IP */
+    SR_DROP_ARP_NOT_FOR_US, /* ARP request for another address */
+    SR_DROP_CKSUM,          /* bad IP header checksum */
+    SR_DROP_TTL,            /* TTL expired in transit */
+    SR_DROP_NO_ROUTE,
+    SR_DROP_ARP_FAIL,       /* next hop did not answer ARP */
+    SR_DROP_QUEUE_FULL,     /* too many packets waiting on ARP */
+    SR_DROP_PORT_UNREACH,   /* TCP/UDP to the router */
+    SR_DROP_ICMP_IGNORED,   /* ICMP to the router other than echo */
+    SR_DROP_TOO_BIG,        /* frame too long to queue on ARP */
+    SR_DROP_MAX
+};
+
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_capture;
+struct sr_flight;
+struct sr_shm_writer;
+struct sr_replay;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -50,10 +74,18 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
-    struct sr_rt* routing_table; /* routing table */
-    struct sr_arpcache cache;   /* ARP cache */
+    struct sr_vrf* vrfs[SR_VRF_MAX]; /* routing tables by ID, 0 always */
+    pthread_mutex_t rt_lock;     /* held to change them, see sr_rt_add */
+    int aggregate;               /* aggregate their fibs (-A) */
+    int ecmp_weighted;           /* weigh multipath by speed (-W) */
+    struct sr_arppools arp_pools; /* ARP requests of all tables */
+    struct sr_pool reply_pool;  /* frames for locally generated replies */
+    struct sr_pool rt_pool;     /* routing table entries */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_capture* capture; /* -l packet capture, or 0 */
+    struct sr_flight* flight;   /* recent packets, or 0 */
+    struct sr_shm_writer* shm;  /* /dev/shm statistics, or 0 */
+    struct sr_replay* replay;   /* session being recorded or replayed, or 0 */
 };
 
 /* -- sr_main.c -- */
@@ -67,13 +99,18 @@ int sr_read_from_server(struct sr_instance* );
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-void handle_arp(struct sr_instance* ,uint8_t *, unsigned int,char *);
+void sr_handlepacket_burst(struct sr_instance* , uint8_t ** , const unsigned int* , char** , unsigned int);
+void sr_drop(struct sr_instance* , struct sr_vrf* , enum sr_drop_reason);
+void sr_drop_queued(struct sr_instance* , uint8_t * , unsigned int , const char* , enum sr_drop_reason);
+const char* sr_drop_reason_name(int);
+void handle_arp(struct sr_instance* , struct sr_vrf* , uint8_t *, unsigned int,char *);
+void flush_arpreq_packets(struct sr_instance *, struct sr_vrf *, struct sr_arpreq *, unsigned char *);
 void replace_etnet_addrs(sr_ethernet_hdr_t *, uint8_t *, uint8_t *);
 void replace_arp_hardware_addrs(sr_arp_hdr_t *, unsigned char *, unsigned char *);
-void handle_ip(struct sr_instance*, uint8_t *, unsigned int, char*);
+void handle_ip(struct sr_instance*, struct sr_vrf*, uint8_t *, unsigned int, char*);
 int validate_ip_cksum (uint8_t *);
-struct sr_rt* rt_entry_lpm(struct sr_instance *, uint32_t);
-int ip_in_sr_interface_list(struct sr_instance*, uint32_t);
+struct sr_rt* rt_entry_lpm(struct sr_vrf *, uint32_t);
+int ip_in_sr_interface_list(struct sr_instance*, struct sr_vrf*, uint32_t);
 void send_icmp_t11_pkt(struct sr_instance*, uint8_t *, char*, unsigned int);
 void send_icmp_t0_pkt(struct sr_instance*, uint8_t *, char*, unsigned int, int, int);
 void send_icmp_t3_pkt(struct sr_instance*, uint8_t *, char*, unsigned int, int, int);
@@ -81,6 +118,7 @@ void send_icmp_t3_pkt(struct sr_instance*, uint8_t *, char*, unsigned int, int,
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
 void sr_set_ether_ip(struct sr_instance* , uint32_t );
+void sr_set_ether_speed(struct sr_instance* , uint32_t );
 void sr_set_ether_addr(struct sr_instance* , const unsigned char* );
 void sr_print_if_list(struct sr_instance* );
 
@@ -12,33 +12,389 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 
 
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #define __USE_MISC 1 /* force linux to show inet_aton */
 #include <arpa/inet.h>
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_fib.h"
+#include "sr_ortc.h"
+#include "sr_rcu.h"
+#include "sr_ecmp.h"
+#include "sr_log.h"
+#include "sr_alloc.h"
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_index
+ *
+ * The routes of the list by prefix, for sr_rt_add and the rest.  A slot
+ * holds the link to its route, the next field of the route before it or
+ * the head of the list, so a route is unlinked without walking to it.
+ * A table that is loaded is indexed as it goes in, and the routes for a
+ * prefix that an earlier route already has become more paths of that
+ * route (sr_ecmp.h).  A table built up route by route is indexed on the
+ * first change, which drops such routes, as those could never be used.
+ *
+ * Changes reported by sr_ortc_update are collected in 'changes' and
+ * applied to the fib once it returns.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_slot
+{
+    uint32_t dest;              /* masked, network byte order */
+    uint32_t mask;
+    struct sr_rt** link;        /* 0 for an empty slot */
+};
+
+struct sr_rt_change
+{
+    uint32_t prefix;
+    int len;
+    int present;
+    uint32_t seq;               /* order reported in */
+    const struct sr_rt* nh;
+};
+
+struct sr_rt_index
+{
+    struct sr_rt_slot* slots;
+    uint32_t size, n;
+    struct sr_rt* tail;
+    struct sr_rt_change* changes;
+    uint32_t nchanges, maxchanges;
+    int failed;                 /* out of memory collecting them */
+};
+
+/* a reload that would change more than 1/SR_RT_SYNC_REBUILD of the
+ * table builds a new fib instead of changing the old one in place */
+#define SR_RT_SYNC_REBUILD 8
+
+/* what sr_rt_sync did */
+struct sr_rt_sync_counts
+{
+    unsigned int added, removed, changed, failed;
+};
+
+static void sr_rt_drop(struct sr_vrf* vrf);
+static void sr_rt_index_destroy(struct sr_rt_index* ix);
+static struct sr_rt_index* sr_rt_index_of(struct sr_vrf* vrf,
+                                          struct sr_rt** head, int merge);
+static struct sr_rt_slot* sr_rt_index_find(struct sr_rt_index* ix,
+                                           uint32_t dest, uint32_t mask);
+static int sr_rt_sync(struct sr_vrf* vrf, struct sr_rt* head,
+                      struct sr_rt_sync_counts* counts);
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: sr_rt_init(..)
+ * Scope:  Global
+ *
+ * Set up the pool routing table entries come from and table 0 (sr_vrf.h).
+ * Must be called before the first route is added.  Returns 0, or -1 out
+ * of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_init(struct sr_instance* sr)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    sr->ecmp_weighted = 0;
+    sr->aggregate = 0;
+    pthread_mutex_init(&(sr->rt_lock), 0);
+    SR_POOL_INIT(&(sr->rt_pool), "rt", struct sr_rt, SR_RT_POOL_BATCH,
+                 SR_POOL_HUGE);
+    return sr_vrf_init(sr);
+} /* -- sr_rt_init -- */
+
+/* -- routes go back to the pool, with their groups, once no reader can
+ *    be on them -- */
+
+static void sr_rt_put_later(void* pool, void* rt)
+{
+    sr_ecmp_free(((struct sr_rt*)rt)->group);
+    sr_pool_put((struct sr_pool*)pool, rt);
+} /* -- sr_rt_put_later -- */
+
+static void sr_rt_put_list(void* pool, void* head)
+{
+    struct sr_rt *rt, *next;
+
+    for(rt = (struct sr_rt*)head; rt; rt = next)
+    {
+        next = rt->next;
+        sr_rt_put_later(pool, rt);
+    }
+} /* -- sr_rt_put_list -- */
+
+/* -- empty the table, with sr->rt_lock held -- */
+static void sr_rt_drop(struct sr_vrf* vrf)
+{
+    struct sr_rt* head = vrf->routing_table;
+
+    sr_fib_publish(vrf, 0);
+    __atomic_store_n(&(vrf->routing_table), 0, __ATOMIC_RELEASE);
+    sr_rt_index_destroy(vrf->rt_index);
+    vrf->rt_index = 0;
+    if(head)
+    { sr_rcu_retire(sr_rt_put_list, &(vrf->sr->rt_pool), head); }
+} /* -- sr_rt_drop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_clear_rt(..)
+ * Scope:  Global
+ *
+ * Empty the routing table, returning its entries to the pool once the
+ * forwarding path can no longer be using them.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_clear_rt(struct sr_vrf* vrf)
+{
+    pthread_mutex_lock(&(vrf->sr->rt_lock));
+    sr_rt_drop(vrf);
+    pthread_mutex_unlock(&(vrf->sr->rt_lock));
+} /* -- sr_clear_rt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_set_table(..)
+ * Scope:  Global
+ *
+ * Make the list at head, which the table takes over, the routing table.
+ * An empty table simply takes it and the fib is built over it.  A live
+ * one is reloaded without stopping the forwarding path: only the routes
+ * that differ are added, removed or changed in place (sr_rt_sync), or,
+ * if most of the table differs, a new fib is built beside the old one
+ * and swapped in with a single store.  Either way what changed and how
+ * long it took is logged.  Routes for a prefix listed before become
+ * paths of the first route for it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_set_table(struct sr_vrf* vrf, struct sr_rt* head)
+{
+    struct sr_rt_sync_counts counts;
+    struct sr_rt_index* ix;
+    struct sr_rt *old, *rt;
+    struct timespec t0, t1;
+    unsigned int n = 0;
+    int mapped;
+
+    pthread_mutex_lock(&(vrf->sr->rt_lock));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    old = vrf->routing_table;
+    mapped = vrf->fib && vrf->fib->map;
+
+    if(old && sr_rt_sync(vrf, head, &counts) == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        sr_log_info("rt: reloaded, %u added, %u removed, %u changed "
+                    "in %.3f ms\n", counts.added, counts.removed,
+                    counts.changed, (t1.tv_sec - t0.tv_sec) * 1e3 +
+                    (t1.tv_nsec - t0.tv_nsec) / 1e6);
+        if(counts.failed)
+        { sr_log_warn("rt: %u routes could not be reloaded\n", counts.failed); }
+        pthread_mutex_unlock(&(vrf->sr->rt_lock));
+        return;
+    }
+
+    /* -- merged before anyone sees it, again after a failed sync, the
+     *    first link then moves from head to the table -- */
+    if((ix = sr_rt_index_of(vrf, &head, 1)) && head)
+    {
+        sr_rt_index_find(ix, head->dest.s_addr & head->mask.s_addr,
+                         head->mask.s_addr)->link = &(vrf->routing_table);
+    }
+
+    /* -- the old fib serves lookups until the new one is published -- */
+    __atomic_store_n(&(vrf->routing_table), head, __ATOMIC_RELEASE);
+    sr_rt_index_destroy(vrf->rt_index);
+    vrf->rt_index = ix;
+    sr_fib_build(vrf);
+    if(old)
+    { sr_rcu_retire(sr_rt_put_list, &(vrf->sr->rt_pool), old); }
+
+    if(old || mapped)
+    {
+        for(rt = head; rt; rt = rt->next)
+        { n++; }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        sr_log_info("rt: reloaded, replaced the table with %u routes "
+                    "in %.3f ms\n", n, (t1.tv_sec - t0.tv_sec) * 1e3 +
+                    (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    }
+    pthread_mutex_unlock(&(vrf->sr->rt_lock));
+} /* -- sr_rt_set_table -- */
+
+/* -- the rtable tokenizer, which never reads at or past end -- */
+
+static const char* sr_rt_skip_blanks(const char* p, const char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    { p++; }
+    return p;
+} /* -- sr_rt_skip_blanks -- */
+
+static const char* sr_rt_skip_line(const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+
+    return nl ? nl + 1 : end;
+} /* -- sr_rt_skip_line -- */
+
+static const char* sr_rt_token_end(const char* p, const char* end)
+{
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+    { p++; }
+    return p;
+} /* -- sr_rt_token_end -- */
+
+/* a dotted quad, into network byte order */
+static int sr_rt_parse_ip(const char** pp, const char* end,
+                          struct in_addr* addr)
+{
+    const char* p = *pp;
+    uint32_t ip = 0, octet;
+    int i, digits;
+
+    for(i = 0; i < 4; i++)
+    {
+        if(i && (p == end || *p++ != '.'))
+        { return -1; }
+        for(octet = 0, digits = 0;
+            p < end && *p >= '0' && *p <= '9' && digits < 3; digits++)
+        { octet = octet * 10 + (*p++ - '0'); }
+        if(digits == 0 || octet > 255)
+        { return -1; }
+        ip = (ip << 8) | octet;
+    }
+    if(sr_rt_token_end(p, end) != p)
+    { return -1; }
+
+    addr->s_addr = htonl(ip);
+    *pp = p;
+    return 0;
+} /* -- sr_rt_parse_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_load_rt_buf(..)
+ * Scope:  Global
+ *
+ * Make the "dest gw mask iface" lines in buf the routing table, see
+ * sr_rt_set_table.  Blank lines and lines starting with # are skipped.
+ * Routes are appended in O(1) and only replace the table once all of
+ * buf has parsed; text with no routes leaves the table as it is.
+ * Returns the number of routes, or -1 on a malformed line.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_load_rt_buf(struct sr_vrf* vrf, const char* buf, size_t len)
+{
+    const char* p = buf;
+    const char* end = buf + len;
+    const char* tok;
+    struct in_addr* addrs[3];
+    struct sr_rt *head = 0, *tail = 0, *rt, *next;
+    unsigned int line = 0;
+    int n = 0, i;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(buf || len == 0);
+
+    for( ; p < end; p = sr_rt_skip_line(p, end))
+    {
+        line++;
+        p = sr_rt_skip_blanks(p, end);
+        if(p == end || *p == '\n' || *p == '#')
+        { continue; }
+
+        if((rt = SR_POOL_GET(&(vrf->sr->rt_pool), struct sr_rt)) == 0)
+        {
+            fprintf(stderr, "Error loading routing table, out of memory\n");
+            goto fail;
+        }
+        rt->group = 0;
+        rt->next = 0;
+        if(tail)
+        { tail->next = rt; }
+        else
+        { head = rt; }
+        tail = rt;
+
+        addrs[0] = &(rt->dest);
+        addrs[1] = &(rt->gw);
+        addrs[2] = &(rt->mask);
+        for(i = 0; i < 3; i++)
+        {
+            tok = p;
+            if(sr_rt_parse_ip(&p, end, addrs[i]) != 0)
+            {
+                fprintf(stderr,
+                        "Error loading routing table, cannot convert %.*s to valid IP\n",
+                        (int)(sr_rt_token_end(tok, end) - tok), tok);
+                goto fail;
+            }
+            p = sr_rt_skip_blanks(p, end);
+        }
+
+        tok = p;
+        p = sr_rt_token_end(p, end);
+        if(p == tok)
+        {
+            fprintf(stderr,
+                    "Error loading routing table, no interface on line %u\n",
+                    line);
+            goto fail;
+        }
+        if(p - tok >= sr_IFACE_NAMELEN)
+        {
+            fprintf(stderr,
+                    "Error loading routing table, interface name too long on line %u\n",
+                    line);
+            goto fail;
+        }
+        memcpy(rt->interface, tok, p - tok);
+        rt->interface[p - tok] = 0;
+        n++;
+    }
+
+    if(n > 0)
+    { sr_rt_set_table(vrf, head); }
+    return n;
+
+fail:
+    for(rt = head; rt; rt = next)
+    {
+        next = rt->next;
+        sr_pool_put(&(vrf->sr->rt_pool), rt);
+    }
+    return -1;
+} /* -- sr_load_rt_buf -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_load_rt(..)
+ * Scope:  Global
+ *
+ * Load the routing table from a file, which is mapped and handed to
+ * sr_load_rt_buf in one piece.  Returns 0 on success.
  *
  *---------------------------------------------------------------------*/
 
-int sr_load_rt(struct sr_instance* sr,const char* filename)
+int sr_load_rt(struct sr_vrf* vrf,const char* filename)
 {
-    FILE* fp;
-    char  line[BUFSIZ];
-    char  dest[32];
-    char  gw[32];
-    char  mask[32];
-    char  iface[32];
-    struct in_addr dest_addr;
-    struct in_addr gw_addr;
-    struct in_addr mask_addr;
-    int clear_routing_table = 0;
+    struct stat st;
+    void* map;
+    int fd, n;
 
     /* -- REQUIRES -- */
     assert(filename);
@@ -48,99 +404,809 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         return -1;
     }
 
-    fp = fopen(filename,"r");
+    if((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+    {
+        perror(filename);
+        if(fd >= 0)
+        { close(fd); }
+        return -1;
+    }
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    n = sr_load_rt_buf(vrf, (const char*)map, st.st_size);
+    munmap(map, st.st_size);
+
+    if(n > 0)
+    { printf("Loading routing table from server, clear local routing table.\n"); }
+
+    return n < 0 ? -1 : 0;
+} /* -- sr_load_rt -- */
 
-    while( fgets(line,BUFSIZ,fp) != 0)
+/* -- the index, open addressing with linear probing -- */
+
+static uint32_t sr_rt_index_hash(uint32_t dest, uint32_t mask)
+{
+    uint32_t h = (dest ^ (mask * 0x9e3779b1u)) * 0x85ebca6bu;
+
+    return h ^ (h >> 15);
+} /* -- sr_rt_index_hash -- */
+
+static struct sr_rt_slot* sr_rt_index_find(struct sr_rt_index* ix,
+                                           uint32_t dest, uint32_t mask)
+{
+    uint32_t i;
+
+    if(ix->size == 0)
+    { return 0; }
+    for(i = sr_rt_index_hash(dest, mask) & (ix->size - 1); ix->slots[i].link;
+        i = (i + 1) & (ix->size - 1))
     {
-        sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
-        if(inet_aton(dest,&dest_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    dest);
-            return -1; 
+        if(ix->slots[i].dest == dest && ix->slots[i].mask == mask)
+        { return &(ix->slots[i]); }
+    }
+    return 0;
+} /* -- sr_rt_index_find -- */
+
+/* -- a slot for dest/mask, which is not in the index yet -- */
+static int sr_rt_index_put(struct sr_rt_index* ix, uint32_t dest,
+                           uint32_t mask, struct sr_rt** link)
+{
+    struct sr_rt_slot* slots = ix->slots;
+    uint32_t size = ix->size, i;
+
+    if((ix->n + 1) * 2 > ix->size)
+    {
+        ix->size = size ? size * 2 : 64;
+        ix->slots = (struct sr_rt_slot*)calloc(ix->size,
+                                               sizeof(struct sr_rt_slot));
+        if(ix->slots == 0)
+        {
+            ix->slots = slots;
+            ix->size = size;
+            return -1;
         }
-        if(inet_aton(gw,&gw_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    gw);
-            return -1; 
+        ix->n = 0;
+        for(i = 0; i < size; i++)
+        {
+            if(slots[i].link)
+            { sr_rt_index_put(ix, slots[i].dest, slots[i].mask, slots[i].link); }
         }
-        if(inet_aton(mask,&mask_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    mask);
-            return -1; 
+        free(slots);
+    }
+
+    for(i = sr_rt_index_hash(dest, mask) & (ix->size - 1); ix->slots[i].link;
+        i = (i + 1) & (ix->size - 1))
+    { }
+    ix->slots[i].dest = dest;
+    ix->slots[i].mask = mask;
+    ix->slots[i].link = link;
+    ix->n++;
+    return 0;
+} /* -- sr_rt_index_put -- */
+
+/* -- empty slot, closing the gap behind it so every probe still finds
+ *    its route -- */
+static void sr_rt_index_del(struct sr_rt_index* ix, struct sr_rt_slot* slot)
+{
+    uint32_t size1 = ix->size - 1;
+    uint32_t i = slot - ix->slots, j = i, home;
+
+    ix->n--;
+    for(;;)
+    {
+        j = (j + 1) & size1;
+        if(ix->slots[j].link == 0)
+        { break; }
+        home = sr_rt_index_hash(ix->slots[j].dest, ix->slots[j].mask) & size1;
+        if(i <= j ? (home > i && home <= j) : (home > i || home <= j))
+        { continue; }
+        ix->slots[i] = ix->slots[j];
+        i = j;
+    }
+    ix->slots[i].link = 0;
+} /* -- sr_rt_index_del -- */
+
+static void sr_rt_index_destroy(struct sr_rt_index* ix)
+{
+    if(ix == 0)
+    { return; }
+    free(ix->slots);
+    free(ix->changes);
+    free(ix);
+} /* -- sr_rt_index_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_index_of(..)
+ * Scope:  Local
+ *
+ * Index the list at *head.  A route for a prefix that an earlier one
+ * has is taken out, and with merge set its path is added to the earlier
+ * route's group unless that has it already or is full, which only a
+ * list no reader can see yet may have done to it.  Returns 0 if out of
+ * memory.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt_index* sr_rt_index_of(struct sr_vrf* vrf,
+                                          struct sr_rt** head, int merge)
+{
+    struct sr_rt_index* ix;
+    struct sr_rt_slot* slot;
+    struct sr_ecmp_group* g;
+    struct sr_rt **link, *rt, *first;
+    unsigned int dropped = 0, merged = 0, full = 0;
+
+    if((ix = (struct sr_rt_index*)calloc(1, sizeof(*ix))) == 0)
+    { return 0; }
+
+    for(link = head; (rt = *link); )
+    {
+        if((slot = sr_rt_index_find(ix, rt->dest.s_addr & rt->mask.s_addr,
+                                    rt->mask.s_addr)))
+        {
+            first = *(slot->link);
+            if(!merge || sr_ecmp_find_path(first, rt->gw, rt->interface) >= 0)
+            { dropped++; }
+            else if(first->group && first->group->npaths == SR_ECMP_MAX_PATHS)
+            { full++; }
+            else if((g = sr_ecmp_add_path(vrf->sr, first, rt)) == 0)
+            {
+                sr_rt_index_destroy(ix);
+                return 0;
+            }
+            else
+            {
+                sr_ecmp_free(first->group);
+                first->group = g;
+                merged++;
+            }
+            __atomic_store_n(link, rt->next, __ATOMIC_RELEASE);
+            sr_rcu_retire(sr_rt_put_later, &(vrf->sr->rt_pool), rt);
+            continue;
         }
-        if( clear_routing_table == 0 ){
-            printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
-            clear_routing_table = 1;
+        if(sr_rt_index_put(ix, rt->dest.s_addr & rt->mask.s_addr,
+                           rt->mask.s_addr, link) != 0)
+        {
+            sr_rt_index_destroy(ix);
+            return 0;
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
-    } /* -- while -- */
+        ix->tail = rt;
+        link = &(rt->next);
+    }
 
-    return 0; /* -- success -- */
-} /* -- sr_load_rt -- */
+    if(dropped)
+    { sr_log_info("rt: dropped %u routes for prefixes routed already\n", dropped); }
+    if(merged)
+    { sr_log_info("rt: %u routes added as paths of earlier ones\n", merged); }
+    if(full)
+    {
+        sr_log_warn("rt: dropped %u paths beyond the %d a route can have\n",
+                    full, SR_ECMP_MAX_PATHS);
+    }
+    return ix;
+} /* -- sr_rt_index_of -- */
+
+static int sr_rt_index_build(struct sr_vrf* vrf)
+{
+    vrf->rt_index = sr_rt_index_of(vrf, &(vrf->routing_table), 0);
+    return vrf->rt_index ? 0 : -1;
+} /* -- sr_rt_index_build -- */
+
+/* -- the route whose next field link is -- */
+static struct sr_rt* sr_rt_of_link(struct sr_vrf* vrf, struct sr_rt** link)
+{
+    if(link == &(vrf->routing_table))
+    { return 0; }
+    return (struct sr_rt*)((char*)link - offsetof(struct sr_rt, next));
+} /* -- sr_rt_of_link -- */
+
+/* -- the route after the one at link now hangs off link -- */
+static void sr_rt_relink(struct sr_vrf* vrf, struct sr_rt* next,
+                         struct sr_rt** link)
+{
+    struct sr_rt_index* ix = vrf->rt_index;
+
+    if(next)
+    {
+        sr_rt_index_find(ix, next->dest.s_addr & next->mask.s_addr,
+                         next->mask.s_addr)->link = link;
+    }
+    else
+    { ix->tail = sr_rt_of_link(vrf, link); }
+} /* -- sr_rt_relink -- */
+
+/* -- the list changes with a single store each, readers may be on it -- */
+
+static int sr_rt_append(struct sr_vrf* vrf, struct sr_rt* rt)
+{
+    struct sr_rt_index* ix = vrf->rt_index;
+    struct sr_rt** link = ix->tail ? &(ix->tail->next) : &(vrf->routing_table);
+
+    if(sr_rt_index_put(ix, rt->dest.s_addr, rt->mask.s_addr, link) != 0)
+    { return -1; }
+    rt->next = 0;
+    __atomic_store_n(link, rt, __ATOMIC_RELEASE);
+    ix->tail = rt;
+    return 0;
+} /* -- sr_rt_append -- */
+
+static void sr_rt_swap(struct sr_vrf* vrf, struct sr_rt_slot* slot,
+                       struct sr_rt* rt)
+{
+    struct sr_rt* old = *(slot->link);
+
+    rt->next = old->next;
+    __atomic_store_n(slot->link, rt, __ATOMIC_RELEASE);
+    sr_rt_relink(vrf, rt->next, &(rt->next));
+    sr_rcu_retire(sr_rt_put_later, &(vrf->sr->rt_pool), old);
+} /* -- sr_rt_swap -- */
+
+static void sr_rt_unlink(struct sr_vrf* vrf, struct sr_rt_slot* slot)
+{
+    struct sr_rt** link = slot->link;
+    struct sr_rt* old = *link;
+
+    __atomic_store_n(link, old->next, __ATOMIC_RELEASE);
+    sr_rt_relink(vrf, old->next, link);
+    sr_rt_index_del(vrf->rt_index, slot);
+    sr_rcu_retire(sr_rt_put_later, &(vrf->sr->rt_pool), old);
+} /* -- sr_rt_unlink -- */
+
+/* -- sr_ortc_update reports each entry of the aggregated set that may
+ *    have changed -- */
+static void sr_rt_ortc_change(void* arg, uint32_t prefix, int len,
+                              int present, const struct sr_rt* nh)
+{
+    struct sr_rt_index* ix = (struct sr_rt_index*)arg;
+    struct sr_rt_change* c;
+    uint32_t n;
+
+    if(ix->nchanges == ix->maxchanges)
+    {
+        n = ix->maxchanges ? ix->maxchanges * 2 : 64;
+        c = (struct sr_rt_change*)realloc(ix->changes, n * sizeof(*c));
+        if(c == 0)
+        {
+            ix->failed = 1;
+            return;
+        }
+        ix->changes = c;
+        ix->maxchanges = n;
+    }
+
+    c = &(ix->changes[ix->nchanges]);
+    c->prefix = prefix;
+    c->len = len;
+    c->present = present;
+    c->seq = ix->nchanges++;
+    c->nh = nh;
+} /* -- sr_rt_ortc_change -- */
+
+/* -- by prefix, then in the order reported -- */
+static int sr_rt_change_by_prefix(const void* a, const void* b)
+{
+    const struct sr_rt_change* x = (const struct sr_rt_change*)a;
+    const struct sr_rt_change* y = (const struct sr_rt_change*)b;
+
+    if(x->prefix != y->prefix)
+    { return x->prefix < y->prefix ? -1 : 1; }
+    if(x->len != y->len)
+    { return x->len - y->len; }
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+} /* -- sr_rt_change_by_prefix -- */
+
+/* -- entries set longest first, then entries gone shortest first -- */
+static int sr_rt_change_by_order(const void* a, const void* b)
+{
+    const struct sr_rt_change* x = (const struct sr_rt_change*)a;
+    const struct sr_rt_change* y = (const struct sr_rt_change*)b;
+
+    if(x->present != y->present)
+    { return y->present - x->present; }
+    return x->present ? y->len - x->len : x->len - y->len;
+} /* -- sr_rt_change_by_order -- */
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: sr_rt_apply(..)
+ * Scope:  Local
+ *
+ * Bring the fib up to date with the route for dest/mask, which is now
+ * rt, or none if rt is 0.  Returns 0 on success.
+ *
+ * Without aggregation that is one prefix, and each entry goes from the
+ * old route to the new in a single store.  With it, one route can
+ * change many entries of the set, and a lookup could see a mix of old
+ * and new entries that neither table would give.  The last report for
+ * each entry is applied in an order that rules this out: new and
+ * changed entries longest first, each taking only addresses that no
+ * longer entry of the new set claims; then entries that are gone,
+ * shortest first, each handing its addresses to an entry of the new
+ * set.  Every address keeps its old route until it gets its new one.
  *
  *---------------------------------------------------------------------*/
 
-void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
-struct in_addr gw, struct in_addr mask,char* if_name)
+static int sr_rt_apply(struct sr_vrf* vrf, struct sr_fib* fib,
+                       struct in_addr dest, struct in_addr mask,
+                       const struct sr_rt* rt)
 {
-    struct sr_rt* rt_walker = 0;
+    struct sr_rt_index* ix = vrf->rt_index;
+    struct sr_rt_change* c;
+    uint32_t i, n;
+    int len = sr_fib_prefix_len(ntohl(mask.s_addr));
+
+    if(!fib->aggregated)
+    {
+        fib->nsource = ix->n;
+        return rt ? sr_fib_set(fib, ntohl(dest.s_addr), len, rt)
+                  : sr_fib_unset(fib, ntohl(dest.s_addr), len);
+    }
+
+    ix->nchanges = 0;
+    ix->failed = 0;
+    if(sr_ortc_update(vrf->ortc, dest, mask, rt, sr_rt_ortc_change, ix) != 0 ||
+       ix->failed)
+    { return -1; }
+    fib->nsource = vrf->ortc->routes;
+
+    /* -- the last report for each entry -- */
+    qsort(ix->changes, ix->nchanges, sizeof(*c), sr_rt_change_by_prefix);
+    for(i = 0, n = 0; i < ix->nchanges; i++)
+    {
+        if(i + 1 < ix->nchanges &&
+           ix->changes[i + 1].prefix == ix->changes[i].prefix &&
+           ix->changes[i + 1].len == ix->changes[i].len)
+        { continue; }
+        ix->changes[n++] = ix->changes[i];
+    }
+    qsort(ix->changes, n, sizeof(*c), sr_rt_change_by_order);
+
+    for(i = 0; i < n; i++)
+    {
+        c = &(ix->changes[i]);
+        if((c->present ? sr_fib_set(fib, c->prefix, c->len, c->nh)
+                       : sr_fib_unset(fib, c->prefix, c->len)) != 0)
+        { return -1; }
+    }
+    return 0;
+} /* -- sr_rt_apply -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_change(..)
+ * Scope:  Local
+ *
+ * One change to the table, with sr->rt_lock held.  The new route takes
+ * over group, which is freed if the change fails.  A path is added to
+ * or taken from a route by replacing the route with one that has a new
+ * group, its first path staying its gateway and interface; the last
+ * path goes with the route.
+ *
+ *---------------------------------------------------------------------*/
+
+#define SR_RT_OP_ADD      0
+#define SR_RT_OP_REPLACE  1
+#define SR_RT_OP_DEL      2
+#define SR_RT_OP_ADD_PATH 3
+#define SR_RT_OP_DEL_PATH 4
+
+static int sr_rt_paths(struct sr_vrf* vrf, int* op,
+                       const struct sr_rt* live, struct in_addr* gw,
+                       const char** iface, struct sr_ecmp_group** group);
+
+static int sr_rt_change(struct sr_vrf* vrf, int op, struct in_addr dest,
+                        struct in_addr gw, struct in_addr mask,
+                        const char* iface, struct sr_ecmp_group* group)
+{
+    struct sr_fib* fib = vrf->fib;
+    struct sr_rt_slot* slot;
+    struct sr_rt* rt = 0;
+    int err = 0;
+
+    if(fib && fib->map)
+    { err = SR_RT_READ_ONLY; }
+    else if(fib && sr_fib_prefix_len(ntohl(mask.s_addr)) < 0)
+    { err = SR_RT_BAD_MASK; }
+    else if(vrf->rt_index == 0 && sr_rt_index_build(vrf) != 0)
+    { err = SR_RT_NO_MEM; }
+    if(err)
+    {
+        sr_ecmp_free(group);
+        return err;
+    }
+
+    dest.s_addr &= mask.s_addr;
+    slot = sr_rt_index_find(vrf->rt_index, dest.s_addr, mask.s_addr);
+    if(op == SR_RT_OP_ADD && slot)
+    { err = SR_RT_EXISTS; }
+    else if((op == SR_RT_OP_DEL || op == SR_RT_OP_DEL_PATH) && slot == 0)
+    { err = SR_RT_NO_ROUTE; }
+    else if(op >= SR_RT_OP_ADD_PATH && slot)
+    { err = sr_rt_paths(vrf, &op, *(slot->link), &gw, &iface, &group); }
+    if(err)
+    {
+        sr_ecmp_free(group);
+        return err;
+    }
+
+    if(op != SR_RT_OP_DEL)
+    {
+        if((rt = SR_POOL_GET(&(vrf->sr->rt_pool), struct sr_rt)) == 0)
+        {
+            sr_ecmp_free(group);
+            return SR_RT_NO_MEM;
+        }
+        rt->dest = dest;
+        rt->gw   = gw;
+        rt->mask = mask;
+        strncpy(rt->interface, iface, sr_IFACE_NAMELEN);
+        rt->interface[sr_IFACE_NAMELEN - 1] = 0;
+        rt->group = group;
+    }
+
+    if(slot == 0)
+    {
+        if(sr_rt_append(vrf, rt) != 0)
+        {
+            sr_rt_put_later(&(vrf->sr->rt_pool), rt);
+            return SR_RT_NO_MEM;
+        }
+    }
+    else if(rt)
+    { sr_rt_swap(vrf, slot, rt); }
+    else
+    { sr_rt_unlink(vrf, slot); }
+
+    /* -- without a fib lookups walk the list, which is up to date -- */
+    if(fib && sr_rt_apply(vrf, fib, dest, mask, rt) != 0)
+    {
+        sr_log_warn("fib: out of memory changing a route, building it again\n");
+        sr_fib_build(vrf);
+    }
+    return 0;
+} /* -- sr_rt_change -- */
+
+/* -- the route that replaces live to add or take out the path through
+ *    *gw and *iface, turning *op into the change that does it -- */
+static int sr_rt_paths(struct sr_vrf* vrf, int* op,
+                       const struct sr_rt* live, struct in_addr* gw,
+                       const char** iface, struct sr_ecmp_group** group)
+{
+    const struct sr_ecmp_group* g = live->group;
+    struct sr_rt path;
+    int i = sr_ecmp_find_path(live, *gw, *iface);
+
+    if(*op == SR_RT_OP_ADD_PATH)
+    {
+        if(i >= 0)
+        { return SR_RT_EXISTS; }
+        if(g && g->npaths == SR_ECMP_MAX_PATHS)
+        { return SR_RT_TOO_MANY_PATHS; }
+        path.gw = *gw;
+        strncpy(path.interface, *iface, sr_IFACE_NAMELEN);
+        path.interface[sr_IFACE_NAMELEN - 1] = 0;
+        if((*group = sr_ecmp_add_path(vrf->sr, live, &path)) == 0)
+        { return SR_RT_NO_MEM; }
+        *gw = live->gw;
+        *iface = live->interface;
+    }
+    else if(i < 0)
+    { return SR_RT_NO_ROUTE; }
+    else if(g == 0)
+    { *op = SR_RT_OP_DEL; }
+    else if(g->npaths == 2)
+    {
+        *gw = g->paths[1 - i].gw;
+        *iface = g->paths[1 - i].interface;
+    }
+    else
+    {
+        if((*group = sr_ecmp_del_path(vrf->sr, live, i)) == 0)
+        { return SR_RT_NO_MEM; }
+        *gw = (*group)->paths[0].gw;
+        *iface = (*group)->paths[0].interface;
+    }
+    *op = *op == SR_RT_OP_DEL ? SR_RT_OP_DEL : SR_RT_OP_REPLACE;
+    return 0;
+} /* -- sr_rt_paths -- */
+
+/* -- the same paths, so a reload can leave the route alone -- */
+static int sr_rt_same(const struct sr_rt* a, const struct sr_rt* b)
+{
+    return a->gw.s_addr == b->gw.s_addr &&
+           strncmp(a->interface, b->interface, sr_IFACE_NAMELEN) == 0 &&
+           sr_ecmp_equal(a->group, b->group);
+} /* -- sr_rt_same -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_sync(..)
+ * Scope:  Local
+ *
+ * Bring the live table to the list at head by changing only the routes
+ * that differ, with sr->rt_lock held: routes whose prefix is gone are
+ * deleted, then new prefixes added and changed next hops replaced, each
+ * a single change the forwarding path sees whole.  The list is freed.
+ * Returns -1 if the table should be replaced instead: too much of it
+ * differs, or there is no memory for the diff.  The list may have been
+ * merged by then, later routes for a prefix unlinked, retired and made
+ * paths of the first.  The first route of the list is never one of
+ * them, so head still starts it and merging it again changes nothing,
+ * which sr_rt_set_table relies on when it builds the table from head.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt_sync(struct sr_vrf* vrf, struct sr_rt* head,
+                      struct sr_rt_sync_counts* counts)
+{
+    struct sr_rt_index* ix;
+    struct sr_rt_slot* slot;
+    struct sr_rt *rt, *next;
+    struct sr_rt* list = head;
+    unsigned int n;
+
+    if(vrf->fib && vrf->fib->map)
+    { return -1; }
+    if(vrf->rt_index == 0 && sr_rt_index_build(vrf) != 0)
+    { return -1; }
+    if((ix = sr_rt_index_of(vrf, &list, 1)) == 0)
+    { return -1; }
+
+    memset(counts, 0, sizeof(*counts));
+    for(rt = list; rt; rt = rt->next)
+    {
+        slot = sr_rt_index_find(vrf->rt_index, rt->dest.s_addr & rt->mask.s_addr,
+                                rt->mask.s_addr);
+        if(slot == 0)
+        { counts->added++; }
+        else if(!sr_rt_same(*(slot->link), rt))
+        { counts->changed++; }
+    }
+    counts->removed = vrf->rt_index->n - (ix->n - counts->added);
+
+    n = counts->added + counts->removed + counts->changed;
+    if(n * SR_RT_SYNC_REBUILD > vrf->rt_index->n)
+    {
+        sr_rt_index_destroy(ix);
+        return -1;
+    }
+
+    for(rt = vrf->routing_table; rt; rt = next)
+    {
+        next = rt->next;
+        if(sr_rt_index_find(ix, rt->dest.s_addr & rt->mask.s_addr,
+                            rt->mask.s_addr) == 0 &&
+           sr_rt_change(vrf, SR_RT_OP_DEL, rt->dest, rt->gw, rt->mask,
+                        rt->interface, 0) != 0)
+        { counts->failed++; }
+    }
+    for(rt = list; rt; rt = rt->next)
+    {
+        slot = sr_rt_index_find(vrf->rt_index, rt->dest.s_addr & rt->mask.s_addr,
+                                rt->mask.s_addr);
+        if(slot && sr_rt_same(*(slot->link), rt))
+        { continue; }
+
+        /* -- the new route takes the group over -- */
+        if(sr_rt_change(vrf, slot ? SR_RT_OP_REPLACE : SR_RT_OP_ADD, rt->dest,
+                        rt->gw, rt->mask, rt->interface, rt->group) != 0)
+        { counts->failed++; }
+        rt->group = 0;
+    }
+
+    sr_rt_index_destroy(ix);
+    sr_rt_put_list(&(vrf->sr->rt_pool), list);
+    return 0;
+} /* -- sr_rt_sync -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_add(..), sr_rt_replace(..), sr_rt_del(..)
+ * Scope:  Global
+ *
+ * Change one route while the router forwards: sr_rt_add fails if the
+ * prefix has a route already, sr_rt_replace adds the route or changes
+ * the one there, and sr_rt_del takes it out.  The fib follows in place
+ * (sr_fib_set), through the aggregated set with sr -A, and lookups see
+ * the old route or the new one without taking a lock.  Callers hold
+ * sr->rt_lock, so a batch of changes can go in under it.  A fib mapped
+ * from an image cannot change.  Return 0 or one of SR_RT_*.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_add(struct sr_vrf* vrf, struct in_addr dest, struct in_addr gw,
+              struct in_addr mask, const char* iface)
+{
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(iface);
+
+    return sr_rt_change(vrf, SR_RT_OP_ADD, dest, gw, mask, iface, 0);
+} /* -- sr_rt_add -- */
+
+int sr_rt_replace(struct sr_vrf* vrf, struct in_addr dest,
+                  struct in_addr gw, struct in_addr mask, const char* iface)
+{
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(iface);
+
+    return sr_rt_change(vrf, SR_RT_OP_REPLACE, dest, gw, mask, iface, 0);
+} /* -- sr_rt_replace -- */
+
+int sr_rt_del(struct sr_vrf* vrf, struct in_addr dest, struct in_addr mask)
+{
+    struct in_addr none;
+
+    /* -- REQUIRES -- */
+    assert(vrf);
+
+    none.s_addr = 0;
+    return sr_rt_change(vrf, SR_RT_OP_DEL, dest, none, mask, "", 0);
+} /* -- sr_rt_del -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_add_path(..), sr_rt_del_path(..)
+ * Scope:  Global
+ *
+ * Add a path through gw and iface to the route for dest/mask, which is
+ * added if there is none, or take one out, the route going with its
+ * last path.  The flows on the other paths stay where they are, see
+ * sr_ecmp.h.  As sr_rt_add otherwise: SR_RT_EXISTS if the route has the
+ * path already, SR_RT_NO_ROUTE if it does not have it to take out.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_add_path(struct sr_vrf* vrf, struct in_addr dest,
+                   struct in_addr gw, struct in_addr mask, const char* iface)
+{
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(iface);
+
+    return sr_rt_change(vrf, SR_RT_OP_ADD_PATH, dest, gw, mask, iface, 0);
+} /* -- sr_rt_add_path -- */
+
+int sr_rt_del_path(struct sr_vrf* vrf, struct in_addr dest,
+                   struct in_addr gw, struct in_addr mask, const char* iface)
+{
+    /* -- REQUIRES -- */
+    assert(vrf);
+    assert(iface);
+
+    return sr_rt_change(vrf, SR_RT_OP_DEL_PATH, dest, gw, mask, iface, 0);
+} /* -- sr_rt_del_path -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_reweigh(..)
+ * Scope:  Global
+ *
+ * With sr -W, give the multipath routes of every table new groups for
+ * the speeds their interfaces have now, which HWINFO only reports once
+ * the tables may have been loaded.  Buckets move only as far as the new shares need.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_reweigh(struct sr_instance* sr)
+{
+    struct sr_ecmp_group* g;
+    struct sr_vrf* vrf;
+    struct sr_rt *rt, *next;
+    unsigned int id, n = 0, failed = 0;
 
     /* -- REQUIRES -- */
-    assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
-    {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+    if(!sr->ecmp_weighted)
+    { return; }
 
-        return;
+    pthread_mutex_lock(&(sr->rt_lock));
+    for(id = 0; id < SR_VRF_MAX; id++)
+    {
+        if((vrf = sr->vrfs[id]) == 0)
+        { continue; }
+        for(rt = vrf->routing_table; rt; rt = next)
+        {
+            next = rt->next;
+            if(rt->group && (g = sr_ecmp_reweigh(sr, rt)))
+            {
+                if(sr_rt_change(vrf, SR_RT_OP_REPLACE, rt->dest, rt->gw,
+                                rt->mask, rt->interface, g) == 0)
+                { n++; }
+                else
+                { failed++; }
+            }
+        }
     }
+    pthread_mutex_unlock(&(sr->rt_lock));
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+    if(n || failed)
+    { sr_log_info("rt: weighed %u multipath routes again, %u failed\n", n, failed); }
+} /* -- sr_rt_reweigh -- */
+
+const char* sr_rt_strerror(int err)
+{
+    switch(err)
+    {
+        case 0:               return "ok";
+        case SR_RT_EXISTS:    return "prefix already routed";
+        case SR_RT_NO_ROUTE:  return "no route for prefix";
+        case SR_RT_BAD_MASK:  return "mask is not a prefix";
+        case SR_RT_READ_ONLY: return "routing table is a mapped fib image";
+        case SR_RT_NO_MEM:    return "out of memory";
+        case SR_RT_TOO_MANY_PATHS: return "route has too many paths";
     }
+    return "unknown error";
+} /* -- sr_rt_strerror -- */
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+/*---------------------------------------------------------------------
+ * Method:
+ *
+ * Add a route unless its prefix has one already, the earlier route
+ * winning as in the linear lookup, see sr_rt_add.
+ *
+ *---------------------------------------------------------------------*/
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+void sr_add_rt_entry(struct sr_vrf* vrf, struct in_addr dest,
+struct in_addr gw, struct in_addr mask,char* if_name)
+{
+    int err;
 
+    /* -- REQUIRES -- */
+    assert(if_name);
+    assert(vrf);
+
+    pthread_mutex_lock(&(vrf->sr->rt_lock));
+    err = sr_rt_add(vrf, dest, gw, mask, if_name);
+    pthread_mutex_unlock(&(vrf->sr->rt_lock));
+
+    if(err != 0 && err != SR_RT_EXISTS)
+    { sr_log_warn("rt: cannot add route: %s\n", sr_rt_strerror(err)); }
 } /* -- sr_add_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_first(..), sr_rt_next(..)
+ * Scope:  Global
+ *
+ * Walk every route, whether the table is the list or only the routes
+ * of a fib mapped from an image (sr -f).  Use these rather than
+ * following routing_table when the table may be mapped.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_rt_first(struct sr_vrf* vrf)
+{
+    if(vrf->routing_table || vrf->fib == 0 || vrf->fib->nroutes == 0)
+    { return vrf->routing_table; }
+    return vrf->fib->rt;
+} /* -- sr_rt_first -- */
+
+struct sr_rt* sr_rt_next(struct sr_vrf* vrf, struct sr_rt* rt)
+{
+    if(vrf->routing_table)
+    { return rt->next; }
+    return rt + 1 < vrf->fib->rt + vrf->fib->nroutes ? rt + 1 : 0;
+} /* -- sr_rt_next -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
  *---------------------------------------------------------------------*/
 
-void sr_print_routing_table(struct sr_instance* sr)
+void sr_print_routing_table(struct sr_vrf* vrf)
 {
     struct sr_rt* rt_walker = 0;
 
-    if(sr->routing_table == 0)
+    if(sr_rt_first(vrf) == 0)
     {
         printf(" *warning* Routing table empty \n");
         return;
@@ -148,14 +1214,9 @@ void sr_print_routing_table(struct sr_instance* sr)
 
     printf("Destination\tGateway\t\tMask\tIface\n");
 
-    rt_walker = sr->routing_table;
-    
-    sr_print_routing_entry(rt_walker);
-    while(rt_walker->next)
-    {
-        rt_walker = rt_walker->next; 
-        sr_print_routing_entry(rt_walker);
-    }
+    for(rt_walker = sr_rt_first(vrf); rt_walker;
+        rt_walker = sr_rt_next(vrf, rt_walker))
+    { sr_print_routing_entry(rt_walker); }
 
 } /* -- sr_print_routing_table -- */
 
@@ -175,4 +1236,20 @@ void sr_print_routing_entry(struct sr_rt* entry)
     printf("%s\t",inet_ntoa(entry->mask));
     printf("%s\n",entry->interface);
 
+    /* -- the paths after the first, with their shares of the flows -- */
+    if(entry->group)
+    {
+        const struct sr_ecmp_group* g = entry->group;
+        unsigned int i, b, n;
+
+        for(i = 1; i < g->npaths; i++)
+        {
+            for(b = 0, n = 0; b < SR_ECMP_BUCKETS; b++)
+            { n += g->bucket[b] == i; }
+            printf("\t\t%s\t\t\t%s (%u/%u)\n",
+                   inet_ntoa(g->paths[i].gw), g->paths[i].interface, n,
+                   SR_ECMP_BUCKETS);
+        }
+    }
+
 } /* -- sr_print_routing_entry -- */
@@ -16,10 +16,14 @@
 #include <sys/types.h>
 #endif
 
+#include <stddef.h>
 #include <netinet/in.h>
 
 #include "sr_if.h"
 
+struct sr_ecmp_group;
+struct sr_vrf;
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -33,14 +37,41 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    struct sr_ecmp_group* group; /* its paths if more than one, see sr_ecmp.h */
     struct sr_rt* next;
 };
 
+#define SR_RT_POOL_BATCH 256    /* routes allocated at a time */
+
+/* errors of sr_rt_add, sr_rt_replace and sr_rt_del */
+#define SR_RT_EXISTS    -1      /* the prefix has a route (sr_rt_add) */
+#define SR_RT_NO_ROUTE  -2      /* it has none (sr_rt_del) */
+#define SR_RT_BAD_MASK  -3      /* not a prefix, which the fib needs */
+#define SR_RT_READ_ONLY -4      /* the table is a mapped fib image */
+#define SR_RT_NO_MEM    -5
+#define SR_RT_TOO_MANY_PATHS -6 /* the route has SR_ECMP_MAX_PATHS */
 
-int sr_load_rt(struct sr_instance*,const char*);
-void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
+int sr_rt_init(struct sr_instance*);
+void sr_clear_rt(struct sr_vrf*);
+void sr_rt_set_table(struct sr_vrf*, struct sr_rt*);
+int sr_load_rt(struct sr_vrf*,const char*);
+int sr_load_rt_buf(struct sr_vrf*, const char*, size_t);
+void sr_add_rt_entry(struct sr_vrf*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
-void sr_print_routing_table(struct sr_instance* sr);
+int sr_rt_add(struct sr_vrf*, struct in_addr dest, struct in_addr gw,
+              struct in_addr mask, const char* iface);
+int sr_rt_replace(struct sr_vrf*, struct in_addr dest, struct in_addr gw,
+                  struct in_addr mask, const char* iface);
+int sr_rt_del(struct sr_vrf*, struct in_addr dest, struct in_addr mask);
+int sr_rt_add_path(struct sr_vrf*, struct in_addr dest, struct in_addr gw,
+                   struct in_addr mask, const char* iface);
+int sr_rt_del_path(struct sr_vrf*, struct in_addr dest, struct in_addr gw,
+                   struct in_addr mask, const char* iface);
+void sr_rt_reweigh(struct sr_instance*);
+const char* sr_rt_strerror(int err);
+struct sr_rt* sr_rt_first(struct sr_vrf*);
+struct sr_rt* sr_rt_next(struct sr_vrf*, struct sr_rt*);
+void sr_print_routing_table(struct sr_vrf* vrf);
 void sr_print_routing_entry(struct sr_rt* entry);
 
 
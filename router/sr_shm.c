@@ -0,0 +1,308 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.c
+ *
+ * Description:
+ *
+ * Publishes the router's counters into a shared memory segment, see
+ * sr_shm.h for the layout.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "sr_shm.h"
+#include "sr_stats.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_rcu.h"
+#include "sr_log.h"
+#include "sr_tsc.h"
+
+struct sr_shm_writer
+{
+    struct sr_instance* sr;
+    char name[SR_SHM_NAME_LEN + sizeof(SR_SHM_PREFIX)];
+    struct sr_shm* shm;         /* the mapped segment */
+    struct sr_shm* next;        /* the update being put together */
+    pthread_t tid;
+    int running;
+};
+
+static uint64_t sr_shm_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_shm_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_fill(..)
+ * Scope:  Local
+ *
+ * Gather the current counters into w->next.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_shm_fill(struct sr_shm_writer* w)
+{
+    struct sr_instance* sr = w->sr;
+    struct sr_shm* s = w->next;
+    struct sr_arpcache* cache;
+    struct sr_arpreq* req;
+    struct sr_vrf* vrf;
+    struct sr_vrf_stats* vs;
+    struct sr_shm_vrf* sv;
+    struct sr_stats total;
+    struct sr_if_stats* is;
+    struct sr_shm_if* si;
+    struct sr_shm_lat* sl;
+    struct sr_hist* h;
+    struct sr_if* iface;
+    struct sr_rt* rt;
+    unsigned int id;
+    int i;
+
+    sr_stats_collect(&total);
+
+    s->nifs = 0;
+    for(iface = sr->if_list; iface && s->nifs < SR_SHM_MAX_IF;
+        iface = iface->next)
+    {
+        si = &(s->ifs[s->nifs++]);
+        is = &(total.ifs[SR_STATS_IF(iface->index)]);
+        strncpy(si->name, iface->name, SR_SHM_NAME_LEN - 1);
+        si->index = iface->index;
+        si->ip = iface->ip;
+        memcpy(si->addr, iface->addr, 6);
+        si->rx_packets = is->rx_packets;
+        si->rx_bytes   = is->rx_bytes;
+        si->tx_packets = is->tx_packets;
+        si->tx_bytes   = is->tx_bytes;
+    }
+
+    s->ndrops = 0;
+    for(i = SR_DROP_NONE + 1; i < SR_DROP_MAX && s->ndrops < SR_SHM_MAX_DROPS;
+        i++)
+    {
+        strncpy(s->drops[s->ndrops].name, sr_drop_reason_name(i),
+                SR_SHM_NAME_LEN - 1);
+        s->drops[s->ndrops++].packets = total.drops[i];
+    }
+
+    s->nlat = 0;
+    for(i = 0; i < SR_LAT_MAX && s->nlat < SR_SHM_MAX_LAT; i++)
+    {
+        sl = &(s->lat[s->nlat++]);
+        h = &(total.lat[i]);
+        strncpy(sl->name, sr_stats_lat_name(i), SR_SHM_NAME_LEN - 1);
+        sl->count   = h->count;
+        sl->mean_ns = h->count ? sr_tsc_to_ns(h->sum / h->count) : 0;
+        sl->p50_ns  = sr_tsc_to_ns(sr_hist_percentile(h, 0.5));
+        sl->p99_ns  = sr_tsc_to_ns(sr_hist_percentile(h, 0.99));
+        sl->p999_ns = sr_tsc_to_ns(sr_hist_percentile(h, 0.999));
+        sl->max_ns  = sr_tsc_to_ns(h->max);
+    }
+
+    /* -- the tables, and their ARP caches and routes summed up -- */
+    s->narp = s->nreqs = s->queued = s->nroutes = s->nvrfs = 0;
+    for(id = 0; id < SR_VRF_MAX && s->nvrfs < SR_SHM_MAX_VRF; id++)
+    {
+        if((vrf = sr->vrfs[id]) == 0)
+        { continue; }
+        sv = &(s->vrfs[s->nvrfs++]);
+        vs = &(total.vrfs[id]);
+        cache = &(vrf->cache);
+        sv->id = id;
+        sv->narp = sv->nroutes = 0;
+
+        pthread_mutex_lock(&(cache->lock));
+        for(i = 0; i < SR_ARPCACHE_SZ; i++)
+        {
+            if(!cache->entries[i].valid)
+            { continue; }
+            sv->narp++;
+            if(s->narp == SR_SHM_MAX_ARP)
+            { continue; }
+            s->arp[s->narp].ip = cache->entries[i].ip;
+            memcpy(s->arp[s->narp].mac, cache->entries[i].mac, 6);
+            s->arp[s->narp].added = cache->entries[i].added;
+            s->arp[s->narp].flags = cache->entries[i].permanent ?
+                SR_SHM_ARP_STATIC : 0;
+            s->arp[s->narp].vrf = id;
+            s->narp++;
+        }
+        for(req = cache->requests; req; req = req->next)
+        {
+            s->nreqs++;
+            s->queued += req->npackets;
+        }
+        pthread_mutex_unlock(&(cache->lock));
+
+        sr_rcu_read_lock();
+        for(rt = sr_rt_first(vrf); rt; rt = sr_rt_next(vrf, rt))
+        { sv->nroutes++; }
+        sr_rcu_read_unlock();
+        s->nroutes += sv->nroutes;
+
+        sv->rx_packets = vs->rx_packets;
+        sv->rx_bytes   = vs->rx_bytes;
+        sv->tx_packets = vs->tx_packets;
+        sv->tx_bytes   = vs->tx_bytes;
+        sv->drops      = vs->drops;
+    }
+} /* -- sr_shm_fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_update(..)
+ * Scope:  Global
+ *
+ * Gather the counters and publish them under the sequence lock.  Called
+ * periodically by the publisher thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_shm_update(struct sr_shm_writer* w)
+{
+    struct sr_shm* shm = w->shm;
+    uint64_t seq = shm->seq;
+    size_t hdr = offsetof(struct sr_shm, nifs);
+
+    sr_shm_fill(w);
+
+    __atomic_store_n(&(shm->seq), seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm->updated_ns = sr_shm_now();
+    memcpy((uint8_t*)shm + hdr, (uint8_t*)w->next + hdr,
+            sizeof(struct sr_shm) - hdr);
+
+    __atomic_store_n(&(shm->seq), seq + 2, __ATOMIC_RELEASE);
+} /* -- sr_shm_update -- */
+
+static void* sr_shm_thread(void* arg)
+{
+    struct sr_shm_writer* w = (struct sr_shm_writer*)arg;
+    struct timespec period;
+
+    period.tv_sec  = SR_SHM_PERIOD_MS / 1000;
+    period.tv_nsec = (SR_SHM_PERIOD_MS % 1000) * 1000000;
+
+    while(__atomic_load_n(&(w->running), __ATOMIC_ACQUIRE))
+    {
+        sr_shm_update(w);
+        nanosleep(&period, 0);
+    }
+
+    return 0;
+} /* -- sr_shm_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_open(..)
+ * Scope:  Global
+ *
+ * Create the segment SR_SHM_PREFIX<name> and start publishing to it.
+ * Must be called after sr_init.  Returns 0 on failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_shm_writer* sr_shm_open(struct sr_instance* sr, const char* name)
+{
+    struct sr_shm_writer* w;
+    void* map;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(name);
+
+    w = (struct sr_shm_writer*)calloc(1, sizeof(struct sr_shm_writer));
+    if(w == 0)
+    { return 0; }
+    w->sr = sr;
+    snprintf(w->name, sizeof(w->name), "%s%s", SR_SHM_PREFIX, name);
+
+    w->next = (struct sr_shm*)calloc(1, sizeof(struct sr_shm));
+    if(w->next == 0)
+    {
+        free(w);
+        return 0;
+    }
+
+    fd = shm_open(w->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, sizeof(struct sr_shm)) < 0)
+    {
+        perror("shm_open(..):sr_shm_open");
+        if(fd >= 0)
+        { close(fd); }
+        free(w->next);
+        free(w);
+        return 0;
+    }
+
+    map = mmap(0, sizeof(struct sr_shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap(..):sr_shm_open");
+        shm_unlink(w->name);
+        free(w->next);
+        free(w);
+        return 0;
+    }
+    w->shm = (struct sr_shm*)map;
+
+    w->shm->version = SR_SHM_VERSION;
+    w->shm->size = sizeof(struct sr_shm);
+    w->shm->pid = getpid();
+    w->shm->started_ns = sr_shm_now();
+    sr_shm_update(w);
+    __atomic_store_n(&(w->shm->magic), SR_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    w->running = 1;
+    if(pthread_create(&(w->tid), 0, sr_shm_thread, w) != 0)
+    {
+        w->running = 0;
+        sr_shm_close(w);
+        return 0;
+    }
+
+    return w;
+} /* -- sr_shm_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_close(..)
+ * Scope:  Global
+ *
+ * Stop publishing and remove the segment.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_shm_close(struct sr_shm_writer* w)
+{
+    if(w == 0)
+    { return; }
+
+    if(w->running)
+    {
+        __atomic_store_n(&(w->running), 0, __ATOMIC_RELEASE);
+        pthread_join(w->tid, 0);
+    }
+
+    munmap(w->shm, sizeof(struct sr_shm));
+    shm_unlink(w->name);
+    free(w->next);
+    free(w);
+} /* -- sr_shm_close -- */
@@ -0,0 +1,151 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.h
+ *
+ * Description:
+ *
+ * Layout of the statistics segment the router publishes in /dev/shm, so
+ * monitoring can read the counters without talking to the router.
+ *
+ * The segment is named "/sr_stats.<host>" after the -v virtual host and
+ * holds one struct sr_shm.  A background thread in the router rewrites
+ * it every SR_SHM_PERIOD_MS; the forwarding threads are not involved.
+ *
+ * Consistency is a sequence lock.  The writer makes seq odd, updates the
+ * segment and makes seq even again, so a reader does
+ *
+ *     do {
+ *         s1 = seq;                  (retry while odd)
+ *         copy the segment
+ *         s2 = seq;
+ *     } while(s1 != s2);
+ *
+ * with acquire ordering on both loads, see sr_stat.c.
+ *
+ * All fields are in host byte order except ip addresses, which are in
+ * network byte order as everywhere else in the router.  Readers must
+ * check magic and version; fields are only ever added at the end, with
+ * version bumped, so a reader may also accept a newer version whose
+ * size is at least what it knows.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SHM_H
+#define SR_SHM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_SHM_MAGIC   0x54535253   /* "SRST" */
+#define SR_SHM_VERSION 3
+
+#define SR_SHM_PREFIX    "/sr_stats."
+#define SR_SHM_PERIOD_MS 100
+
+#define SR_SHM_NAME_LEN  32
+#define SR_SHM_MAX_IF    64
+#define SR_SHM_MAX_DROPS 32
+#define SR_SHM_MAX_ARP   128
+#define SR_SHM_MAX_LAT   8
+#define SR_SHM_MAX_VRF   64
+
+struct sr_shm_if
+{
+    char     name[SR_SHM_NAME_LEN];
+    uint32_t index;
+    uint32_t ip;
+    uint8_t  addr[6];
+    uint8_t  pad[6];
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+};
+
+struct sr_shm_drop
+{
+    char     name[SR_SHM_NAME_LEN];
+    uint64_t packets;
+};
+
+#define SR_SHM_ARP_STATIC 0x1     /* set on the control socket */
+
+struct sr_shm_arp
+{
+    uint32_t ip;
+    uint8_t  mac[6];
+    uint8_t  flags;             /* SR_SHM_ARP_*, 0 from older writers */
+    uint8_t  vrf;               /* routing table, 0 from older writers */
+    int64_t  added;             /* time(2) the entry was learned */
+};
+
+struct sr_shm_lat
+{
+    char     name[SR_SHM_NAME_LEN];
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+/* a routing table, see sr_vrf.h */
+struct sr_shm_vrf
+{
+    uint32_t id;
+    uint32_t nroutes;
+    uint32_t narp;              /* valid entries of its ARP cache */
+    uint32_t pad;
+    uint64_t rx_packets;        /* on its interfaces */
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t drops;
+};
+
+struct sr_shm
+{
+    /* -- header, never changes between versions -- */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              /* sizeof(struct sr_shm) of the writer */
+    uint32_t pid;
+    uint64_t seq;               /* odd while an update is in progress */
+    uint64_t updated_ns;        /* CLOCK_REALTIME of the last update */
+    uint64_t started_ns;
+
+    /* -- version 1 -- */
+    uint32_t nifs;
+    uint32_t ndrops;
+    uint32_t narp;              /* valid ARP cache entries, all tables */
+    uint32_t nreqs;             /* outstanding ARP requests */
+    uint32_t queued;            /* packets waiting on those requests */
+    uint32_t nroutes;           /* entries in the routing tables */
+    struct sr_shm_if   ifs[SR_SHM_MAX_IF];
+    struct sr_shm_drop drops[SR_SHM_MAX_DROPS];
+    struct sr_shm_arp  arp[SR_SHM_MAX_ARP];
+
+    /* -- version 2 -- */
+    uint32_t nlat;
+    uint32_t pad;
+    struct sr_shm_lat  lat[SR_SHM_MAX_LAT];
+
+    /* -- version 3 -- */
+    uint32_t nvrfs;
+    uint32_t pad3;
+    struct sr_shm_vrf  vrfs[SR_SHM_MAX_VRF];
+};
+
+struct sr_instance;
+struct sr_shm_writer;
+
+struct sr_shm_writer* sr_shm_open(struct sr_instance* sr, const char* name);
+void sr_shm_update(struct sr_shm_writer* w);
+void sr_shm_close(struct sr_shm_writer* w);
+
+#endif /* -- SR_SHM_H -- */
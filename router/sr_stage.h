@@ -0,0 +1,55 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stage.h
+ *
+ * Description:
+ *
+ * Optional per stage cycle accounting for the forwarding pipeline.
+ *
+ * Wrapping a statement in SR_STAGE charges the sr_tsc cycles it takes to
+ * a stage in the calling thread's counters, and the stats report turns
+ * them into a table of cycles per packet for each stage.  The wrapped
+ * statement may be an assignment:
+ *
+ *     SR_STAGE(SR_STAGE_LPM, rt = rt_entry_lpm(sr, dst));
+ *
+ * Accounting is only compiled in with "make STAGES=1" (-DSR_STAGES);
+ * otherwise SR_STAGE is just the statement and costs nothing.  Changing
+ * the flag needs a "make clean" as it changes struct sr_stats.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STAGE_H
+#define SR_STAGE_H
+
+enum sr_stage
+{
+    SR_STAGE_PARSE = 0,     /* ethernet and ip header checks */
+    SR_STAGE_CKSUM,         /* validate_ip_cksum */
+    SR_STAGE_LPM,           /* rt_entry_lpm */
+    SR_STAGE_ARP,           /* sr_arpcache_lookup */
+    SR_STAGE_REWRITE,       /* ttl, checksum and ethernet addresses */
+    SR_STAGE_SEND,          /* sr_send_packet, less its logging */
+    SR_STAGE_LOG,           /* capture, flight recorder and debug logs */
+    SR_STAGE_MAX
+};
+
+#ifdef SR_STAGES
+
+#include "sr_tsc.h"
+
+void sr_stage_add(int stage, uint64_t cycles);
+
+#define SR_STAGE(stage, stmt) \
+    do { \
+        uint64_t sr_stage_t0_ = sr_tsc(); \
+        stmt; \
+        sr_stage_add(stage, sr_tsc() - sr_stage_t0_); \
+    } while(0)
+
+#else
+
+#define SR_STAGE(stage, stmt) do { stmt; } while(0)
+
+#endif /* SR_STAGES */
+
+#endif /* -- SR_STAGE_H -- */
@@ -0,0 +1,412 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stat.c
+ *
+ * Description:
+ *
+ * Reads the statistics segment of a running router (see sr_shm.h) and
+ * prints it, or the difference between two snapshots.  Reading never
+ * involves the router itself.
+ *
+ *   sr_stat                       print the current counters
+ *   sr_stat -i 1                  print rates every second
+ *   sr_stat -o file               save a snapshot to file
+ *   sr_stat -d file               print what changed since a saved one
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_shm.h"
+
+#define DEFAULT_HOST "vrhost"
+#define SR_STAT_RETRIES 1000
+
+static void usage(char* argv0);
+
+/*---------------------------------------------------------------------
+ * Method: sr_stat_attach(..)
+ * Scope:  Local
+ *
+ * Map the segment of router 'host' read only.
+ *
+ *---------------------------------------------------------------------*/
+
+static const struct sr_shm* sr_stat_attach(const char* host)
+{
+    char name[SR_SHM_NAME_LEN + sizeof(SR_SHM_PREFIX)];
+    const struct sr_shm* shm;
+    struct stat st;
+    void* map;
+    int fd;
+
+    snprintf(name, sizeof(name), "%s%s", SR_SHM_PREFIX, host);
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0)
+    {
+        fprintf(stderr, "sr_stat: no statistics for %s (%s)\n", host,
+                strerror(errno));
+        return 0;
+    }
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct sr_shm))
+    {
+        fprintf(stderr, "sr_stat: %s is not a statistics segment\n", name);
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(0, sizeof(struct sr_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        return 0;
+    }
+
+    shm = (const struct sr_shm*)map;
+    if(__atomic_load_n(&(shm->magic), __ATOMIC_ACQUIRE) != SR_SHM_MAGIC ||
+       shm->version < SR_SHM_VERSION || shm->size < sizeof(struct sr_shm))
+    {
+        fprintf(stderr, "sr_stat: %s has an unknown layout\n", name);
+        munmap(map, sizeof(struct sr_shm));
+        return 0;
+    }
+
+    return shm;
+} /* -- sr_stat_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stat_read(..)
+ * Scope:  Local
+ *
+ * Take a consistent copy of the segment, retrying while the router is
+ * in the middle of an update.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_stat_read(const struct sr_shm* shm, struct sr_shm* out)
+{
+    uint64_t s1, s2;
+    int i;
+
+    for(i = 0; i < SR_STAT_RETRIES; i++)
+    {
+        s1 = __atomic_load_n(&(shm->seq), __ATOMIC_ACQUIRE);
+        if(s1 & 1)
+        { continue; }
+
+        memcpy(out, shm, sizeof(struct sr_shm));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&(shm->seq), __ATOMIC_RELAXED);
+        if(s1 == s2)
+        { return 0; }
+    }
+
+    return -1;
+} /* -- sr_stat_read -- */
+
+static const char* sr_stat_ip(uint32_t ip)
+{
+    struct in_addr a;
+
+    a.s_addr = ip;
+    return inet_ntoa(a);
+} /* -- sr_stat_ip -- */
+
+static const char* sr_stat_mac(const uint8_t* mac)
+{
+    static char buf[18];
+
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buf;
+} /* -- sr_stat_mac -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stat_print(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_stat_print(const struct sr_shm* s)
+{
+    unsigned int i;
+    char age[24];
+    time_t now = time(0);
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    printf("router pid %u, up %.1fs, updated %.3fs ago%s\n", s->pid,
+            (s->updated_ns - s->started_ns) / 1e9,
+            (ts.tv_sec + ts.tv_nsec / 1e9) - s->updated_ns / 1e9,
+            kill(s->pid, 0) == 0 || errno == EPERM ? "" : " (not running)");
+    printf("routes %u, arp entries %u, arp requests %u, queued %u\n\n",
+            s->nroutes, s->narp, s->nreqs, s->queued);
+
+    printf("%-8s %-15s %-17s %12s %14s %12s %14s\n", "iface", "ip", "mac",
+            "rx_packets", "rx_bytes", "tx_packets", "tx_bytes");
+    for(i = 0; i < s->nifs; i++)
+    {
+        printf("%-8s %-15s %-17s %12llu %14llu %12llu %14llu\n",
+                s->ifs[i].name, sr_stat_ip(s->ifs[i].ip),
+                sr_stat_mac(s->ifs[i].addr),
+                (unsigned long long)s->ifs[i].rx_packets,
+                (unsigned long long)s->ifs[i].rx_bytes,
+                (unsigned long long)s->ifs[i].tx_packets,
+                (unsigned long long)s->ifs[i].tx_bytes);
+    }
+
+    printf("\n%-20s %12s\n", "drop reason", "packets");
+    for(i = 0; i < s->ndrops; i++)
+    {
+        printf("%-20s %12llu\n", s->drops[i].name,
+                (unsigned long long)s->drops[i].packets);
+    }
+
+    if(s->nvrfs > 1)
+    {
+        printf("\n%-8s %10s %8s %12s %14s %12s %14s %12s\n", "vrf", "routes",
+                "arp", "rx_packets", "rx_bytes", "tx_packets", "tx_bytes",
+                "drops");
+        for(i = 0; i < s->nvrfs; i++)
+        {
+            printf("%-8u %10u %8u %12llu %14llu %12llu %14llu %12llu\n",
+                    s->vrfs[i].id, s->vrfs[i].nroutes, s->vrfs[i].narp,
+                    (unsigned long long)s->vrfs[i].rx_packets,
+                    (unsigned long long)s->vrfs[i].rx_bytes,
+                    (unsigned long long)s->vrfs[i].tx_packets,
+                    (unsigned long long)s->vrfs[i].tx_bytes,
+                    (unsigned long long)s->vrfs[i].drops);
+        }
+    }
+
+    printf("\n%-20s %12s %10s %10s %10s %10s %10s\n", "latency (ns)",
+            "count", "mean", "p50", "p99", "p99.9", "max");
+    for(i = 0; i < s->nlat; i++)
+    {
+        printf("%-20s %12llu %10llu %10llu %10llu %10llu %10llu\n",
+                s->lat[i].name, (unsigned long long)s->lat[i].count,
+                (unsigned long long)s->lat[i].mean_ns,
+                (unsigned long long)s->lat[i].p50_ns,
+                (unsigned long long)s->lat[i].p99_ns,
+                (unsigned long long)s->lat[i].p999_ns,
+                (unsigned long long)s->lat[i].max_ns);
+    }
+
+    printf("\n%-15s %-17s %8s%s\n", "arp ip", "mac", "age",
+            s->nvrfs > 1 ? "  vrf" : "");
+    for(i = 0; i < s->narp; i++)
+    {
+        if(s->arp[i].flags & SR_SHM_ARP_STATIC)
+        { snprintf(age, sizeof(age), "%8s", "static"); }
+        else
+        { snprintf(age, sizeof(age), "%7lds", (long)(now - s->arp[i].added)); }
+        printf("%-15s %-17s %s", sr_stat_ip(s->arp[i].ip),
+                sr_stat_mac(s->arp[i].mac), age);
+        if(s->nvrfs > 1)
+        { printf("  %u", s->arp[i].vrf); }
+        printf("\n");
+    }
+} /* -- sr_stat_print -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stat_diff(..)
+ * Scope:  Local
+ *
+ * Print the change from snapshot a to snapshot b, as totals and per
+ * second rates.  Interfaces and drop reasons are matched by name.
+ *
+ *---------------------------------------------------------------------*/
+
+#define SR_STAT_DELTA(b, a, f) ((unsigned long long)((b)->f - (a)->f))
+
+static void sr_stat_diff(const struct sr_shm* a, const struct sr_shm* b)
+{
+    const struct sr_shm_if* ia;
+    const struct sr_shm_if* ib;
+    double secs = (b->updated_ns - a->updated_ns) / 1e9;
+    unsigned int i, j;
+    unsigned long long d;
+
+    if(a->started_ns != b->started_ns)
+    { printf("router restarted between snapshots\n"); }
+    if(secs <= 0)
+    { secs = 1e-9; }
+
+    printf("over %.3fs\n", secs);
+    printf("%-8s %12s %10s %12s %14s %12s %10s %12s %14s\n", "iface",
+            "rx_packets", "rx_pps", "rx_bytes", "rx_bps",
+            "tx_packets", "tx_pps", "tx_bytes", "tx_bps");
+    for(i = 0; i < b->nifs; i++)
+    {
+        ib = &(b->ifs[i]);
+        ia = 0;
+        for(j = 0; j < a->nifs && !ia; j++)
+        {
+            if(strcmp(a->ifs[j].name, ib->name) == 0)
+            { ia = &(a->ifs[j]); }
+        }
+        if(!ia)
+        { continue; }
+
+        printf("%-8s %12llu %10.0f %12llu %14.0f %12llu %10.0f %12llu %14.0f\n",
+                ib->name,
+                SR_STAT_DELTA(ib, ia, rx_packets),
+                SR_STAT_DELTA(ib, ia, rx_packets) / secs,
+                SR_STAT_DELTA(ib, ia, rx_bytes),
+                SR_STAT_DELTA(ib, ia, rx_bytes) * 8 / secs,
+                SR_STAT_DELTA(ib, ia, tx_packets),
+                SR_STAT_DELTA(ib, ia, tx_packets) / secs,
+                SR_STAT_DELTA(ib, ia, tx_bytes),
+                SR_STAT_DELTA(ib, ia, tx_bytes) * 8 / secs);
+    }
+
+    for(i = 0; i < b->ndrops; i++)
+    {
+        for(j = 0; j < a->ndrops; j++)
+        {
+            if(strcmp(a->drops[j].name, b->drops[i].name) != 0)
+            { continue; }
+            d = SR_STAT_DELTA(&(b->drops[i]), &(a->drops[j]), packets);
+            if(d)
+            {
+                printf("drop %-20s %12llu %10.0f/s\n", b->drops[i].name,
+                        d, d / secs);
+            }
+        }
+    }
+    fflush(stdout);
+} /* -- sr_stat_diff -- */
+
+static int sr_stat_load(const char* path, struct sr_shm* out)
+{
+    FILE* fp = fopen(path, "rb");
+    int ok;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    ok = fread(out, sizeof(struct sr_shm), 1, fp) == 1 &&
+         out->magic == SR_SHM_MAGIC && out->version == SR_SHM_VERSION;
+    fclose(fp);
+
+    if(!ok)
+    {
+        fprintf(stderr, "sr_stat: %s is not a snapshot\n", path);
+        return -1;
+    }
+    return 0;
+} /* -- sr_stat_load -- */
+
+static int sr_stat_save(const char* path, const struct sr_shm* s)
+{
+    FILE* fp = fopen(path, "wb");
+    int ok;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    ok = fwrite(s, sizeof(struct sr_shm), 1, fp) == 1;
+    ok &= fclose(fp) == 0;
+
+    return ok ? 0 : -1;
+} /* -- sr_stat_save -- */
+
+int main(int argc, char** argv)
+{
+    const char* host = DEFAULT_HOST;
+    const char* save = 0;
+    const char* base = 0;
+    const struct sr_shm* shm;
+    struct sr_shm snap[2];
+    unsigned int interval = 0;
+    int count = -1, cur = 0;
+    int c;
+
+    while((c = getopt(argc, argv, "hv:i:c:o:d:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'v':
+                host = optarg;
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 'c':
+                count = atoi(optarg);
+                break;
+            case 'o':
+                save = optarg;
+                break;
+            case 'd':
+                base = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    if((shm = sr_stat_attach(host)) == 0)
+    { return 1; }
+
+    if(sr_stat_read(shm, &snap[0]) != 0)
+    {
+        fprintf(stderr, "sr_stat: could not get a consistent snapshot\n");
+        return 1;
+    }
+
+    if(save)
+    { return sr_stat_save(save, &snap[0]) == 0 ? 0 : 1; }
+
+    if(base)
+    {
+        if(sr_stat_load(base, &snap[1]) != 0)
+        { return 1; }
+        sr_stat_diff(&snap[1], &snap[0]);
+        return 0;
+    }
+
+    if(interval == 0)
+    {
+        sr_stat_print(&snap[0]);
+        return 0;
+    }
+
+    while(count < 0 || count-- > 0)
+    {
+        sleep(interval);
+        if(sr_stat_read(shm, &snap[!cur]) != 0)
+        { continue; }
+        sr_stat_diff(&snap[cur], &snap[!cur]);
+        cur = !cur;
+    }
+
+    return 0;
+} /* -- main -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-v host] [-i interval [-c count]] \n", argv0);
+    printf("           [-o save snapshot to file] [-d diff against file] \n");
+    printf("   default host=%s  \n", DEFAULT_HOST);
+} /* -- usage -- */
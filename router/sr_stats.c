@@ -0,0 +1,401 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.c
+ *
+ * Description:
+ *
+ * Packet and drop counters, see sr_stats.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sr_stats.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+#include "sr_tsc.h"
+#include "sr_fib.h"
+#include "sr_alloc.h"
+
+__thread struct sr_counters* sr_counters_self = 0;
+
+/* shared by threads whose own block could not be allocated */
+static struct sr_counters sr_counters_spare;
+
+static struct sr_counters* sr_counters_list = &sr_counters_spare;
+static pthread_mutex_t sr_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* sr_stats_lat_names[SR_LAT_MAX] = {
+    "fastpath",
+    "arp queue wait",
+    "arp resolve"
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_register(..)
+ * Scope:  Global
+ *
+ * Give the calling thread a zeroed block of counters and add it to the
+ * list read by sr_stats_collect.  Blocks are kept after their thread
+ * exits so the totals do not drop.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_counters* sr_counters_register(void)
+{
+    struct sr_counters* c;
+
+    if(posix_memalign((void**)&c, 64, sizeof(struct sr_counters)) != 0)
+    {
+        sr_counters_self = &sr_counters_spare;
+        return sr_counters_self;
+    }
+    memset(c, 0, sizeof(struct sr_counters));
+
+    pthread_mutex_lock(&sr_counters_lock);
+    c->next = sr_counters_list;
+    __atomic_store_n(&sr_counters_list, c, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sr_counters_lock);
+
+    sr_counters_self = c;
+    return c;
+} /* -- sr_counters_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_collect(..)
+ * Scope:  Global
+ *
+ * Add up the counters of all threads into 'total'.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_stats_collect(struct sr_stats* total)
+{
+    struct sr_counters* c;
+    const uint64_t* src;
+    uint64_t* dst;
+    unsigned int i, n = offsetof(struct sr_stats, lat) / sizeof(uint64_t);
+
+    /* -- REQUIRES -- */
+    assert(total);
+
+    memset(total, 0, sizeof(struct sr_stats));
+
+    c = __atomic_load_n(&sr_counters_list, __ATOMIC_ACQUIRE);
+    for(; c; c = c->next)
+    {
+        src = (const uint64_t*)&(c->s);
+        dst = (uint64_t*)total;
+        for(i = 0; i < n; i++)
+        { dst[i] += __atomic_load_n(&(src[i]), __ATOMIC_RELAXED); }
+        for(i = 0; i < SR_LAT_MAX; i++)
+        { sr_hist_merge(&(total->lat[i]), &(c->s.lat[i])); }
+    }
+} /* -- sr_stats_collect -- */
+
+#ifdef SR_STAGES
+
+static const char* sr_stage_names[SR_STAGE_MAX] = {
+    "parse",
+    "cksum",
+    "lpm",
+    "arp lookup",
+    "rewrite",
+    "send",
+    "log"
+};
+
+void sr_stage_add(int stage, uint64_t cycles)
+{
+    struct sr_stats* s = &(sr_counters()->s);
+
+    s->stage_cycles[stage] += cycles;
+    s->stage_calls[stage]++;
+} /* -- sr_stage_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stage_overhead(..)
+ * Scope:  Local
+ *
+ * Cycles SR_STAGE measures around an empty statement, taken off every
+ * call in the report.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_stage_overhead(void)
+{
+    static uint64_t overhead = 0;
+    uint64_t t0, d, best = ~((uint64_t)0);
+    int i;
+
+    if(overhead)
+    { return overhead; }
+
+    for(i = 0; i < 1000; i++)
+    {
+        t0 = sr_tsc();
+        d = sr_tsc() - t0;
+        if(d < best)
+        { best = d; }
+    }
+
+    overhead = best ? best : 1;
+    return overhead;
+} /* -- sr_stage_overhead -- */
+
+#endif /* SR_STAGES */
+
+const char* sr_stats_lat_name(int lat)
+{
+    if(lat < 0 || lat >= SR_LAT_MAX)
+    { return "unknown"; }
+    return sr_stats_lat_names[lat];
+} /* -- sr_stats_lat_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_format(..)
+ * Scope:  Global
+ *
+ * Write the current totals as text into buf, returns the length.
+ *
+ *---------------------------------------------------------------------*/
+
+#define SR_STATS_PUT(fmt, args...) \
+    do { \
+        if(len < size) \
+        { len += snprintf(buf + len, size - len, fmt, ## args); } \
+    } while(0)
+
+int sr_stats_format(struct sr_instance* sr, char* buf, unsigned int size)
+{
+    struct sr_stats total;
+    struct sr_if_stats* s;
+    struct sr_vrf_stats* v;
+    struct sr_hist* h;
+    struct sr_if* iface;
+    unsigned int len = 0;
+    int i, nvrfs;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(buf);
+    assert(size > 0);
+
+    sr_stats_collect(&total);
+
+    SR_STATS_PUT("%-12s %14s %16s %14s %16s\n", "interface",
+            "rx_packets", "rx_bytes", "tx_packets", "tx_bytes");
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        s = &(total.ifs[SR_STATS_IF(iface->index)]);
+        SR_STATS_PUT("%-12s %14llu %16llu %14llu %16llu\n", iface->name,
+                (unsigned long long)s->rx_packets,
+                (unsigned long long)s->rx_bytes,
+                (unsigned long long)s->tx_packets,
+                (unsigned long long)s->tx_bytes);
+    }
+    s = &(total.ifs[SR_STATS_MAX_IF]);
+    if(s->rx_packets || s->tx_packets)
+    {
+        SR_STATS_PUT("%-12s %14llu %16llu %14llu %16llu\n", "unknown",
+                (unsigned long long)s->rx_packets,
+                (unsigned long long)s->rx_bytes,
+                (unsigned long long)s->tx_packets,
+                (unsigned long long)s->tx_bytes);
+    }
+
+    SR_STATS_PUT("%-20s %14s\n", "drop reason", "packets");
+    for(i = SR_DROP_NONE + 1; i < SR_DROP_MAX; i++)
+    {
+        SR_STATS_PUT("%-20s %14llu\n", sr_drop_reason_name(i),
+                (unsigned long long)total.drops[i]);
+    }
+
+    /* -- by routing table, once there is more than table 0 -- */
+    for(i = 0, nvrfs = 0; i < SR_VRF_MAX; i++)
+    { nvrfs += sr->vrfs[i] != 0; }
+    if(nvrfs > 1)
+    {
+        SR_STATS_PUT("%-12s %14s %16s %14s %16s %14s\n", "vrf",
+                "rx_packets", "rx_bytes", "tx_packets", "tx_bytes", "drops");
+        for(i = 0; i < SR_VRF_MAX; i++)
+        {
+            if(sr->vrfs[i] == 0)
+            { continue; }
+            v = &(total.vrfs[i]);
+            SR_STATS_PUT("%-12d %14llu %16llu %14llu %16llu %14llu\n", i,
+                    (unsigned long long)v->rx_packets,
+                    (unsigned long long)v->rx_bytes,
+                    (unsigned long long)v->tx_packets,
+                    (unsigned long long)v->tx_bytes,
+                    (unsigned long long)v->drops);
+        }
+    }
+
+    SR_STATS_PUT("%-20s %14s %10s %10s %10s %10s\n", "latency (ns)",
+            "count", "p50", "p99", "p99.9", "max");
+    for(i = 0; i < SR_LAT_MAX; i++)
+    {
+        h = &(total.lat[i]);
+        SR_STATS_PUT("%-20s %14llu %10llu %10llu %10llu %10llu\n",
+                sr_stats_lat_name(i), (unsigned long long)h->count,
+                (unsigned long long)sr_tsc_to_ns(sr_hist_percentile(h, 0.5)),
+                (unsigned long long)sr_tsc_to_ns(sr_hist_percentile(h, 0.99)),
+                (unsigned long long)sr_tsc_to_ns(sr_hist_percentile(h, 0.999)),
+                (unsigned long long)sr_tsc_to_ns(h->max));
+    }
+
+#ifdef SR_STAGES
+    {
+        uint64_t packets = total.lat[SR_LAT_FASTPATH].count;
+        uint64_t overhead = sr_stage_overhead();
+        uint64_t cycles, sum = 0;
+
+        SR_STATS_PUT("%-20s %14s %14s %10s  (less %llu cycles timer overhead)\n",
+                "stage", "calls", "cycles/call", "cycles/pkt",
+                (unsigned long long)overhead);
+        for(i = 0; i < SR_STAGE_MAX; i++)
+        {
+            cycles = total.stage_cycles[i];
+            cycles -= cycles > total.stage_calls[i] * overhead ?
+                      total.stage_calls[i] * overhead : cycles;
+            sum += cycles;
+            SR_STATS_PUT("%-20s %14llu %14.1f %10.1f\n", sr_stage_names[i],
+                    (unsigned long long)total.stage_calls[i],
+                    total.stage_calls[i] ?
+                        (double)cycles / total.stage_calls[i] : 0.0,
+                    packets ? (double)cycles / packets : 0.0);
+        }
+        SR_STATS_PUT("%-20s %14s %14s %10.1f\n", "total", "", "",
+                packets ? (double)sum / packets : 0.0);
+    }
+#endif /* SR_STAGES */
+
+    for(i = 0; i < SR_VRF_MAX; i++)
+    {
+        if(sr->vrfs[i] == 0)
+        { continue; }
+        if(i != 0)
+        { SR_STATS_PUT("vrf %d ", i); }
+        if(len < size)
+        { len += sr_fib_format(sr->vrfs[i], buf + len, size - len); }
+    }
+    if(len < size)
+    { len += sr_pool_format(buf + len, size - len); }
+
+    return len < size ? len : size - 1;
+} /* -- sr_stats_format -- */
+
+void sr_stats_print(struct sr_instance* sr, FILE* fp)
+{
+    char buf[SR_STATS_MAX_TEXT];
+    int len = sr_stats_format(sr, buf, sizeof(buf));
+
+    fwrite(buf, 1, len, fp);
+    fflush(fp);
+} /* -- sr_stats_print -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_listen(..)
+ * Scope:  Global
+ *
+ * Serve the totals on a unix stream socket at 'path': every client
+ * that connects is sent the text of sr_stats_format and disconnected.
+ * Returns 0 if the socket could be set up, -1 otherwise.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_stats_server
+{
+    struct sr_instance* sr;
+    int fd;
+};
+
+static void* sr_stats_serve(void* arg)
+{
+    struct sr_stats_server* srv = (struct sr_stats_server*)arg;
+    char buf[SR_STATS_MAX_TEXT];
+    int fd, len, off, n;
+
+    for(;;)
+    {
+        fd = accept(srv->fd, 0, 0);
+        if(fd < 0)
+        { continue; }
+
+        len = sr_stats_format(srv->sr, buf, sizeof(buf));
+        for(off = 0; off < len; off += n)
+        {
+            n = write(fd, buf + off, len - off);
+            if(n <= 0)
+            { break; }
+        }
+        close(fd);
+    }
+
+    return 0;
+} /* -- sr_stats_serve -- */
+
+int sr_stats_listen(struct sr_instance* sr, const char* path)
+{
+    struct sr_stats_server* srv;
+    struct sockaddr_un addr;
+    pthread_t tid;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        sr_log_err("stats socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_stats_listen");
+        return -1;
+    }
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(fd, 8) < 0)
+    {
+        perror("bind(..):sr_stats_listen");
+        close(fd);
+        return -1;
+    }
+
+    srv = (struct sr_stats_server*)malloc(sizeof(struct sr_stats_server));
+    if(srv == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    srv->sr = sr;
+    srv->fd = fd;
+
+    if(pthread_create(&tid, 0, sr_stats_serve, srv) != 0)
+    {
+        close(fd);
+        free(srv);
+        return -1;
+    }
+    pthread_detach(tid);
+
+    return 0;
+} /* -- sr_stats_listen -- */
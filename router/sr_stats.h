@@ -0,0 +1,143 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.h
+ *
+ * Description:
+ *
+ * Packet and drop counters.
+ *
+ * Every thread that counts gets its own block of counters, aligned and
+ * padded to cache lines and registered on first use, so the hot path is
+ * a plain increment with no atomic operation and no sharing between
+ * threads.  Readers add up the blocks of all threads on demand; a total
+ * may be a few packets behind but never goes backwards.
+ *
+ * Packets and drops are counted per routing table (sr_vrf.h) as well.
+ *
+ * Latencies are kept the same way, as per thread histograms of sr_tsc
+ * cycles that are merged when read, and so are the per stage cycles of
+ * sr_stage.h.
+ *
+ * The totals are printed on SIGUSR1 and returned to anything connecting
+ * to the -S unix socket, e.g. "nc -U <path>".
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STATS_H
+#define SR_STATS_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_router.h"
+#include "sr_hist.h"
+#include "sr_stage.h"
+
+#define SR_STATS_MAX_IF 64          /* higher ifindexes count as unknown */
+#define SR_STATS_MAX_TEXT 32768     /* largest sr_stats_format output */
+
+struct sr_if_stats
+{
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+};
+
+struct sr_vrf_stats
+{
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t drops;
+};
+
+/* what the latency histograms measure */
+enum sr_lat
+{
+    SR_LAT_FASTPATH = 0,    /* one packet through sr_handlepacket */
+    SR_LAT_ARPQ_WAIT,       /* a packet queued until its ARP reply */
+    SR_LAT_ARP_RESOLVE,     /* an ARP request queued until answered */
+    SR_LAT_MAX
+};
+
+struct sr_stats
+{
+    struct sr_if_stats ifs[SR_STATS_MAX_IF + 1];    /* last is unknown */
+    uint64_t drops[SR_DROP_MAX];
+    struct sr_vrf_stats vrfs[SR_VRF_MAX];           /* by table ID */
+#ifdef SR_STAGES
+    uint64_t stage_cycles[SR_STAGE_MAX];
+    uint64_t stage_calls[SR_STAGE_MAX];
+#endif
+    struct sr_hist lat[SR_LAT_MAX];                 /* in sr_tsc cycles */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_counters
+ *
+ * One thread's counters, only ever written by that thread.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_counters
+{
+    struct sr_stats s;
+    struct sr_counters* next;
+} __attribute__ ((aligned (64)));
+
+extern __thread struct sr_counters* sr_counters_self;
+struct sr_counters* sr_counters_register(void);
+
+#define sr_counters() \
+    (sr_counters_self ? sr_counters_self : sr_counters_register())
+
+#define SR_STATS_IF(ifindex) \
+    ((ifindex) < SR_STATS_MAX_IF ? (ifindex) : SR_STATS_MAX_IF)
+
+static __inline__ void sr_stats_rx(unsigned int ifindex, unsigned int vrf,
+                                   unsigned int len)
+{
+    struct sr_stats* c = &(sr_counters()->s);
+    struct sr_if_stats* s = &(c->ifs[SR_STATS_IF(ifindex)]);
+    s->rx_packets++;
+    s->rx_bytes += len;
+    c->vrfs[vrf].rx_packets++;
+    c->vrfs[vrf].rx_bytes += len;
+}
+
+static __inline__ void sr_stats_tx(unsigned int ifindex, unsigned int vrf,
+                                   unsigned int len)
+{
+    struct sr_stats* c = &(sr_counters()->s);
+    struct sr_if_stats* s = &(c->ifs[SR_STATS_IF(ifindex)]);
+    s->tx_packets++;
+    s->tx_bytes += len;
+    c->vrfs[vrf].tx_packets++;
+    c->vrfs[vrf].tx_bytes += len;
+}
+
+static __inline__ void sr_stats_drop(unsigned int vrf, int reason)
+{
+    struct sr_stats* c = &(sr_counters()->s);
+    c->drops[reason]++;
+    c->vrfs[vrf].drops++;
+}
+
+static __inline__ void sr_stats_latency(int lat, uint64_t cycles)
+{ sr_hist_record(&(sr_counters()->s.lat[lat]), cycles); }
+
+void sr_stats_collect(struct sr_stats* total);
+const char* sr_stats_lat_name(int lat);
+int  sr_stats_format(struct sr_instance* sr, char* buf, unsigned int size);
+void sr_stats_print(struct sr_instance* sr, FILE* fp);
+int  sr_stats_listen(struct sr_instance* sr, const char* path);
+
+#endif /* -- SR_STATS_H -- */
@@ -0,0 +1,65 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tsc.c
+ *
+ * Description:
+ *
+ * Calibration of sr_tsc, see sr_tsc.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <time.h>
+
+#include "sr_tsc.h"
+
+#define SR_TSC_CALIBRATE_MS 20
+
+static double sr_tsc_rate = 0;      /* cycles per nanosecond */
+
+static uint64_t sr_tsc_mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_tsc_mono_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tsc_init(..)
+ * Scope:  Global
+ *
+ * Measure the counter against the monotonic clock.  Takes about
+ * SR_TSC_CALIBRATE_MS, so call it once at start up; sr_tsc_per_ns
+ * calls it if nobody has.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_tsc_init(void)
+{
+    struct timespec wait;
+    uint64_t ns0, ns1, c0, c1;
+
+    wait.tv_sec  = 0;
+    wait.tv_nsec = SR_TSC_CALIBRATE_MS * 1000000;
+
+    ns0 = sr_tsc_mono_ns();
+    c0  = sr_tsc();
+    nanosleep(&wait, 0);
+    ns1 = sr_tsc_mono_ns();
+    c1  = sr_tsc();
+
+    sr_tsc_rate = ns1 > ns0 ? (double)(c1 - c0) / (ns1 - ns0) : 1.0;
+    if(sr_tsc_rate <= 0)
+    { sr_tsc_rate = 1.0; }
+} /* -- sr_tsc_init -- */
+
+double sr_tsc_per_ns(void)
+{
+    if(sr_tsc_rate == 0)
+    { sr_tsc_init(); }
+    return sr_tsc_rate;
+} /* -- sr_tsc_per_ns -- */
+
+uint64_t sr_tsc_to_ns(uint64_t cycles)
+{
+    return (uint64_t)(cycles / sr_tsc_per_ns());
+} /* -- sr_tsc_to_ns -- */
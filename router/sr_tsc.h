@@ -0,0 +1,46 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tsc.h
+ *
+ * Description:
+ *
+ * Cheap cycle timestamps for measuring short intervals on the forwarding
+ * path.  On x86 this is the time stamp counter, which is constant rate
+ * on anything recent; elsewhere it falls back to the monotonic clock in
+ * nanoseconds.  sr_tsc_init measures the rate once so intervals can be
+ * reported in nanoseconds.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TSC_H
+#define SR_TSC_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <time.h>
+
+static __inline__ uint64_t sr_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void     sr_tsc_init(void);
+double   sr_tsc_per_ns(void);
+uint64_t sr_tsc_to_ns(uint64_t cycles);
+
+#endif /* -- SR_TSC_H -- */
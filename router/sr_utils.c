@@ -6,13 +6,24 @@
 
 
 uint16_t cksum (const void *_data, int len) {
+  return cksum_fold(cksum_partial(_data, len, 0));
+}
+
+/* Adds the 16 bit words of data to an unfolded ones' complement sum, so a
+   checksum can be built up from several pieces. Every piece except the
+   last must have an even length. */
+uint32_t cksum_partial (const void *_data, int len, uint32_t sum) {
   const uint8_t *data = _data;
-  uint32_t sum;
 
-  for (sum = 0;len >= 2; data += 2, len -= 2)
+  for (;len >= 2; data += 2, len -= 2)
     sum += data[0] << 8 | data[1];
   if (len > 0)
     sum += data[0] << 8;
+  return sum;
+}
+
+/* Folds a sum from cksum_partial into a checksum ready to be stored. */
+uint16_t cksum_fold (uint32_t sum) {
   while (sum > 0xffff)
     sum = (sum >> 16) + (sum & 0xffff);
   sum = htons (~sum);
@@ -35,16 +35,31 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
+#include "sr_rt.h"
 #include "sr_protocol.h"
+#include "sr_icmp.h"
+#include "sr_log.h"
+#include "sr_capture.h"
+#include "sr_stats.h"
+#include "sr_tsc.h"
+#include "sr_stage.h"
+#include "sr_replay.h"
+#include "sr_rcu.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
+#include "sr_alloc.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+#define SR_RX_BURST 32  /* packet commands handed to the router at once */
+
+static int  sr_send_frame(struct sr_instance* , uint8_t* , unsigned int ,
+                          const char* );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
@@ -201,6 +216,8 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWSPEED:
                 /* Debug("Speed: %d\n",
                         ntohl(*((unsigned int*)hwinfo->mHWInfo[i].value))); */
+                sr_set_ether_speed(sr,
+                        ntohl(*((uint32_t*)hwinfo->mHWInfo[i].value)));
                 break;
             case HWSUBNET:
                 /* Debug("Subnet: %s\n",inet_ntoa(
@@ -226,6 +243,8 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
         } /* -- switch -- */
     } /* -- for -- */
 
+    sr_icmp_init_templates(sr);
+
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
 
@@ -331,22 +350,21 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
     return sr_read_from_server_expect(sr, 0);
 }
 
-int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+/*-----------------------------------------------------------------------------
+ * Method: sr_recv_command(..)
+ * Scope: local
+ *
+ * Read one command from the server into buf, which has room for size
+ * bytes, and return its length, or -1 if the connection failed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_recv_command(struct sr_instance* sr /* borrowed */,
+                           unsigned char* buf, int size)
 {
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
+    int len;
     int ret = 0, bytes_read = 0;
 
-    /* REQUIRES */
-    assert(sr);
-
-    /*---------------------------------------------------------------------------
-      Read a command from the server
-      -------------------------------------------------------------------------*/
-
-    bytes_read = 0;
-
     /* attempt to read the size of the incoming packet */
     while( bytes_read < 4)
     {
@@ -369,19 +387,13 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     len = ntohl(len);
 
-    if ( len > 10000 || len < 0 )
+    if ( len > size || len < 0 )
     {
         fprintf(stderr,"Error: command length to large %d\n",len);
         close(sr->sockfd);
         return -1;
     }
 
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
-        return -1;
-    }
-
     /* set first field of command since we've already read it */
     *((int *)buf) = htonl(len);
 
@@ -406,6 +418,98 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         } while (errno == EINTR); /* be mindful of signals */
     }
 
+    return len;
+} /* -- sr_recv_command -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_packet_waiting(..)
+ * Scope: local
+ *
+ * Return 1 if the next command from the server is a packet that has
+ * arrived whole, so reading it will not block, else 0.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_packet_waiting(struct sr_instance* sr /* borrowed */)
+{
+    uint32_t hdr[2];
+    int avail;
+
+    if(recv(sr->sockfd, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT) !=
+       sizeof(hdr) || ntohl(hdr[1]) != VNSPACKET)
+    { return 0; }
+    if(ioctl(sr->sockfd, FIONREAD, &avail) == -1)
+    { return 0; }
+    return avail >= (int)ntohl(hdr[0]);
+} /* -- sr_packet_waiting -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_packet_admit(..)
+ * Scope: local
+ *
+ * Log the packet command in buf, of len bytes, and return 1 if it is for
+ * the router, 0 if it is an ARP request for another router and dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_packet_admit(struct sr_instance* sr /* borrowed */,
+                           unsigned char* buf, int len)
+{
+    c_packet_ethernet_header* sr_pkt = (c_packet_ethernet_header *)buf;
+
+    /* -- log packet -- */
+    SR_STAGE(SR_STAGE_LOG, sr_log_packet(sr,
+            buf + sizeof(c_packet_header),
+            ntohl(sr_pkt->mLen) - sizeof(c_packet_header),
+            (char*)(buf + sizeof(c_base)), SR_CAPTURE_RX));
+
+    /* -- check if it is an ARP to another router if so drop   -- */
+    if ( sr_arp_req_not_for_us(sr,
+            (buf+sizeof(c_packet_header)),
+            len - sizeof(c_packet_ethernet_header) +
+            sizeof(struct sr_ethernet_hdr),
+            (char*)(buf + sizeof(c_base))) )
+    {
+        sr_drop(sr, sr_vrf_of(sr, (char*)(buf + sizeof(c_base))),
+                SR_DROP_ARP_NOT_FOR_US);
+        return 0;
+    }
+    return 1;
+} /* -- sr_packet_admit -- */
+
+int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+{
+    /* -- commands are read into the same buffers every time, only this
+          thread reads from the server and the router copies what it keeps.
+          A packet and those queued behind it take one buffer each -- */
+    static uint32_t cmds[SR_RX_BURST][VNS_MAX_COMMAND / sizeof(uint32_t)];
+    unsigned char *buf = (unsigned char*)cmds[0];
+    uint8_t* packets[SR_RX_BURST];
+    unsigned int lens[SR_RX_BURST];
+    char* ifaces[SR_RX_BURST];
+    unsigned int i, n;
+    int command, len;
+    uint64_t start;
+    int ret = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    /*---------------------------------------------------------------------------
+      Read a command from the server, or the session log when replaying
+      -------------------------------------------------------------------------*/
+
+    if(sr_replaying(sr))
+    { len = sr_replay_next(sr->replay, sr, buf, sizeof(cmds[0])); }
+    else
+    { len = sr_recv_command(sr, buf, sizeof(cmds[0])); }
+
+    if(len <= 0)
+    { return len; }
+
+    if(sr->replay)
+    { sr_record_command(sr->replay, buf, len); }
+
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
     command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
@@ -424,26 +528,48 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         /* -------------        VNSPACKET     -------------------- */
 
         case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+            /* -- take the packets already received behind this one too,
+             *    up to the first other command, without waiting for more.
+             *    A replayed session is fed one packet at a time -- */
+            for(n = 0; ; )
+            {
+                if(sr_packet_admit(sr, buf, len))
+                {
+                    packets[n] = buf + sizeof(c_packet_header);
+                    lens[n] = len - sizeof(c_packet_ethernet_header) +
+                              sizeof(struct sr_ethernet_hdr);
+                    ifaces[n] = (char*)(buf + sizeof(c_base));
+                    n++;
+                }
+                if(n == SR_RX_BURST || sr_replaying(sr) ||
+                   !sr_packet_waiting(sr))
+                { break; }
+
+                buf = (unsigned char*)cmds[n];
+                if((len = sr_recv_command(sr, buf, sizeof(cmds[0]))) <= 0)
+                {
+                    ret = len;
+                    break;
+                }
+                if(sr->replay)
+                { sr_record_command(sr->replay, buf, len); }
+                *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
+            }
+            if(n == 0)
             { break; }
 
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+            /* -- pass to router, student's code should take over here.
+             *    The routing table may change under it, see sr_rcu.h -- */
+            start = sr_tsc();
+            sr_rcu_read_lock();
+            if(n == 1)
+            { sr_handlepacket(sr, packets[0], lens[0], ifaces[0]); }
+            else
+            { sr_handlepacket_burst(sr, packets, lens, ifaces, n); }
+            sr_rcu_read_unlock();
+            start = (sr_tsc() - start) / n;
+            for(i = 0; i < n; i++)
+            { sr_stats_latency(SR_LAT_FASTPATH, start); }
 
             break;
 
@@ -453,9 +579,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"VNS server closed session.\n");
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
-
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -469,6 +592,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
         case VNSHWINFO:
             sr_handle_hwinfo(sr,(c_hwinfo*)buf);
+            sr_rt_reweigh(sr);
             if(sr_verify_routing_table(sr) != 0)
             {
                 fprintf(stderr,"Routing table not consistent with hardware\n");
@@ -485,6 +609,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
             /* ------------- VNS_AUTH_REQUEST ------------- */
         case VNS_AUTH_REQUEST:
+            if(sr_replaying(sr))
+            { break; } /* -- nobody to answer -- */
             if(!sr_handle_auth_request(sr, (c_auth_request*)buf))
                 ret = -1;
             break;
@@ -501,8 +627,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
 }/* -- sr_read_from_server -- */
 
@@ -531,12 +655,12 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
     iface = sr_get_interface(sr, name);
 
     if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        sr_log_err("** Error, interface %s, does not exist\n", name);
         return 0;
     }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
-        fprintf( stderr, "** Error, source address does not match interface\n");
+        sr_log_err("** Error, source address does not match interface\n");
         return 0;
     }
 
@@ -564,8 +688,7 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          unsigned int len,
                          const char* iface /* borrowed */)
 {
-    c_packet_header *sr_pkt;
-    unsigned int total_len =  len + (sizeof(c_packet_header));
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
@@ -574,66 +697,59 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
 
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) ){
-        fprintf(stderr , "** Error: packet is wayy to short \n");
+        sr_log_err("** Error: packet is wayy to short \n");
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
-
     /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
+    SR_STAGE(SR_STAGE_LOG, sr_log_packet(sr,buf,len,iface,SR_CAPTURE_TX));
 
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
-        return -1;
-    }
-
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
-        return -1;
-    }
+    SR_STAGE(SR_STAGE_SEND, ret = sr_send_frame(sr, buf, len, iface));
 
-    free(sr_pkt);
-
-    return 0;
+    return ret;
 } /* -- sr_send_packet -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_log_packet()
+ * Method: sr_send_frame(..)
  * Scope: Local
  *
+ * Wrap the packet in a VNSPACKET command and write it to the server.
+ *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+static int sr_send_frame(struct sr_instance* sr, uint8_t* buf,
+                         unsigned int len, const char* iface)
 {
-    struct pcap_pkthdr h;
-    int size;
+    c_packet_header sr_pkt;
+    struct iovec iov[2];
+    unsigned int total_len =  len + (sizeof(c_packet_header));
 
-    /* REQUIRES */
-    assert(sr);
+    /* Create packet, the frame is written straight from buf */
+    sr_pkt.mLen  = htonl(total_len);
+    sr_pkt.mType = htonl(VNSPACKET);
+    strncpy(sr_pkt.mInterfaceName,iface,16);
+    iov[0].iov_base = &sr_pkt;
+    iov[0].iov_len  = sizeof(c_packet_header);
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = len;
 
-    if(!sr->logfile)
-    {return; }
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
+        sr_log_err("*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
 
-    size = min(PACKET_DUMP_SIZE, len);
+    /* -- a replayed session has no server to send to -- */
+    if ( sr_replaying(sr) ){
+        return 0;
+    }
 
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
+    if( writev(sr->sockfd, iov, 2) < total_len ){
+        sr_log_err("Error writing packet\n");
+        return -1;
+    }
 
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
-} /* -- sr_log_packet -- */
+    return 0;
+} /* -- sr_send_frame -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_arp_req_not_for_us()
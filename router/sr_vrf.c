@@ -0,0 +1,287 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vrf.c
+ *
+ * Description:
+ *
+ * Routing tables other than 0 and the interfaces bound to them, see
+ * sr_vrf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_vrf.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_ortc.h"
+#include "sr_log.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_init(..)
+ * Scope:  Global
+ *
+ * Set up the ARP pools the tables share and table 0.  Returns 0, or -1
+ * out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_vrf_init(struct sr_instance* sr)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    memset(sr->vrfs, 0, sizeof(sr->vrfs));
+    if(sr_arppools_init(&(sr->arp_pools)) != 0)
+    { return -1; }
+    return sr_vrf_create(sr, 0) ? 0 : -1;
+} /* -- sr_vrf_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_create(..)
+ * Scope:  Global
+ *
+ * Return table id, making it, empty, if there is none yet.  Returns 0
+ * for an id out of range or out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_vrf* sr_vrf_create(struct sr_instance* sr, unsigned int id)
+{
+    struct sr_vrf* vrf;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(id >= SR_VRF_MAX)
+    { return 0; }
+    if(sr->vrfs[id])
+    { return sr->vrfs[id]; }
+
+    if((vrf = (struct sr_vrf*)calloc(1, sizeof(struct sr_vrf))) == 0)
+    { return 0; }
+    vrf->id = id;
+    vrf->sr = sr;
+    if(sr_arpcache_init(&(vrf->cache), &(sr->arp_pools)) != 0 ||
+       (sr->aggregate && (vrf->ortc = sr_ortc_create()) == 0))
+    {
+        free(vrf);
+        return 0;
+    }
+
+    /* -- complete before the forwarding path can find it -- */
+    __atomic_store_n(&(sr->vrfs[id]), vrf, __ATOMIC_RELEASE);
+    return vrf;
+} /* -- sr_vrf_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_aggregate(..)
+ * Scope:  Global
+ *
+ * Aggregate the fib of every table, those made later too (sr -A).  Must
+ * be called before routes are loaded.  Returns 0, or -1 out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_vrf_aggregate(struct sr_instance* sr)
+{
+    unsigned int id;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    sr->aggregate = 1;
+    for(id = 0; id < SR_VRF_MAX; id++)
+    {
+        if(sr->vrfs[id] && sr->vrfs[id]->ortc == 0 &&
+           (sr->vrfs[id]->ortc = sr_ortc_create()) == 0)
+        { return -1; }
+    }
+    return 0;
+} /* -- sr_vrf_aggregate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_bind(..)
+ * Scope:  Global
+ *
+ * Bind the interface named iface to table id, making the table if need
+ * be.  Interfaces that do not exist yet get it once HWINFO adds them.
+ * Returns 0, or -1 if it is bound to another table already, the table
+ * has SR_VRF_MAX_IF interfaces or it cannot be made.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_vrf_bind(struct sr_instance* sr, const char* iface, unsigned int id)
+{
+    struct sr_vrf* vrf;
+    struct sr_if* ifp;
+    unsigned int bound;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(iface);
+
+    if((bound = sr_vrf_bound(sr, iface)) != 0)
+    { return bound == id ? 0 : -1; }
+    if(id == 0)
+    { return 0; }
+    if((vrf = sr_vrf_create(sr, id)) == 0 || vrf->nifaces == SR_VRF_MAX_IF)
+    { return -1; }
+
+    strncpy(vrf->ifaces[vrf->nifaces], iface, sr_IFACE_NAMELEN - 1);
+    vrf->ifaces[vrf->nifaces][sr_IFACE_NAMELEN - 1] = 0;
+    vrf->nifaces++;
+
+    if((ifp = sr_get_interface(sr, iface)))
+    { ifp->vrf = id; }
+    return 0;
+} /* -- sr_vrf_bind -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_bound(..)
+ * Scope:  Global
+ *
+ * The table the interface named iface is bound to, 0 unless -V bound it
+ * to another.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_vrf_bound(struct sr_instance* sr, const char* iface)
+{
+    unsigned int id, i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(iface);
+
+    for(id = 1; id < SR_VRF_MAX; id++)
+    {
+        if(sr->vrfs[id] == 0)
+        { continue; }
+        for(i = 0; i < sr->vrfs[id]->nifaces; i++)
+        {
+            if(strncmp(sr->vrfs[id]->ifaces[i], iface, sr_IFACE_NAMELEN) == 0)
+            { return id; }
+        }
+    }
+    return 0;
+} /* -- sr_vrf_bound -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_of(..)
+ * Scope:  Global
+ *
+ * The table of the interface named iface, table 0 if there is no such
+ * interface.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_vrf* sr_vrf_of(struct sr_instance* sr, const char* iface)
+{
+    struct sr_if* ifp;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(iface && (ifp = sr_get_interface(sr, iface)) && sr->vrfs[ifp->vrf])
+    { return sr->vrfs[ifp->vrf]; }
+    return sr->vrfs[0];
+} /* -- sr_vrf_of -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_load(..)
+ * Scope:  Global
+ *
+ * Make the tables the -V file at path lists, binding their interfaces
+ * and loading their routes.  Returns 0, or -1 with the line that failed
+ * logged.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_vrf_load(struct sr_instance* sr, const char* path)
+{
+    FILE* fp;
+    char line[BUFSIZ];
+    char *tok, *rtable, *end;
+    struct sr_vrf* vrf;
+    unsigned long id;
+    unsigned int lineno = 0;
+    int err = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    if((fp = fopen(path, "r")) == 0)
+    {
+        sr_log_err("vrf: cannot open %s\n", path);
+        return -1;
+    }
+
+    while(err == 0 && fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if((tok = strtok(line, " \t\r\n")) == 0 || tok[0] == '#')
+        { continue; }
+
+        err = -1;
+        if(strcmp(tok, "vrf") != 0 || (tok = strtok(0, " \t\r\n")) == 0)
+        { break; }
+        id = strtoul(tok, &end, 10);
+        if(*end || id == 0 || id >= SR_VRF_MAX)
+        { break; }
+        if((rtable = strtok(0, " \t\r\n")) == 0 ||
+           (vrf = sr_vrf_create(sr, id)) == 0 || vrf->rtable)
+        { break; }
+        if((vrf->rtable = strdup(rtable)) == 0)
+        { break; }
+
+        while((tok = strtok(0, " \t\r\n")))
+        {
+            if(sr_vrf_bind(sr, tok, id) != 0)
+            {
+                sr_log_err("vrf: %s:%u: cannot bind %s to table %lu\n",
+                           path, lineno, tok, id);
+                goto done;
+            }
+        }
+        if(vrf->nifaces == 0 || sr_load_rt(vrf, vrf->rtable) != 0)
+        { break; }
+        err = 0;
+    }
+
+    if(err)
+    { sr_log_err("vrf: %s:%u: bad table\n", path, lineno); }
+done:
+    fclose(fp);
+    return err;
+} /* -- sr_vrf_load -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_vrf_reload(..)
+ * Scope:  Global
+ *
+ * Load the routes of every table -V made from its file again, applying
+ * only what changed, as SIGHUP does for table 0.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_vrf_reload(struct sr_instance* sr)
+{
+    unsigned int id;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(id = 1; id < SR_VRF_MAX; id++)
+    {
+        if(sr->vrfs[id] == 0 || sr->vrfs[id]->rtable == 0)
+        { continue; }
+        sr_log_info("vrf: reloading table %u from %s\n", id,
+                    sr->vrfs[id]->rtable);
+        if(sr_load_rt(sr->vrfs[id], sr->vrfs[id]->rtable) != 0)
+        { sr_log_err("vrf: cannot reload table %u, keeping it\n", id); }
+    }
+} /* -- sr_vrf_reload -- */
@@ -0,0 +1,78 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vrf.h
+ *
+ * Description:
+ *
+ * Virtual routing and forwarding: one router serving several networks
+ * that must not see each other, e.g. those of different customers.
+ * Every interface is bound to a table ID, 0 unless sr -V binds it to
+ * another, and a packet is handled entirely in the table of the
+ * interface it arrived on: routed with that table's routes, answered by
+ * the router only at the addresses of that table's interfaces, and sent
+ * to next hops resolved in that table's ARP cache.  The address spaces
+ * of two tables may overlap.
+ *
+ * A table, struct sr_vrf, has its own routes, fib, aggregation (-A), ARP
+ * cache and counters (sr_stats.h).  The code over them is the same for
+ * every table, and the pools their routes, ARP requests and queued
+ * frames come from, like sr->rt_lock, are shared.  Table 0 always
+ * exists; it is the one -r, -m and -f load and the one the control
+ * socket changes unless told otherwise.  Others are made by -V, whose
+ * file has a line
+ *
+ *   vrf <id> <rtable> <iface> [<iface> ..]
+ *
+ * for each, binding the interfaces to table id and loading its routes
+ * from the rtable file, again on SIGHUP.  Blank lines and lines
+ * starting with # are skipped.  The routes of a table may only go out
+ * through interfaces bound to it (sr_verify_routing_table).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_VRF_H
+#define SR_VRF_H
+
+#include "sr_if.h"
+#include "sr_arpcache.h"
+
+#define SR_VRF_MAX    64          /* table IDs 0 .. SR_VRF_MAX - 1 */
+#define SR_VRF_MAX_IF 32          /* interfaces -V binds to one table */
+
+struct sr_instance;
+struct sr_rt;
+struct sr_fib;
+struct sr_ortc;
+struct sr_rt_index;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vrf
+ *
+ * One routing table and what goes with it.  Tables are made before the
+ * router starts forwarding and live as long as it does.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vrf
+{
+    unsigned int id;
+    struct sr_instance* sr;         /* the router it is part of */
+    struct sr_rt* routing_table;
+    struct sr_fib* fib;             /* lookup structure over it, or 0 */
+    struct sr_ortc* ortc;           /* aggregates it for the fib (-A), or 0 */
+    struct sr_rt_index* rt_index;   /* its routes by prefix, once changed */
+    struct sr_arpcache cache;       /* ARP cache */
+    char* rtable;                   /* file -V loads it from, or 0 */
+    unsigned int nifaces;
+    char ifaces[SR_VRF_MAX_IF][sr_IFACE_NAMELEN]; /* bound by -V */
+};
+
+int  sr_vrf_init(struct sr_instance* sr);
+struct sr_vrf* sr_vrf_create(struct sr_instance* sr, unsigned int id);
+int  sr_vrf_aggregate(struct sr_instance* sr);
+int  sr_vrf_bind(struct sr_instance* sr, const char* iface, unsigned int id);
+unsigned int sr_vrf_bound(struct sr_instance* sr, const char* iface);
+struct sr_vrf* sr_vrf_of(struct sr_instance* sr, const char* iface);
+int  sr_vrf_load(struct sr_instance* sr, const char* path);
+void sr_vrf_reload(struct sr_instance* sr);
+
+#endif /* -- SR_VRF_H -- */
@@ -20,6 +20,8 @@
 
 #define IDSIZE 32
 
+#define VNS_MAX_COMMAND 10000   /* longest command a router will accept */
+
 /*-----------------------------------------------------------------------------
                                  BASE
   ---------------------------------------------------------------------------*/